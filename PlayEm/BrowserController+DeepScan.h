@@ -12,8 +12,15 @@
 
 @interface BrowserController (DeepScan)
 
+/// Pausing stops new scans from being started; running ones complete. Persisted
+/// across launches.
+@property (assign, nonatomic) BOOL deepScanPaused;
+
 - (void)startDeepScanSchedulerIfNeeded;
 - (void)wakeDeepScanScheduler;
+/// Moves the songs currently visible in the songs table to the front of the
+/// queue, and gets their artwork prefetched.
+- (void)songsTableDidScroll:(NSNotification*)notification;
 - (void)enqueueReconcileWithCompletion:(void (^)(NSArray<MediaMetaData*>* _Nullable refreshedMetas,
                                                  NSArray<MediaMetaData*>* _Nullable changedMetas,
                                                  NSArray<NSURL*>* missingFiles,
@@ -12,15 +12,27 @@
 #import <objc/runtime.h>
 
 #import "ActivityManager.h"
+#import "AnalysisPipeline.h"
 #import "AudioController.h"
-#import "BeatTrackedSample.h"
-#import "KeyTrackedSample.h"
+#import "AudioDuration.h"
+#import "BeatAnalyzer.h"
+#import "ContentHashAnalyzer.h"
+#import "DeepScanWorkerPool.h"
+#import "KeyAnalyzer.h"
 #import "LazySample.h"
 #import "LibraryStore.h"
+#import "LoudnessAnalyzer.h"
 #import "MediaMetaData.h"
+#import "TotalIdentificationController.h"
 
 static NSString* const kDeepScanPausedDefaultsKey = @"deepScanPaused";
-static const NSTimeInterval kDeepScanIdleInterval = 8.0;
+static const NSTimeInterval kDeepScanMinimumTimeout = 60.0;
+/// Delay for coalescing scroll events before visible rows get prioritized.
+static const NSTimeInterval kDeepScanVisibleRowsDelay = 0.3;
+/// Delay for coalescing finished scans before columns and filters get refreshed.
+static const NSTimeInterval kDeepScanRefreshDelay = 1.0;
+static void* kDeepScanPlaybackActiveKey = &kDeepScanPlaybackActiveKey;
+static void* kDeepScanBackingOffKey = &kDeepScanBackingOffKey;
 static NSSet<NSString*>* DeepScanExcludedGenres(void)
 {
     static NSSet<NSString*>* excluded = nil;
@@ -34,19 +46,18 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
 @interface BrowserController ()
 @property (nonatomic, strong) LibraryStore* libraryStore;
 @property (nonatomic, strong) NSMutableArray<MediaMetaData*>* cachedLibrary;
-@property (nonatomic, strong) AudioController* deepScanAudioController;
+@property (nonatomic, strong) NSMutableArray<AudioController*>* deepScanAudioControllers;
 @property (nonatomic, strong) NSMutableArray<NSString*>* tempos;
 @property (nonatomic, strong) NSMutableArray<NSString*>* keys;
 @property (nonatomic, strong) NSArray<MediaMetaData*>* filteredItems;
 @property (nonatomic, weak) NSTableView* songsTable;
 @property (nonatomic, weak) NSTableView* temposTable;
 @property (nonatomic, weak) NSTableView* keysTable;
-@property (strong, nonatomic) dispatch_queue_t deepScanQueue;
-@property (strong, nonatomic) dispatch_semaphore_t deepScanWake;
-@property (assign, nonatomic) BOOL deepScanStop;
+@property (strong, nonatomic) DeepScanWorkerPool* deepScanPool;
 @property (strong, nonatomic) ActivityToken* deepScanToken;
 @property (assign, nonatomic) NSInteger deepScanTotalCount;
 @property (assign, nonatomic) NSInteger deepScanCompletedCount;
+@property (assign, nonatomic) BOOL deepScanRefreshScheduled;
 @property (assign, nonatomic) BOOL reconcileRequested;
 @property (assign, nonatomic) BOOL reconcileRunning;
 @property (copy, nonatomic) void (^reconcileCompletion)(NSArray<MediaMetaData*>* _Nullable refreshedMetas,
@@ -54,6 +65,9 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
                                                         NSArray<NSURL*>* missingFiles,
                                                         NSError* _Nullable error);
 - (void)refreshUIWithLibrary:(NSArray<MediaMetaData*>*)library;
+- (NSMutableDictionary<NSString*, MediaMetaData*>*)cachedLibraryByURL;
+- (void)invalidateLibraryColumns;
+- (void)scheduleVisibleArtworkPrefetch;
 - (NSUInteger)songsRowForMeta:(MediaMetaData*)meta;
 - (void)columnsFromMediaItems:(NSArray*)items
                        genres:(NSMutableArray*)genres
@@ -108,7 +122,23 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
         [self cancelForegroundDeepScanForURL:url];
         return;
     }
+    // Playback runs the same trackers the analyzers wrap.
+    NSMutableArray<NSString*>* analyzers = [NSMutableArray array];
+    if (duration != nil) {
+        [analyzers addObject:LibraryStoreDurationAnalyzer];
+    }
+    if (tempo != nil) {
+        [analyzers addObject:@"beats"];
+    }
+    if (key != nil) {
+        [analyzers addObject:@"key"];
+    }
+    // Recorded first, like a background scan does; completing decides on
+    // queueing the track again by the recorded versions.
     NSError* error = nil;
+    if (![self.libraryStore recordAnalyzers:analyzers forURL:url error:&error]) {
+        NSLog(@"Foreground deep scan: failed to record analyzer versions for %@: %@", url, error);
+    }
     if (![self.libraryStore completeDeepScanForURL:url duration:duration tempo:tempo key:key error:&error]) {
         NSLog(@"Foreground deep scan: failed to store results for %@: %@", url, error);
         [self cancelForegroundDeepScanForURL:url];
@@ -120,7 +150,6 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
         if (updatedMeta == nil || self.songsTable == nil) {
             return;
         }
-        [self updateTempoAndKeyFilters];
         NSUInteger row = [self songsRowForMeta:updatedMeta];
         if (row == NSNotFound || row >= (NSUInteger) self.songsTable.numberOfRows) {
             return;
@@ -164,11 +193,18 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
     return name.length > 0 ? name : url.absoluteString;
 }
 
-- (NSTimeInterval)estimatedDurationForKeyDecision:(LazySample*)sample
+/// Duration of the sample in seconds, from the file header when that has it;
+/// sizes the analysis timeout before anything got decoded.
+- (NSTimeInterval)estimatedDurationOfSample:(LazySample*)sample
 {
     if (sample == nil) {
         return 0.0;
     }
+    // Asking the source for its length may scan an entire VBR file.
+    AudioDuration* header = [AudioDuration durationOfURL:sample.source.url error:nil];
+    if (header != nil) {
+        return header.milliseconds / 1000.0;
+    }
     double rate = sample.fileSampleRate;
     unsigned long long frames = sample.frames;
     if (rate <= 0.0 || frames == 0) {
@@ -177,48 +213,51 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
     return (double) frames / rate;
 }
 
-- (BOOL)shouldAnalyzeKeyForSample:(LazySample*)sample
-{
-    NSTimeInterval duration = [self estimatedDurationForKeyDecision:sample];
-    if (duration <= 0.0) {
-        return YES;
-    }
-    return [KeyTrackedSample needsKeyForSampleDuration:duration];
-}
-
 - (MediaMetaData* _Nullable)cachedMetaForURL:(NSURL*)url
 {
     if (self.cachedLibrary == nil || url == nil) {
         return nil;
     }
-    for (MediaMetaData* meta in self.cachedLibrary) {
-        if ([meta.location.absoluteString isEqualToString:url.absoluteString]) {
-            return meta;
-        }
+    @synchronized(self) {
+        return [self cachedLibraryByURL][url.absoluteString];
     }
-    return nil;
 }
 
 - (void)updateDeepScanActivityWithDetail:(NSString*)detail stepProgress:(double)stepProgress
 {
-    if (self.deepScanToken == nil) {
+    ActivityToken* token = nil;
+    NSInteger total = 0;
+    NSInteger completedCount = 0;
+    @synchronized(self) {
+        token = self.deepScanToken;
+        total = self.deepScanTotalCount;
+        completedCount = self.deepScanCompletedCount;
+    }
+    if (token == nil) {
         return;
     }
 
-    if (self.deepScanTotalCount <= 0) {
-        [[ActivityManager shared] updateActivity:self.deepScanToken progress:-1.0 detail:detail];
+    if (total <= 0) {
+        [[ActivityManager shared] updateActivity:token progress:-1.0 detail:detail];
         return;
     }
 
-    double completed = (double) self.deepScanCompletedCount + stepProgress;
-    double progress = completed / (double) self.deepScanTotalCount;
+    double completed = (double) completedCount + stepProgress;
+    double progress = completed / (double) total;
     if (progress < 0.0) {
         progress = 0.0;
     } else if (progress > 1.0) {
         progress = 1.0;
     }
 
-    [[ActivityManager shared] updateActivity:self.deepScanToken progress:progress detail:detail];
+    [[ActivityManager shared] updateActivity:token progress:progress detail:detail];
+}
+
+- (void)countFinishedDeepScan
+{
+    @synchronized(self) {
+        self.deepScanCompletedCount += 1;
+    }
 }
 
 - (void)updateFilterTable:(NSTableView*)table
@@ -283,27 +322,29 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
         return;
     }
 
-    if (outstanding == 0) {
-        if (self.deepScanToken != nil && [[ActivityManager shared] isActive:self.deepScanToken]) {
-            [[ActivityManager shared] completeActivity:self.deepScanToken];
+    @synchronized(self) {
+        if (outstanding == 0) {
+            if (self.deepScanToken != nil && [[ActivityManager shared] isActive:self.deepScanToken]) {
+                [[ActivityManager shared] completeActivity:self.deepScanToken];
+            }
+            self.deepScanToken = nil;
+            self.deepScanTotalCount = 0;
+            self.deepScanCompletedCount = 0;
+            return;
         }
-        self.deepScanToken = nil;
-        self.deepScanTotalCount = 0;
-        self.deepScanCompletedCount = 0;
-        return;
-    }
 
-    if (self.deepScanToken == nil || ![[ActivityManager shared] isActive:self.deepScanToken]) {
-        self.deepScanTotalCount = outstanding;
-        self.deepScanCompletedCount = 0;
-        self.deepScanToken = [[ActivityManager shared] beginActivityWithTitle:NSLocalizedString(@"activity.deep_scan.title", @"Title for deep scan activity")
-                                                                      detail:detail
-                                                                 cancellable:NO
-                                                               cancelHandler:nil];
-    } else {
-        NSInteger expectedTotal = self.deepScanCompletedCount + outstanding;
-        if (expectedTotal > self.deepScanTotalCount) {
-            self.deepScanTotalCount = expectedTotal;
+        if (self.deepScanToken == nil || ![[ActivityManager shared] isActive:self.deepScanToken]) {
+            self.deepScanTotalCount = outstanding;
+            self.deepScanCompletedCount = 0;
+            self.deepScanToken = [[ActivityManager shared] beginActivityWithTitle:NSLocalizedString(@"activity.deep_scan.title", @"Title for deep scan activity")
+                                                                          detail:detail
+                                                                     cancellable:NO
+                                                                   cancelHandler:nil];
+        } else {
+            NSInteger expectedTotal = self.deepScanCompletedCount + outstanding;
+            if (expectedTotal > self.deepScanTotalCount) {
+                self.deepScanTotalCount = expectedTotal;
+            }
         }
     }
 
@@ -340,75 +381,155 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
 
 - (void)startDeepScanSchedulerIfNeeded
 {
-    if (self.deepScanQueue != nil) {
+    if (self.deepScanPool != nil) {
         return;
     }
     NSLog(@"Deep scan scheduler: starting");
-    self.deepScanStop = NO;
-    self.deepScanWake = dispatch_semaphore_create(0);
-    self.deepScanQueue = dispatch_queue_create("PlayEm.DeepScanQueue", DISPATCH_QUEUE_SERIAL);
-
-    NSError* resetError = nil;
-    if (![self.libraryStore resetDeepScanRunningState:&resetError]) {
-        NSLog(@"Deep scan reset failed: %@", resetError);
-    }
 
     [self ensureDeepScanActivityWithDetail:NSLocalizedString(@"activity.deep_scan.waiting", @"Detail while waiting for deep scan")
                               stepProgress:0.0];
 
+    NSUInteger workerCount = [DeepScanWorkerPool defaultWorkerCount];
+    self.deepScanAudioControllers = [NSMutableArray arrayWithCapacity:workerCount];
+
     BrowserController* __weak weakSelf = self;
-    dispatch_async(self.deepScanQueue, ^{
-        [weakSelf runDeepScanLoop];
+    self.deepScanPool = [[DeepScanWorkerPool alloc] initWithStore:self.libraryStore
+                                                      workerCount:workerCount
+                                                     memoryBudget:[DeepScanWorkerPool defaultMemoryBudget]
+                                                      workHandler:^BOOL(DeepScanJob* job) {
+                                                          return [weakSelf performDeepScanForJob:job];
+                                                      }];
+    // Playback and identification win, one scan keeps trickling along.
+    self.deepScanPool.foregroundWorkerLimit = 1;
+    self.deepScanPool.maintenanceHandler = ^BOOL {
+        BrowserController* strongSelf = weakSelf;
+        if (strongSelf == nil || !strongSelf.reconcileRequested || strongSelf.reconcileRunning) {
+            return NO;
+        }
+        NSLog(@"Deep scan scheduler: running reconcile task");
+        strongSelf.reconcileRequested = NO;
+        strongSelf.reconcileRunning = YES;
+        [strongSelf performReconcileTask];
+        strongSelf.reconcileRunning = NO;
+        return YES;
+    };
+    self.deepScanPool.paused = [[NSUserDefaults standardUserDefaults] boolForKey:kDeepScanPausedDefaultsKey];
+
+    NSNotificationCenter* center = [NSNotificationCenter defaultCenter];
+    [center addObserver:self
+               selector:@selector(deepScanForegroundActivityChanged:)
+                   name:kAudioControllerChangedPlaybackStateNotification
+                 object:nil];
+    [center addObserver:self
+               selector:@selector(deepScanForegroundActivityChanged:)
+                   name:kTotalIdentificationControllerDidStartNotification
+                 object:nil];
+    [center addObserver:self
+               selector:@selector(deepScanForegroundActivityChanged:)
+                   name:kTotalIdentificationControllerDidFinishNotification
+                 object:nil];
+
+    [self.deepScanPool start];
+}
+
+- (NSHashTable*)deepScanForegroundIdentifications
+{
+    static void* kDeepScanForegroundIdentificationsKey = &kDeepScanForegroundIdentificationsKey;
+    // Weak, so an identification that vanished without finishing stops counting.
+    NSHashTable* identifications = objc_getAssociatedObject(self, kDeepScanForegroundIdentificationsKey);
+    if (identifications == nil) {
+        identifications = [NSHashTable weakObjectsHashTable];
+        objc_setAssociatedObject(self, kDeepScanForegroundIdentificationsKey, identifications, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    }
+    return identifications;
+}
+
+- (void)deepScanForegroundActivityChanged:(NSNotification*)notification
+{
+    dispatch_async(dispatch_get_main_queue(), ^{
+        NSString* name = notification.name;
+        if ([name isEqualToString:kAudioControllerChangedPlaybackStateNotification]) {
+            NSString* state = notification.object;
+            BOOL playing = [state isEqualToString:kPlaybackStateStarted] || [state isEqualToString:kPlaybackStatePlaying];
+            objc_setAssociatedObject(self, kDeepScanPlaybackActiveKey, @(playing), OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+        } else if ([name isEqualToString:kTotalIdentificationControllerDidStartNotification]) {
+            [[self deepScanForegroundIdentifications] addObject:notification.object];
+        } else if ([name isEqualToString:kTotalIdentificationControllerDidFinishNotification]) {
+            [[self deepScanForegroundIdentifications] removeObject:notification.object];
+        }
+
+        BOOL playing = [objc_getAssociatedObject(self, kDeepScanPlaybackActiveKey) boolValue];
+        BOOL active = playing || [self deepScanForegroundIdentifications].allObjects.count > 0;
+        BOOL backingOff = [objc_getAssociatedObject(self, kDeepScanBackingOffKey) boolValue];
+        if (active == backingOff) {
+            return;
+        }
+        objc_setAssociatedObject(self, kDeepScanBackingOffKey, @(active), OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+        NSLog(@"Deep scan scheduler: %@", active ? @"backing off for foreground activity" : @"foreground activity ended");
+        if (active) {
+            [self.deepScanPool beginForegroundActivity];
+        } else {
+            [self.deepScanPool endForegroundActivity];
+        }
     });
 }
 
 - (void)wakeDeepScanScheduler
 {
-    if (self.deepScanWake != nil) {
-        dispatch_semaphore_signal(self.deepScanWake);
-    }
+    [self.deepScanPool wake];
 }
 
-- (void)runDeepScanLoop
+- (BOOL)deepScanPaused
 {
-    while (!self.deepScanStop) {
-        @autoreleasepool {
-            if (self.reconcileRequested && !self.reconcileRunning) {
-                NSLog(@"Deep scan scheduler: running reconcile task");
-                self.reconcileRequested = NO;
-                self.reconcileRunning = YES;
-                [self performReconcileTask];
-                self.reconcileRunning = NO;
-                continue;
-            }
-            if ([[NSUserDefaults standardUserDefaults] boolForKey:kDeepScanPausedDefaultsKey]) {
-                NSLog(@"Deep scan scheduler: paused");
-                dispatch_semaphore_wait(self.deepScanWake, dispatch_time(DISPATCH_TIME_NOW, (int64_t) (kDeepScanIdleInterval * NSEC_PER_SEC)));
-                continue;
-            }
+    return [[NSUserDefaults standardUserDefaults] boolForKey:kDeepScanPausedDefaultsKey];
+}
 
-            NSError* selectError = nil;
-            NSURL* url = [self.libraryStore nextDeepScanURL:&selectError];
-            if (url == nil) {
-                if (selectError) {
-                    NSLog(@"Deep scan select failed: %@", selectError);
-                } else {
-                    NSLog(@"Deep scan scheduler: no pending items");
-                }
-                dispatch_semaphore_wait(self.deepScanWake, dispatch_time(DISPATCH_TIME_NOW, (int64_t) (kDeepScanIdleInterval * NSEC_PER_SEC)));
-                continue;
-            }
+- (void)setDeepScanPaused:(BOOL)paused
+{
+    [[NSUserDefaults standardUserDefaults] setBool:paused forKey:kDeepScanPausedDefaultsKey];
+    self.deepScanPool.paused = paused;
+    NSLog(@"Deep scan scheduler: %@", paused ? @"paused" : @"resumed");
+}
 
-            NSError* markError = nil;
-            if (![self.libraryStore markDeepScanRunningForURL:url error:&markError]) {
-                NSLog(@"Deep scan running mark failed: %@", markError);
-                dispatch_semaphore_wait(self.deepScanWake, dispatch_time(DISPATCH_TIME_NOW, (int64_t) (kDeepScanIdleInterval * NSEC_PER_SEC)));
-                continue;
-            }
+- (void)songsTableDidScroll:(NSNotification*)notification
+{
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(prioritizeVisibleDeepScanRows) object:nil];
+    [self performSelector:@selector(prioritizeVisibleDeepScanRows) withObject:nil afterDelay:kDeepScanVisibleRowsDelay];
+    [self scheduleVisibleArtworkPrefetch];
+}
+
+- (void)prioritizeVisibleDeepScanRows
+{
+    if (self.deepScanPool == nil || self.songsTable == nil) {
+        return;
+    }
+    NSRange rows = [self.songsTable rowsInRect:self.songsTable.visibleRect];
+    NSArray<MediaMetaData*>* items = self.filteredItems;
+    NSMutableArray<NSURL*>* urls = [NSMutableArray arrayWithCapacity:rows.length];
+    for (NSUInteger row = rows.location; row < NSMaxRange(rows) && row < items.count; row++) {
+        MediaMetaData* meta = items[row];
+        BOOL needsScan = meta.duration == nil || meta.tempo == nil || meta.tempo.doubleValue <= 0.0 || meta.key.length == 0;
+        if (meta.location != nil && needsScan) {
+            [urls addObject:meta.location];
+        }
+    }
+    if (urls.count == 0) {
+        return;
+    }
+    DeepScanWorkerPool* pool = self.deepScanPool;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        [pool prioritizeURLs:urls];
+    });
+}
 
-            NSLog(@"Deep scan scheduler: scanning %@", url);
-            [self performDeepScanForURL:url];
+- (AudioController*)deepScanAudioControllerForWorker:(NSUInteger)worker
+{
+    // AudioController runs a single decode at a time, hence one per worker.
+    @synchronized(self.deepScanAudioControllers) {
+        while (self.deepScanAudioControllers.count <= worker) {
+            [self.deepScanAudioControllers addObject:[AudioController new]];
         }
+        return self.deepScanAudioControllers[worker];
     }
 }
 
@@ -447,16 +568,18 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
         });
     }
 
-    self.deepScanCompletedCount = 0;
-    self.deepScanTotalCount = 0;
+    @synchronized(self) {
+        self.deepScanCompletedCount = 0;
+        self.deepScanTotalCount = 0;
+    }
 }
 
-- (void)performDeepScanForURL:(NSURL*)url
+- (BOOL)performDeepScanForJob:(DeepScanJob*)job
 {
+    NSURL* url = job.url;
     NSString* displayName = [self deepScanDisplayNameForURL:url];
     NSString* durationFormat = NSLocalizedString(@"activity.deep_scan.duration_format", @"Detail while analyzing duration");
-    NSString* tempoFormat = NSLocalizedString(@"activity.deep_scan.tempo_format", @"Detail while analyzing tempo");
-    NSString* keyFormat = NSLocalizedString(@"activity.deep_scan.key_format", @"Detail while analyzing key");
+    NSString* analyzeFormat = NSLocalizedString(@"activity.deep_scan.analyze_format", @"Detail while decoding and analyzing");
 
     NSError* sampleError = nil;
     LazySample* sample = [[LazySample alloc] initWithPath:url.path error:&sampleError];
@@ -467,54 +590,117 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
     MediaMetaData* cachedMeta = [self cachedMetaForURL:url];
     NSString* genre = cachedMeta.genre.length > 0 ? cachedMeta.genre.lowercaseString : @"";
     BOOL isExcludedGenre = [DeepScanExcludedGenres() containsObject:genre];
-    BOOL needsTempo = !isExcludedGenre && (cachedMeta == nil || cachedMeta.tempo == nil || cachedMeta.tempo.doubleValue <= 0.0);
-    BOOL hasKey = (cachedMeta != nil && cachedMeta.key.length > 0);
-
-    if (sample != nil) {
-        if (self.deepScanAudioController == nil) {
-            self.deepScanAudioController = [AudioController new];
-        }
-        if (needsTempo || (!hasKey && !isExcludedGenre)) {
-            dispatch_semaphore_t decodeSemaphore = dispatch_semaphore_create(0);
-            __block BOOL decodeDone = NO;
-            [self.deepScanAudioController decodeAsyncForAnalysisWithSample:sample
-                                                          completionQueue:dispatch_get_global_queue(QOS_CLASS_UTILITY, 0)
-                                                                  callback:^(BOOL done) {
-                                                                      decodeDone = done;
-                                                                      dispatch_semaphore_signal(decodeSemaphore);
-                                                                  }];
-            dispatch_semaphore_wait(decodeSemaphore, dispatch_time(DISPATCH_TIME_NOW, (int64_t) (60 * NSEC_PER_SEC)));
-            if (!decodeDone) {
-                NSLog(@"Deep scan: decode timed out for %@", url);
-            }
-        }
-    }
-
-    BOOL needsKey = sample != nil && !hasKey && !isExcludedGenre && [self shouldAnalyzeKeyForSample:sample];
-    NSInteger stepCount = 1 + (sample != nil ? 1 : 0) + (needsKey ? 1 : 0);
-    NSInteger stepIndex = 0;
-
-    [self ensureDeepScanActivityWithDetail:[NSString localizedStringWithFormat:durationFormat, displayName]
-                              stepProgress:stepCount > 0 ? (double) stepIndex / (double) stepCount : 0.0];
-    NSNumber* duration = [self resolvedDurationForURL:url];
-    stepIndex += 1;
 
+    // Results stored by an older analyzer version get recomputed, those an
+    // analyzer never produced (tags, for instance) are kept.
+    NSError* versionError = nil;
+    NSDictionary<NSString*, NSNumber*>* recorded = [self.libraryStore recordedAnalyzerVersionsForURL:url error:&versionError];
+    if (recorded == nil) {
+        NSLog(@"Deep scan: failed to read analyzer versions for %@: %@", url, versionError);
+        recorded = @{};
+    }
+    NSDictionary<NSString*, NSNumber*>* current = [LibraryStore analyzerVersions];
+    BOOL (^outdated)(NSString*) = ^BOOL(NSString* name) {
+        return recorded[name] != nil && recorded[name].integerValue < current[name].integerValue;
+    };
+
+    BOOL hasTempo = (cachedMeta != nil && cachedMeta.tempo != nil && cachedMeta.tempo.doubleValue > 0.0);
+    BOOL needsTempo = !isExcludedGenre && (!hasTempo || outdated(@"beats"));
+    BOOL hasKey = (cachedMeta != nil && cachedMeta.key.length > 0);
+    BOOL needsKey = sample != nil && (!hasKey || outdated(@"key")) && !isExcludedGenre;
+    BOOL hasDuration = (cachedMeta != nil && cachedMeta.duration != nil && cachedMeta.duration.doubleValue > 0.0);
+    BOOL needsDuration = !hasDuration || outdated(LibraryStoreDurationAnalyzer);
+    BOOL needsLoudness = recorded[@"loudness"] == nil || outdated(@"loudness");
+    BOOL needsContentHash = recorded[@"contentHash"] == nil || outdated(@"contentHash");
+    // Queued only because some analyzer got updated; whatever is stored stays valid.
+    BOOL refreshOnly = hasDuration && (hasTempo || isExcludedGenre) && hasKey;
+
+    NSNumber* duration = nil;
     NSNumber* tempo = nil;
     NSString* key = nil;
-    if (sample != nil) {
+    LoudnessAnalyzer* loudness = nil;
+    ContentHashAnalyzer* contentHash = nil;
+    NSMutableArray<NSString*>* ranAnalyzers = [NSMutableArray array];
+    NSMutableArray<NSString*>* failedAnalyzers = [NSMutableArray array];
+
+    if (sample != nil && (needsTempo || needsKey || needsLoudness || needsContentHash)) {
+        [self ensureDeepScanActivityWithDetail:[NSString localizedStringWithFormat:analyzeFormat, displayName]
+                                  stepProgress:0.0];
+
+        // Everything gets derived from one decode pass, every analyzer fed
+        // each page on its own queue as it got decoded. Nothing else reads
+        // this sample, so consumed pages can go right away.
+        AnalysisPipeline* pipeline = [[AnalysisPipeline alloc] initWithSample:sample];
+        pipeline.streaming = YES;
+        BeatAnalyzer* beats = nil;
         if (needsTempo) {
-            [self updateDeepScanActivityWithDetail:[NSString localizedStringWithFormat:tempoFormat, displayName]
-                                      stepProgress:stepCount > 0 ? (double) stepIndex / (double) stepCount : 0.0];
-            tempo = [self resolvedTempoForSample:sample];
-            stepIndex += 1;
+            beats = [BeatAnalyzer new];
+            [pipeline addAnalyzer:beats];
         }
-
+        KeyAnalyzer* keys = nil;
         if (needsKey) {
-            [self updateDeepScanActivityWithDetail:[NSString localizedStringWithFormat:keyFormat, displayName]
-                                      stepProgress:stepCount > 0 ? (double) stepIndex / (double) stepCount : 0.0];
-            key = [self resolvedKeyForSample:sample];
-            stepIndex += 1;
+            keys = [KeyAnalyzer new];
+            [pipeline addAnalyzer:keys];
+        }
+        if (needsLoudness) {
+            loudness = [LoudnessAnalyzer new];
+            [pipeline addAnalyzer:loudness];
+        }
+        if (needsContentHash) {
+            contentHash = [ContentHashAnalyzer new];
+            [pipeline addAnalyzer:contentHash];
+        }
+
+        NSTimeInterval timeout = MAX(kDeepScanMinimumTimeout, [self estimatedDurationOfSample:sample] / 4.0);
+        NSError* pipelineError = nil;
+        // The pool holds this scan at a page boundary when preempted.
+        job.suspendHandler = ^(BOOL suspend) {
+            if (suspend) {
+                [pipeline suspend];
+            } else {
+                [pipeline resume];
+            }
+        };
+        BOOL analyzed = [pipeline runWithDecoder:[self deepScanAudioControllerForWorker:job.worker] timeout:timeout error:&pipelineError];
+        job.suspendHandler = nil;
+        // Only results that got stored are current. Failed analyzers lose an
+        // outdated record instead, or the track would keep getting queued.
+        for (id<SampleAnalyzer> analyzer in pipeline.analyzers) {
+            if (current[analyzer.name] == nil) {
+                continue;
+            }
+            if (analyzed && analyzer.error == nil) {
+                [ranAnalyzers addObject:analyzer.name];
+            } else {
+                [failedAnalyzers addObject:analyzer.name];
+            }
         }
+        if (analyzed) {
+            // The rendered length is exact, `decodedFrames` rounds up to full pages.
+            if (sample.renderedSampleRate > 0.0 && sample.renderedLength > 0) {
+                duration = @((double) sample.renderedLength / sample.renderedSampleRate * 1000.0);
+            }
+            tempo = beats.tempo;
+            key = keys.key;
+        } else {
+            NSLog(@"Deep scan: analysis failed for %@: %@", url, pipelineError);
+            loudness = nil;
+            contentHash = nil;
+        }
+        [pipeline.errors enumerateKeysAndObjectsUsingBlock:^(NSString* name, NSError* error, BOOL* stop) {
+            NSLog(@"Deep scan: %@ analysis failed for %@: %@", name, url, error);
+        }];
+    }
+
+    if (duration == nil && needsDuration) {
+        [self ensureDeepScanActivityWithDetail:[NSString localizedStringWithFormat:durationFormat, displayName]
+                                  stepProgress:0.5];
+        duration = [self resolvedDurationForURL:url];
+    }
+    if (duration != nil) {
+        [ranAnalyzers addObject:LibraryStoreDurationAnalyzer];
+    } else if (needsDuration) {
+        [failedAnalyzers addObject:LibraryStoreDurationAnalyzer];
     }
 
     if (key.length == 0) {
@@ -526,10 +712,17 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
 
     BOOL hasResults = (duration != nil || tempo != nil || key != nil);
     NSError* updateError = nil;
-    if (hasResults) {
+    // Before the track gets updated, as that decides whether it gets queued again.
+    if (![self.libraryStore recordAnalyzers:ranAnalyzers forURL:url error:&updateError]) {
+        NSLog(@"Deep scan: failed to record analyzer versions for %@: %@", url, updateError);
+    }
+    if (![self.libraryStore forgetAnalyzers:failedAnalyzers forURL:url error:&updateError]) {
+        NSLog(@"Deep scan: failed to drop analyzer versions for %@: %@", url, updateError);
+    }
+    if (hasResults || refreshOnly) {
         if (![self.libraryStore completeDeepScanForURL:url duration:duration tempo:tempo key:key error:&updateError]) {
             NSLog(@"Deep scan update failed: %@", updateError);
-            return;
+            return NO;
         }
     } else {
         NSString* reason = @"No deep metadata available";
@@ -537,10 +730,19 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
             NSLog(@"Deep scan failure mark failed: %@", updateError);
         }
         NSString* failedFormat = NSLocalizedString(@"activity.deep_scan.failed_format", @"Detail when deep scan fails");
-        self.deepScanCompletedCount += 1;
+        [self countFinishedDeepScan];
         [self updateDeepScanActivityWithDetail:[NSString localizedStringWithFormat:failedFormat, displayName]
                                   stepProgress:1.0];
-        return;
+        return NO;
+    }
+
+    if (loudness != nil || contentHash != nil) {
+        NSNumber* loudnessValue = (loudness != nil && loudness.error == nil && isfinite(loudness.loudness)) ? @(loudness.loudness) : nil;
+        NSNumber* peakValue = (loudness != nil && loudness.error == nil) ? @(loudness.peak) : nil;
+        NSString* hashValue = contentHash.error == nil ? contentHash.contentHash : nil;
+        if (![self.libraryStore updateAnalysisForURL:url loudness:loudnessValue peak:peakValue contentHash:hashValue error:&updateError]) {
+            NSLog(@"Deep scan analysis update failed: %@", updateError);
+        }
     }
 
     dispatch_async(dispatch_get_main_queue(), ^{
@@ -548,7 +750,6 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
         if (updatedMeta == nil || self.songsTable == nil) {
             return;
         }
-        [self updateTempoAndKeyFilters];
         NSUInteger row = [self songsRowForMeta:updatedMeta];
         if (row == NSNotFound || row >= (NSUInteger) self.songsTable.numberOfRows) {
             return;
@@ -558,9 +759,13 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
         [self.songsTable reloadDataForRowIndexes:rows columnIndexes:cols];
     });
 
-    self.deepScanCompletedCount += 1;
+    [self countFinishedDeepScan];
+    DeepScanWorkerPool* pool = self.deepScanPool;
+    NSLog(@"Deep scan: %lu running, %lu suspended, %.1f/min, %lu failed, %ld queued",
+          (unsigned long) pool.activeCount, (unsigned long) pool.suspendedCount, pool.throughput, (unsigned long) pool.failedCount, (long) [pool queueDepth]);
     //NSString* completedDetail = NSLocalizedString(@"activity.deep_scan.completed", @"Detail when deep scan completes");
     //[self ensureDeepScanActivityWithDetail:completedDetail stepProgress:1.0];
+    return YES;
 }
 
 - (NSNumber* _Nullable)resolvedDurationForURL:(NSURL*)url
@@ -568,6 +773,14 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
     if (url == nil) {
         return nil;
     }
+    // Container headers are exact and instant; the asset is the fallback for
+    // anything those do not cover.
+    NSError* headerError = nil;
+    AudioDuration* header = [AudioDuration durationOfURL:url error:&headerError];
+    if (header != nil) {
+        return @(header.milliseconds);
+    }
+    NSLog(@"Deep scan: no header duration for %@: %@", url, headerError);
     AVURLAsset* asset = [AVURLAsset URLAssetWithURL:url options:@{AVURLAssetPreferPreciseDurationAndTimingKey : @YES}];
     dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
     __block AVKeyValueStatus status = AVKeyValueStatusUnknown;
@@ -598,71 +811,48 @@ static NSSet<NSString*>* DeepScanExcludedGenres(void)
     return @(seconds * 1000.0);
 }
 
-- (NSNumber* _Nullable)resolvedTempoForSample:(LazySample*)sample
+- (MediaMetaData* _Nullable)updateCachedMetaForURL:(NSURL*)url
+                                          duration:(NSNumber* _Nullable)duration
+                                             tempo:(NSNumber* _Nullable)tempo
+                                               key:(NSString* _Nullable)key
 {
-    BeatTrackedSample* beatSample = [[BeatTrackedSample alloc] initWithSample:sample];
-    beatSample.suppressActivity = YES;
-    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
-    __block BOOL ready = NO;
-    [beatSample trackBeatsAsyncWithCompletionQueue:dispatch_get_global_queue(QOS_CLASS_UTILITY, 0) callback:^(BOOL done) {
-        ready = done;
-        dispatch_semaphore_signal(semaphore);
-    }];
-    dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, (int64_t) (60 * NSEC_PER_SEC)));
-
-    if (!ready) {
+    MediaMetaData* meta = [self cachedMetaForURL:url];
+    if (meta == nil) {
         return nil;
     }
-    float tempo = [beatSample averageTempo];
-    NSLog(@"resolved tempo for sample: %.0f", tempo);
-    return tempo > 0.0f ? @(tempo) : nil;
-}
-
-- (NSString* _Nullable)resolvedKeyForSample:(LazySample*)sample
-{
-    if (![self shouldAnalyzeKeyForSample:sample]) {
-        return nil;
+    if (duration != nil) {
+        meta.duration = duration;
     }
-    KeyTrackedSample* keySample = [[KeyTrackedSample alloc] initWithSample:sample];
-    keySample.suppressActivity = YES;
-    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
-    __block BOOL ready = NO;
-    [keySample trackKeyAsyncWithCompletionQueue:dispatch_get_global_queue(QOS_CLASS_UTILITY, 0) callback:^(BOOL done) {
-        ready = done;
-        dispatch_semaphore_signal(semaphore);
-    }];
-    dispatch_semaphore_wait(semaphore, dispatch_time(DISPATCH_TIME_NOW, (int64_t) (60 * NSEC_PER_SEC)));
-
-    if (!ready) {
-        return nil;
+    if (tempo != nil) {
+        meta.tempo = tempo;
+    }
+    if (key != nil) {
+        meta.key = key;
+    }
+    if (tempo != nil || key != nil) {
+        [self scheduleDeepScanRefresh];
     }
-    return keySample.key;
+    return meta;
 }
 
-- (MediaMetaData* _Nullable)updateCachedMetaForURL:(NSURL*)url
-                                          duration:(NSNumber* _Nullable)duration
-                                             tempo:(NSNumber* _Nullable)tempo
-                                               key:(NSString* _Nullable)key
+/// Scans finish one after the other; their rows get reloaded right away while
+/// the columns and the tempo and key filters catch up with all of them at once.
+- (void)scheduleDeepScanRefresh
 {
-    if (self.cachedLibrary == nil || url == nil) {
-        return nil;
+    if (self.deepScanRefreshScheduled) {
+        return;
     }
-    for (MediaMetaData* meta in self.cachedLibrary) {
-        if (![meta.location.absoluteString isEqualToString:url.absoluteString]) {
-            continue;
-        }
-        if (duration != nil) {
-            meta.duration = duration;
-        }
-        if (tempo != nil) {
-            meta.tempo = tempo;
-        }
-        if (key != nil) {
-            meta.key = key;
+    self.deepScanRefreshScheduled = YES;
+    BrowserController* __weak weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (kDeepScanRefreshDelay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        BrowserController* strongSelf = weakSelf;
+        if (!strongSelf) {
+            return;
         }
-        return meta;
-    }
-    return nil;
+        strongSelf.deepScanRefreshScheduled = NO;
+        [strongSelf invalidateLibraryColumns];
+        [strongSelf updateTempoAndKeyFilters];
+    });
 }
 
 @end
@@ -38,6 +38,7 @@ extern NSString* const kSongsColGenre;
 
 @class MediaMetaData;
 @class ActivityToken;
+@class TrackList;
 
 @protocol BrowserControllerDelegate <NSObject>
 - (MediaMetaData*)currentSongMeta;
@@ -85,6 +86,11 @@ extern NSString* const kSongsColGenre;
 /// Reconcile the cached library (validate files on disk and refresh metadata).
 - (IBAction)reconcileLibrary:(id)sender;
 
+/// Tracklist the library store holds for the set at `url`; empty when it holds none.
+- (TrackList*)storedTrackListForURL:(NSURL*)url;
+/// Mirror the tracklist of the set into the library store.
+- (void)storeTrackListOfMeta:(MediaMetaData*)meta;
+
 - (void)removeFilesAtURLs:(NSArray<NSURL*>*)urls;
 - (void)boostDeepScanForURL:(NSURL*)url;
 
@@ -17,7 +17,12 @@
 
 #import "ActivityManager.h"
 #import "CAShapeLayer+Path.h"
+#import "CancelableBlockOperation.h"
+#import "DeepScanWorkerPool.h"
+#import "LibraryColumns.h"
+#import "LibraryFilter.h"
 #import "LibraryStore.h"
+#import "LibraryWatcher.h"
 #import "MediaMetaData.h"
 #import "NSBezierPath+CGPath.h"
 #import "NSString+BeautifulPast.h"
@@ -41,10 +46,22 @@ NSString* const kSongsColTags = @"TagsCell";
 NSString* const kSongsColAdded = @"AddedCell";
 NSString* const kSongsColGenre = @"GenreCell";
 
+/// Delay for coalescing scroll events before artwork of visible rows gets fetched.
+static const NSTimeInterval kArtworkPrefetchDelay = 0.1;
+/// Quiet time on disk before changed files get picked up.
+static const NSTimeInterval kLibraryWatcherLatency = 2.0;
+/// Latest file system event handled, to catch up from on the next launch.
+static NSString* const kLibraryWatcherEventIdDefaultsKey = @"libraryWatcherEventId";
+
 @interface BrowserController ()
 @property (nonatomic, strong) ITLibrary* library;
 @property (nonatomic, strong) NSMutableArray<MediaMetaData*>* cachedLibrary;
+/// Items of `cachedLibrary` by absolute URL; built on first use.
+@property (nonatomic, strong, nullable) NSMutableDictionary<NSString*, MediaMetaData*>* cachedLibraryIndex;
+/// Store revision `cachedLibrary` reflects; -1 while unknown.
+@property (atomic, assign) int64_t libraryRevision;
 @property (nonatomic, strong) LibraryStore* libraryStore;
+@property (nonatomic, strong, nullable) LibraryWatcher* libraryWatcher;
 
 @property (nonatomic, weak) NSTableView* genresTable;
 @property (nonatomic, weak) NSTableView* artistsTable;
@@ -68,13 +85,24 @@ NSString* const kSongsColGenre = @"GenreCell";
 @property (nonatomic, strong) NSArray<MediaMetaData*>* filteredItems;
 
 @property (strong, nonatomic) dispatch_queue_t filterQueue;
-@property (strong, nonatomic) dispatch_queue_t deepScanQueue;
-@property (strong, nonatomic) dispatch_semaphore_t deepScanWake;
-@property (assign, nonatomic) BOOL deepScanStop;
+/// Search running for the latest needle; cancelled once the needle changes again.
+@property (strong, nonatomic, nullable) CancelableBlockOperation* needleOperation;
+/// Last complete search result and what it got filtered by. A search for a
+/// needle extending that one narrows it down instead of filtering everything.
+/// Use and change while synchronized on self.
+@property (strong, nonatomic, nullable) LibraryFilter* needleBaseFilter;
+@property (strong, nonatomic, nullable) NSArray<MediaMetaData*>* needleBaseItems;
+/// Columns of the cached library, taken on the filter queue on first use and
+/// dropped whenever the library changes; use while synchronized on self.
+@property (strong, nonatomic, nullable) LibraryColumns* libraryColumns;
+@property (strong, nonatomic) DeepScanWorkerPool* deepScanPool;
 @property (strong, nonatomic) ActivityToken* deepScanToken;
 @property (assign, nonatomic) NSInteger deepScanTotalCount;
 @property (assign, nonatomic) NSInteger deepScanCompletedCount;
-@property (strong, nonatomic) AudioController* deepScanAudioController;
+/// A refresh of columns and filters for results of finished deep scans is
+/// pending; main thread only.
+@property (assign, nonatomic) BOOL deepScanRefreshScheduled;
+@property (strong, nonatomic) NSMutableArray<AudioController*>* deepScanAudioControllers;
 @property (assign, nonatomic) BOOL reconcileRequested;
 @property (assign, nonatomic) BOOL reconcileRunning;
 @property (copy, nonatomic) void (^reconcileCompletion)(NSArray<MediaMetaData*>* _Nullable refreshedMetas,
@@ -84,6 +112,7 @@ NSString* const kSongsColGenre = @"GenreCell";
 
 - (void)mergeMetasIntoCache:(NSArray<MediaMetaData*>*)metas;
 - (void)refreshUIWithLibrary:(NSArray<MediaMetaData*>*)library;
+- (void)applyLibraryChanges;
 
 @end
 
@@ -99,6 +128,240 @@ NSString* const kSongsColGenre = @"GenreCell";
     BOOL _reloadingLibrary;
 
     MediaMetaData* _lazyUpdatedMeta;
+
+    NSUInteger _libraryColumnsGeneration;
+}
+
+- (void)setFilteredItems:(NSArray<MediaMetaData*>*)filteredItems
+{
+    _filteredItems = filteredItems;
+    // Filtered by something else than the needle; searches start over.
+    @synchronized(self) {
+        _needleBaseFilter = nil;
+        _needleBaseItems = nil;
+    }
+}
+
+- (void)setCachedLibrary:(NSMutableArray<MediaMetaData*>*)cachedLibrary
+{
+    @synchronized(self) {
+        _cachedLibrary = cachedLibrary;
+        _cachedLibraryIndex = nil;
+    }
+    [self invalidateLibraryColumns];
+    if (cachedLibrary.count == 0) {
+        return;
+    }
+    // Have search keys and columns ready ahead of the first search; items that
+    // got searched before keep their keys.
+    NSArray<MediaMetaData*>* items = [cachedLibrary copy];
+    BrowserController* __weak weakSelf = self;
+    dispatch_async(_filterQueue, ^{
+        [LibraryFilter prepareSearchKeysOfItems:items];
+        [weakSelf cachedLibraryColumns];
+    });
+}
+
+- (void)invalidateLibraryColumns
+{
+    @synchronized(self) {
+        _libraryColumns = nil;
+        _libraryColumnsGeneration++;
+    }
+}
+
+/// Columns of the cached library, taken when missing. Call on the filter queue.
+- (LibraryColumns*)cachedLibraryColumns
+{
+    NSArray<MediaMetaData*>* items = nil;
+    NSUInteger generation = 0;
+    @synchronized(self) {
+        if (_libraryColumns != nil) {
+            return _libraryColumns;
+        }
+        items = [_cachedLibrary copy] ?: @[];
+        generation = _libraryColumnsGeneration;
+    }
+    LibraryColumns* columns = [[LibraryColumns alloc] initWithItems:items];
+    @synchronized(self) {
+        // Not kept when the library changed while taking it.
+        if (generation == _libraryColumnsGeneration) {
+            _libraryColumns = columns;
+        }
+    }
+    return columns;
+}
+
+/// `items` sorted; through the library columns when they hold all of them,
+/// which rank each sort key once and keep the recent orders.
+- (NSArray<MediaMetaData*>*)sortedItems:(NSArray<MediaMetaData*>*)items descriptors:(NSArray<NSSortDescriptor*>*)descriptors
+{
+    LibraryColumns* columns = nil;
+    @synchronized(self) {
+        columns = _libraryColumns;
+    }
+    NSIndexSet* rows = [columns rowsOfItems:items];
+    NSArray<MediaMetaData*>* sorted = nil;
+    if (rows.count == items.count) {
+        sorted = [columns itemsAtRows:rows sortedUsingDescriptors:descriptors];
+    }
+    return sorted ?: [items sortedArrayUsingDescriptors:descriptors];
+}
+
+/// Deep scan workers look items up concurrently; take the index while
+/// synchronized on self. It gets replaced, never changed, once taken.
+- (NSMutableDictionary<NSString*, MediaMetaData*>*)cachedLibraryByURL
+{
+    @synchronized(self) {
+        if (_cachedLibraryIndex == nil) {
+            NSMutableDictionary<NSString*, MediaMetaData*>* index = [NSMutableDictionary dictionaryWithCapacity:_cachedLibrary.count];
+            for (MediaMetaData* meta in _cachedLibrary) {
+                NSString* url = meta.location.absoluteString;
+                if (url != nil) {
+                    index[url] = meta;
+                }
+            }
+            _cachedLibraryIndex = index;
+        }
+        return _cachedLibraryIndex;
+    }
+}
+
+/// Copy the value `source` holds for `key` over to `target`; NO when they are alike.
+static BOOL patchMetaValue(MediaMetaData* target, MediaMetaData* source, NSString* key)
+{
+    if ([key isEqualToString:@"artwork"]) {
+        NSString* hash = source.artworkHash;
+        if (hash == target.artworkHash || [hash isEqualToString:target.artworkHash]) {
+            return NO;
+        }
+        if (hash != nil && source.artworkSource != nil) {
+            [target setArtworkHash:hash source:source.artworkSource];
+        } else {
+            target.artwork = source.artwork;
+        }
+        target.artworkFormat = source.artworkFormat;
+        return YES;
+    }
+    id value = [source valueForKey:key];
+    id current = [target valueForKey:key];
+    if (value == current || [value isEqual:current]) {
+        return NO;
+    }
+    [target setValue:value forKey:key];
+    return YES;
+}
+
+/// Catch up with what changed in the store since `libraryRevision`. Changed
+/// items get patched in place and only their rows reloaded; changes adding,
+/// removing or moving items between filter values or sort positions refresh
+/// the lists as a whole.
+- (void)applyLibraryChanges
+{
+    BrowserController* __weak weakSelf = self;
+    dispatch_async(_filterQueue, ^{
+        BrowserController* strongSelf = weakSelf;
+        int64_t since = strongSelf ? strongSelf.libraryRevision : -1;
+        if (since < 0) {
+            return;
+        }
+        int64_t latest = since;
+        NSError* error = nil;
+        NSArray<LibraryChange*>* changes = [strongSelf.libraryStore changesSinceRevision:since latest:&latest error:&error];
+        if (changes == nil) {
+            NSLog(@"Library changes unavailable, reloading: %@", error);
+            strongSelf.libraryRevision = -1;
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [weakSelf loadCachedLibrary];
+            });
+            return;
+        }
+        strongSelf.libraryRevision = latest;
+        if (changes.count == 0) {
+            return;
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [weakSelf patchCachedLibraryWithChanges:changes];
+        });
+    });
+}
+
+- (void)patchCachedLibraryWithChanges:(NSArray<LibraryChange*>*)changes
+{
+    if (_cachedLibrary == nil) {
+        return;
+    }
+    NSMutableSet<NSString*>* layoutKeys = [NSMutableSet setWithArray:@[ @"genre", @"artist", @"album", @"tempo", @"key", @"rating", @"tags" ]];
+    for (NSSortDescriptor* descriptor in _songsTable.sortDescriptors) {
+        if (descriptor.key != nil) {
+            [layoutKeys addObject:descriptor.key];
+        }
+    }
+
+    // Filter queue blocks hold on to the cached library while iterating it;
+    // items get added and removed on a copy that replaces it as a whole.
+    NSMutableDictionary<NSString*, MediaMetaData*>* byURL = nil;
+    @synchronized(self) {
+        byURL = [self cachedLibraryByURL];
+    }
+    NSMutableArray<MediaMetaData*>* library = nil;
+    NSHashTable<MediaMetaData*>* touched = [NSHashTable hashTableWithOptions:NSPointerFunctionsObjectPointerPersonality];
+    BOOL relayout = NO;
+    for (LibraryChange* change in changes) {
+        NSString* url = change.url.absoluteString;
+        MediaMetaData* cached = byURL[url];
+        if (change.kind == LibraryChangeKindDelete && cached != nil) {
+            if (library == nil) {
+                library = [_cachedLibrary mutableCopy];
+                byURL = [byURL mutableCopy];
+            }
+            [library removeObjectIdenticalTo:cached];
+            [byURL removeObjectForKey:url];
+            relayout = YES;
+        } else if (change.kind != LibraryChangeKindDelete && cached == nil) {
+            if (library == nil) {
+                library = [_cachedLibrary mutableCopy];
+                byURL = [byURL mutableCopy];
+            }
+            [library addObject:change.meta];
+            byURL[url] = change.meta;
+            relayout = YES;
+        }
+        if (change.kind == LibraryChangeKindDelete || cached == nil) {
+            continue;
+        }
+        for (NSString* key in change.keys) {
+            if (!patchMetaValue(cached, change.meta, key)) {
+                continue;
+            }
+            [touched addObject:cached];
+            relayout = relayout || [layoutKeys containsObject:key];
+        }
+    }
+
+    if (library != nil) {
+        self.cachedLibrary = library;
+        @synchronized(self) {
+            _cachedLibraryIndex = byURL;
+        }
+    } else if (relayout || touched.count > 0) {
+        [self invalidateLibraryColumns];
+    }
+    if (relayout) {
+        // Filters and search stay as selected.
+        [self reloadData];
+        return;
+    }
+    if (touched.count == 0) {
+        return;
+    }
+    NSIndexSet* rows = [_filteredItems indexesOfObjectsPassingTest:^BOOL(MediaMetaData* meta, NSUInteger idx, BOOL* stop) {
+        return [touched containsObject:meta];
+    }];
+    if (rows.count > 0) {
+        NSIndexSet* cols = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, _songsTable.tableColumns.count)];
+        [_songsTable reloadDataForRowIndexes:rows columnIndexes:cols];
+    }
 }
 
 - (void)mergeMetasIntoCache:(NSArray<MediaMetaData*>*)metas
@@ -120,7 +383,7 @@ NSString* const kSongsColGenre = @"GenreCell";
 
 - (void)refreshUIWithLibrary:(NSArray<MediaMetaData*>*)library
 {
-    self.filteredItems = [library sortedArrayUsingDescriptors:[_songsTable sortDescriptors]];
+    self.filteredItems = [self sortedItems:library descriptors:[_songsTable sortDescriptors]];
     [self columnsFromMediaItems:self.filteredItems
                          genres:self.genres
                         artists:self.artists
@@ -178,6 +441,7 @@ NSString* const kSongsColGenre = @"GenreCell";
         NSURL* dbDir = [appSupport URLByAppendingPathComponent:@"PlayEm" isDirectory:YES];
         NSURL* dbURL = [dbDir URLByAppendingPathComponent:@"library.sqlite"];
         _libraryStore = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+        _libraryRevision = -1;
 
         _searchField = searchField;
         _searchField.delegate = self;
@@ -225,6 +489,13 @@ NSString* const kSongsColGenre = @"GenreCell";
         _songsTable.allowsColumnResizing = YES;
         _songsTable.doubleAction = @selector(doubleClickedSongsTableRow:);
 
+        NSClipView* songsClipView = _songsTable.enclosingScrollView.contentView;
+        songsClipView.postsBoundsChangedNotifications = YES;
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(songsTableDidScroll:)
+                                                     name:NSViewBoundsDidChangeNotification
+                                                   object:songsClipView];
+
         dispatch_queue_attr_t attr = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, 0);
         _filterQueue = dispatch_queue_create("PlayEm.BrowserFilterQueue", attr);
 
@@ -263,15 +534,15 @@ NSString* const kSongsColGenre = @"GenreCell";
             return;
         }
         // Apply filtering and sorting.
-        filteredItems = [[strongSelf filterMediaItems:cachedLibrary
-                                                genre:genre
-                                               artist:artist
-                                                album:album
-                                                tempo:tempo
-                                                  key:key
-                                               rating:rating
-                                                  tag:tag
-                                               needle:needle] sortedArrayUsingDescriptors:descriptors];
+        filteredItems = [strongSelf sortedItems:[strongSelf filterMediaItems:cachedLibrary
+                                                                       genre:genre
+                                                                      artist:artist
+                                                                       album:album
+                                                                       tempo:tempo
+                                                                         key:key
+                                                                      rating:rating
+                                                                         tag:tag
+                                                                      needle:needle] descriptors:descriptors];
 
         // This weird construct shall assure that we only reload those columns that
         // are undetermined by a selection with a priority built in. That means that
@@ -309,6 +580,7 @@ NSString* const kSongsColGenre = @"GenreCell";
             }
         }
         [strongSelf columnsFromMediaItems:filteredItems
+                              facetFilter:[strongSelf facetFilterWithGenre:genre artist:artist album:album tempo:tempo key:key rating:rating tag:tag needle:needle]
                                    genres:destGenres
                                   artists:destArtists
                                    albums:destAlbums
@@ -420,7 +692,20 @@ NSString* const kSongsColGenre = @"GenreCell";
     }
     if (index != NSNotFound) {
         NSLog(@"MediaMetaData %p updated does not exist in cached library", meta);
-        [self.cachedLibrary replaceObjectAtIndex:index withObject:updatedMeta];
+        // Swapped rather than changed; see patchCachedLibraryWithChanges:.
+        NSMutableArray<MediaMetaData*>* library = [self.cachedLibrary mutableCopy];
+        [library replaceObjectAtIndex:index withObject:updatedMeta];
+        NSMutableDictionary<NSString*, MediaMetaData*>* byURL = nil;
+        @synchronized(self) {
+            byURL = [[self cachedLibraryByURL] mutableCopy];
+        }
+        if (updatedMeta.location.absoluteString != nil) {
+            byURL[updatedMeta.location.absoluteString] = updatedMeta;
+        }
+        self.cachedLibrary = library;
+        @synchronized(self) {
+            _cachedLibraryIndex = byURL;
+        }
     }
     // NSLog(@"replaced metadata in cachedLibrary %p with %p", meta, updatedMeta);
 
@@ -504,8 +789,9 @@ NSString* const kSongsColGenre = @"GenreCell";
                                                                        cancellable:NO
                                                                      cancelHandler:nil];
 
-    _filteredItems = nil;
-    _cachedLibrary = nil;
+    self.filteredItems = nil;
+    self.cachedLibrary = nil;
+    self.libraryRevision = -1;
 
     _genres = [NSMutableArray array];
     _artists = [NSMutableArray array];
@@ -541,6 +827,8 @@ NSString* const kSongsColGenre = @"GenreCell";
         NSMutableArray<MediaMetaData*>* cachedLibrary = nil;
         NSError* storeLoadError = nil;
 
+        // Taken first so that nothing written while loading gets missed.
+        int64_t revision = [strongSelf.libraryStore currentRevision:&storeLoadError];
         NSArray<MediaMetaData*>* stored = [strongSelf.libraryStore loadAllMediaItems:&storeLoadError];
 
         if (stored && stored.count > 0) {
@@ -563,7 +851,8 @@ NSString* const kSongsColGenre = @"GenreCell";
         }
 
         [strongSelf mergeMetasIntoCache:cachedLibrary];
-        NSArray<MediaMetaData*>* filtered = [strongSelf.cachedLibrary sortedArrayUsingDescriptors:descriptors];
+        strongSelf.libraryRevision = revision;
+        NSArray<MediaMetaData*>* filtered = [strongSelf sortedItems:strongSelf.cachedLibrary descriptors:descriptors];
 
         dispatch_sync(dispatch_get_main_queue(), ^{
             BrowserController* strongSelf = weakSelf;
@@ -573,6 +862,7 @@ NSString* const kSongsColGenre = @"GenreCell";
 
             strongSelf.filteredItems = filtered;
             [strongSelf refreshUIWithLibrary:strongSelf.filteredItems];
+            [strongSelf prefetchVisibleArtwork];
             strongSelf->_updatingGenres = NO;
             strongSelf->_updatingArtists = NO;
             strongSelf->_updatingAlbums = NO;
@@ -585,6 +875,9 @@ NSString* const kSongsColGenre = @"GenreCell";
             [[ActivityManager shared] completeActivity:libraryToken];
             strongSelf->_reloadingLibrary = NO;
             [strongSelf startDeepScanSchedulerIfNeeded];
+            [strongSelf watchLibraryFolders];
+            // Catch up with writes that went on while loading.
+            [strongSelf applyLibraryChanges];
         });
     });
 }
@@ -624,9 +917,10 @@ NSString* const kSongsColGenre = @"GenreCell";
         if (![strongSelf.libraryStore importMediaItems:cachedLibrary preferExisting:YES error:&storeError]) {
             NSLog(@"LibraryStore import failed: %@", storeError);
         }
+        strongSelf.libraryRevision = [strongSelf.libraryStore currentRevision:&storeError];
 
         // Apply sorting.
-        strongSelf.filteredItems = [cachedLibrary sortedArrayUsingDescriptors:descriptors];
+        strongSelf.filteredItems = [strongSelf sortedItems:cachedLibrary descriptors:descriptors];
         strongSelf.cachedLibrary = cachedLibrary;
 
         [strongSelf columnsFromMediaItems:strongSelf.filteredItems
@@ -670,6 +964,7 @@ NSString* const kSongsColGenre = @"GenreCell";
 
             strongSelf->_reloadingLibrary = NO;
             [strongSelf startDeepScanSchedulerIfNeeded];
+            [strongSelf watchLibraryFolders];
         });
     });
 }
@@ -700,11 +995,13 @@ NSString* const kSongsColGenre = @"GenreCell";
                 return;
             }
 
-            if (refreshedCount > 0) {
+            // With the store revision known, the change log tells what to patch.
+            BOOL incremental = strongSelf.libraryRevision >= 0;
+            if (refreshedCount > 0 && !incremental) {
                 [strongSelf mergeMetasIntoCache:metas];
             }
 
-            NSArray<MediaMetaData*>* sorted = strongSelf.cachedLibrary ? [strongSelf.cachedLibrary sortedArrayUsingDescriptors:descriptors] : @[];
+            NSArray<MediaMetaData*>* sorted = (strongSelf.cachedLibrary && !incremental) ? [strongSelf sortedItems:strongSelf.cachedLibrary descriptors:descriptors] : @[];
 
             dispatch_async(dispatch_get_main_queue(), ^{
                 BrowserController* strongSelf = weakSelf;
@@ -713,7 +1010,11 @@ NSString* const kSongsColGenre = @"GenreCell";
                 }
 
                 if (refreshedCount > 0) {
-                    [strongSelf refreshUIWithLibrary:sorted];
+                    if (incremental) {
+                        [strongSelf applyLibraryChanges];
+                    } else {
+                        [strongSelf refreshUIWithLibrary:sorted];
+                    }
                 }
 
                 NSMutableArray<NSString*>* lines = [NSMutableArray array];
@@ -865,32 +1166,100 @@ NSString* const kSongsColGenre = @"GenreCell";
 
     BrowserController* __weak weakSelf = self;
     NSArray<NSSortDescriptor*>* descriptors = [_songsTable sortDescriptors];
-
-    dispatch_async(_filterQueue, ^{
-        BrowserController* strongSelf = weakSelf;
-        if (!strongSelf) {
-            return;
-        }
-        strongSelf.filteredItems = [[strongSelf filterMediaItems:strongSelf.cachedLibrary
-                                                           genre:genre
-                                                          artist:artist
-                                                           album:album
-                                                           tempo:tempo
-                                                             key:key
-                                                          rating:rating
-                                                             tag:tag
-                                                          needle:needle] sortedArrayUsingDescriptors:descriptors];
-
-        dispatch_sync(dispatch_get_main_queue(), ^{
+    // Rows down to the bottom of the visible ones get shown as soon as they are known.
+    NSUInteger visibleRowCount = NSMaxRange([_songsTable rowsInRect:_songsTable.visibleRect]);
+
+    // A search for an older needle is of no use anymore.
+    [self.needleOperation cancel];
+    CancelableBlockOperation* operation = [CancelableBlockOperation new];
+    CancelableBlockOperation* __weak weakOperation = operation;
+    self.needleOperation = operation;
+
+    // Hands a result to the songs table unless a newer search took over.
+    void (^show)(NSArray<MediaMetaData*>*) = ^(NSArray<MediaMetaData*>* items) {
+        dispatch_async(dispatch_get_main_queue(), ^{
             BrowserController* mainSelf = weakSelf;
-            if (!mainSelf) {
+            CancelableBlockOperation* current = weakOperation;
+            if (!mainSelf || current == nil || mainSelf.needleOperation != current || current.isCancelled) {
                 return;
             }
+            mainSelf->_filteredItems = items;
             [mainSelf.songsTable beginUpdates];
             [mainSelf.songsTable reloadData];
             [mainSelf.songsTable endUpdates];
+            [mainSelf.delegate updateSongsCount:mainSelf.cachedLibrary.count filtered:items.count];
         });
-    });
+    };
+
+    [operation run:^{
+        BrowserController* strongSelf = weakSelf;
+        if (!strongSelf || weakOperation.isCancelled) {
+            return;
+        }
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        LibraryFilter* filter = [strongSelf libraryFilterWithGenre:genre artist:artist album:album tempo:tempo key:key rating:rating tag:tag needle:needle];
+
+        // Narrowing a sorted result keeps it sorted, so its first matches are
+        // the first rows already.
+        NSArray<MediaMetaData*>* base = nil;
+        LibraryFilter* baseFilter = nil;
+        @synchronized(strongSelf) {
+            if (strongSelf.needleBaseFilter != nil && [filter narrows:strongSelf.needleBaseFilter]) {
+                base = strongSelf.needleBaseItems;
+                baseFilter = strongSelf.needleBaseFilter;
+            }
+        }
+        [strongSelf indexFilter:filter narrowing:baseFilter];
+        NSArray<MediaMetaData*>* filtered = nil;
+        if (base != nil) {
+            filtered = [filter filterItems:base
+                                 operation:weakOperation
+                           firstMatchCount:visibleRowCount
+                              firstMatches:^(NSArray<MediaMetaData*>* matches) {
+                                  show(matches);
+                              }];
+        } else {
+            filtered = [filter filterItems:strongSelf.cachedLibrary operation:weakOperation firstMatchCount:0 firstMatches:nil];
+            filtered = filtered ? [strongSelf sortedItems:filtered descriptors:descriptors] : nil;
+        }
+        if (filtered == nil) {
+            NSLog(@"search for: %@ got cancelled", needle);
+            return;
+        }
+        NSLog(@"search for: %@ %@ %ld entries in %.0fms",
+              needle,
+              base != nil ? @"narrowed to" : @"found",
+              filtered.count,
+              (CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+
+        @synchronized(strongSelf) {
+            strongSelf.needleBaseFilter = filter;
+            strongSelf.needleBaseItems = filtered;
+        }
+        show(filtered);
+    }];
+    dispatch_async(_filterQueue, operation.dispatchBlock);
+}
+
+/// Coalesces scroll events into one artwork prefetch once scrolling settles.
+- (void)scheduleVisibleArtworkPrefetch
+{
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(prefetchVisibleArtwork) object:nil];
+    [self performSelector:@selector(prefetchVisibleArtwork) withObject:nil afterDelay:kArtworkPrefetchDelay];
+}
+
+/// Artwork is fetched from the store on demand; get what the visible rows and
+/// a page in either direction need into memory ahead of that.
+- (void)prefetchVisibleArtwork
+{
+    NSArray<MediaMetaData*>* items = self.filteredItems;
+    NSRange rows = [_songsTable rowsInRect:_songsTable.visibleRect];
+    NSUInteger start = rows.location > rows.length ? rows.location - rows.length : 0;
+    NSUInteger end = MIN(NSMaxRange(rows) + rows.length, items.count);
+    if (start >= end) {
+        return;
+    }
+    [self.libraryStore prefetchArtworkForMetas:[items subarrayWithRange:NSMakeRange(start, end - start)]];
 }
 
 - (void)showSongRowForMeta:(MediaMetaData*)meta
@@ -986,74 +1355,29 @@ NSString* const kSongsColGenre = @"GenreCell";
     NSLog(@"filtered based on genre:%@ artist:%@ album:%@ tempo:%@ key:%@, "
           @"rating:%@, tag:%@, needle: %@",
           genre, artist, album, tempo, key, rating, tag, needle);
-    NSMutableArray* filtered = [NSMutableArray array];
-
-    // We need to match a bit more elaborately here. The challenge is that ie on a US-
-    // keyboard entering a U-umlaut will be hard. If now the song of desire happens to
-    // be using that letter, how shall the user ever find it? On the other hand, maybe
-    // that user actually uses a German keyboard layout and has no issue entering U-umlaut.
-    // For those users, the assumption is that a perfect match is desired and no diacritic
-    // variants should match, but the one entered.
-    //
-    // The solution is dynamically chosen matching: When entering without diacritics the
-    // diacritics-insensitive matcher is used (U matches U-umlaut). When searching for a
-    // needly with diacritics the plain matcher is used (U-umlaut only matches U-umlaut).
-    //
-    BOOL (^matching)(NSString*, NSString*) = NULL;
-
-    // Does the folded version equal the unfolded one? -> that baby has no diacritics.
-    NSString* folded = [needle stringByFoldingWithOptions:NSDiacriticInsensitiveSearch
-                                                   locale:[NSLocale currentLocale]];
-    if (![needle isEqualToString:folded]) {
-        // Our needle has diacritics, we shall match exactly.
-        matching = ^BOOL(NSString* haystack, NSString* needle) {
-            return [haystack localizedCaseInsensitiveContainsString:needle];
-        };
-    } else {
-        // Our needle has no diacritics, we shall match insensitive to those.
-        matching = ^BOOL(NSString* haystack, NSString* foldedNeedle) {
-            NSString* foldedHay = [haystack stringByFoldingWithOptions:(NSDiacriticInsensitiveSearch |
-                                                                        NSCaseInsensitiveSearch |
-                                                                        NSWidthInsensitiveSearch)
-                                                                locale:[NSLocale currentLocale]];
-            return [foldedHay containsString:foldedNeedle];
-        };
-        needle = [needle stringByFoldingWithOptions:(NSDiacriticInsensitiveSearch |
-                                                     NSCaseInsensitiveSearch |
-                                                     NSWidthInsensitiveSearch)
-                                             locale:[NSLocale currentLocale]];
-    }
-
-    for (MediaMetaData* d in items) {
-        // FIXME: WTF is this, midway in a filter function, we are starting to parse and
-        // FIXME: separate? This appears to be a bad spot for doing so.
-        NSArray* tags = nil;
-        if (d.tags && d.tags.length) {
-            if ([[d.tags substringToIndex:1] isEqualToString:@"#"]) {
-                tags = [[d.tags substringFromIndex:1] componentsSeparatedByString:@"#"];
-            }
-        }
-        // Filter per column browser first.
-        if ((genre == nil || (d.genre && d.genre.length && [d.genre isEqualTo:genre])) &&
-            (artist == nil || (d.artist && d.artist.length && [d.artist isEqualTo:artist])) &&
-            (album == nil || (d.album && d.album.length && [d.album isEqualTo:album])) && (key == nil || (d.key && d.key.length && [d.key isEqualTo:key])) &&
-            (rating == nil || (d.rating && d.stars.length && [d.stars isEqualTo:rating])) && (tag == nil || [tags containsObject:tag]) &&
-            (tempo == nil || (d.tempo && [[d.tempo stringValue] isEqualTo:tempo]))) {
-            // When the user entered a search needle, we additionally filter for that.
-            if (needle.length) {
-                if ((d.genre && d.genre.length && matching(d.genre, needle)) ||
-                    (d.title && d.title.length && matching(d.title, needle)) ||
-                    (d.artist && d.artist.length && matching(d.artist, needle)) ||
-                    (d.album && d.album.length && matching(d.album, needle)) ||
-                    (d.key && d.key.length && [d.key localizedCaseInsensitiveContainsString:needle]) ||
-                    (d.rating && d.stars.length && [d.stars localizedCaseInsensitiveContainsString:needle]) || ([tags containsObject:needle]) ||
-                    ([[d.tempo stringValue] localizedCaseInsensitiveContainsString:needle])) {
-                    [filtered addObject:d];
-                }
-            } else {
-                [filtered addObject:d];
-            }
+    NSArray<MediaMetaData*>* filtered = nil;
+    if (items == _cachedLibrary) {
+        // The selection compares codes in the library columns; just the needle
+        // is left to match item by item.
+        NSMutableDictionary<NSNumber*, NSString*>* selection = [NSMutableDictionary dictionary];
+        selection[@(LibraryColumnGenre)] = genre;
+        selection[@(LibraryColumnArtist)] = artist;
+        selection[@(LibraryColumnAlbum)] = album;
+        selection[@(LibraryColumnTempo)] = tempo;
+        selection[@(LibraryColumnKey)] = key;
+        selection[@(LibraryColumnRating)] = rating;
+        selection[@(LibraryColumnTags)] = tag;
+        LibraryColumns* columns = [self cachedLibraryColumns];
+        filtered = [columns itemsAtRows:[columns rowsMatchingValues:selection]];
+        if (needle.length) {
+            LibraryFilter* filter = [self libraryFilterWithGenre:nil artist:nil album:nil tempo:nil key:nil rating:nil tag:nil needle:needle];
+            [self indexFilter:filter narrowing:nil];
+            filtered = [filter filterItems:filtered operation:nil firstMatchCount:0 firstMatches:nil];
         }
+    } else {
+        LibraryFilter* filter = [self libraryFilterWithGenre:genre artist:artist album:album tempo:tempo key:key rating:rating tag:tag needle:needle];
+        [self indexFilter:filter narrowing:nil];
+        filtered = [filter filterItems:items operation:nil firstMatchCount:0 firstMatches:nil];
     }
 
     NSLog(@"filtered narrowed from %ld to %ld entries", items.count, filtered.count);
@@ -1068,6 +1392,73 @@ NSString* const kSongsColGenre = @"GenreCell";
     return filtered;
 }
 
+- (LibraryFilter*)libraryFilterWithGenre:(NSString*)genre
+                                  artist:(NSString*)artist
+                                   album:(NSString*)album
+                                   tempo:(NSString*)tempo
+                                     key:(NSString*)key
+                                  rating:(NSString*)rating
+                                     tag:(NSString*)tag
+                                  needle:(NSString*)needle
+{
+    LibraryFilter* filter = [LibraryFilter new];
+    filter.genre = genre;
+    filter.artist = artist;
+    filter.album = album;
+    filter.tempo = tempo;
+    filter.key = key;
+    filter.rating = rating;
+    filter.tag = tag;
+    filter.needle = needle;
+    return filter;
+}
+
+/// The library index answers for title, artist, album, genre and tags at
+/// once, so only the items it found need their text checked. What got found
+/// for a needle covers all that an extended one finds, hence a filter
+/// narrowing `base` reuses that instead of querying on every keystroke.
+- (void)indexFilter:(LibraryFilter*)filter narrowing:(LibraryFilter* _Nullable)base
+{
+    if (filter.needle.length == 0) {
+        return;
+    }
+    if (base.needle.length > 0) {
+        filter.indexedURLs = base.indexedURLs;
+        return;
+    }
+    filter.indexedURLs = [self.libraryStore searchURLsMatchingNeedle:filter.needle error:nil];
+}
+
+/// Facet filter equivalent to the given selection, or nil when ratings, tags or
+/// a search needle take part that the library store cannot filter by.
+- (NSDictionary<NSNumber*, NSString*>*)facetFilterWithGenre:(NSString*)genre
+                                                     artist:(NSString*)artist
+                                                      album:(NSString*)album
+                                                      tempo:(NSString*)tempo
+                                                        key:(NSString*)key
+                                                     rating:(NSString*)rating
+                                                        tag:(NSString*)tag
+                                                     needle:(NSString*)needle
+{
+    if (rating != nil || tag != nil || needle.length > 0) {
+        return nil;
+    }
+    NSMutableDictionary<NSNumber*, NSString*>* filter = [NSMutableDictionary dictionary];
+    filter[@(LibraryFacetGenre)] = genre;
+    filter[@(LibraryFacetArtist)] = artist;
+    filter[@(LibraryFacetAlbum)] = album;
+    filter[@(LibraryFacetTempo)] = tempo;
+    filter[@(LibraryFacetKey)] = key;
+    return filter;
+}
+
+static void setColumnValues(NSMutableArray* column, NSArray* values, NSString* singularLabel, NSString* pluralLabel)
+{
+    NSString* label = [NSString stringWithFormat:values.count != 1 ? pluralLabel : singularLabel, values.count];
+    [column setArray:[values sortedArrayUsingSelector:@selector(localizedCaseInsensitiveCompare:)]];
+    [column insertObject:label atIndex:0];
+}
+
 // Get column lists for the items in the given list.
 - (void)columnsFromMediaItems:(NSArray*)items
                        genres:(NSMutableArray*)genres
@@ -1078,6 +1469,82 @@ NSString* const kSongsColGenre = @"GenreCell";
                       ratings:(NSMutableArray*)ratings
                          tags:(NSMutableArray*)tags
 {
+    [self columnsFromMediaItems:items facetFilter:nil genres:genres artists:artists albums:albums tempos:tempos keys:keys ratings:ratings tags:tags];
+}
+
+// Same as above; with a facet filter describing what the items were filtered
+// by, the genre, artist, album, tempo and key lists get taken from the library
+// store's indices rather than from walking the items.
+- (void)columnsFromMediaItems:(NSArray*)items
+                  facetFilter:(NSDictionary<NSNumber*, NSString*>*)facetFilter
+                       genres:(NSMutableArray*)genres
+                      artists:(NSMutableArray*)artists
+                       albums:(NSMutableArray*)albums
+                       tempos:(NSMutableArray*)tempos
+                         keys:(NSMutableArray*)keys
+                      ratings:(NSMutableArray*)ratings
+                         tags:(NSMutableArray*)tags
+{
+    if (facetFilter != nil) {
+        NSArray<NSMutableArray*>* columns = @[ genres ?: NSNull.null, artists ?: NSNull.null, albums ?: NSNull.null, tempos ?: NSNull.null, keys ?: NSNull.null ];
+        NSArray<NSNumber*>* facets = @[ @(LibraryFacetGenre), @(LibraryFacetArtist), @(LibraryFacetAlbum), @(LibraryFacetTempo), @(LibraryFacetKey) ];
+        NSArray<NSArray<NSString*>*>* labels = @[
+            @[ @"All (%ld Genre)", @"All (%ld Genres)" ], @[ @"All (%ld Artist)", @"All (%ld Artists)" ], @[ @"All (%ld Album)", @"All (%ld Albums)" ],
+            @[ @"All (%ld Tempo)", @"All (%ld Tempos)" ], @[ @"All (%ld Key)", @"All (%ld Keys)" ]
+        ];
+        NSMutableIndexSet* answered = [NSMutableIndexSet indexSet];
+        for (NSUInteger i = 0; i < facets.count; i++) {
+            if (columns[i] == (id) NSNull.null) {
+                continue;
+            }
+            NSError* error = nil;
+            NSDictionary<NSString*, NSNumber*>* values = [self.libraryStore valuesOfFacet:facets[i].integerValue filter:facetFilter error:&error];
+            if (values == nil) {
+                NSLog(@"facet query failed, walking the items instead: %@", error);
+                break;
+            }
+            setColumnValues(columns[i], values.allKeys, labels[i][0], labels[i][1]);
+            [answered addIndex:i];
+        }
+        genres = [answered containsIndex:0] ? nil : genres;
+        artists = [answered containsIndex:1] ? nil : artists;
+        albums = [answered containsIndex:2] ? nil : albums;
+        tempos = [answered containsIndex:3] ? nil : tempos;
+        keys = [answered containsIndex:4] ? nil : keys;
+        if (genres == nil && artists == nil && albums == nil && tempos == nil && keys == nil && ratings == nil && tags == nil) {
+            return;
+        }
+    }
+
+    // Items out of the library columns get counted there.
+    LibraryColumns* libraryColumns = nil;
+    @synchronized(self) {
+        libraryColumns = _libraryColumns;
+    }
+    NSIndexSet* rows = [libraryColumns rowsOfItems:items];
+    if (rows != nil) {
+        NSArray<NSMutableArray*>* columns = @[
+            genres ?: NSNull.null, artists ?: NSNull.null, albums ?: NSNull.null, tempos ?: NSNull.null, keys ?: NSNull.null, ratings ?: NSNull.null,
+            tags ?: NSNull.null
+        ];
+        NSArray<NSNumber*>* sources = @[
+            @(LibraryColumnGenre), @(LibraryColumnArtist), @(LibraryColumnAlbum), @(LibraryColumnTempo), @(LibraryColumnKey), @(LibraryColumnRating),
+            @(LibraryColumnTags)
+        ];
+        NSArray<NSArray<NSString*>*>* labels = @[
+            @[ @"All (%ld Genre)", @"All (%ld Genres)" ], @[ @"All (%ld Artist)", @"All (%ld Artists)" ], @[ @"All (%ld Album)", @"All (%ld Albums)" ],
+            @[ @"All (%ld Tempo)", @"All (%ld Tempos)" ], @[ @"All (%ld Key)", @"All (%ld Keys)" ], @[ @"All (%ld Rating)", @"All (%ld Ratings)" ],
+            @[ @"All (%ld Tag)", @"All (%ld Tags)" ]
+        ];
+        for (NSUInteger i = 0; i < columns.count; i++) {
+            if (columns[i] != (id) NSNull.null) {
+                NSDictionary<NSString*, NSNumber*>* values = [libraryColumns valuesOfColumn:sources[i].integerValue rows:rows];
+                setColumnValues(columns[i], values.allKeys, labels[i][0], labels[i][1]);
+            }
+        }
+        return;
+    }
+
     NSMutableDictionary* filteredGenres = [NSMutableDictionary dictionary];
     NSMutableDictionary* filteredArtists = [NSMutableDictionary dictionary];
     NSMutableDictionary* filteredAlbums = [NSMutableDictionary dictionary];
@@ -1086,30 +1553,28 @@ NSString* const kSongsColGenre = @"GenreCell";
     NSMutableDictionary* filteredRatings = [NSMutableDictionary dictionary];
     NSMutableDictionary* filteredTags = [NSMutableDictionary dictionary];
 
-    size_t itemCount = items.count;
-    size_t itemIndex = 0;
     for (MediaMetaData* d in items) {
-        if (d.genre && d.genre.length) {
+        if (genres != nil && d.genre && d.genre.length) {
             filteredGenres[d.genre] = d.genre;
         }
-        if (d.artist && d.artist.length) {
+        if (artists != nil && d.artist && d.artist.length) {
             filteredArtists[d.artist] = d.artist;
         }
-        if (d.album && d.album.length) {
+        if (albums != nil && d.album && d.album.length) {
             filteredAlbums[d.album] = d.album;
         }
-        if (d.tempo && [d.tempo intValue] > 0) {
+        if (tempos != nil && d.tempo && [d.tempo intValue] > 0) {
             NSString* t = [d.tempo stringValue];
             filteredTempos[t] = t;
         }
-        if (d.key && d.key.length > 0) {
+        if (keys != nil && d.key && d.key.length > 0) {
             filteredKeys[d.key] = d.key;
         }
-        if (d.rating && [d.rating intValue] > 0) {
+        if (ratings != nil && d.rating && [d.rating intValue] > 0) {
             NSString* s = d.stars;
             filteredRatings[s] = s;
         }
-        if (d.tags && d.tags.length > 0) {
+        if (tags != nil && d.tags && d.tags.length > 0) {
             if ([[d.tags substringToIndex:1] isEqualToString:@"#"]) {
                 NSString* r = [d.tags substringFromIndex:1];
                 NSArray<NSString*>* components = [r componentsSeparatedByString:@"#"];
@@ -1118,59 +1583,29 @@ NSString* const kSongsColGenre = @"GenreCell";
                 }
             }
         }
-        //        dispatch_async(dispatch_get_main_queue(), ^{
-        //            [self.delegate loadLibraryState:LoadStateLoading
-        //                                      value:(double)(itemIndex + 1) /
-        //                                      (double)itemCount];
-        //        });
-        itemIndex++;
     }
 
     if (genres != nil) {
-        NSArray* array = [filteredGenres allKeys];
-        NSString* label = [NSString stringWithFormat:array.count != 1 ? @"All (%ld Genres)" : @"All (%ld Genre)", array.count];
-        [genres setArray:[array sortedArrayUsingSelector:@selector(localizedCaseInsensitiveCompare:)]];
-        [genres insertObject:label atIndex:0];
+        setColumnValues(genres, filteredGenres.allKeys, @"All (%ld Genre)", @"All (%ld Genres)");
     }
     if (artists != nil) {
-        NSArray* array = [filteredArtists allKeys];
-        NSString* label = [NSString stringWithFormat:array.count != 1 ? @"All (%ld Artists)" : @"All (%ld Artist)", array.count];
-        [artists setArray:[[filteredArtists allKeys] sortedArrayUsingSelector:@selector(localizedCaseInsensitiveCompare:)]];
-        [artists insertObject:label atIndex:0];
+        setColumnValues(artists, filteredArtists.allKeys, @"All (%ld Artist)", @"All (%ld Artists)");
     }
     if (albums != nil) {
-        NSArray* array = [filteredAlbums allKeys];
-        NSString* label = [NSString stringWithFormat:array.count != 1 ? @"All (%ld Albums)" : @"All (%ld Album)", array.count];
-        [albums setArray:[[filteredAlbums allKeys] sortedArrayUsingSelector:@selector(localizedCaseInsensitiveCompare:)]];
-        [albums insertObject:label atIndex:0];
+        setColumnValues(albums, filteredAlbums.allKeys, @"All (%ld Album)", @"All (%ld Albums)");
     }
     if (tempos != nil) {
-        NSArray* array = [filteredTempos allKeys];
-        NSString* label = [NSString stringWithFormat:array.count != 1 ? @"All (%ld Tempos)" : @"All (%ld Tempo)", array.count];
-        [tempos setArray:[[filteredTempos allKeys] sortedArrayUsingSelector:@selector(localizedCaseInsensitiveCompare:)]];
-        [tempos insertObject:label atIndex:0];
+        setColumnValues(tempos, filteredTempos.allKeys, @"All (%ld Tempo)", @"All (%ld Tempos)");
     }
     if (keys != nil) {
-        NSArray* array = [filteredKeys allKeys];
-        NSString* label = [NSString stringWithFormat:array.count != 1 ? @"All (%ld Keys)" : @"All (%ld Key)", array.count];
-        [keys setArray:[[filteredKeys allKeys] sortedArrayUsingSelector:@selector(localizedCaseInsensitiveCompare:)]];
-        [keys insertObject:label atIndex:0];
+        setColumnValues(keys, filteredKeys.allKeys, @"All (%ld Key)", @"All (%ld Keys)");
     }
     if (ratings != nil) {
-        NSArray* array = [filteredRatings allKeys];
-        NSString* label = [NSString stringWithFormat:array.count != 1 ? @"All (%ld Ratings)" : @"All (%ld Rating)", array.count];
-        [ratings setArray:[[filteredRatings allKeys] sortedArrayUsingSelector:@selector(localizedCaseInsensitiveCompare:)]];
-        [ratings insertObject:label atIndex:0];
+        setColumnValues(ratings, filteredRatings.allKeys, @"All (%ld Rating)", @"All (%ld Ratings)");
     }
     if (tags != nil) {
-        NSArray* array = [filteredTags allKeys];
-        NSString* label = [NSString stringWithFormat:array.count != 1 ? @"All (%ld Tags)" : @"All (%ld Tag)", array.count];
-        [tags setArray:[[filteredTags allKeys] sortedArrayUsingSelector:@selector(localizedCaseInsensitiveCompare:)]];
-        [tags insertObject:label atIndex:0];
+        setColumnValues(tags, filteredTags.allKeys, @"All (%ld Tag)", @"All (%ld Tags)");
     }
-    //    dispatch_async(dispatch_get_main_queue(), ^{
-    //        [self.delegate loadLibraryState:LoadStateStopped];
-    //    });
 }
 
 - (void)genresTableViewSelectionDidChange:(NSInteger)row
@@ -1197,17 +1632,18 @@ NSString* const kSongsColGenre = @"GenreCell";
         if (!strongSelf) {
             return;
         }
-        strongSelf.filteredItems = [[strongSelf filterMediaItems:strongSelf.cachedLibrary
-                                                           genre:genre
-                                                          artist:artist
-                                                           album:album
-                                                           tempo:tempo
-                                                             key:key
-                                                          rating:rating
-                                                             tag:tag
-                                                          needle:needle] sortedArrayUsingDescriptors:descriptors];
+        strongSelf.filteredItems = [strongSelf sortedItems:[strongSelf filterMediaItems:strongSelf.cachedLibrary
+                                                                                  genre:genre
+                                                                                 artist:artist
+                                                                                  album:album
+                                                                                  tempo:tempo
+                                                                                    key:key
+                                                                                 rating:rating
+                                                                                    tag:tag
+                                                                                 needle:needle] descriptors:descriptors];
 
         [strongSelf columnsFromMediaItems:strongSelf.filteredItems
+                              facetFilter:[strongSelf facetFilterWithGenre:genre artist:artist album:album tempo:tempo key:key rating:rating tag:tag needle:needle]
                                    genres:nil
                                   artists:strongSelf.artists
                                    albums:strongSelf.albums
@@ -1296,17 +1732,18 @@ NSString* const kSongsColGenre = @"GenreCell";
         if (!strongSelf) {
             return;
         }
-        strongSelf.filteredItems = [[strongSelf filterMediaItems:strongSelf.cachedLibrary
-                                                           genre:genre
-                                                          artist:artist
-                                                           album:album
-                                                           tempo:tempo
-                                                             key:key
-                                                          rating:rating
-                                                             tag:tag
-                                                          needle:needle] sortedArrayUsingDescriptors:descriptors];
+        strongSelf.filteredItems = [strongSelf sortedItems:[strongSelf filterMediaItems:strongSelf.cachedLibrary
+                                                                                  genre:genre
+                                                                                 artist:artist
+                                                                                  album:album
+                                                                                  tempo:tempo
+                                                                                    key:key
+                                                                                 rating:rating
+                                                                                    tag:tag
+                                                                                 needle:needle] descriptors:descriptors];
 
         [strongSelf columnsFromMediaItems:strongSelf.filteredItems
+                              facetFilter:[strongSelf facetFilterWithGenre:genre artist:artist album:album tempo:tempo key:key rating:rating tag:tag needle:needle]
                                    genres:nil
                                   artists:nil
                                    albums:strongSelf.albums
@@ -1387,17 +1824,18 @@ NSString* const kSongsColGenre = @"GenreCell";
         if (!strongSelf) {
             return;
         }
-        strongSelf.filteredItems = [[strongSelf filterMediaItems:strongSelf.cachedLibrary
-                                                           genre:genre
-                                                          artist:artist
-                                                           album:album
-                                                           tempo:tempo
-                                                             key:key
-                                                          rating:rating
-                                                             tag:tag
-                                                          needle:needle] sortedArrayUsingDescriptors:descriptors];
+        strongSelf.filteredItems = [strongSelf sortedItems:[strongSelf filterMediaItems:strongSelf.cachedLibrary
+                                                                                  genre:genre
+                                                                                 artist:artist
+                                                                                  album:album
+                                                                                  tempo:tempo
+                                                                                    key:key
+                                                                                 rating:rating
+                                                                                    tag:tag
+                                                                                 needle:needle] descriptors:descriptors];
 
         [strongSelf columnsFromMediaItems:strongSelf.filteredItems
+                              facetFilter:[strongSelf facetFilterWithGenre:genre artist:artist album:album tempo:tempo key:key rating:rating tag:tag needle:needle]
                                    genres:nil
                                   artists:nil
                                    albums:nil
@@ -1470,17 +1908,18 @@ NSString* const kSongsColGenre = @"GenreCell";
         if (!strongSelf) {
             return;
         }
-        strongSelf.filteredItems = [[strongSelf filterMediaItems:strongSelf.cachedLibrary
-                                                           genre:genre
-                                                          artist:artist
-                                                           album:album
-                                                           tempo:tempo
-                                                             key:key
-                                                          rating:rating
-                                                             tag:tag
-                                                          needle:needle] sortedArrayUsingDescriptors:descriptors];
+        strongSelf.filteredItems = [strongSelf sortedItems:[strongSelf filterMediaItems:strongSelf.cachedLibrary
+                                                                                  genre:genre
+                                                                                 artist:artist
+                                                                                  album:album
+                                                                                  tempo:tempo
+                                                                                    key:key
+                                                                                 rating:rating
+                                                                                    tag:tag
+                                                                                 needle:needle] descriptors:descriptors];
 
         [strongSelf columnsFromMediaItems:strongSelf.filteredItems
+                              facetFilter:[strongSelf facetFilterWithGenre:genre artist:artist album:album tempo:tempo key:key rating:rating tag:tag needle:needle]
                                    genres:nil
                                   artists:nil
                                    albums:nil
@@ -1548,15 +1987,15 @@ NSString* const kSongsColGenre = @"GenreCell";
         if (!strongSelf) {
             return;
         }
-        strongSelf.filteredItems = [[strongSelf filterMediaItems:strongSelf.cachedLibrary
-                                                           genre:genre
-                                                          artist:artist
-                                                           album:album
-                                                           tempo:tempo
-                                                             key:key
-                                                          rating:rating
-                                                             tag:tag
-                                                          needle:needle] sortedArrayUsingDescriptors:descriptors];
+        strongSelf.filteredItems = [strongSelf sortedItems:[strongSelf filterMediaItems:strongSelf.cachedLibrary
+                                                                                  genre:genre
+                                                                                 artist:artist
+                                                                                  album:album
+                                                                                  tempo:tempo
+                                                                                    key:key
+                                                                                 rating:rating
+                                                                                    tag:tag
+                                                                                 needle:needle] descriptors:descriptors];
 
         dispatch_sync(dispatch_get_main_queue(), ^{
             BrowserController* mainSelf = weakSelf;
@@ -1609,15 +2048,15 @@ NSString* const kSongsColGenre = @"GenreCell";
         if (!strongSelf) {
             return;
         }
-        strongSelf.filteredItems = [[strongSelf filterMediaItems:strongSelf.cachedLibrary
-                                                           genre:genre
-                                                          artist:artist
-                                                           album:album
-                                                           tempo:tempo
-                                                             key:key
-                                                          rating:rating
-                                                             tag:tag
-                                                          needle:needle] sortedArrayUsingDescriptors:descriptors];
+        strongSelf.filteredItems = [strongSelf sortedItems:[strongSelf filterMediaItems:strongSelf.cachedLibrary
+                                                                                  genre:genre
+                                                                                 artist:artist
+                                                                                  album:album
+                                                                                  tempo:tempo
+                                                                                    key:key
+                                                                                 rating:rating
+                                                                                    tag:tag
+                                                                                 needle:needle] descriptors:descriptors];
 
         dispatch_sync(dispatch_get_main_queue(), ^{
             BrowserController* mainSelf = weakSelf;
@@ -1663,15 +2102,15 @@ NSString* const kSongsColGenre = @"GenreCell";
         if (!strongSelf) {
             return;
         }
-        strongSelf.filteredItems = [[strongSelf filterMediaItems:strongSelf.cachedLibrary
-                                                           genre:genre
-                                                          artist:artist
-                                                           album:album
-                                                           tempo:tempo
-                                                             key:key
-                                                          rating:rating
-                                                             tag:tag
-                                                          needle:needle] sortedArrayUsingDescriptors:descriptors];
+        strongSelf.filteredItems = [strongSelf sortedItems:[strongSelf filterMediaItems:strongSelf.cachedLibrary
+                                                                                  genre:genre
+                                                                                 artist:artist
+                                                                                  album:album
+                                                                                  tempo:tempo
+                                                                                    key:key
+                                                                                 rating:rating
+                                                                                    tag:tag
+                                                                                 needle:needle] descriptors:descriptors];
 
         dispatch_sync(dispatch_get_main_queue(), ^{
             BrowserController* mainSelf = weakSelf;
@@ -1892,7 +2331,9 @@ NSString* const kSongsColGenre = @"GenreCell";
 - (void)tableView:(NSTableView*)tableView sortDescriptorsDidChange:(NSArray<NSSortDescriptor*>*)oldDescriptors
 {
     NSArray<NSSortDescriptor*>* descriptors = [tableView sortDescriptors];
-    _filteredItems = [_filteredItems sortedArrayUsingDescriptors:descriptors];
+    // Through the setter; results narrowed from the previous search would
+    // come back in the order they had before.
+    self.filteredItems = [self sortedItems:_filteredItems descriptors:descriptors];
     [tableView reloadData];
 }
 
@@ -2018,8 +2459,17 @@ NSString* const kSongsColGenre = @"GenreCell";
 }
 
 - (void)importFilesAtURLs:(NSArray<NSURL*>*)urls
+{
+    [self importFilesAtURLs:urls completion:nil];
+}
+
+/// `completion` gets invoked once the files made it into the store.
+- (void)importFilesAtURLs:(NSArray<NSURL*>*)urls completion:(nullable dispatch_block_t)completion
 {
     if (urls.count == 0) {
+        if (completion != nil) {
+            completion();
+        }
         return;
     }
     BrowserController* __weak weakSelf = self;
@@ -2028,6 +2478,9 @@ NSString* const kSongsColGenre = @"GenreCell";
                                if (err) {
                                    NSLog(@"Library import failed: %@", err);
                                }
+                               if (completion != nil) {
+                                   completion();
+                               }
                                if (metas.count == 0) {
                                    return;
                                }
@@ -2049,6 +2502,10 @@ NSString* const kSongsColGenre = @"GenreCell";
                                        [self wakeDeepScanScheduler];
                                    }
                                }
+                               if (self.libraryRevision >= 0) {
+                                   [self applyLibraryChanges];
+                                   return;
+                               }
                                dispatch_async(_filterQueue, ^{
                                    BrowserController* strongSelf = weakSelf;
                                    if (!strongSelf) {
@@ -2058,7 +2515,7 @@ NSString* const kSongsColGenre = @"GenreCell";
                                    [strongSelf mergeMetasIntoCache:metas];
 
                                    NSArray<NSSortDescriptor*>* descriptors = [strongSelf.songsTable sortDescriptors];
-                                   NSArray<MediaMetaData*>* sorted = [strongSelf.cachedLibrary sortedArrayUsingDescriptors:descriptors];
+                                   NSArray<MediaMetaData*>* sorted = [strongSelf sortedItems:strongSelf.cachedLibrary descriptors:descriptors];
 
                                    dispatch_async(dispatch_get_main_queue(), ^{
                                        BrowserController* strongSelf = weakSelf;
@@ -2072,4 +2529,194 @@ NSString* const kSongsColGenre = @"GenreCell";
                            }];
 }
 
+#pragma mark - Library Watcher
+
+/// Files of the types `MediaMetaData` reads.
+static BOOL isImportableFileURL(NSURL* url)
+{
+    static NSSet<NSString*>* extensions = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        extensions = [NSSet setWithArray:@[ @"mp3", @"mp4", @"m4a", @"m4v", @"m4p", @"m4r", @"aif", @"aiff", @"wav" ]];
+    });
+    return [extensions containsObject:url.pathExtension.lowercaseString];
+}
+
+/// Keep an eye on the folders holding the library, so that files changing on
+/// disk get picked up without reconciling everything.
+- (void)watchLibraryFolders
+{
+    BrowserController* __weak weakSelf = self;
+    dispatch_async(_filterQueue, ^{
+        BrowserController* strongSelf = weakSelf;
+        if (!strongSelf) {
+            return;
+        }
+        NSMutableArray<NSURL*>* locations = [NSMutableArray arrayWithCapacity:strongSelf.cachedLibrary.count];
+        for (MediaMetaData* meta in strongSelf.cachedLibrary) {
+            if (meta.location != nil) {
+                [locations addObject:meta.location];
+            }
+        }
+        NSArray<NSURL*>* roots = [LibraryWatcher rootsCoveringURLs:locations];
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            BrowserController* strongSelf = weakSelf;
+            if (!strongSelf || [strongSelf.libraryWatcher.roots isEqualToArray:roots]) {
+                return;
+            }
+            [strongSelf.libraryWatcher stop];
+            strongSelf.libraryWatcher = nil;
+            if (roots.count == 0) {
+                return;
+            }
+            LibraryWatcher* watcher = [[LibraryWatcher alloc] initWithRoots:roots
+                                                                    latency:kLibraryWatcherLatency
+                                                                    handler:^(LibraryWatcherBatch* batch) {
+                                                                        [weakSelf applyLibraryWatcherBatch:batch];
+                                                                    }];
+            // Changes made while not running get reported first.
+            NSNumber* since = [[NSUserDefaults standardUserDefaults] objectForKey:kLibraryWatcherEventIdDefaultsKey];
+            if ([watcher startSinceEventId:since ? since.unsignedLongLongValue : LibraryWatcherSinceNow]) {
+                strongSelf.libraryWatcher = watcher;
+            }
+        });
+    });
+}
+
+/// Runs on the watcher queue. Known files get their tags read again where they
+/// changed. New files get imported when they turn out to be moved library
+/// files or land in a folder already holding library tracks. Removed files stay
+/// listed, as with reconciling; their volume may just be unmounted.
+- (void)applyLibraryWatcherBatch:(LibraryWatcherBatch*)batch
+{
+    NSMutableSet<NSURL*>* files = [batch.changedFiles mutableCopy];
+    for (NSURL* directory in batch.scannedDirectories) {
+        NSDirectoryEnumerator<NSURL*>* enumerator = [[NSFileManager defaultManager] enumeratorAtURL:directory
+                                                                         includingPropertiesForKeys:@[ NSURLIsRegularFileKey ]
+                                                                                            options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                                                       errorHandler:nil];
+        for (NSURL* url in enumerator) {
+            NSNumber* regular = nil;
+            [url getResourceValue:&regular forKey:NSURLIsRegularFileKey error:nil];
+            if (regular.boolValue && isImportableFileURL(url)) {
+                [files addObject:url];
+            }
+        }
+    }
+
+    NSMutableArray<NSURL*>* known = [NSMutableArray array];
+    NSMutableArray<NSURL*>* unknown = [NSMutableArray array];
+    @synchronized(self) {
+        NSDictionary<NSString*, MediaMetaData*>* library = [self cachedLibraryByURL];
+        for (NSURL* url in files) {
+            if (library[url.absoluteString] != nil) {
+                [known addObject:url];
+            } else if (isImportableFileURL(url)) {
+                [unknown addObject:url];
+            }
+        }
+    }
+
+    // The event ID gets saved once everything the batch brought up is in the
+    // store; quitting before that has the batch reported again on the next run.
+    dispatch_group_t stored = dispatch_group_create();
+    BrowserController* __weak weakSelf = self;
+    if (known.count > 0) {
+        dispatch_group_enter(stored);
+        [self.libraryStore reconcileFileURLs:known
+                                  completion:^(NSArray<MediaMetaData*>* _Nullable refreshedMetas,
+                                               NSArray<MediaMetaData*>* _Nullable changedMetas,
+                                               NSArray<NSURL*>* missingFiles,
+                                               NSError* _Nullable error) {
+                                      if (error) {
+                                          NSLog(@"Library watcher: refreshing changed files failed: %@", error);
+                                      }
+                                      [weakSelf applyLibraryChanges];
+                                      dispatch_group_leave(stored);
+                                  }];
+    }
+
+    NSMutableArray<NSURL*>* imports = [NSMutableArray array];
+    NSUInteger relocatedCount = 0;
+    if (unknown.count > 0) {
+        NSError* error = nil;
+        NSDictionary<NSURL*, NSURL*>* relocated = [self.libraryStore relocateEntriesToURLs:unknown error:&error];
+        if (relocated == nil) {
+            NSLog(@"Library watcher: matching moved files failed: %@", error);
+        }
+        relocatedCount = relocated.count;
+
+        NSMutableSet<NSString*>* folders = [NSMutableSet set];
+        @synchronized(self) {
+            for (MediaMetaData* meta in [self cachedLibraryByURL].objectEnumerator) {
+                NSString* folder = meta.location.URLByDeletingLastPathComponent.path;
+                if (folder != nil) {
+                    [folders addObject:folder];
+                }
+            }
+        }
+        for (NSURL* url in unknown) {
+            if (relocated[url] == nil && [folders containsObject:url.URLByDeletingLastPathComponent.path]) {
+                [imports addObject:url];
+            }
+        }
+        if (relocatedCount > 0) {
+            [self applyLibraryChanges];
+        }
+        if (imports.count > 0) {
+            dispatch_group_enter(stored);
+            dispatch_async(dispatch_get_main_queue(), ^{
+                BrowserController* strongSelf = weakSelf;
+                if (!strongSelf) {
+                    dispatch_group_leave(stored);
+                    return;
+                }
+                [strongSelf importFilesAtURLs:imports
+                                   completion:^{
+                                       dispatch_group_leave(stored);
+                                   }];
+            });
+        }
+    }
+
+    // Batches get saved in order; a later one never gets ahead of a batch still
+    // being stored.
+    static dispatch_queue_t saveQueue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        saveQueue = dispatch_queue_create("PlayEm.LibraryWatcherSave", DISPATCH_QUEUE_SERIAL);
+    });
+    uint64_t eventId = batch.lastEventId;
+    dispatch_async(saveQueue, ^{
+        dispatch_group_wait(stored, DISPATCH_TIME_FOREVER);
+        [[NSUserDefaults standardUserDefaults] setObject:@(eventId) forKey:kLibraryWatcherEventIdDefaultsKey];
+    });
+    NSLog(@"Library watcher: %lu events, %lu known files changed, %lu moved, %lu new, %lu paths removed",
+          (unsigned long) batch.eventCount, (unsigned long) known.count, (unsigned long) relocatedCount, (unsigned long) imports.count,
+          (unsigned long) batch.removedPaths.count);
+}
+
+- (TrackList*)storedTrackListForURL:(NSURL*)url
+{
+    NSError* error = nil;
+    TrackList* trackList = [self.libraryStore trackListForURL:url error:&error];
+    if (trackList == nil) {
+        NSLog(@"Tracklist load failed: %@", error);
+        return [TrackList new];
+    }
+    return trackList;
+}
+
+- (void)storeTrackListOfMeta:(MediaMetaData*)meta
+{
+    if (meta.location == nil || meta.trackList == nil) {
+        return;
+    }
+    NSError* error = nil;
+    if (![self.libraryStore storeTrackList:meta.trackList forURL:meta.location error:&error]) {
+        NSLog(@"Tracklist store failed: %@", error);
+    }
+}
+
 @end
@@ -29,6 +29,7 @@ extern NSString* const kTracklistControllerChangedActiveTrackNotification;
 
 - (void)playAtFrame:(unsigned long long)frame;
 - (void)updatedTracks;
+- (void)storedTracklistOfMeta:(MediaMetaData*)meta;
 
 @end
 
@@ -239,6 +239,17 @@ static const NSAutoresizingMaskOptions kViewFullySizeable = NSViewHeightSizable
     return trackFrames;
 }
 
+/// Write the tracklist next to its set and have it mirrored into the library.
+- (void)storeTracklist
+{
+    NSError* error = nil;
+    BOOL done = [_current storeTracklistWithError:&error];
+    if (!done) {
+        NSLog(@"failed to write tracklist: %@", error);
+    }
+    [_delegate storedTracklistOfMeta:_current];
+}
+
 - (void)clearTracklist
 {
     [_current.trackList clear];
@@ -259,11 +270,7 @@ static const NSAutoresizingMaskOptions kViewFullySizeable = NSViewHeightSizable
 
     _current.frameToSeconds = [self frameToSecondsBlock];
 
-    NSError* error = nil;
-    BOOL done = [_current storeTracklistWithError:&error];
-    if (!done) {
-        NSLog(@"failed to write tracklist: %@", error);
-    }
+    [self storeTracklist];
     _detectButton.hidden = _current.trackList.tracks.count > 0;
 }
 
@@ -343,11 +350,7 @@ static const NSAutoresizingMaskOptions kViewFullySizeable = NSViewHeightSizable
 
     _current.frameToSeconds = [self frameToSecondsBlock];
 
-    NSError* error = nil;
-    BOOL done = [_current storeTracklistWithError:&error];
-    if (!done) {
-        NSLog(@"failed to write tracklist: %@", error);
-    }
+    [self storeTracklist];
 }
 
 - (void)addTracks:(NSArray<TimedMediaMetaData*>*)tracks
@@ -361,11 +364,7 @@ static const NSAutoresizingMaskOptions kViewFullySizeable = NSViewHeightSizable
 
     _current.frameToSeconds = [self frameToSecondsBlock];
 
-    NSError* error = nil;
-    BOOL done = [_current storeTracklistWithError:&error];
-    if (!done) {
-        NSLog(@"failed to write tracklist: %@", error);
-    }
+    [self storeTracklist];
     _detectButton.hidden = _current.trackList.tracks.count > 0;
 }
 
@@ -390,11 +389,7 @@ static const NSAutoresizingMaskOptions kViewFullySizeable = NSViewHeightSizable
 
     _current.frameToSeconds = [self frameToSecondsBlock];
 
-    NSError* error = nil;
-    BOOL done = [_current storeTracklistWithError:&error];
-    if (!done) {
-        NSLog(@"failed to write tracklist: %@", error);
-    }
+    [self storeTracklist];
     _detectButton.hidden = _current.trackList.tracks.count > 0;
 }
 
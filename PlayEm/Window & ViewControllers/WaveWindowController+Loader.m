@@ -23,9 +23,13 @@
 #import "MetaController.h"
 #import "NSAlert+BetterError.h"
 #import "PlaylistController.h"
+#import "TimedMediaMetaData.h"
+#import "TrackList.h"
 #import "TracklistController.h"
 #import "VisualSample.h"
 #import "WaveViewController.h"
+#import "WaveformCache.h"
+#import "WaveformPyramid.h"
 
 typedef NS_ENUM(NSUInteger, LoaderState) {
     LoaderStateReady,
@@ -71,6 +75,41 @@ typedef struct {
 
 static void* kLoaderStateKey = &kLoaderStateKey;
 
+static BOOL isEqualOrBothNil(id a, id b)
+{
+    return a == b || [a isEqual:b];
+}
+
+/// Whether both lists hold the same tracks, as far as the library store keeps them.
+static BOOL trackListsMatchAsStored(TrackList* a, TrackList* b)
+{
+    NSArray<TimedMediaMetaData*>* tracks = a.tracks;
+    NSArray<TimedMediaMetaData*>* others = b.tracks;
+    if (tracks.count != others.count) {
+        return NO;
+    }
+    for (NSUInteger i = 0; i < tracks.count; i++) {
+        TimedMediaMetaData* track = tracks[i];
+        TimedMediaMetaData* other = others[i];
+        MediaMetaData* meta = track.meta;
+        MediaMetaData* otherMeta = other.meta;
+        if (!isEqualOrBothNil(track.frame, other.frame) || !isEqualOrBothNil(track.endFrame, other.endFrame) ||
+            !isEqualOrBothNil(track.confidence, other.confidence) || !isEqualOrBothNil(track.score, other.score) ||
+            !isEqualOrBothNil(track.supportCount, other.supportCount)) {
+            return NO;
+        }
+        if (!isEqualOrBothNil(meta.title, otherMeta.title) || !isEqualOrBothNil(meta.artist, otherMeta.artist) ||
+            !isEqualOrBothNil(meta.album, otherMeta.album) || !isEqualOrBothNil(meta.genre, otherMeta.genre) ||
+            !isEqualOrBothNil(meta.location.absoluteString, otherMeta.location.absoluteString) ||
+            !isEqualOrBothNil(meta.artworkLocation.absoluteString, otherMeta.artworkLocation.absoluteString) ||
+            !isEqualOrBothNil(meta.appleLocation.absoluteString, otherMeta.appleLocation.absoluteString) ||
+            !isEqualOrBothNil(meta.key.length > 0 ? meta.key : nil, otherMeta.key.length > 0 ? otherMeta.key : nil)) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
 - (LoaderState)loaderState
 {
     NSNumber* value = objc_getAssociatedObject(self, kLoaderStateKey);
@@ -211,11 +250,13 @@ static void* kLoaderStateKey = &kLoaderStateKey;
                                                   if (!completed) {
                                                       NSLog(@"tracklist recovery failed: %@", error);
                                                   }
+                                                  [weakSelf settleTrackListOfMeta:meta];
                                                   [[ActivityManager shared] updateActivity:token progress:-1.0 detail:NSLocalizedString(@"activity.metadata.tracklist.loaded", @"Detail when tracklist is loaded")];
                                                   [weakSelf metaLoadedWithContext:c];
                                                   [[ActivityManager shared] completeActivity:token];
                                               }];
                                           } else {
+                                              [weakSelf settleTrackListOfMeta:meta];
                                               [weakSelf metaLoadedWithContext:c];
                                               [[ActivityManager shared] completeActivity:token];
                                           }
@@ -228,6 +269,40 @@ static void* kLoaderStateKey = &kLoaderStateKey;
                                   }];
 }
 
+/// Chapters and sidecar are what gets edited, so those win. The library store
+/// adds the keys detected per track, and stands in when neither exists.
+- (void)settleTrackListOfMeta:(MediaMetaData*)meta
+{
+    if (meta.location == nil) {
+        return;
+    }
+    // The library store answers without unarchiving anything.
+    TrackList* stored = [self.browser storedTrackListForURL:meta.location];
+    if (meta.trackList.tracks.count == 0) {
+        if (stored.tracks.count > 0) {
+            meta.trackList = stored;
+        }
+        return;
+    }
+
+    NSMutableDictionary<NSNumber*, NSString*>* storedKeys = [NSMutableDictionary dictionary];
+    for (TimedMediaMetaData* track in stored.tracks) {
+        if (track.frame != nil && track.meta.key.length > 0) {
+            storedKeys[track.frame] = track.meta.key;
+        }
+    }
+    for (TimedMediaMetaData* track in meta.trackList.tracks) {
+        if (track.frame != nil && track.meta != nil && track.meta.key.length == 0) {
+            track.meta.key = storedKeys[track.frame];
+        }
+    }
+    // Opening a track should not rewrite what the store holds already; a
+    // missing stored list comes back empty and differs.
+    if (!trackListsMatchAsStored(meta.trackList, stored)) {
+        [self.browser storeTrackListOfMeta:meta];
+    }
+}
+
 - (void)metaLoadedWithContext:(LoaderContext)context
 {
     WaveWindowController* __weak weakSelf = self;
@@ -476,6 +551,16 @@ static void* kLoaderStateKey = &kLoaderStateKey;
         [self.browser beginForegroundDeepScanForURL:deepScanURL];
     }
 
+    // An overview summarized on an earlier load shows right away, before
+    // decoding starts; otherwise the visuals start a fresh one.
+    if (sample.source.url != nil) {
+        NSString* waveformKey = [WaveformCache keyForURL:sample.source.url sampleRate:sample.renderedSampleRate];
+        WaveformPyramid* cached = waveformKey != nil ? [[WaveformCache shared] pyramidForKey:waveformKey] : nil;
+        if (cached != nil) {
+            sample.waveformPyramid = cached;
+        }
+    }
+
     self.visualSample = [[VisualSample alloc] initWithSample:sample pixelPerSecond:kPixelPerSecond tileWidth:self.scrollingWaveViewController.tileWidth];
     self.scrollingWaveViewController.visualSample = self.visualSample;
     assert(sample.renderedSampleRate > 0);
@@ -498,8 +583,7 @@ static void* kLoaderStateKey = &kLoaderStateKey;
 
     self.scrollingWaveViewController.view.frame = CGRectMake(0.0, 0.0, self.visualSample.width, self.scrollingWaveViewController.view.bounds.size.height);
 
-    NSTimeInterval duration = [self.visualSample.sample timeForFrame:sample.frames];
-    [self.controlPanelController setKeyHidden:duration > kBeatSampleDurationThreshold];
+    [self.controlPanelController setKeyHidden:NO];
     [self.controlPanelController setKey:@"" hint:@""];
 
     NSLog(@"playback starting...");
@@ -528,6 +612,8 @@ static void* kLoaderStateKey = &kLoaderStateKey;
 
 - (void)sampleDecoded
 {
+    [self storeWaveformOfSample:self.sample];
+
     BeatTrackedSample* beatSample = [[BeatTrackedSample alloc] initWithSample:self.sample];
 
     self.scrollingWaveViewController.beatSample = beatSample;
@@ -547,6 +633,29 @@ static void* kLoaderStateKey = &kLoaderStateKey;
     }
 }
 
+/// Keeps the overview of a decoded sample for loading it again, unless it
+/// came from the cache in the first place.
+- (void)storeWaveformOfSample:(LazySample*)sample
+{
+    WaveformPyramid* pyramid = sample.waveformPyramid;
+    NSURL* url = sample.source.url;
+    if (pyramid == nil || !pyramid.finished || url == nil) {
+        return;
+    }
+    const double sampleRate = sample.renderedSampleRate;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        WaveformCache* cache = [WaveformCache shared];
+        NSString* key = [WaveformCache keyForURL:url sampleRate:sampleRate];
+        if (key == nil || [cache hasPyramidForKey:key]) {
+            return;
+        }
+        NSError* error = nil;
+        if (![cache storePyramid:pyramid forKey:key error:&error]) {
+            NSLog(@"failed to store the waveform of %@: %@", url, error);
+        }
+    });
+}
+
 - (void)loadBeats:(BeatTrackedSample*)beatsSample
 {
     if (self.loaderState == LoaderStateAborted) {
@@ -609,6 +718,14 @@ static void* kLoaderStateKey = &kLoaderStateKey;
         if (keyFinished) {
             NSLog(@"key tracking finished");
             [self.controlPanelController setKey:self.keySample.key hint:self.keySample.hint];
+            if (self.keySample.segments.count > 0 && self.meta.trackList != nil) {
+                NSUInteger applied = [self.keySample applyKeysToTrackList:self.meta.trackList frames:self.sample.frames];
+                NSLog(@"attached segment keys to %lu tracklist entries", (unsigned long) applied);
+                if (applied > 0) {
+                    // The library store keeps the keys for the next load.
+                    [self.browser storeTrackListOfMeta:self.meta];
+                }
+            }
         } else {
             NSLog(@"never finished the key tracking");
         }
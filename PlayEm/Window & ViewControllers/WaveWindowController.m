@@ -1094,7 +1094,7 @@ static const NSString* kIdentifyToolbarIdentifier = @"Live Identify";
     col.width = titleColumnWidth - selectorColumnInset;
     col.minWidth = (titleColumnWidth - selectorColumnInset) / 2.0f;
     col.resizingMask = NSTableColumnUserResizingMask;
-    col.sortDescriptorPrototype = [[NSSortDescriptor alloc] initWithKey:@"title" ascending:YES selector:@selector(compare:)];
+    col.sortDescriptorPrototype = [[NSSortDescriptor alloc] initWithKey:@"title" ascending:YES selector:@selector(localizedStandardCompare:)];
     [_songsTable addTableColumn:col];
     
     col = [[NSTableColumn alloc] initWithIdentifier:kSongsColTime];
@@ -1110,7 +1110,7 @@ static const NSString* kIdentifyToolbarIdentifier = @"Live Identify";
     col.width = artistColumnWidth - selectorColumnInset;
     col.minWidth = (artistColumnWidth - selectorColumnInset) / 2.0;
     col.resizingMask = NSTableColumnUserResizingMask;
-    col.sortDescriptorPrototype = [[NSSortDescriptor alloc] initWithKey:@"artist" ascending:YES selector:@selector(compare:)];
+    col.sortDescriptorPrototype = [[NSSortDescriptor alloc] initWithKey:@"artist" ascending:YES selector:@selector(localizedStandardCompare:)];
     [_songsTable addTableColumn:col];
     
     col = [[NSTableColumn alloc] initWithIdentifier:kSongsColAlbum];
@@ -1118,7 +1118,7 @@ static const NSString* kIdentifyToolbarIdentifier = @"Live Identify";
     col.width = albumColumnWidth - selectorColumnInset;
     col.minWidth = (albumColumnWidth - selectorColumnInset) / 2.0;
     col.resizingMask = NSTableColumnUserResizingMask;
-    col.sortDescriptorPrototype = [[NSSortDescriptor alloc] initWithKey:@"album" ascending:YES selector:@selector(compare:)];
+    col.sortDescriptorPrototype = [[NSSortDescriptor alloc] initWithKey:@"album" ascending:YES selector:@selector(localizedStandardCompare:)];
     [_songsTable addTableColumn:col];
     
     col = [[NSTableColumn alloc] initWithIdentifier:kSongsColGenre];
@@ -1126,7 +1126,7 @@ static const NSString* kIdentifyToolbarIdentifier = @"Live Identify";
     col.width = genreColumnWidth - selectorColumnInset;
     col.minWidth = (genreColumnWidth - selectorColumnInset) / 2.0;
     col.resizingMask = NSTableColumnAutoresizingMask | NSTableColumnUserResizingMask;
-    col.sortDescriptorPrototype = [[NSSortDescriptor alloc] initWithKey:@"genre" ascending:YES selector:@selector(compare:)];
+    col.sortDescriptorPrototype = [[NSSortDescriptor alloc] initWithKey:@"genre" ascending:YES selector:@selector(localizedStandardCompare:)];
     [_songsTable addTableColumn:col];
     
     col = [[NSTableColumn alloc] initWithIdentifier:kSongsColAdded];
@@ -1150,7 +1150,7 @@ static const NSString* kIdentifyToolbarIdentifier = @"Live Identify";
     col.width = keyColumnWidth - selectorColumnInset;
     col.minWidth = (keyColumnWidth - selectorColumnInset) / 2.0;
     col.resizingMask = NSTableColumnUserResizingMask;
-    col.sortDescriptorPrototype = [[NSSortDescriptor alloc] initWithKey:@"key" ascending:YES selector:@selector(compare:)];
+    col.sortDescriptorPrototype = [[NSSortDescriptor alloc] initWithKey:@"key" ascending:YES selector:@selector(localizedStandardCompare:)];
     [_songsTable addTableColumn:col];
     
     col = [[NSTableColumn alloc] initWithIdentifier:kSongsColRating];
@@ -1165,7 +1165,7 @@ static const NSString* kIdentifyToolbarIdentifier = @"Live Identify";
     col.title = NSLocalizedString(@"table.songs.tags", @"Table column title");
     col.minWidth = (tagsColumnWidth - selectorColumnInset) / 2.0;
     col.resizingMask = NSTableColumnAutoresizingMask;
-    col.sortDescriptorPrototype = [[NSSortDescriptor alloc] initWithKey:@"tags" ascending:YES selector:@selector(compare:)];
+    col.sortDescriptorPrototype = [[NSSortDescriptor alloc] initWithKey:@"tags" ascending:YES selector:@selector(localizedStandardCompare:)];
     [_songsTable addTableColumn:col];
     
     sv.documentView = _songsTable;
@@ -2449,6 +2449,11 @@ call super's supplementalTargetForAction:sender:.
     [_totalWaveViewController reloadTracklist];
 }
 
+- (void)storedTracklistOfMeta:(MediaMetaData*)meta
+{
+    [_browser storeTrackListOfMeta:meta];
+}
+
 - (TimedMediaMetaData*)currentTrack
 {
     return [_tracklist currentTrack];
@@ -0,0 +1,364 @@
+//
+//  main.m
+//  PlayEmAnalyzeCLI
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#include <getopt.h>
+// Use direct relative imports so we don't depend on framework header exports.
+#import "../PlayEmCore/Analysis/AnalysisPipeline.h"
+#import "../PlayEmCore/Analysis/BeatAnalyzer.h"
+#import "../PlayEmCore/Analysis/ContentHashAnalyzer.h"
+#import "../PlayEmCore/Analysis/KeyAnalyzer.h"
+#import "../PlayEmCore/Analysis/LoudnessAnalyzer.h"
+#import "../PlayEmCore/Analysis/WaveformOverviewAnalyzer.h"
+#import "../PlayEmCore/Audio/FileSampleDecoder.h"
+#import "../PlayEmCore/LibraryStore.h"
+#import "../PlayEmCore/Metadata/MediaMetaData.h"
+#import "../PlayEmCore/Sample/LazySample.h"
+
+static const NSTimeInterval kDefaultTimeout = 600.0;
+
+static void PrintUsage(const char* tool)
+{
+    fprintf(stderr,
+            "usage: %s [-j jobs] [-o results.jsonl] [-d library.sqlite] [-t timeout] [--no-beats] [--no-key] path ...\n"
+            "\n"
+            "  path              audio file, directory (scanned recursively) or @list (one path per line)\n"
+            "  -j, --jobs        files analyzed concurrently (default: half the cores)\n"
+            "  -o, --output      write results as JSON lines to a file, '-' for stdout (default)\n"
+            "  -d, --database    store results in a library database\n"
+            "  -t, --timeout     per-file timeout in seconds (default: %.0f)\n"
+            "      --no-beats    skip beat tracking\n"
+            "      --no-key      skip key detection\n",
+            tool, kDefaultTimeout);
+}
+
+static NSSet<NSString*>* AudioFileExtensions(void)
+{
+    static NSSet<NSString*>* extensions = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        extensions = [NSSet setWithArray:@[ @"aac", @"aif", @"aiff", @"alac", @"caf", @"flac", @"m4a", @"mp3", @"mp4", @"wav" ]];
+    });
+    return extensions;
+}
+
+static void CollectURLs(NSString* argument, NSMutableArray<NSURL*>* urls)
+{
+    if ([argument hasPrefix:@"@"]) {
+        NSError* error = nil;
+        NSString* list = [NSString stringWithContentsOfFile:[argument substringFromIndex:1] encoding:NSUTF8StringEncoding error:&error];
+        if (list == nil) {
+            fprintf(stderr, "Failed to read %s: %s\n", argument.UTF8String, error.localizedDescription.UTF8String);
+            return;
+        }
+        for (NSString* line in [list componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]]) {
+            NSString* path = [line stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+            if (path.length > 0) {
+                CollectURLs(path, urls);
+            }
+        }
+        return;
+    }
+
+    NSString* path = argument.stringByExpandingTildeInPath;
+    BOOL isDirectory = NO;
+    if (![[NSFileManager defaultManager] fileExistsAtPath:path isDirectory:&isDirectory]) {
+        fprintf(stderr, "No such file: %s\n", path.UTF8String);
+        return;
+    }
+    if (!isDirectory) {
+        [urls addObject:[NSURL fileURLWithPath:path]];
+        return;
+    }
+
+    NSDirectoryEnumerator<NSURL*>* enumerator = [[NSFileManager defaultManager] enumeratorAtURL:[NSURL fileURLWithPath:path isDirectory:YES]
+                                                                     includingPropertiesForKeys:@[ NSURLIsRegularFileKey ]
+                                                                                        options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                                                   errorHandler:nil];
+    for (NSURL* url in enumerator) {
+        NSNumber* isRegular = nil;
+        [url getResourceValue:&isRegular forKey:NSURLIsRegularFileKey error:nil];
+        if (isRegular.boolValue && [AudioFileExtensions() containsObject:url.pathExtension.lowercaseString]) {
+            [urls addObject:url];
+        }
+    }
+}
+
+static NSDictionary* AnalyzeURL(NSURL* url, NSTimeInterval timeout, BOOL beats, BOOL key)
+{
+    NSMutableDictionary* result = [NSMutableDictionary dictionary];
+    result[@"path"] = url.path;
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    NSError* error = nil;
+    LazySample* sample = [[LazySample alloc] initWithPath:url.path error:&error];
+    if (sample == nil) {
+        result[@"error"] = error.localizedDescription ?: @"Failed to open";
+        return result;
+    }
+    double openTime = CFAbsoluteTimeGetCurrent() - start;
+
+    AnalysisPipeline* pipeline = [[AnalysisPipeline alloc] initWithSample:sample];
+    pipeline.streaming = YES;
+    BeatAnalyzer* beatAnalyzer = nil;
+    if (beats) {
+        beatAnalyzer = [BeatAnalyzer new];
+        [pipeline addAnalyzer:beatAnalyzer];
+    }
+    KeyAnalyzer* keyAnalyzer = nil;
+    if (key) {
+        keyAnalyzer = [KeyAnalyzer new];
+        [pipeline addAnalyzer:keyAnalyzer];
+    }
+    LoudnessAnalyzer* loudness = [LoudnessAnalyzer new];
+    [pipeline addAnalyzer:loudness];
+    WaveformOverviewAnalyzer* waveform = [WaveformOverviewAnalyzer new];
+    [pipeline addAnalyzer:waveform];
+    ContentHashAnalyzer* contentHash = [ContentHashAnalyzer new];
+    [pipeline addAnalyzer:contentHash];
+
+    if (![pipeline runWithDecoder:[FileSampleDecoder new] timeout:timeout error:&error]) {
+        result[@"error"] = error.localizedDescription ?: @"Analysis failed";
+        return result;
+    }
+
+    if (sample.renderedSampleRate > 0.0) {
+        result[@"duration"] = @((double) sample.renderedLength / sample.renderedSampleRate);
+    }
+    result[@"sampleRate"] = @(sample.renderedSampleRate);
+    result[@"channels"] = @(sample.sampleFormat.channels);
+    if (beatAnalyzer.tempo != nil) {
+        result[@"tempo"] = beatAnalyzer.tempo;
+    }
+    if (keyAnalyzer.key != nil) {
+        result[@"key"] = keyAnalyzer.key;
+    }
+    if (loudness.error == nil) {
+        if (isfinite(loudness.loudness)) {
+            result[@"loudness"] = @(loudness.loudness);
+        }
+        result[@"peak"] = @(loudness.peak);
+    }
+    if (waveform.error == nil && waveform.overview != nil) {
+        result[@"waveform"] = @{
+            @"width" : @(waveform.width),
+            @"framesPerPair" : @(waveform.framesPerPair),
+            @"pairs" : [waveform.overview base64EncodedStringWithOptions:0],
+        };
+    }
+    if (contentHash.error == nil && contentHash.contentHash != nil) {
+        result[@"contentHash"] = contentHash.contentHash;
+    }
+
+    NSMutableDictionary<NSString*, NSNumber*>* timings = [NSMutableDictionary dictionaryWithDictionary:pipeline.timings];
+    timings[@"open"] = @(openTime);
+    timings[@"total"] = @(CFAbsoluteTimeGetCurrent() - start);
+    result[@"timings"] = timings;
+
+    if (pipeline.errors.count > 0) {
+        NSMutableDictionary<NSString*, NSString*>* errors = [NSMutableDictionary dictionary];
+        [pipeline.errors enumerateKeysAndObjectsUsingBlock:^(NSString* name, NSError* analyzerError, BOOL* stop) {
+            errors[name] = analyzerError.localizedDescription;
+        }];
+        result[@"errors"] = errors;
+    }
+    NSMutableArray<NSString*>* succeeded = [NSMutableArray array];
+    for (id<SampleAnalyzer> analyzer in pipeline.analyzers) {
+        if (analyzer.error == nil) {
+            [succeeded addObject:analyzer.name];
+        }
+    }
+    result[@"analyzers"] = succeeded;
+    return result;
+}
+
+static BOOL StoreResult(LibraryStore* store, NSURL* url, NSDictionary* result, NSError** error)
+{
+    MediaMetaData* meta = [MediaMetaData mediaMetaDataWithURL:url error:nil];
+    NSURL* location = meta.location ?: url;
+    if (![store hasEntryForURL:location error:error]) {
+        if (meta == nil || ![store importMediaItems:@[ meta ] preferExisting:YES error:error]) {
+            return NO;
+        }
+    }
+    NSNumber* duration = result[@"duration"];
+    if (duration != nil) {
+        duration = @(duration.doubleValue * 1000.0);
+    }
+
+    // Like the app's deep scan: only stored results are current, failed
+    // analyzers lose their record, and both happen before the track gets
+    // updated as that decides whether it gets queued again.
+    NSDictionary<NSString*, NSNumber*>* current = [LibraryStore analyzerVersions];
+    NSMutableArray<NSString*>* ranAnalyzers = [NSMutableArray array];
+    for (NSString* name in result[@"analyzers"]) {
+        if (current[name] != nil) {
+            [ranAnalyzers addObject:name];
+        }
+    }
+    NSMutableArray<NSString*>* failedAnalyzers = [NSMutableArray array];
+    for (NSString* name in result[@"errors"]) {
+        if (current[name] != nil) {
+            [failedAnalyzers addObject:name];
+        }
+    }
+    if (duration != nil) {
+        [ranAnalyzers addObject:LibraryStoreDurationAnalyzer];
+    } else {
+        [failedAnalyzers addObject:LibraryStoreDurationAnalyzer];
+    }
+    if (![store recordAnalyzers:ranAnalyzers forURL:location error:error]) {
+        return NO;
+    }
+    if (![store forgetAnalyzers:failedAnalyzers forURL:location error:error]) {
+        return NO;
+    }
+    if (![store completeDeepScanForURL:location duration:duration tempo:result[@"tempo"] key:result[@"key"] error:error]) {
+        return NO;
+    }
+    return [store updateAnalysisForURL:location loudness:result[@"loudness"] peak:result[@"peak"] contentHash:result[@"contentHash"] error:error];
+}
+
+int main(int argc, char* const argv[])
+{
+    @autoreleasepool {
+        NSUInteger jobs = MAX(1, [NSProcessInfo processInfo].activeProcessorCount / 2);
+        NSString* outputPath = nil;
+        NSString* databasePath = nil;
+        NSTimeInterval timeout = kDefaultTimeout;
+        int noBeats = 0;
+        int noKey = 0;
+
+        static struct option options[] = {
+            {"jobs", required_argument, NULL, 'j'},
+            {"output", required_argument, NULL, 'o'},
+            {"database", required_argument, NULL, 'd'},
+            {"timeout", required_argument, NULL, 't'},
+            {"no-beats", no_argument, NULL, 'B'},
+            {"no-key", no_argument, NULL, 'K'},
+            {"help", no_argument, NULL, 'h'},
+            {NULL, 0, NULL, 0},
+        };
+        int option = 0;
+        while ((option = getopt_long(argc, argv, "j:o:d:t:h", options, NULL)) != -1) {
+            switch (option) {
+            case 'j':
+                jobs = (NSUInteger) MAX(1, atoi(optarg));
+                break;
+            case 'o':
+                outputPath = @(optarg);
+                break;
+            case 'd':
+                databasePath = @(optarg).stringByExpandingTildeInPath;
+                break;
+            case 't':
+                timeout = MAX(1.0, atof(optarg));
+                break;
+            case 'B':
+                noBeats = 1;
+                break;
+            case 'K':
+                noKey = 1;
+                break;
+            default:
+                PrintUsage(argv[0]);
+                return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+            }
+        }
+
+        NSMutableArray<NSURL*>* urls = [NSMutableArray array];
+        for (int i = optind; i < argc; i++) {
+            CollectURLs(@(argv[i]), urls);
+        }
+        if (urls.count == 0) {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        NSFileHandle* output = nil;
+        if (outputPath != nil && ![outputPath isEqualToString:@"-"]) {
+            [[NSFileManager defaultManager] createFileAtPath:outputPath contents:nil attributes:nil];
+            output = [NSFileHandle fileHandleForWritingAtPath:outputPath];
+            if (output == nil) {
+                fprintf(stderr, "Failed to open %s for writing\n", outputPath.UTF8String);
+                return EXIT_FAILURE;
+            }
+        } else if (databasePath == nil || outputPath != nil) {
+            output = [NSFileHandle fileHandleWithStandardOutput];
+        }
+
+        LibraryStore* store = nil;
+        if (databasePath != nil) {
+            store = [[LibraryStore alloc] initWithDatabaseURL:[NSURL fileURLWithPath:databasePath]];
+            NSError* error = nil;
+            if (![store open:&error]) {
+                fprintf(stderr, "Failed to open %s: %s\n", databasePath.UTF8String, error.localizedDescription.UTF8String);
+                return EXIT_FAILURE;
+            }
+        }
+
+        fprintf(stderr, "Analyzing %lu files with %lu jobs\n", (unsigned long) urls.count, (unsigned long) jobs);
+
+        dispatch_queue_t writeQueue = dispatch_queue_create("PlayEm.AnalyzeCLI.Write", DISPATCH_QUEUE_SERIAL);
+        NSMutableDictionary<NSString*, NSNumber*>* stageTotals = [NSMutableDictionary dictionary];
+        __block NSUInteger finished = 0;
+        __block NSUInteger failed = 0;
+
+        NSOperationQueue* queue = [NSOperationQueue new];
+        queue.maxConcurrentOperationCount = (NSInteger) jobs;
+        queue.qualityOfService = NSQualityOfServiceUtility;
+
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSURL* url in urls) {
+            [queue addOperationWithBlock:^{
+                NSDictionary* result = AnalyzeURL(url, timeout, !noBeats, !noKey);
+                dispatch_sync(writeQueue, ^{
+                    finished++;
+                    BOOL success = result[@"error"] == nil;
+                    if (success && store != nil) {
+                        NSError* storeError = nil;
+                        if (!StoreResult(store, url, result, &storeError)) {
+                            fprintf(stderr, "Failed to store %s: %s\n", url.path.UTF8String, storeError.localizedDescription.UTF8String);
+                            success = NO;
+                        }
+                    }
+                    if (!success) {
+                        failed++;
+                    }
+                    if (output != nil) {
+                        NSData* line = [NSJSONSerialization dataWithJSONObject:result options:NSJSONWritingSortedKeys error:nil];
+                        [output writeData:line];
+                        [output writeData:[NSData dataWithBytes:"\n" length:1]];
+                    }
+                    NSDictionary<NSString*, NSNumber*>* timings = result[@"timings"];
+                    [timings enumerateKeysAndObjectsUsingBlock:^(NSString* stage, NSNumber* seconds, BOOL* stop) {
+                        stageTotals[stage] = @(stageTotals[stage].doubleValue + seconds.doubleValue);
+                    }];
+                    fprintf(stderr, "[%lu/%lu] %s %s (%.2fs)\n", (unsigned long) finished, (unsigned long) urls.count, success ? "ok    " : "FAILED",
+                            url.lastPathComponent.UTF8String, [timings[@"total"] doubleValue]);
+                });
+            }];
+        }
+        [queue waitUntilAllOperationsAreFinished];
+        double elapsed = CFAbsoluteTimeGetCurrent() - start;
+
+        fprintf(stderr, "\n%lu files, %lu failed, %.1fs wall, %.1f files/min\n", (unsigned long) finished, (unsigned long) failed, elapsed,
+                elapsed > 0.0 ? (double) finished * 60.0 / elapsed : 0.0);
+        NSUInteger succeeded = finished - failed;
+        if (succeeded > 0) {
+            fprintf(stderr, "mean seconds per file until stage was done:\n");
+            for (NSString* stage in [stageTotals.allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+                fprintf(stderr, "  %-12s %8.3f\n", stage.UTF8String, stageTotals[stage].doubleValue / (double) succeeded);
+            }
+        }
+        if (outputPath != nil && ![outputPath isEqualToString:@"-"]) {
+            [output closeFile];
+        }
+        return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+}
@@ -0,0 +1,72 @@
+//
+//  AnalysisPipeline.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "../Audio/SampleDecoder.h"
+#import "SampleAnalyzer.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class LazySample;
+
+extern NSString* const kAnalysisPipelineDecodeStage;
+/// Decoded audio, in seconds, a streaming run keeps around at most.
+extern const NSTimeInterval kAnalysisStreamingWindow;
+
+/// Decodes a sample exactly once and fans every decoded page out to a set of
+/// analyzers.
+///
+/// Each analyzer runs on its own serial queue, so a slow analyzer never holds
+/// up the decoder or its siblings beyond the pages it has yet to consume.
+@interface AnalysisPipeline : NSObject
+
+@property (readonly, nonatomic) LazySample* sample;
+@property (readonly, nonatomic) NSArray<id<SampleAnalyzer>>* analyzers;
+/// Errors of failed analyzers, keyed by analyzer name.
+@property (readonly, nonatomic) NSDictionary<NSString*, NSError*>* errors;
+/// Seconds from the start of the run until each stage was done, keyed by
+/// analyzer name plus `kAnalysisPipelineDecodeStage` for the decoder.
+@property (readonly, nonatomic) NSDictionary<NSString*, NSNumber*>* timings;
+
+/// Drop decoded pages once every analyzer is past them, keeping peak memory
+/// independent of the sample duration. The sample is useless for anything
+/// but this analysis afterwards.
+@property (assign, nonatomic) BOOL streaming;
+
+/// Set while the run is held at a page boundary.
+@property (readonly, nonatomic) BOOL suspended;
+
+- (instancetype)initWithSample:(LazySample*)sample;
+
+/// Register an analyzer; has to happen before `runWithDecoder:timeout:error:`.
+- (void)addAnalyzer:(id<SampleAnalyzer>)analyzer;
+
+/// Decode the sample and run all analyzers to completion. Blocks the caller.
+///
+/// - Parameters:
+///   - decoder: Decoder filling the sample, e.g. an `AudioController`.
+///   - timeout: Upper bound for decoding and analysis, in seconds.
+///   - error: Set when decoding failed or timed out.
+/// - Returns: YES when the sample got fully decoded; individual analyzer
+///   failures are reported via `errors`.
+- (BOOL)runWithDecoder:(id<SampleDecoder>)decoder timeout:(NSTimeInterval)timeout error:(NSError* _Nullable*)error;
+
+/// Hold the decoder before handing out its next page; may be called from any
+/// thread.
+///
+/// The analyzer queues get suspended as well, so pages already handed out
+/// wait in those queues instead of occupying worker threads. A suspended run
+/// costs no CPU while keeping all analyzer state for resuming where it
+/// stopped. Time spent suspended does not count against the timeout.
+- (void)suspend;
+- (void)resume;
+
+@end
+
+NS_ASSUME_NONNULL_END
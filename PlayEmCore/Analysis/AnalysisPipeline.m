@@ -0,0 +1,324 @@
+//
+//  AnalysisPipeline.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "AnalysisPipeline.h"
+
+#import "LazySample.h"
+
+NSErrorDomain const SampleAnalyzerErrorDomain = @"SampleAnalyzer";
+NSString* const kAnalysisPipelineDecodeStage = @"decode";
+
+/// Time granted to analyzers for winding down after a cancel.
+static const NSTimeInterval kAnalysisCancelGrace = 5.0;
+
+// Bounds what a reader lagging behind the decoder keeps resident.
+const NSTimeInterval kAnalysisStreamingWindow = 2.0 * 60.0;
+
+/// Granularity of timeout bookkeeping while waiting for decoder and analyzers.
+static const NSTimeInterval kAnalysisWaitSlice = 1.0;
+
+@implementation AnalysisPipeline {
+    NSMutableArray<id<SampleAnalyzer>>* _analyzers;
+    NSMutableArray<dispatch_queue_t>* _queues;
+    NSDictionary<NSString*, NSError*>* _errors;
+    NSDictionary<NSString*, NSNumber*>* _timings;
+    NSCondition* _suspension;
+    BOOL _suspended;
+    CFAbsoluteTime _suspendedAt;
+    NSTimeInterval _suspendedTime;
+}
+
+- (instancetype)initWithSample:(LazySample*)sample
+{
+    self = [super init];
+    if (self) {
+        _sample = sample;
+        _analyzers = [NSMutableArray array];
+        _queues = [NSMutableArray array];
+        _errors = @{};
+        _timings = @{};
+        _suspension = [NSCondition new];
+        _suspended = NO;
+        _suspendedTime = 0.0;
+    }
+    return self;
+}
+
+- (NSArray<id<SampleAnalyzer>>*)analyzers
+{
+    return [_analyzers copy];
+}
+
+- (NSDictionary<NSString*, NSError*>*)errors
+{
+    return _errors;
+}
+
+- (NSDictionary<NSString*, NSNumber*>*)timings
+{
+    return _timings;
+}
+
+- (void)dealloc
+{
+    // Releasing a suspended queue is fatal.
+    [self resume];
+}
+
+- (void)addAnalyzer:(id<SampleAnalyzer>)analyzer
+{
+    NSString* label = [NSString stringWithFormat:@"PlayEm.Analysis.%@", analyzer.name];
+    dispatch_queue_attr_t attr = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0);
+    dispatch_queue_t queue = dispatch_queue_create(label.UTF8String, attr);
+    [_suspension lock];
+    if (_suspended) {
+        dispatch_suspend(queue);
+    }
+    [_queues addObject:queue];
+    [_suspension unlock];
+    [_analyzers addObject:analyzer];
+}
+
+#pragma mark - Suspension
+
+- (BOOL)suspended
+{
+    [_suspension lock];
+    BOOL suspended = _suspended;
+    [_suspension unlock];
+    return suspended;
+}
+
+- (void)suspend
+{
+    [_suspension lock];
+    if (!_suspended) {
+        _suspended = YES;
+        _suspendedAt = CFAbsoluteTimeGetCurrent();
+        // Queued pages wait in their queues; no analyzer holds a thread.
+        for (dispatch_queue_t queue in _queues) {
+            dispatch_suspend(queue);
+        }
+    }
+    [_suspension unlock];
+}
+
+- (void)resume
+{
+    [_suspension lock];
+    if (_suspended) {
+        _suspended = NO;
+        _suspendedTime += CFAbsoluteTimeGetCurrent() - _suspendedAt;
+        for (dispatch_queue_t queue in _queues) {
+            dispatch_resume(queue);
+        }
+        [_suspension broadcast];
+    }
+    [_suspension unlock];
+}
+
+/// Total time spent suspended, including an ongoing suspension.
+- (NSTimeInterval)suspendedTime
+{
+    [_suspension lock];
+    NSTimeInterval time = _suspendedTime + (_suspended ? CFAbsoluteTimeGetCurrent() - _suspendedAt : 0.0);
+    [_suspension unlock];
+    return time;
+}
+
+- (void)waitWhileSuspended
+{
+    [_suspension lock];
+    while (_suspended) {
+        [_suspension wait];
+    }
+    [_suspension unlock];
+}
+
+/// Runs `wait` in slices until it succeeds or `remaining` is used up; time
+/// spent suspended is not taken from `remaining`.
+- (BOOL)waitWithBlock:(long (^)(dispatch_time_t timeout))wait remaining:(NSTimeInterval*)remaining
+{
+    while (true) {
+        CFAbsoluteTime before = CFAbsoluteTimeGetCurrent();
+        NSTimeInterval suspendedBefore = [self suspendedTime];
+        NSTimeInterval slice = MAX(0.0, MIN(*remaining, kAnalysisWaitSlice));
+        BOOL done = wait(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (slice * NSEC_PER_SEC))) == 0;
+        NSTimeInterval active = (CFAbsoluteTimeGetCurrent() - before) - ([self suspendedTime] - suspendedBefore);
+        *remaining -= MAX(0.0, active);
+        if (done) {
+            return YES;
+        }
+        if (*remaining <= 0.0) {
+            return NO;
+        }
+    }
+}
+
+#pragma mark - Running
+
+- (void)cancelAnalyzers
+{
+    // Held analyzer queues would never get to wind down.
+    [self resume];
+    for (id<SampleAnalyzer> analyzer in _analyzers) {
+        if ([analyzer respondsToSelector:@selector(cancel)]) {
+            [analyzer cancel];
+        }
+    }
+}
+
+- (BOOL)runWithDecoder:(id<SampleDecoder>)decoder timeout:(NSTimeInterval)timeout error:(NSError* _Nullable*)error
+{
+    NSArray<id<SampleAnalyzer>>* analyzers = [_analyzers copy];
+    NSArray<dispatch_queue_t>* queues = [_queues copy];
+    LazySample* sample = _sample;
+
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_semaphore_t decoded = dispatch_semaphore_create(0);
+    __block BOOL decodeSuccess = NO;
+    // Only touched from the decoder thread and, once decoding is over, from here.
+    __block BOOL begun = NO;
+
+    const BOOL streaming = _streaming;
+    NSUInteger holdReader = 0;
+    if (streaming) {
+        sample.discardsConsumedPages = YES;
+        sample.retainedFramesLimit = (unsigned long long) (kAnalysisStreamingWindow * sample.fileSampleRate);
+        // Keeps the first pages until the analyzers had a chance to register
+        // as readers.
+        holdReader = [sample addReaderAtFrame:0];
+    }
+
+    void (^beginAll)(void) = ^{
+        begun = YES;
+        for (NSUInteger i = 0; i < analyzers.count; i++) {
+            id<SampleAnalyzer> analyzer = analyzers[i];
+            if (streaming) {
+                dispatch_sync(queues[i], ^{
+                    [analyzer beginWithSample:sample];
+                });
+            } else {
+                dispatch_group_async(group, queues[i], ^{
+                    [analyzer beginWithSample:sample];
+                });
+            }
+        }
+        if (streaming) {
+            [sample removeReader:holdReader];
+        }
+    };
+
+    AnalysisPipeline* __weak weakSelf = self;
+    DecodedPageBlock pageHandler = ^(unsigned long long frameOffset, unsigned long long frameCount, NSArray<NSData*>* channels) {
+        // Page boundaries are where a run can be held without losing state.
+        [weakSelf waitWhileSuspended];
+        // The rendered format is only known once the decoder is up, hence
+        // analyzers get started with the first page.
+        if (!begun) {
+            beginAll();
+        }
+        for (NSUInteger i = 0; i < analyzers.count; i++) {
+            id<SampleAnalyzer> analyzer = analyzers[i];
+            dispatch_group_async(group, queues[i], ^{
+                [analyzer processFrames:frameCount offset:frameOffset channels:channels];
+            });
+        }
+    };
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    NSMutableDictionary<NSString*, NSNumber*>* timings = [NSMutableDictionary dictionary];
+
+    [decoder decodeAsyncForAnalysisWithSample:sample
+                                  pageHandler:pageHandler
+                              completionQueue:nil
+                                     callback:^(BOOL success) {
+                                         decodeSuccess = success;
+                                         dispatch_semaphore_signal(decoded);
+                                     }];
+
+    NSTimeInterval remaining = timeout;
+    const BOOL decodeFinished = [self waitWithBlock:^long(dispatch_time_t slice) {
+        return dispatch_semaphore_wait(decoded, slice);
+    }
+                                          remaining:&remaining];
+    if (streaming && !begun) {
+        [sample removeReader:holdReader];
+    }
+
+    if (!decodeFinished) {
+        NSLog(@"analysis decode timed out after %.0fs", timeout);
+        // A held decoder would never notice the abort.
+        [self resume];
+        dispatch_semaphore_t aborted = dispatch_semaphore_create(0);
+        [decoder decodeAbortWithCallback:^{
+            dispatch_semaphore_signal(aborted);
+        }];
+        dispatch_semaphore_wait(aborted, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kAnalysisCancelGrace * NSEC_PER_SEC)));
+        [self cancelAnalyzers];
+        dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kAnalysisCancelGrace * NSEC_PER_SEC)));
+        if (error) {
+            *error = [NSError errorWithDomain:SampleAnalyzerErrorDomain
+                                         code:SampleAnalyzerErrorCancelled
+                                     userInfo:@{NSLocalizedDescriptionKey : @"Decoding timed out"}];
+        }
+        return NO;
+    }
+
+    if (!decodeSuccess) {
+        [self cancelAnalyzers];
+        dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kAnalysisCancelGrace * NSEC_PER_SEC)));
+        if (error) {
+            *error = [NSError errorWithDomain:SampleAnalyzerErrorDomain
+                                         code:SampleAnalyzerErrorNoData
+                                     userInfo:@{NSLocalizedDescriptionKey : @"Decoding failed"}];
+        }
+        return NO;
+    }
+
+    timings[kAnalysisPipelineDecodeStage] = @(CFAbsoluteTimeGetCurrent() - start);
+
+    if (!begun) {
+        beginAll();
+    }
+    for (NSUInteger i = 0; i < analyzers.count; i++) {
+        id<SampleAnalyzer> analyzer = analyzers[i];
+        dispatch_group_async(group, queues[i], ^{
+            [analyzer finish];
+            NSNumber* elapsed = @(CFAbsoluteTimeGetCurrent() - start);
+            @synchronized(timings) {
+                timings[analyzer.name] = elapsed;
+            }
+        });
+    }
+
+    if (![self waitWithBlock:^long(dispatch_time_t slice) {
+            return dispatch_group_wait(group, slice);
+        }
+                   remaining:&remaining]) {
+        NSLog(@"analysis timed out after %.0fs, cancelling", timeout);
+        [self cancelAnalyzers];
+        dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kAnalysisCancelGrace * NSEC_PER_SEC)));
+    }
+
+    NSMutableDictionary<NSString*, NSError*>* errors = [NSMutableDictionary dictionary];
+    for (id<SampleAnalyzer> analyzer in analyzers) {
+        NSError* analyzerError = analyzer.error;
+        if (analyzerError != nil) {
+            errors[analyzer.name] = analyzerError;
+        }
+    }
+    _errors = [errors copy];
+    @synchronized(timings) {
+        _timings = [timings copy];
+    }
+
+    return YES;
+}
+
+@end
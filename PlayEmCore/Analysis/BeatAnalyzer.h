@@ -0,0 +1,29 @@
+//
+//  BeatAnalyzer.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "SampleAnalyzer.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class BeatTrackedSample;
+
+/// Runs `BeatTrackedSample` alongside the decoder.
+///
+/// Pages get handed to the tracker on the analyzer queue, just as with
+/// `KeyAnalyzer`; nothing waits on the sample when the pipeline is held.
+@interface BeatAnalyzer : NSObject <SampleAnalyzer>
+
+@property (readonly, nonatomic, nullable) BeatTrackedSample* beatSample;
+/// Average tempo in BPM, nil when none could be detected.
+@property (readonly, nonatomic, nullable) NSNumber* tempo;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,80 @@
+//
+//  BeatAnalyzer.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "BeatAnalyzer.h"
+
+#import "BeatTrackedSample.h"
+#import "LazySample.h"
+
+@implementation BeatAnalyzer {
+    NSNumber* _tempo;
+    NSError* _error;
+}
+
+- (NSString*)name
+{
+    return @"beats";
+}
+
++ (NSInteger)version
+{
+    return 1;
+}
+
+- (NSError*)error
+{
+    return _error;
+}
+
+- (NSNumber*)tempo
+{
+    return _tempo;
+}
+
+- (void)beginWithSample:(LazySample*)sample
+{
+    _tempo = nil;
+    _error = nil;
+
+    _beatSample = [[BeatTrackedSample alloc] initWithSample:sample];
+    _beatSample.suppressActivity = YES;
+    [_beatSample beginPageTracking];
+}
+
+- (void)processFrames:(unsigned long long)frames offset:(unsigned long long)offset channels:(NSArray<NSData*>*)channels
+{
+    [_beatSample trackPageWithFrames:frames offset:offset channels:channels];
+}
+
+- (void)finish
+{
+    if (_beatSample == nil) {
+        return;
+    }
+    if (![_beatSample finishPageTracking]) {
+        _error = [NSError errorWithDomain:SampleAnalyzerErrorDomain
+                                     code:SampleAnalyzerErrorCancelled
+                                 userInfo:@{NSLocalizedDescriptionKey : @"Beat tracking did not finish"}];
+        return;
+    }
+    float tempo = [_beatSample averageTempo];
+    if (tempo <= 0.0f) {
+        _error = [NSError errorWithDomain:SampleAnalyzerErrorDomain
+                                     code:SampleAnalyzerErrorFailed
+                                 userInfo:@{NSLocalizedDescriptionKey : @"No tempo detected"}];
+        return;
+    }
+    _tempo = @(tempo);
+}
+
+- (void)cancel
+{
+    [_beatSample abortWithCallback:^{}];
+}
+
+@end
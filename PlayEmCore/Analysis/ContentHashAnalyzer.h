@@ -0,0 +1,26 @@
+//
+//  ContentHashAnalyzer.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "SampleAnalyzer.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// SHA-256 over the decoded audio, independent of tags and container.
+///
+/// Samples are quantized to 16 bit and interleaved before hashing, so the
+/// digest does not depend on page boundaries or tiny float deviations.
+@interface ContentHashAnalyzer : NSObject <SampleAnalyzer>
+
+/// Short hex digest (first 12 bytes), matching `NSData shortSHA256`.
+@property (readonly, nonatomic, nullable) NSString* contentHash;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,97 @@
+//
+//  ContentHashAnalyzer.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "ContentHashAnalyzer.h"
+
+#import <CommonCrypto/CommonDigest.h>
+
+#import "LazySample.h"
+
+@implementation ContentHashAnalyzer {
+    CC_SHA256_CTX _context;
+    NSMutableData* _quantized;
+    unsigned long long _frames;
+    NSString* _contentHash;
+    NSError* _error;
+}
+
+- (NSString*)name
+{
+    return @"contentHash";
+}
+
++ (NSInteger)version
+{
+    return 1;
+}
+
+- (NSError*)error
+{
+    return _error;
+}
+
+- (NSString*)contentHash
+{
+    return _contentHash;
+}
+
+- (void)beginWithSample:(LazySample*)sample
+{
+    CC_SHA256_Init(&_context);
+    _quantized = [NSMutableData data];
+    _frames = 0;
+    _contentHash = nil;
+    _error = nil;
+}
+
+- (void)processFrames:(unsigned long long)frames offset:(unsigned long long)offset channels:(NSArray<NSData*>*)channels
+{
+    const NSUInteger channelCount = channels.count;
+    if (channelCount == 0 || frames == 0) {
+        return;
+    }
+
+    [_quantized setLength:frames * channelCount * sizeof(int16_t)];
+    int16_t* output = (int16_t*) _quantized.mutableBytes;
+
+    const float* data[channelCount];
+    for (NSUInteger channel = 0; channel < channelCount; channel++) {
+        data[channel] = (const float*) channels[channel].bytes;
+    }
+    for (unsigned long long frameIndex = 0; frameIndex < frames; frameIndex++) {
+        for (NSUInteger channel = 0; channel < channelCount; channel++) {
+            float v = MAX(-1.0f, MIN(1.0f, data[channel][frameIndex]));
+            *output++ = (int16_t) lrintf(v * 32767.0f);
+        }
+    }
+
+    CC_SHA256_Update(&_context, _quantized.bytes, (CC_LONG) _quantized.length);
+    _frames += frames;
+}
+
+- (void)finish
+{
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH] = {0};
+    CC_SHA256_Final(digest, &_context);
+    _quantized = nil;
+
+    if (_frames == 0) {
+        _error = [NSError errorWithDomain:SampleAnalyzerErrorDomain
+                                     code:SampleAnalyzerErrorNoData
+                                 userInfo:@{NSLocalizedDescriptionKey : @"No frames to hash"}];
+        return;
+    }
+
+    NSMutableString* hash = [NSMutableString stringWithCapacity:24];
+    for (int i = 0; i < 12; i++) {
+        [hash appendFormat:@"%02x", digest[i]];
+    }
+    _contentHash = hash;
+}
+
+@end
@@ -0,0 +1,29 @@
+//
+//  KeyAnalyzer.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "SampleAnalyzer.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class KeyTrackedSample;
+
+/// Runs `KeyTrackedSample` alongside the decoder.
+///
+/// The tracker gets fed each page on the analyzer queue rather than pulling
+/// from the sample, so a suspended pipeline parks it without holding a thread.
+@interface KeyAnalyzer : NSObject <SampleAnalyzer>
+
+@property (readonly, nonatomic, nullable) KeyTrackedSample* keySample;
+/// Camelot key, nil when none could be detected.
+@property (readonly, nonatomic, nullable) NSString* key;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,79 @@
+//
+//  KeyAnalyzer.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "KeyAnalyzer.h"
+
+#import "KeyTrackedSample.h"
+#import "LazySample.h"
+
+@implementation KeyAnalyzer {
+    NSString* _key;
+    NSError* _error;
+}
+
+- (NSString*)name
+{
+    return @"key";
+}
+
++ (NSInteger)version
+{
+    return 1;
+}
+
+- (NSError*)error
+{
+    return _error;
+}
+
+- (NSString*)key
+{
+    return _key;
+}
+
+- (void)beginWithSample:(LazySample*)sample
+{
+    _key = nil;
+    _error = nil;
+
+    _keySample = [[KeyTrackedSample alloc] initWithSample:sample];
+    _keySample.suppressActivity = YES;
+    [_keySample beginPageTracking];
+}
+
+- (void)processFrames:(unsigned long long)frames offset:(unsigned long long)offset channels:(NSArray<NSData*>*)channels
+{
+    [_keySample trackPageWithFrames:frames offset:offset channels:channels];
+}
+
+- (void)finish
+{
+    if (_keySample == nil) {
+        return;
+    }
+    if (![_keySample finishPageTracking]) {
+        _error = [NSError errorWithDomain:SampleAnalyzerErrorDomain
+                                     code:SampleAnalyzerErrorCancelled
+                                 userInfo:@{NSLocalizedDescriptionKey : @"Key detection did not finish"}];
+        return;
+    }
+    if (_keySample.key.length == 0) {
+        _error = [NSError errorWithDomain:SampleAnalyzerErrorDomain
+                                     code:SampleAnalyzerErrorFailed
+                                 userInfo:@{NSLocalizedDescriptionKey : @"No key detected"}];
+        return;
+    }
+    _key = _keySample.key;
+}
+
+- (void)cancel
+{
+    [_keySample abortWithCallback:^{}];
+}
+
+@end
@@ -0,0 +1,27 @@
+//
+//  LoudnessAnalyzer.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "SampleAnalyzer.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Streams RMS energy and peak level over all channels.
+@interface LoudnessAnalyzer : NSObject <SampleAnalyzer>
+
+/// Linear RMS across all channels and frames.
+@property (readonly, nonatomic) double rms;
+/// Linear absolute peak across all channels.
+@property (readonly, nonatomic) double peak;
+/// RMS level in dBFS; -INFINITY for digital silence.
+@property (readonly, nonatomic) double loudness;
+
+@end
+
+NS_ASSUME_NONNULL_END
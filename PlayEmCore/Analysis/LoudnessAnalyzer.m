@@ -0,0 +1,90 @@
+//
+//  LoudnessAnalyzer.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "LoudnessAnalyzer.h"
+
+#import <Accelerate/Accelerate.h>
+
+#import "LazySample.h"
+
+@implementation LoudnessAnalyzer {
+    double _sumOfSquares;
+    float _peak;
+    unsigned long long _samples;
+    NSError* _error;
+}
+
+- (NSString*)name
+{
+    return @"loudness";
+}
+
++ (NSInteger)version
+{
+    return 1;
+}
+
+- (NSError*)error
+{
+    return _error;
+}
+
+- (void)beginWithSample:(LazySample*)sample
+{
+    _sumOfSquares = 0.0;
+    _peak = 0.0f;
+    _samples = 0;
+    _error = nil;
+}
+
+- (void)processFrames:(unsigned long long)frames offset:(unsigned long long)offset channels:(NSArray<NSData*>*)channels
+{
+    for (NSData* channel in channels) {
+        const float* data = (const float*) channel.bytes;
+        float squares = 0.0f;
+        float peak = 0.0f;
+        vDSP_svesq(data, 1, &squares, (vDSP_Length) frames);
+        vDSP_maxmgv(data, 1, &peak, (vDSP_Length) frames);
+        _sumOfSquares += squares;
+        _peak = MAX(_peak, peak);
+        _samples += frames;
+    }
+}
+
+- (void)finish
+{
+    if (_samples == 0) {
+        _error = [NSError errorWithDomain:SampleAnalyzerErrorDomain
+                                     code:SampleAnalyzerErrorNoData
+                                 userInfo:@{NSLocalizedDescriptionKey : @"No frames to measure loudness"}];
+    }
+}
+
+- (double)rms
+{
+    if (_samples == 0) {
+        return 0.0;
+    }
+    return sqrt(_sumOfSquares / (double) _samples);
+}
+
+- (double)peak
+{
+    return _peak;
+}
+
+- (double)loudness
+{
+    double rms = self.rms;
+    if (rms <= 0.0) {
+        return -INFINITY;
+    }
+    return 20.0 * log10(rms);
+}
+
+@end
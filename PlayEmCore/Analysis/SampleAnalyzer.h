@@ -0,0 +1,67 @@
+//
+//  SampleAnalyzer.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#ifndef SampleAnalyzer_h
+#define SampleAnalyzer_h
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class LazySample;
+
+extern NSErrorDomain const SampleAnalyzerErrorDomain;
+
+typedef NS_ENUM(NSInteger, SampleAnalyzerError) {
+    SampleAnalyzerErrorNoData = 1,
+    SampleAnalyzerErrorFailed = 2,
+    SampleAnalyzerErrorCancelled = 3,
+};
+
+/// A consumer of decoded sample pages, driven by an `AnalysisPipeline`.
+///
+/// All calls for one analyzer arrive on the same serial queue, in order:
+/// `beginWithSample:` once, `processFrames:offset:channels:` per decoded page,
+/// then `finish` once.
+@protocol SampleAnalyzer <NSObject>
+
+/// Short identifier used for logging and error reporting.
+@property (readonly, nonatomic) NSString* name;
+
+/// Result version. Bump it whenever a change makes previously stored results
+/// worth recomputing; the deep scan re-runs analyzers whose results are older.
+@property (class, readonly, nonatomic) NSInteger version;
+
+/// Set when the analyzer failed; its result is meaningless then.
+@property (readonly, nonatomic, nullable) NSError* error;
+
+/// Called before the first page, once the rendered format is known.
+///
+/// - Parameter sample: Sample being decoded.
+- (void)beginWithSample:(LazySample*)sample;
+
+/// Called for every decoded page.
+///
+/// - Parameters:
+///   - frames: Number of frames in the page.
+///   - offset: Frame offset of the page within the sample.
+///   - channels: One non-interleaved float buffer per channel.
+- (void)processFrames:(unsigned long long)frames offset:(unsigned long long)offset channels:(NSArray<NSData*>*)channels;
+
+/// Called after the last page; may block until the result is available.
+- (void)finish;
+
+@optional
+
+/// Abort pending work; a following `finish` has to return promptly.
+- (void)cancel;
+
+@end
+
+NS_ASSUME_NONNULL_END
+#endif /* SampleAnalyzer_h */
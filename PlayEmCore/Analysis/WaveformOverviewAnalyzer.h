@@ -0,0 +1,29 @@
+//
+//  WaveformOverviewAnalyzer.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "SampleAnalyzer.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+extern const size_t kWaveformOverviewWidth;
+
+/// Reduces the entire sample to a fixed number of `VisualPair`s while decoding.
+@interface WaveformOverviewAnalyzer : NSObject <SampleAnalyzer>
+
+/// Number of pairs to produce; defaults to `kWaveformOverviewWidth`.
+@property (assign, nonatomic) size_t width;
+/// Frames folded into each pair.
+@property (readonly, nonatomic) unsigned long long framesPerPair;
+/// Packed `VisualPair` values, mono-mixed.
+@property (readonly, nonatomic, nullable) NSData* overview;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,121 @@
+//
+//  WaveformOverviewAnalyzer.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "WaveformOverviewAnalyzer.h"
+
+#import "LazySample.h"
+#import "VisualPair.h"
+#import "VisualPairContext.h"
+
+const size_t kWaveformOverviewWidth = 2048;
+
+@implementation WaveformOverviewAnalyzer {
+    NSMutableData* _pairs;
+    VisualPairContext _context;
+    unsigned long long _pairFrame;
+    NSError* _error;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _width = kWaveformOverviewWidth;
+    }
+    return self;
+}
+
+- (NSString*)name
+{
+    return @"waveform";
+}
+
++ (NSInteger)version
+{
+    return 1;
+}
+
+- (NSError*)error
+{
+    return _error;
+}
+
+- (NSData*)overview
+{
+    return _error == nil ? _pairs : nil;
+}
+
+- (void)beginWithSample:(LazySample*)sample
+{
+    // The frame count is an estimate until decoding is done; that is close
+    // enough for sizing the bins.
+    unsigned long long frames = sample.frames;
+    _framesPerPair = MAX(1ULL, (frames + _width - 1) / _width);
+    _pairs = [NSMutableData dataWithCapacity:_width * sizeof(VisualPair)];
+    _context = (VisualPairContext) {.negativeSum = 0.0, .positiveSum = 0.0, .negativeCount = 0, .positiveCount = 0};
+    _pairFrame = 0;
+    _error = nil;
+}
+
+- (void)appendPair
+{
+    const float negativeAverage = _context.negativeCount > 0 ? _context.negativeSum / _context.negativeCount : 0.0;
+    const float positiveAverage = _context.positiveCount > 0 ? _context.positiveSum / _context.positiveCount : 0.0;
+    VisualPair pair = {.negativeAverage = negativeAverage, .positiveAverage = positiveAverage};
+    [_pairs appendBytes:&pair length:sizeof(VisualPair)];
+
+    _context = (VisualPairContext) {.negativeSum = 0.0, .positiveSum = 0.0, .negativeCount = 0, .positiveCount = 0};
+    _pairFrame = 0;
+}
+
+- (void)processFrames:(unsigned long long)frames offset:(unsigned long long)offset channels:(NSArray<NSData*>*)channels
+{
+    const NSUInteger channelCount = channels.count;
+    if (channelCount == 0) {
+        return;
+    }
+    const float* data[channelCount];
+    for (NSUInteger channel = 0; channel < channelCount; channel++) {
+        data[channel] = (const float*) channels[channel].bytes;
+    }
+
+    for (unsigned long long frameIndex = 0; frameIndex < frames; frameIndex++) {
+        double s = 0.0;
+        for (NSUInteger channel = 0; channel < channelCount; channel++) {
+            s += data[channel][frameIndex];
+        }
+        s /= channelCount;
+
+        if (s >= 0) {
+            _context.positiveSum += s;
+            _context.positiveCount++;
+        } else {
+            _context.negativeSum += s;
+            _context.negativeCount++;
+        }
+
+        _pairFrame++;
+        if (_pairFrame >= _framesPerPair) {
+            [self appendPair];
+        }
+    }
+}
+
+- (void)finish
+{
+    if (_pairFrame > 0) {
+        [self appendPair];
+    }
+    if (_pairs.length == 0) {
+        _error = [NSError errorWithDomain:SampleAnalyzerErrorDomain
+                                     code:SampleAnalyzerErrorNoData
+                                 userInfo:@{NSLocalizedDescriptionKey : @"No frames to reduce into a waveform overview"}];
+    }
+}
+
+@end
@@ -12,6 +12,7 @@
 
 #import "../Sample/SampleFormat.h"
 #import "AudioPlaybackBackend.h"
+#import "SampleDecoder.h"
 NS_ASSUME_NONNULL_BEGIN
 
 extern const unsigned int kPlaybackBufferFrames;
@@ -36,7 +37,7 @@ extern NSString* const kGraphChangeDeviceIdKey;
 
 typedef void (^TapBlock)(unsigned long long framePosition, float* frameData, unsigned int frameCount);
 
-@interface AudioController : NSObject
+@interface AudioController : NSObject <SampleDecoder>
 
 @property (nonatomic, assign, readonly) SampleFormat sampleFormat;
 @property (nonatomic, assign) AVAudioFramePosition currentFrame;
@@ -107,6 +108,21 @@ typedef void (^TapBlock)(unsigned long long framePosition, float* frameData, uns
                         completionQueue:(dispatch_queue_t _Nullable)queue
                                 callback:(void (^)(BOOL))callback;
 
+/// Asynchronously decode a sample for analysis, handing each decoded page to a handler.
+///
+/// Analysis decoding renders at the file sample rate; there is no playback device
+/// to match and skipping the resampler keeps results deterministic.
+///
+/// - Parameters:
+///   - sample: Sample to decode.
+///   - pageHandler: Invoked on the decoder thread for every decoded page, in order.
+///   - queue: Completion queue (defaults to global utility queue when nil).
+///   - callback: Completion invoked on the queue.
+- (void)decodeAsyncForAnalysisWithSample:(LazySample*)sample
+                             pageHandler:(DecodedPageBlock _Nullable)pageHandler
+                         completionQueue:(dispatch_queue_t _Nullable)queue
+                                callback:(void (^)(BOOL))callback;
+
 /// Check whether the current default output device supports the sample's native rate.
 ///
 /// - Parameter sample: Sample to test.
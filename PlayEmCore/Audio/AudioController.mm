@@ -47,7 +47,6 @@ static OSStatus DefaultOutputDeviceChanged(AudioObjectID objectId, UInt32 number
 @property (nonatomic, strong) id<AudioPlaybackBackend> backend;
 @property (nonatomic, strong, nullable) LazySample* sampleRef;
 @property (nonatomic, strong, nullable) dispatch_block_t decodeOperation;
-@property (nonatomic, assign) BOOL suppressDecodeNotifications;
 @property (nonatomic, copy, nullable) TapBlock tapBlock;
 @property (nonatomic, assign) AVAudioFramePosition cachedLatency;
 @property (nonatomic, assign) AudioObjectID cachedDeviceId;
@@ -497,7 +496,13 @@ static OSStatus DefaultOutputDeviceChanged(AudioObjectID objectId, UInt32 number
     return [AudioDevice device:deviceId supportsSampleRate:sourceRate];
 }
 
-- (BOOL)decode:(LazySample*)encodedSample frame:(unsigned long long)frame token:(ActivityToken*)token reachedFrame:(void (^)(void))reachedFrame cancelTest:(BOOL (^)(void))cancelTest
+- (BOOL)decode:(LazySample*)encodedSample
+           frame:(unsigned long long)frame
+           token:(ActivityToken*)token
+     forAnalysis:(BOOL)forAnalysis
+     pageHandler:(DecodedPageBlock _Nullable)pageHandler
+    reachedFrame:(void (^)(void))reachedFrame
+      cancelTest:(BOOL (^)(void))cancelTest
 {
     if (token != nil) {
         [[ActivityManager shared] updateActivity:token progress:0.0 detail:PECLocalizedString(@"activity.decode.initializing_engine", @"Detail when initializing audio decode engine")];
@@ -522,7 +527,9 @@ static OSStatus DefaultOutputDeviceChanged(AudioObjectID objectId, UInt32 number
     // beginning.
     // It is, in my opinion totally worth it. We are using the decoder/resampler in mastering
     // mode, not meant for real-time use -- we just make things appear as if it was real-time.
-    Float64 renderRate = (deviceRate > 0 ? deviceRate : sourceRate);
+    //
+    // Analysis has no device to match, it renders at the file rate.
+    Float64 renderRate = (deviceRate > 0 && !forAnalysis ? deviceRate : sourceRate);
     double expectedRenderedFrames = (sourceRate > 0 ? (double) encodedSample.source.length * (renderRate / sourceRate) : (double) encodedSample.source.length);
     // Update rate immediately so early playback (before full decode) uses the device rate.
     encodedSample.sampleFormat = (SampleFormat){.channels = encodedSample.sampleFormat.channels, .rate = (long) renderRate};
@@ -530,7 +537,7 @@ static OSStatus DefaultOutputDeviceChanged(AudioObjectID objectId, UInt32 number
     [encodedSample setRenderedLength:(unsigned long long) ceil(expectedRenderedFrames)];
 
     // We now know which rate that file will get decoded/resampled to, lets tell the world.
-    if (!self.suppressDecodeNotifications) {
+    if (!forAnalysis) {
         dispatch_async(dispatch_get_main_queue(), ^{
             [[NSNotificationCenter defaultCenter] postNotificationName:kPlaybackGraphChanged
                                                                 object:self
@@ -590,6 +597,9 @@ static OSStatus DefaultOutputDeviceChanged(AudioObjectID objectId, UInt32 number
                 [channels addObject:channel];
             }
             [encodedSample addLazyPageIndex:pageIndex channels:channels];
+            if (pageHandler != nil) {
+                pageHandler(totalRenderedFrames, outputBuffer.frameLength, channels);
+            }
             pageIndex++;
             totalRenderedFrames += outputBuffer.frameLength;
         } else if (status == AVAudioConverterOutputStatus_EndOfStream) {
@@ -641,6 +651,8 @@ static OSStatus DefaultOutputDeviceChanged(AudioObjectID objectId, UInt32 number
         done = [weakSelf decode:sample
                           frame:frame
                           token:decoderToken
+                    forAnalysis:NO
+                    pageHandler:nil
                    reachedFrame:^ {
             dispatch_async(dispatch_get_main_queue(), ^{
                 callback(NO, YES);
@@ -665,6 +677,14 @@ static OSStatus DefaultOutputDeviceChanged(AudioObjectID objectId, UInt32 number
 - (void)decodeAsyncForAnalysisWithSample:(LazySample*)sample
                         completionQueue:(dispatch_queue_t _Nullable)queue
                                 callback:(void (^)(BOOL))callback
+{
+    [self decodeAsyncForAnalysisWithSample:sample pageHandler:nil completionQueue:queue callback:callback];
+}
+
+- (void)decodeAsyncForAnalysisWithSample:(LazySample*)sample
+                             pageHandler:(DecodedPageBlock _Nullable)pageHandler
+                         completionQueue:(dispatch_queue_t _Nullable)queue
+                                callback:(void (^)(BOOL))callback
 {
     __weak AudioController* weakSelf = self;
 
@@ -676,18 +696,19 @@ static OSStatus DefaultOutputDeviceChanged(AudioObjectID objectId, UInt32 number
         if (!strongSelf) {
             return;
         }
-        strongSelf.suppressDecodeNotifications = YES;
         done = [strongSelf decode:sample
                             frame:0
                             token:nil
+                      forAnalysis:YES
+                      pageHandler:pageHandler
                      reachedFrame:^{}
                        cancelTest:^BOOL {
             return dispatch_block_testcancel(weakBlock) != 0 ? YES : NO;
         }];
-        strongSelf.suppressDecodeNotifications = NO;
     });
 
     weakBlock = block;
+    self.decodeOperation = block;
     dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), block);
 
     dispatch_block_notify(block, queue ?: dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
@@ -0,0 +1,59 @@
+//
+//  AudioDuration.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+extern NSErrorDomain const AudioDurationErrorDomain;
+
+typedef NS_ENUM(NSInteger, AudioDurationError) {
+    AudioDurationErrorUnreadable = 1,
+    AudioDurationErrorUnsupported,
+    AudioDurationErrorMalformed,
+};
+
+/// Where a duration was taken from.
+typedef NS_ENUM(NSInteger, AudioDurationSource) {
+    /// Xing or Info header of the first MPEG audio frame, LAME gapless info applied.
+    AudioDurationSourceXingHeader,
+    /// Fraunhofer VBRI header of the first MPEG audio frame.
+    AudioDurationSourceVBRIHeader,
+    /// Counted MPEG audio frame headers.
+    AudioDurationSourceFrameScan,
+    /// `stts` of the MP4 sound track, edit list applied.
+    AudioDurationSourceMP4SampleTable,
+    /// `mdhd` or `mvhd` of an MP4 without usable sample table.
+    AudioDurationSourceMP4Header,
+    /// `COMM` chunk of an AIFF or AIFC.
+    AudioDurationSourceAIFFCommon,
+    /// `fmt `, `fact` and `data` chunks of a WAV, RF64 or BW64.
+    AudioDurationSourceWAVEFormat,
+};
+
+/// Exact duration of an audio file, read from its container headers without
+/// decoding anything.
+///
+/// Understands MPEG audio (Xing/Info, LAME, VBRI, falling back to a frame
+/// header scan), MP4/M4A (`mvhd`, `mdhd`, `stts`, `elst`), AIFF/AIFC and
+/// WAV/RF64. The format is sniffed from the content, not the file extension.
+@interface AudioDuration : NSObject
+
+/// Number of sample frames as presented, with encoder delay and padding
+/// removed where the container tells about them.
+@property (readonly, nonatomic) unsigned long long frames;
+@property (readonly, nonatomic) double sampleRate;
+@property (readonly, nonatomic) AudioDurationSource source;
+@property (readonly, nonatomic) double milliseconds;
+
++ (nullable instancetype)durationOfURL:(NSURL*)url error:(NSError* _Nullable*)error;
++ (nullable instancetype)durationOfData:(NSData*)data error:(NSError* _Nullable*)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
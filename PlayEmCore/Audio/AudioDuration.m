@@ -0,0 +1,644 @@
+//
+//  AudioDuration.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "AudioDuration.h"
+
+#include <math.h>
+
+NSErrorDomain const AudioDurationErrorDomain = @"AudioDuration";
+
+#pragma mark - Byte access
+
+static inline uint16_t readBE16(const uint8_t* p)
+{
+    return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t readBE24(const uint8_t* p)
+{
+    return ((uint32_t) p[0] << 16) | ((uint32_t) p[1] << 8) | p[2];
+}
+
+static inline uint32_t readBE32(const uint8_t* p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static inline uint64_t readBE64(const uint8_t* p)
+{
+    return ((uint64_t) readBE32(p) << 32) | readBE32(p + 4);
+}
+
+static inline uint16_t readLE16(const uint8_t* p)
+{
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static inline uint32_t readLE32(const uint8_t* p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline uint64_t readLE64(const uint8_t* p)
+{
+    return ((uint64_t) readLE32(p + 4) << 32) | readLE32(p);
+}
+
+static inline BOOL matches(const uint8_t* p, const char* fourCC)
+{
+    return memcmp(p, fourCC, 4) == 0;
+}
+
+/// IEEE 754 80-bit extended, as used for the AIFF sample rate.
+static double readExtended(const uint8_t* p)
+{
+    const int exponent = ((p[0] & 0x7F) << 8) | p[1];
+    const uint64_t mantissa = readBE64(p + 2);
+    if (exponent == 0 && mantissa == 0) {
+        return 0.0;
+    }
+    const double value = ldexp((double) mantissa, exponent - 16383 - 63);
+    return (p[0] & 0x80) ? -value : value;
+}
+
+#pragma mark - MPEG audio
+
+typedef struct {
+    int version;  // 0 = MPEG-1, 1 = MPEG-2, 2 = MPEG-2.5
+    int layer;    // 1 ... 3
+    unsigned int sampleRate;
+    unsigned int channels;
+    unsigned int samplesPerFrame;
+    size_t length;
+} MPEGFrameHeader;
+
+static const unsigned int kMPEGBitrates[2][3][15] = {
+    {
+        // MPEG-1, layer I, II, III
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+    },
+    {
+        // MPEG-2 and 2.5, layer I, II, III
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+    },
+};
+
+static const unsigned int kMPEGSampleRates[3][3] = {
+    {44100, 48000, 32000},
+    {22050, 24000, 16000},
+    {11025, 12000, 8000},
+};
+
+static BOOL parseMPEGFrameHeader(const uint8_t* p, MPEGFrameHeader* header)
+{
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) {
+        return NO;
+    }
+    const int versionBits = (p[1] >> 3) & 0x03;
+    const int layerBits = (p[1] >> 1) & 0x03;
+    const int bitrateIndex = p[2] >> 4;
+    const int sampleRateIndex = (p[2] >> 2) & 0x03;
+    if (versionBits == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3) {
+        // Reserved values; free format is not worth supporting.
+        return NO;
+    }
+
+    const int version = versionBits == 3 ? 0 : (versionBits == 2 ? 1 : 2);
+    const int layer = 4 - layerBits;
+    const unsigned int bitrate = kMPEGBitrates[version == 0 ? 0 : 1][layer - 1][bitrateIndex] * 1000;
+    const unsigned int sampleRate = kMPEGSampleRates[version][sampleRateIndex];
+    const unsigned int padding = (p[2] >> 1) & 0x01;
+
+    header->version = version;
+    header->layer = layer;
+    header->sampleRate = sampleRate;
+    header->channels = (p[3] >> 6) == 3 ? 1 : 2;
+    if (layer == 1) {
+        header->samplesPerFrame = 384;
+        header->length = (12 * bitrate / sampleRate + padding) * 4;
+    } else if (layer == 2 || version == 0) {
+        header->samplesPerFrame = 1152;
+        header->length = 144 * bitrate / sampleRate + padding;
+    } else {
+        header->samplesPerFrame = 576;
+        header->length = 72 * bitrate / sampleRate + padding;
+    }
+    return header->length > 4;
+}
+
+static BOOL sameMPEGStream(const MPEGFrameHeader* a, const MPEGFrameHeader* b)
+{
+    return a->version == b->version && a->layer == b->layer && a->sampleRate == b->sampleRate;
+}
+
+/// A frame header counts as found when the frame after it looks alike, or
+/// when the frame ends exactly with the data.
+static BOOL isMPEGFrameAt(const uint8_t* bytes, size_t length, size_t offset, MPEGFrameHeader* header)
+{
+    if (offset + 4 > length || !parseMPEGFrameHeader(bytes + offset, header)) {
+        return NO;
+    }
+    const size_t next = offset + header->length;
+    if (next == length) {
+        return YES;
+    }
+    MPEGFrameHeader following;
+    return next + 4 <= length && parseMPEGFrameHeader(bytes + next, &following) && sameMPEGStream(header, &following);
+}
+
+static size_t skipID3v2(const uint8_t* bytes, size_t length)
+{
+    size_t offset = 0;
+    // Some taggers stack several tags.
+    while (offset + 10 <= length && memcmp(bytes + offset, "ID3", 3) == 0) {
+        const uint8_t* p = bytes + offset;
+        const size_t size = ((size_t) (p[6] & 0x7F) << 21) | ((size_t) (p[7] & 0x7F) << 14) | ((size_t) (p[8] & 0x7F) << 7) | (p[9] & 0x7F);
+        const BOOL footer = (p[5] & 0x10) != 0;
+        offset += 10 + size + (footer ? 10 : 0);
+    }
+    return MIN(offset, length);
+}
+
+static size_t findMPEGFrame(const uint8_t* bytes, size_t length, size_t offset, MPEGFrameHeader* header)
+{
+    for (; offset + 4 <= length; offset++) {
+        if (bytes[offset] == 0xFF && isMPEGFrameAt(bytes, length, offset, header)) {
+            return offset;
+        }
+    }
+    return NSNotFound;
+}
+
+/// Counts frames from `offset` on, resyncing over junk in between.
+static unsigned long long scanMPEGFrames(const uint8_t* bytes, size_t length, size_t offset, const MPEGFrameHeader* first)
+{
+    unsigned long long count = 0;
+    MPEGFrameHeader header;
+    while (offset + 4 <= length) {
+        if (parseMPEGFrameHeader(bytes + offset, &header) && sameMPEGStream(first, &header)) {
+            if (offset + header.length > length) {
+                // Truncated frame, decoders drop it as well.
+                break;
+            }
+            count++;
+            offset += header.length;
+            continue;
+        }
+        offset = findMPEGFrame(bytes, length, offset + 1, &header);
+        if (offset == NSNotFound || !sameMPEGStream(first, &header)) {
+            break;
+        }
+    }
+    return count;
+}
+
+static BOOL resolveMPEG(const uint8_t* bytes, size_t length, unsigned long long* frames, double* sampleRate, AudioDurationSource* source)
+{
+    MPEGFrameHeader header;
+    const size_t offset = findMPEGFrame(bytes, length, skipID3v2(bytes, length), &header);
+    if (offset == NSNotFound) {
+        return NO;
+    }
+    const uint8_t* frame = bytes + offset;
+    const size_t available = MIN(header.length, length - offset);
+    *sampleRate = header.sampleRate;
+
+    const size_t sideInfo = header.version == 0 ? (header.channels == 1 ? 17 : 32) : (header.channels == 1 ? 9 : 17);
+    const size_t xing = 4 + sideInfo;
+    BOOL hasInfoFrame = NO;
+    if (header.layer == 3 && xing + 8 <= available && (matches(frame + xing, "Xing") || matches(frame + xing, "Info"))) {
+        hasInfoFrame = YES;
+        const uint32_t flags = readBE32(frame + xing + 4);
+        size_t field = xing + 8;
+        if ((flags & 0x01) && field + 4 <= available) {
+            const unsigned long long frameCount = readBE32(frame + field);
+            field += 4;
+            field += (flags & 0x02) ? 4 : 0;
+            field += (flags & 0x04) ? 100 : 0;
+            field += (flags & 0x08) ? 4 : 0;
+
+            unsigned long long samples = frameCount * header.samplesPerFrame;
+            // LAME (and libavcodec imitating it) tells encoder delay and padding.
+            if (field + 24 <= available && (matches(frame + field, "LAME") || memcmp(frame + field, "Lav", 3) == 0)) {
+                const uint32_t gapless = readBE24(frame + field + 21);
+                const unsigned long long trim = (gapless >> 12) + (gapless & 0x0FFF);
+                samples = samples > trim ? samples - trim : 0;
+            }
+            *frames = samples;
+            *source = AudioDurationSourceXingHeader;
+            return YES;
+        }
+    }
+
+    const size_t vbri = 4 + 32;
+    if (header.layer == 3 && vbri + 18 <= available && matches(frame + vbri, "VBRI")) {
+        *frames = (unsigned long long) readBE32(frame + vbri + 14) * header.samplesPerFrame;
+        *source = AudioDurationSourceVBRIHeader;
+        return YES;
+    }
+
+    // Headerless, hence likely CBR -- counting still is the only exact way.
+    size_t scanOffset = hasInfoFrame ? offset + header.length : offset;
+    *frames = scanMPEGFrames(bytes, length, scanOffset, &header) * header.samplesPerFrame;
+    *source = AudioDurationSourceFrameScan;
+    return *frames > 0;
+}
+
+#pragma mark - MP4
+
+typedef struct {
+    size_t start;  // first payload byte
+    size_t end;    // past the last payload byte
+} MP4Box;
+
+/// Finds the first child box of the given type within `parent`.
+static BOOL findMP4Box(const uint8_t* bytes, MP4Box parent, const char* type, MP4Box* box)
+{
+    size_t offset = parent.start;
+    while (offset + 8 <= parent.end) {
+        uint64_t size = readBE32(bytes + offset);
+        size_t header = 8;
+        if (size == 1) {
+            if (offset + 16 > parent.end) {
+                return NO;
+            }
+            size = readBE64(bytes + offset + 8);
+            header = 16;
+        } else if (size == 0) {
+            size = parent.end - offset;
+        }
+        if (size < header) {
+            return NO;
+        }
+        // Top-level boxes of truncated files may claim more than there is.
+        const size_t end = size > parent.end - offset ? parent.end : offset + (size_t) size;
+        if (matches(bytes + offset + 4, type)) {
+            box->start = offset + header;
+            box->end = end;
+            return YES;
+        }
+        offset = end;
+    }
+    return NO;
+}
+
+static BOOL findMP4Path(const uint8_t* bytes, MP4Box parent, NSArray<NSString*>* path, MP4Box* box)
+{
+    MP4Box current = parent;
+    for (NSString* type in path) {
+        if (!findMP4Box(bytes, current, type.UTF8String, &current)) {
+            return NO;
+        }
+    }
+    *box = current;
+    return YES;
+}
+
+/// Timescale and duration of a `mvhd` or `mdhd` payload; both share the layout.
+static BOOL readMP4Header(const uint8_t* bytes, MP4Box box, uint32_t* timescale, uint64_t* duration)
+{
+    if (box.end - box.start < 4) {
+        return NO;
+    }
+    const uint8_t* p = bytes + box.start;
+    if (p[0] == 1) {
+        if (box.end - box.start < 32) {
+            return NO;
+        }
+        *timescale = readBE32(p + 20);
+        *duration = readBE64(p + 24);
+    } else {
+        if (box.end - box.start < 20) {
+            return NO;
+        }
+        *timescale = readBE32(p + 12);
+        *duration = readBE32(p + 16);
+    }
+    return *timescale > 0;
+}
+
+static BOOL isMP4SoundTrack(const uint8_t* bytes, MP4Box trak)
+{
+    MP4Box hdlr;
+    if (!findMP4Path(bytes, trak, @[ @"mdia", @"hdlr" ], &hdlr) || hdlr.end - hdlr.start < 12) {
+        return NO;
+    }
+    return matches(bytes + hdlr.start + 8, "soun");
+}
+
+static uint64_t sumMP4TimeToSample(const uint8_t* bytes, MP4Box stts)
+{
+    if (stts.end - stts.start < 8) {
+        return 0;
+    }
+    const uint32_t entries = readBE32(bytes + stts.start + 4);
+    if ((uint64_t) entries * 8 > stts.end - stts.start - 8) {
+        return 0;
+    }
+    uint64_t total = 0;
+    const uint8_t* entry = bytes + stts.start + 8;
+    for (uint32_t i = 0; i < entries; i++, entry += 8) {
+        total += (uint64_t) readBE32(entry) * readBE32(entry + 4);
+    }
+    return total;
+}
+
+/// Duration of all non-empty edits in movie timescale, the media time the
+/// first of those starts at in `mediaStart`.
+static uint64_t sumMP4Edits(const uint8_t* bytes, MP4Box elst, int64_t* mediaStart)
+{
+    if (elst.end - elst.start < 8) {
+        return 0;
+    }
+    const uint8_t* p = bytes + elst.start;
+    const BOOL wide = p[0] == 1;
+    const uint32_t entries = readBE32(p + 4);
+    const size_t entrySize = wide ? 20 : 12;
+    if ((uint64_t) entries * entrySize > elst.end - elst.start - 8) {
+        return 0;
+    }
+    uint64_t total = 0;
+    BOOL first = YES;
+    const uint8_t* entry = p + 8;
+    for (uint32_t i = 0; i < entries; i++, entry += entrySize) {
+        const uint64_t segment = wide ? readBE64(entry) : readBE32(entry);
+        const int64_t mediaTime = wide ? (int64_t) readBE64(entry + 8) : (int32_t) readBE32(entry + 4);
+        if (mediaTime < 0) {
+            // Empty edit, a leading gap.
+            continue;
+        }
+        if (first) {
+            *mediaStart = mediaTime;
+            first = NO;
+        }
+        total += segment;
+    }
+    return total;
+}
+
+static BOOL resolveMP4(const uint8_t* bytes, size_t length, unsigned long long* frames, double* sampleRate, AudioDurationSource* source)
+{
+    MP4Box file = {0, length};
+    MP4Box moov;
+    if (!findMP4Box(bytes, file, "moov", &moov)) {
+        return NO;
+    }
+    uint32_t movieTimescale = 0;
+    uint64_t movieDuration = 0;
+    MP4Box mvhd;
+    if (findMP4Box(bytes, moov, "mvhd", &mvhd)) {
+        readMP4Header(bytes, mvhd, &movieTimescale, &movieDuration);
+    }
+
+    MP4Box trak = {0, 0};
+    BOOL found = NO;
+    size_t offset = moov.start;
+    MP4Box candidate;
+    while (findMP4Box(bytes, (MP4Box){offset, moov.end}, "trak", &candidate)) {
+        if (isMP4SoundTrack(bytes, candidate)) {
+            trak = candidate;
+            found = YES;
+            break;
+        }
+        offset = candidate.end;
+    }
+
+    uint32_t mediaTimescale = 0;
+    uint64_t mediaDuration = 0;
+    MP4Box mdhd;
+    if (!found || !findMP4Path(bytes, trak, @[ @"mdia", @"mdhd" ], &mdhd) || !readMP4Header(bytes, mdhd, &mediaTimescale, &mediaDuration)) {
+        // No sound track worth a look, the movie header is all there is.
+        if (movieTimescale == 0 || movieDuration == 0) {
+            return NO;
+        }
+        *sampleRate = movieTimescale;
+        *frames = movieDuration;
+        *source = AudioDurationSourceMP4Header;
+        return YES;
+    }
+
+    // The sample entry knows the real rate, the media timescale usually matches.
+    double rate = mediaTimescale;
+    MP4Box stsd;
+    if (findMP4Path(bytes, trak, @[ @"mdia", @"minf", @"stbl", @"stsd" ], &stsd) && stsd.end - stsd.start >= 8 + 36) {
+        const uint32_t entryRate = readBE32(bytes + stsd.start + 8 + 32) >> 16;
+        if (entryRate > 0) {
+            rate = entryRate;
+        }
+    }
+
+    uint64_t ticks = 0;
+    AudioDurationSource origin = AudioDurationSourceMP4Header;
+    MP4Box stts;
+    if (findMP4Path(bytes, trak, @[ @"mdia", @"minf", @"stbl", @"stts" ], &stts)) {
+        ticks = sumMP4TimeToSample(bytes, stts);
+        origin = AudioDurationSourceMP4SampleTable;
+    }
+    if (ticks == 0) {
+        ticks = mediaDuration;
+        origin = AudioDurationSourceMP4Header;
+    }
+
+    // Edit lists trim encoder priming and padding, e.g. of AAC.
+    MP4Box elst;
+    if (movieTimescale > 0 && findMP4Path(bytes, trak, @[ @"edts", @"elst" ], &elst)) {
+        int64_t mediaStart = 0;
+        const uint64_t edited = sumMP4Edits(bytes, elst, &mediaStart);
+        if (edited > 0) {
+            const uint64_t editedTicks = (uint64_t) llround((double) edited * mediaTimescale / movieTimescale);
+            const uint64_t available = ticks > (uint64_t) mediaStart ? ticks - (uint64_t) mediaStart : 0;
+            ticks = MIN(editedTicks, available);
+        }
+    }
+    if (ticks == 0) {
+        return NO;
+    }
+
+    *sampleRate = rate;
+    *frames = rate == mediaTimescale ? ticks : (unsigned long long) llround((double) ticks * rate / mediaTimescale);
+    *source = origin;
+    return YES;
+}
+
+#pragma mark - AIFF
+
+static BOOL resolveAIFF(const uint8_t* bytes, size_t length, unsigned long long* frames, double* sampleRate, AudioDurationSource* source)
+{
+    const BOOL compressed = matches(bytes + 8, "AIFC");
+    size_t offset = 12;
+    while (offset + 8 <= length) {
+        const uint32_t size = readBE32(bytes + offset + 4);
+        const uint8_t* payload = bytes + offset + 8;
+        if (matches(bytes + offset, "COMM")) {
+            if (size < 18 || offset + 8 + 18 > length) {
+                return NO;
+            }
+            unsigned long long count = readBE32(payload + 2);
+            // IMA ADPCM counts packets of 64 frames each.
+            if (compressed && size >= 22 && offset + 8 + 22 <= length && matches(payload + 18, "ima4")) {
+                count *= 64;
+            }
+            *frames = count;
+            *sampleRate = readExtended(payload + 8);
+            *source = AudioDurationSourceAIFFCommon;
+            return *sampleRate > 0.0;
+        }
+        offset += 8 + (size_t) size + (size & 1);
+    }
+    return NO;
+}
+
+#pragma mark - WAVE
+
+static BOOL resolveWAVE(const uint8_t* bytes, size_t length, unsigned long long* frames, double* sampleRate, AudioDurationSource* source)
+{
+    uint16_t formatTag = 0;
+    uint16_t blockAlign = 0;
+    uint32_t rate = 0;
+    uint64_t factFrames = 0;
+    uint64_t dataSize = 0;
+    BOOL hasData = NO;
+    uint64_t wideDataSize = 0;
+    uint64_t wideFrames = 0;
+
+    size_t offset = 12;
+    while (offset + 8 <= length) {
+        uint64_t size = readLE32(bytes + offset + 4);
+        const uint8_t* payload = bytes + offset + 8;
+        const size_t available = length - offset - 8;
+        if (matches(bytes + offset, "ds64") && available >= 24) {
+            wideDataSize = readLE64(payload + 8);
+            wideFrames = readLE64(payload + 16);
+        } else if (matches(bytes + offset, "fmt ") && available >= 16) {
+            formatTag = readLE16(payload);
+            rate = readLE32(payload + 4);
+            blockAlign = readLE16(payload + 12);
+            if (formatTag == 0xFFFE && size >= 26 && available >= 26) {
+                // WAVE_FORMAT_EXTENSIBLE; the subformat GUID leads with the tag.
+                formatTag = readLE16(payload + 24);
+            }
+        } else if (matches(bytes + offset, "fact") && available >= 4) {
+            factFrames = readLE32(payload);
+        } else if (matches(bytes + offset, "data")) {
+            if (size == 0xFFFFFFFF && wideDataSize > 0) {
+                size = wideDataSize;
+            }
+            // Still being written or truncated.
+            dataSize = MIN(size, (uint64_t) available);
+            hasData = YES;
+        }
+        if (size > available) {
+            break;
+        }
+        offset += 8 + (size_t) size + (size & 1);
+    }
+
+    if (!hasData || rate == 0) {
+        return NO;
+    }
+    const BOOL linear = formatTag == 1 || formatTag == 3;
+    if (linear && blockAlign > 0) {
+        *frames = dataSize / blockAlign;
+    } else if (wideFrames > 0) {
+        *frames = wideFrames;
+    } else if (factFrames > 0) {
+        *frames = factFrames;
+    } else {
+        return NO;
+    }
+    *sampleRate = rate;
+    *source = AudioDurationSourceWAVEFormat;
+    return YES;
+}
+
+#pragma mark -
+
+@implementation AudioDuration
+
+- (instancetype)initWithFrames:(unsigned long long)frames sampleRate:(double)sampleRate source:(AudioDurationSource)source
+{
+    self = [super init];
+    if (self) {
+        _frames = frames;
+        _sampleRate = sampleRate;
+        _source = source;
+    }
+    return self;
+}
+
+- (double)milliseconds
+{
+    return (double) _frames * 1000.0 / _sampleRate;
+}
+
+- (NSString*)description
+{
+    return [NSString stringWithFormat:@"%llu frames at %.0f Hz (%.3f ms)", _frames, _sampleRate, self.milliseconds];
+}
+
++ (NSError*)errorWithCode:(AudioDurationError)code description:(NSString*)description
+{
+    return [NSError errorWithDomain:AudioDurationErrorDomain code:code userInfo:@{NSLocalizedDescriptionKey : description}];
+}
+
++ (nullable instancetype)durationOfURL:(NSURL*)url error:(NSError* _Nullable*)error
+{
+    // Mapped, so scanning frame headers of a long MP3 only pages in what it
+    // touches.
+    NSData* data = [NSData dataWithContentsOfURL:url options:NSDataReadingMappedIfSafe error:error];
+    if (data == nil) {
+        return nil;
+    }
+    return [self durationOfData:data error:error];
+}
+
++ (nullable instancetype)durationOfData:(NSData*)data error:(NSError* _Nullable*)error
+{
+    const uint8_t* bytes = data.bytes;
+    const size_t length = data.length;
+    if (length < 12) {
+        if (error) {
+            *error = [self errorWithCode:AudioDurationErrorUnreadable description:@"Too short for any audio container"];
+        }
+        return nil;
+    }
+
+    unsigned long long frames = 0;
+    double sampleRate = 0.0;
+    AudioDurationSource source = AudioDurationSourceFrameScan;
+    BOOL resolved = NO;
+
+    if ((matches(bytes, "RIFF") || matches(bytes, "RF64") || matches(bytes, "BW64")) && matches(bytes + 8, "WAVE")) {
+        resolved = resolveWAVE(bytes, length, &frames, &sampleRate, &source);
+    } else if (matches(bytes, "FORM") && (matches(bytes + 8, "AIFF") || matches(bytes + 8, "AIFC"))) {
+        resolved = resolveAIFF(bytes, length, &frames, &sampleRate, &source);
+    } else if (matches(bytes + 4, "ftyp") || matches(bytes + 4, "moov")) {
+        resolved = resolveMP4(bytes, length, &frames, &sampleRate, &source);
+    } else if (memcmp(bytes, "ID3", 3) == 0 || (bytes[0] == 0xFF && (bytes[1] & 0xE0) == 0xE0)) {
+        resolved = resolveMPEG(bytes, length, &frames, &sampleRate, &source);
+    } else {
+        if (error) {
+            *error = [self errorWithCode:AudioDurationErrorUnsupported description:@"Unknown audio container"];
+        }
+        return nil;
+    }
+
+    if (!resolved || sampleRate <= 0.0) {
+        if (error) {
+            *error = [self errorWithCode:AudioDurationErrorMalformed description:@"No duration in container headers"];
+        }
+        return nil;
+    }
+    return [[self alloc] initWithFrames:frames sampleRate:sampleRate source:source];
+}
+
+@end
@@ -0,0 +1,24 @@
+//
+//  FileSampleDecoder.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "SampleDecoder.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Decodes straight from the sample's source file, without an output device,
+/// playback backend or resampler.
+///
+/// Meant for headless analysis where an `AudioController` is not available or
+/// too heavy to keep one per worker.
+@interface FileSampleDecoder : NSObject <SampleDecoder>
+
+@end
+
+NS_ASSUME_NONNULL_END
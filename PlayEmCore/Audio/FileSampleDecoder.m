@@ -0,0 +1,136 @@
+//
+//  FileSampleDecoder.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "FileSampleDecoder.h"
+
+#import <AVFoundation/AVFoundation.h>
+
+#import "../Sample/LazySample.h"
+
+/// Has to match the page size of `LazySample`.
+static const AVAudioFrameCount kFileDecoderPageFrames = 16384;
+
+@implementation FileSampleDecoder {
+    dispatch_block_t _decodeOperation;
+}
+
++ (BOOL)decode:(LazySample*)sample pageHandler:(DecodedPageBlock _Nullable)pageHandler cancelTest:(BOOL (^)(void))cancelTest
+{
+    AVAudioFile* file = sample.source;
+    AVAudioFormat* format = file.processingFormat;
+    AVAudioChannelCount channelCount = format.channelCount;
+    double rate = sample.fileSampleRate;
+
+    sample.sampleFormat = (SampleFormat){.channels = sample.sampleFormat.channels, .rate = (long) rate};
+    sample.renderedSampleRate = rate;
+    [sample setRenderedLength:(unsigned long long) file.length];
+
+    AVAudioPCMBuffer* buffer = [[AVAudioPCMBuffer alloc] initWithPCMFormat:format frameCapacity:kFileDecoderPageFrames];
+    file.framePosition = 0;
+
+    unsigned long long pageIndex = 0;
+    unsigned long long totalFrames = 0;
+    BOOL ret = YES;
+    BOOL endOfFile = NO;
+
+    while (!endOfFile) {
+        if (cancelTest()) {
+            ret = NO;
+            break;
+        }
+
+        // Fill a full page; compressed sources may hand out less per read.
+        NSMutableArray<NSMutableData*>* channels = [NSMutableArray arrayWithCapacity:channelCount];
+        for (AVAudioChannelCount channel = 0; channel < channelCount; channel++) {
+            [channels addObject:[NSMutableData dataWithCapacity:kFileDecoderPageFrames * sizeof(float)]];
+        }
+        AVAudioFrameCount pageFrames = 0;
+        while (pageFrames < kFileDecoderPageFrames) {
+            NSError* readError = nil;
+            buffer.frameLength = 0;
+            if (![file readIntoBuffer:buffer frameCount:kFileDecoderPageFrames - pageFrames error:&readError]) {
+                NSLog(@"FileSampleDecoder: read failed: %@", readError);
+                ret = NO;
+                endOfFile = YES;
+                break;
+            }
+            if (buffer.frameLength == 0) {
+                endOfFile = YES;
+                break;
+            }
+            for (AVAudioChannelCount channel = 0; channel < channelCount; channel++) {
+                [channels[channel] appendBytes:buffer.floatChannelData[channel] length:buffer.frameLength * sizeof(float)];
+            }
+            pageFrames += buffer.frameLength;
+        }
+        if (!ret) {
+            break;
+        }
+        if (pageFrames == 0) {
+            break;
+        }
+
+        NSArray<NSData*>* page = [channels copy];
+        [sample addLazyPageIndex:pageIndex channels:page];
+        if (pageHandler != nil) {
+            pageHandler(totalFrames, pageFrames, page);
+        }
+        pageIndex++;
+        totalFrames += pageFrames;
+    }
+
+    [sample setRenderedLength:totalFrames];
+    [sample markDecodingComplete];
+    return ret;
+}
+
+- (void)decodeAsyncForAnalysisWithSample:(LazySample*)sample
+                             pageHandler:(DecodedPageBlock _Nullable)pageHandler
+                         completionQueue:(dispatch_queue_t _Nullable)queue
+                                callback:(void (^)(BOOL))callback
+{
+    __block BOOL done = NO;
+    __weak __block dispatch_block_t weakBlock;
+
+    dispatch_block_t block = dispatch_block_create(DISPATCH_BLOCK_NO_QOS_CLASS, ^{
+        done = [FileSampleDecoder decode:sample
+                             pageHandler:pageHandler
+                              cancelTest:^BOOL {
+                                  return dispatch_block_testcancel(weakBlock) != 0 ? YES : NO;
+                              }];
+    });
+
+    weakBlock = block;
+    @synchronized(self) {
+        _decodeOperation = block;
+    }
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), block);
+
+    dispatch_block_notify(block, queue ?: dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        callback(done);
+    });
+}
+
+- (void)decodeAbortWithCallback:(void (^)(void))callback
+{
+    dispatch_block_t block = nil;
+    @synchronized(self) {
+        block = _decodeOperation;
+    }
+    if (block == NULL) {
+        callback();
+        return;
+    }
+    dispatch_block_cancel(block);
+    // Not the main queue; headless callers may block it while waiting.
+    dispatch_block_notify(block, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        callback();
+    });
+}
+
+@end
@@ -0,0 +1,42 @@
+//
+//  SampleDecoder.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#ifndef SampleDecoder_h
+#define SampleDecoder_h
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class LazySample;
+
+/// Receives every decoded page right after it got added to the sample.
+typedef void (^DecodedPageBlock)(unsigned long long frameOffset, unsigned long long frameCount, NSArray<NSData*>* channels);
+
+/// Something that can fill a `LazySample` with decoded pages for analysis.
+@protocol SampleDecoder <NSObject>
+
+/// Asynchronously decode a sample at its file sample rate, handing each decoded page to a handler.
+///
+/// - Parameters:
+///   - sample: Sample to decode.
+///   - pageHandler: Invoked on the decoder thread for every decoded page, in order.
+///   - queue: Completion queue (defaults to global utility queue when nil).
+///   - callback: Completion invoked on the queue, YES on success.
+- (void)decodeAsyncForAnalysisWithSample:(LazySample*)sample
+                             pageHandler:(DecodedPageBlock _Nullable)pageHandler
+                         completionQueue:(dispatch_queue_t _Nullable)queue
+                                callback:(void (^)(BOOL))callback;
+
+/// Abort pending decode; callback once aborted.
+- (void)decodeAbortWithCallback:(void (^)(void))callback;
+
+@end
+
+NS_ASSUME_NONNULL_END
+#endif /* SampleDecoder_h */
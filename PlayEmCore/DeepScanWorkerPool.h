@@ -0,0 +1,108 @@
+//
+//  DeepScanWorkerPool.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class LibraryStore;
+
+/// A claimed URL being scanned.
+@interface DeepScanJob : NSObject
+
+@property (readonly, nonatomic) NSURL* url;
+/// Stable slot index below `2 * workerCount` that may be used to pick
+/// per-worker resources; suspended jobs keep theirs.
+@property (readonly, nonatomic) NSUInteger worker;
+/// Queue priority the URL was claimed with (0 = low, 1 = high).
+@property (readonly, nonatomic) NSInteger priority;
+@property (readonly, nonatomic) BOOL suspended;
+/// Set by the work handler once it has something that can be held, cleared
+/// when done. Invoked with YES for suspending and NO for resuming, right away
+/// when the job already is suspended.
+@property (copy, nonatomic, nullable) void (^suspendHandler)(BOOL suspend);
+
+@end
+
+/// Scans the URL of a job. Returns YES on success.
+typedef BOOL (^DeepScanWorkHandler)(DeepScanJob* job);
+
+/// Runs before each claim on the dispatcher; return YES when it did some work
+/// so the dispatcher re-evaluates before claiming the next URL.
+typedef BOOL (^DeepScanMaintenanceHandler)(void);
+
+/// Claims pending deep scans from a `LibraryStore` and runs them on a fixed
+/// number of concurrent workers.
+///
+/// A single dispatcher thread claims URLs in priority order, so no URL is handed
+/// out twice. Before a claimed URL is started, its decoded PCM footprint is
+/// estimated and the URL waits until it fits into the memory budget. A URL larger
+/// than the whole budget still runs, but only when no other worker is busy.
+///
+/// Running jobs get suspended, not aborted, to make room: for a high priority
+/// URL while all workers are busy with low priority ones, and while foreground
+/// activity is going on. Suspended jobs resume where they stopped once a
+/// worker is available again.
+@interface DeepScanWorkerPool : NSObject
+
+@property (readonly, nonatomic) NSUInteger workerCount;
+/// Upper bound in bytes for the summed memory estimates of running scans.
+@property (readonly, nonatomic) unsigned long long memoryBudget;
+/// When set, no further URLs get started; running scans complete.
+@property (assign, nonatomic) BOOL paused;
+@property (copy, nonatomic, nullable) DeepScanMaintenanceHandler maintenanceHandler;
+
+/// Scans allowed to keep running while foreground activity is going on.
+@property (assign, nonatomic) NSUInteger foregroundWorkerLimit;
+
+/// Number of scans currently running, not counting suspended ones.
+@property (readonly, nonatomic) NSUInteger activeCount;
+/// Number of scans currently suspended.
+@property (readonly, nonatomic) NSUInteger suspendedCount;
+/// Summed memory estimate of the running scans, in bytes.
+@property (readonly, nonatomic) unsigned long long memoryInUse;
+/// Scans finished successfully since start.
+@property (readonly, nonatomic) NSUInteger completedCount;
+/// Scans that failed since start.
+@property (readonly, nonatomic) NSUInteger failedCount;
+/// Successfully finished scans per minute, measured over the last minute.
+/// Failed ones only show in `failedCount`; they tend to end early.
+@property (readonly, nonatomic) double throughput;
+
+/// Worker count matching the machine, leaving room for playback and UI.
++ (NSUInteger)defaultWorkerCount;
+/// Memory budget matching the machine.
++ (unsigned long long)defaultMemoryBudget;
+/// Estimated peak memory needed for scanning a file, in bytes.
++ (unsigned long long)estimatedMemoryCostForURL:(NSURL*)url;
+
+- (instancetype)initWithStore:(LibraryStore*)store
+                  workerCount:(NSUInteger)workerCount
+                 memoryBudget:(unsigned long long)memoryBudget
+                  workHandler:(DeepScanWorkHandler)workHandler;
+
+- (void)start;
+/// Stop claiming; running scans complete in the background.
+- (void)stop;
+/// Nudge the dispatcher, e.g. after new URLs got enqueued.
+- (void)wake;
+/// Move queued URLs to the front, e.g. rows that just became visible.
+- (void)prioritizeURLs:(NSArray<NSURL*>*)urls;
+
+/// Playback, identification and the like; calls nest. Scans beyond
+/// `foregroundWorkerLimit` get suspended until a while after the last one
+/// ended.
+- (void)beginForegroundActivity;
+- (void)endForegroundActivity;
+
+/// Entries still waiting for a scan, not counting the running ones; -1 on error.
+- (NSInteger)queueDepth;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,545 @@
+//
+//  DeepScanWorkerPool.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "DeepScanWorkerPool.h"
+
+#import <AVFoundation/AVFoundation.h>
+
+#import "AnalysisPipeline.h"
+#import "LibraryStore.h"
+
+static const NSTimeInterval kDeepScanPoolIdleInterval = 8.0;
+static const NSTimeInterval kDeepScanPoolThroughputWindow = 60.0;
+/// Trackers, converter buffers and analyzer state on top of the decoded PCM.
+static const unsigned long long kDeepScanPoolBaseCost = 32ULL * 1024ULL * 1024ULL;
+static const unsigned long long kDeepScanPoolMaximumBudget = 4ULL * 1024ULL * 1024ULL * 1024ULL;
+/// Foreground activity often comes in bursts, e.g. skipping through tracks.
+static const NSTimeInterval kDeepScanPoolBackOffDelay = 10.0;
+
+@interface DeepScanJob ()
+
+@property (strong, nonatomic) NSURL* url;
+@property (assign, nonatomic) NSUInteger worker;
+@property (assign, nonatomic) NSInteger priority;
+@property (assign, nonatomic) unsigned long long cost;
+/// Claim order, for telling older from newer jobs.
+@property (assign, nonatomic) NSUInteger sequence;
+
+- (void)setSuspended:(BOOL)suspended;
+
+@end
+
+@implementation DeepScanJob {
+    BOOL _suspended;
+    void (^_suspendHandler)(BOOL);
+}
+
+- (BOOL)suspended
+{
+    @synchronized(self) {
+        return _suspended;
+    }
+}
+
+- (void)setSuspended:(BOOL)suspended
+{
+    void (^handler)(BOOL) = nil;
+    @synchronized(self) {
+        if (_suspended == suspended) {
+            return;
+        }
+        _suspended = suspended;
+        handler = _suspendHandler;
+    }
+    NSLog(@"Deep scan pool: %@ %@", suspended ? @"suspending" : @"resuming", _url.lastPathComponent);
+    if (handler != nil) {
+        handler(suspended);
+    }
+}
+
+- (void (^)(BOOL))suspendHandler
+{
+    @synchronized(self) {
+        return _suspendHandler;
+    }
+}
+
+- (void)setSuspendHandler:(void (^)(BOOL))suspendHandler
+{
+    BOOL suspended = NO;
+    @synchronized(self) {
+        _suspendHandler = [suspendHandler copy];
+        suspended = _suspended;
+    }
+    if (suspendHandler != nil && suspended) {
+        suspendHandler(YES);
+    }
+}
+
+@end
+
+@implementation DeepScanWorkerPool {
+    LibraryStore* _store;
+    DeepScanWorkHandler _workHandler;
+    dispatch_queue_t _dispatchQueue;
+    dispatch_queue_t _workQueue;
+    dispatch_semaphore_t _wake;
+    NSMutableIndexSet* _freeWorkers;
+    NSMutableArray<DeepScanJob*>* _jobs;
+    NSUInteger _jobSequence;
+    NSUInteger _foregroundActivities;
+    CFAbsoluteTime _foregroundEndedAt;
+    NSMutableArray<NSNumber*>* _completionTimes;
+    unsigned long long _memoryInUse;
+    NSUInteger _completedCount;
+    NSUInteger _failedCount;
+    BOOL _paused;
+    BOOL _started;
+    BOOL _stop;
+}
+
++ (NSUInteger)defaultWorkerCount
+{
+    NSUInteger cores = [NSProcessInfo processInfo].activeProcessorCount;
+    return MAX(1, cores / 2);
+}
+
++ (unsigned long long)defaultMemoryBudget
+{
+    unsigned long long physical = [NSProcessInfo processInfo].physicalMemory;
+    return MIN(physical / 4, kDeepScanPoolMaximumBudget);
+}
+
++ (unsigned long long)estimatedMemoryCostForURL:(NSURL*)url
+{
+    // Analysis decodes at the file rate into float pages. Those are streamed,
+    // so no more than the streaming window stays resident.
+    AVAudioFile* file = [[AVAudioFile alloc] initForReading:url error:nil];
+    if (file == nil) {
+        return kDeepScanPoolBaseCost;
+    }
+    unsigned long long frames = file.length > 0 ? (unsigned long long) file.length : 0;
+    frames = MIN(frames, (unsigned long long) (kAnalysisStreamingWindow * file.processingFormat.sampleRate));
+    unsigned long long channels = file.processingFormat.channelCount;
+    return kDeepScanPoolBaseCost + frames * channels * sizeof(float);
+}
+
+- (instancetype)initWithStore:(LibraryStore*)store
+                  workerCount:(NSUInteger)workerCount
+                 memoryBudget:(unsigned long long)memoryBudget
+                  workHandler:(DeepScanWorkHandler)workHandler
+{
+    self = [super init];
+    if (self) {
+        _store = store;
+        _workerCount = MAX(1, workerCount);
+        _memoryBudget = memoryBudget;
+        _workHandler = [workHandler copy];
+        _wake = dispatch_semaphore_create(0);
+        // Suspended jobs keep their slot, hence twice as many as may run.
+        _freeWorkers = [NSMutableIndexSet indexSetWithIndexesInRange:NSMakeRange(0, _workerCount * 2)];
+        _jobs = [NSMutableArray array];
+        _jobSequence = 0;
+        _foregroundActivities = 0;
+        _foregroundEndedAt = 0.0;
+        _foregroundWorkerLimit = 0;
+        _completionTimes = [NSMutableArray array];
+        _dispatchQueue = dispatch_queue_create("PlayEm.DeepScanQueue", DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_attr_t attr = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_CONCURRENT, QOS_CLASS_UTILITY, 0);
+        _workQueue = dispatch_queue_create("PlayEm.DeepScanWorkers", attr);
+    }
+    return self;
+}
+
+#pragma mark - Counters
+
+- (NSUInteger)activeCount
+{
+    @synchronized(self) {
+        return [self runningJobs].count;
+    }
+}
+
+- (NSUInteger)suspendedCount
+{
+    @synchronized(self) {
+        return _jobs.count - [self runningJobs].count;
+    }
+}
+
+/// Has to be called while synchronized on self.
+- (NSArray<DeepScanJob*>*)runningJobs
+{
+    return [_jobs filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(DeepScanJob* job, NSDictionary* bindings) {
+                      return !job.suspended;
+                  }]];
+}
+
+- (unsigned long long)memoryInUse
+{
+    @synchronized(self) {
+        return _memoryInUse;
+    }
+}
+
+- (NSUInteger)completedCount
+{
+    @synchronized(self) {
+        return _completedCount;
+    }
+}
+
+- (NSUInteger)failedCount
+{
+    @synchronized(self) {
+        return _failedCount;
+    }
+}
+
+- (double)throughput
+{
+    @synchronized(self) {
+        [self pruneCompletionTimes];
+        return (double) _completionTimes.count * 60.0 / kDeepScanPoolThroughputWindow;
+    }
+}
+
+- (void)pruneCompletionTimes
+{
+    NSTimeInterval cutoff = [NSDate timeIntervalSinceReferenceDate] - kDeepScanPoolThroughputWindow;
+    while (_completionTimes.count > 0 && _completionTimes[0].doubleValue < cutoff) {
+        [_completionTimes removeObjectAtIndex:0];
+    }
+}
+
+- (NSInteger)queueDepth
+{
+    NSInteger outstanding = [_store deepScanOutstandingCount:nil];
+    if (outstanding < 0) {
+        return -1;
+    }
+    NSUInteger claimed = 0;
+    @synchronized(self) {
+        claimed = _jobs.count;
+    }
+    return MAX(0, outstanding - (NSInteger) claimed);
+}
+
+#pragma mark - Control
+
+- (void)setPaused:(BOOL)paused
+{
+    @synchronized(self) {
+        _paused = paused;
+    }
+    [self wake];
+}
+
+- (BOOL)paused
+{
+    @synchronized(self) {
+        return _paused;
+    }
+}
+
+- (void)start
+{
+    @synchronized(self) {
+        if (_started) {
+            return;
+        }
+        _started = YES;
+        _stop = NO;
+    }
+
+    NSError* resetError = nil;
+    if (![_store resetDeepScanRunningState:&resetError]) {
+        NSLog(@"Deep scan pool: reset failed: %@", resetError);
+    }
+
+    NSLog(@"Deep scan pool: starting %lu workers, %llu MB budget",
+          (unsigned long) _workerCount, _memoryBudget / (1024ULL * 1024ULL));
+
+    DeepScanWorkerPool* __weak weakSelf = self;
+    dispatch_async(_dispatchQueue, ^{
+        [weakSelf runDispatcher];
+    });
+}
+
+- (void)stop
+{
+    NSArray<DeepScanJob*>* jobs = nil;
+    @synchronized(self) {
+        _stop = YES;
+        _started = NO;
+        jobs = [_jobs copy];
+    }
+    // Running scans complete in the background, suspended ones included.
+    for (DeepScanJob* job in jobs) {
+        [job setSuspended:NO];
+    }
+    [self wake];
+}
+
+- (void)wake
+{
+    dispatch_semaphore_signal(_wake);
+}
+
+- (void)prioritizeURLs:(NSArray<NSURL*>*)urls
+{
+    if (urls.count == 0) {
+        return;
+    }
+    NSError* error = nil;
+    if (![_store prioritizeDeepScanForURLs:urls error:&error]) {
+        NSLog(@"Deep scan pool: prioritizing failed: %@", error);
+        return;
+    }
+    [self wake];
+}
+
+- (void)beginForegroundActivity
+{
+    @synchronized(self) {
+        _foregroundActivities += 1;
+    }
+    [self wake];
+}
+
+- (void)endForegroundActivity
+{
+    @synchronized(self) {
+        if (_foregroundActivities == 0) {
+            return;
+        }
+        _foregroundActivities -= 1;
+        _foregroundEndedAt = CFAbsoluteTimeGetCurrent();
+    }
+    DeepScanWorkerPool* __weak weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (kDeepScanPoolBackOffDelay * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        [weakSelf wake];
+    });
+}
+
+#pragma mark - Dispatcher
+
+/// Number of jobs that may run right now.
+- (NSUInteger)allowedRunningCount
+{
+    @synchronized(self) {
+        BOOL backingOff = _foregroundActivities > 0 || CFAbsoluteTimeGetCurrent() - _foregroundEndedAt < kDeepScanPoolBackOffDelay;
+        return backingOff ? MIN(_foregroundWorkerLimit, _workerCount) : _workerCount;
+    }
+}
+
+/// Suspends jobs beyond the allowed count, lowest priority and newest first,
+/// and resumes suspended ones when there is room, in the opposite order.
+- (void)rebalanceJobs
+{
+    NSUInteger allowed = [self allowedRunningCount];
+    NSMutableArray<DeepScanJob*>* suspend = [NSMutableArray array];
+    NSMutableArray<DeepScanJob*>* resume = [NSMutableArray array];
+    @synchronized(self) {
+        NSArray<DeepScanJob*>* ordered = [_jobs sortedArrayUsingComparator:^NSComparisonResult(DeepScanJob* a, DeepScanJob* b) {
+            if (a.priority != b.priority) {
+                return a.priority > b.priority ? NSOrderedAscending : NSOrderedDescending;
+            }
+            return a.sequence < b.sequence ? NSOrderedAscending : NSOrderedDescending;
+        }];
+        NSUInteger running = [self runningJobs].count;
+        if (running > allowed) {
+            for (DeepScanJob* job in ordered.reverseObjectEnumerator) {
+                if (running <= allowed) {
+                    break;
+                }
+                if (!job.suspended) {
+                    [suspend addObject:job];
+                    running--;
+                }
+            }
+        } else {
+            for (DeepScanJob* job in ordered) {
+                if (running >= allowed) {
+                    break;
+                }
+                if (job.suspended) {
+                    [resume addObject:job];
+                    running++;
+                }
+            }
+        }
+    }
+    for (DeepScanJob* job in suspend) {
+        [job setSuspended:YES];
+    }
+    for (DeepScanJob* job in resume) {
+        [job setSuspended:NO];
+    }
+}
+
+/// Suspends the newest running low priority job to make room for a high
+/// priority one. Returns NO when there is none or no slot left to park it.
+- (BOOL)preemptLowPriorityJob
+{
+    DeepScanJob* victim = nil;
+    @synchronized(self) {
+        if (_freeWorkers.count == 0) {
+            return NO;
+        }
+        for (DeepScanJob* job in [self runningJobs]) {
+            if (job.priority > 0) {
+                continue;
+            }
+            if (victim == nil || job.sequence > victim.sequence) {
+                victim = job;
+            }
+        }
+    }
+    if (victim == nil) {
+        return NO;
+    }
+    [victim setSuspended:YES];
+    return YES;
+}
+
+- (BOOL)hasPreemptableJob
+{
+    @synchronized(self) {
+        if (_freeWorkers.count == 0) {
+            return NO;
+        }
+        for (DeepScanJob* job in [self runningJobs]) {
+            if (job.priority == 0) {
+                return YES;
+            }
+        }
+        return NO;
+    }
+}
+
+- (void)idle
+{
+    dispatch_semaphore_wait(_wake, dispatch_time(DISPATCH_TIME_NOW, (int64_t) (kDeepScanPoolIdleInterval * NSEC_PER_SEC)));
+}
+
+- (BOOL)shouldStop
+{
+    @synchronized(self) {
+        return _stop;
+    }
+}
+
+- (void)runDispatcher
+{
+    // A URL that got claimed but could not be started yet.
+    NSURL* claimed = nil;
+    NSInteger claimedPriority = 0;
+    unsigned long long claimedCost = 0;
+
+    while (![self shouldStop]) {
+        @autoreleasepool {
+            if (_maintenanceHandler != nil && _maintenanceHandler()) {
+                continue;
+            }
+            [self rebalanceJobs];
+            if (self.paused) {
+                [self idle];
+                continue;
+            }
+
+            BOOL full = self.activeCount >= [self allowedRunningCount];
+            if (claimed == nil) {
+                // While full, only a high priority URL may get claimed, making
+                // room by preempting a low priority job.
+                if (full && ![self hasPreemptableJob]) {
+                    [self idle];
+                    continue;
+                }
+                NSError* claimError = nil;
+                NSArray<NSNumber*>* priorities = nil;
+                NSArray<NSURL*>* urls = [_store claimDeepScanURLs:1 minimumPriority:full ? 1 : 0 priorities:&priorities error:&claimError];
+                if (urls.count == 0) {
+                    if (claimError) {
+                        NSLog(@"Deep scan pool: claim failed: %@", claimError);
+                    }
+                    [self idle];
+                    continue;
+                }
+                claimed = urls.firstObject;
+                claimedPriority = priorities.firstObject.integerValue;
+                claimedCost = [DeepScanWorkerPool estimatedMemoryCostForURL:claimed];
+            }
+
+            if (full && (claimedPriority == 0 || ![self preemptLowPriorityJob])) {
+                [self idle];
+                continue;
+            }
+
+            DeepScanJob* job = nil;
+            @synchronized(self) {
+                if (_freeWorkers.count > 0 && (_jobs.count == 0 || _memoryInUse + claimedCost <= _memoryBudget)) {
+                    job = [DeepScanJob new];
+                    job.url = claimed;
+                    job.priority = claimedPriority;
+                    job.cost = claimedCost;
+                    job.worker = _freeWorkers.firstIndex;
+                    job.sequence = _jobSequence++;
+                    [_freeWorkers removeIndex:job.worker];
+                    [_jobs addObject:job];
+                    _memoryInUse += claimedCost;
+                }
+            }
+            if (job == nil) {
+                // Wait for a running scan to release its share.
+                [self idle];
+                continue;
+            }
+
+            [self runJob:job];
+            claimed = nil;
+            claimedPriority = 0;
+            claimedCost = 0;
+        }
+    }
+
+    if (claimed != nil) {
+        NSError* error = nil;
+        if (![_store enqueueDeepScanForURLs:@[ claimed ] priority:claimedPriority error:&error]) {
+            NSLog(@"Deep scan pool: failed to re-enqueue %@: %@", claimed, error);
+        }
+    }
+    NSLog(@"Deep scan pool: stopped");
+}
+
+- (void)runJob:(DeepScanJob*)job
+{
+    DeepScanWorkHandler handler = _workHandler;
+    dispatch_async(_workQueue, ^{
+        BOOL success = NO;
+        @autoreleasepool {
+            success = handler(job);
+        }
+        job.suspendHandler = nil;
+        @synchronized(self) {
+            [self->_jobs removeObject:job];
+            [self->_freeWorkers addIndex:job.worker];
+            self->_memoryInUse -= job.cost;
+            if (success) {
+                self->_completedCount += 1;
+                [self->_completionTimes addObject:@([NSDate timeIntervalSinceReferenceDate])];
+            } else {
+                self->_failedCount += 1;
+            }
+            [self pruneCompletionTimes];
+        }
+        [self wake];
+    });
+}
+
+@end
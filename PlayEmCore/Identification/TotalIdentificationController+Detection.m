@@ -372,6 +372,8 @@ static uint64_t HashAudioSlice(float* const* channels, uint32_t channelCount, AV
                                                     }];
                                                 }];
 
+    [[NSNotificationCenter defaultCenter] postNotificationName:kTotalIdentificationControllerDidStartNotification object:self];
+
     dispatch_block_t block = dispatch_block_create(DISPATCH_BLOCK_NO_QOS_CLASS, ^{
         __strong typeof(weakSelf) strongSelf = weakSelf;
         if (strongSelf == nil) {
@@ -405,9 +407,11 @@ static uint64_t HashAudioSlice(float* const* channels, uint32_t channelCount, AV
     if (_queueOperation != NULL) {
         dispatch_block_cancel(_queueOperation);
         dispatch_block_notify(_queueOperation, dispatch_get_main_queue(), ^{
+            [[NSNotificationCenter defaultCenter] postNotificationName:kTotalIdentificationControllerDidFinishNotification object:self];
             callback();
         });
     } else {
+        [[NSNotificationCenter defaultCenter] postNotificationName:kTotalIdentificationControllerDidFinishNotification object:self];
         callback();
     }
 }
@@ -496,6 +500,7 @@ static uint64_t HashAudioSlice(float* const* channels, uint32_t channelCount, AV
         [[ActivityManager shared] updateActivity:_token detail:PECLocalizedString(@"activity.tracklist_detection.refinement_done", @"Detail when tracklist refinement is done")];
     }
     [[ActivityManager shared] completeActivity:_token];
+    [[NSNotificationCenter defaultCenter] postNotificationName:kTotalIdentificationControllerDidFinishNotification object:self];
 
     if (_completionHandler) {
         __weak typeof(self) weakSelf = self;
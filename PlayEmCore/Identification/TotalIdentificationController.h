@@ -16,6 +16,11 @@ NS_ASSUME_NONNULL_BEGIN
 @class ActivityToken;
 @class TimedMediaMetaData;
 
+/// Posted with the controller as object when tracklist detection starts and
+/// when it finished, failed or got aborted.
+extern NSString* const kTotalIdentificationControllerDidStartNotification;
+extern NSString* const kTotalIdentificationControllerDidFinishNotification;
+
 @interface TotalIdentificationController : NSObject <SHSessionDelegate>
 
 - (id)initWithSample:(LazySample*)sample;
@@ -14,6 +14,9 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+NSString* const kTotalIdentificationControllerDidStartNotification = @"TotalIdentificationControllerDidStartNotification";
+NSString* const kTotalIdentificationControllerDidFinishNotification = @"TotalIdentificationControllerDidFinishNotification";
+
 // Test-only setter to inject raw hits for refinement without exposing the
 // property publicly.
 #ifdef DEBUG
@@ -0,0 +1,71 @@
+//
+//  LibraryColumns.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class MediaMetaData;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Fields of library items that get held in columns. Tags hold any number of
+/// values per item.
+typedef NS_ENUM(NSInteger, LibraryColumn) {
+    LibraryColumnGenre,
+    LibraryColumnArtist,
+    LibraryColumnAlbum,
+    LibraryColumnTempo,
+    LibraryColumnKey,
+    LibraryColumnRating,
+    LibraryColumnYear,
+    LibraryColumnTags,
+};
+
+/// Snapshot of the library in columns: each field of all items as one
+/// contiguous array of codes into a dictionary of the distinct values, each
+/// value held once. Filtering, faceting and sorting by those fields compare
+/// integers instead of chasing strings across the heap.
+///
+/// Values are what the browser lists: tempos and years as rendered by
+/// `NSNumber.stringValue`, ratings as stars; empty values, tempos, years and
+/// ratings below 1 count as none. Changes of the items after the snapshot got
+/// taken are not seen.
+@interface LibraryColumns : NSObject
+
+- (instancetype)initWithItems:(NSArray<MediaMetaData*>*)items;
+
+@property (readonly, nonatomic) NSArray<MediaMetaData*>* items;
+/// Bytes held by the codes and the distinct values.
+@property (readonly, nonatomic) size_t footprint;
+
+/// Distinct values of `column`.
+- (NSUInteger)valueCountOfColumn:(LibraryColumn)column;
+
+/// Rows holding all the given values, keyed by column.
+- (NSIndexSet*)rowsMatchingValues:(NSDictionary<NSNumber*, NSString*>*)values;
+
+/// Distinct values of `column` with the number of rows holding each, counting
+/// just `rows`, or all rows when nil.
+- (NSDictionary<NSString*, NSNumber*>*)valuesOfColumn:(LibraryColumn)column rows:(NSIndexSet* _Nullable)rows;
+
+/// Rows of the given items, found by identity; nil when any is not part of
+/// the snapshot.
+- (NSIndexSet* _Nullable)rowsOfItems:(NSArray<MediaMetaData*>*)items;
+
+- (NSArray<MediaMetaData*>*)itemsAtRows:(NSIndexSet*)rows;
+
+/// Items at `rows` sorted like `sortedArrayUsingDescriptors:` would, rows
+/// comparing the same staying in order. Each key and selector gets ranked
+/// once per snapshot, so that sorting compares integers; the last few sorts of
+/// all rows are kept, so that sorting again, the other way around or just
+/// some of the rows picks from those. Nil for descriptors comparing by block
+/// or values that cannot be compared.
+- (NSArray<MediaMetaData*>* _Nullable)itemsAtRows:(NSIndexSet*)rows sortedUsingDescriptors:(NSArray<NSSortDescriptor*>*)descriptors;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,479 @@
+//
+//  LibraryColumns.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "LibraryColumns.h"
+
+#include <stdlib.h>
+
+#import "MediaMetaData.h"
+
+/// Columns holding one value per row; tags come after those.
+static const NSUInteger kSingleValueColumnCount = LibraryColumnTags;
+static const NSUInteger kColumnCount = LibraryColumnTags + 1;
+
+/// Code of rows holding no value.
+static const uint32_t kNoValue = 0;
+
+/// Single value of `column` the browser lists for `meta`, nil for none.
+static NSString* columnValue(MediaMetaData* meta, LibraryColumn column)
+{
+    switch (column) {
+    case LibraryColumnGenre:
+        return meta.genre;
+    case LibraryColumnArtist:
+        return meta.artist;
+    case LibraryColumnAlbum:
+        return meta.album;
+    case LibraryColumnKey:
+        return meta.key;
+    case LibraryColumnTempo:
+        return meta.tempo.intValue > 0 ? meta.tempo.stringValue : nil;
+    case LibraryColumnYear:
+        return meta.year.intValue > 0 ? meta.year.stringValue : nil;
+    case LibraryColumnRating:
+        return meta.rating.intValue > 0 ? meta.stars : nil;
+    case LibraryColumnTags:
+        break;
+    }
+    return nil;
+}
+
+/// Sorts of all rows kept for sorting again.
+static const NSUInteger kSortPermutationLimit = 4;
+/// Sorting fewer than one in this many rows sorts just those, unless a sort of
+/// all rows got kept.
+static const NSUInteger kSubsetSortShare = 8;
+
+/// What a sort descriptor compares, regardless of its direction.
+static NSString* sortKeyIdentity(NSSortDescriptor* descriptor)
+{
+    return [NSString stringWithFormat:@"%@ %@", descriptor.key, NSStringFromSelector(descriptor.selector)];
+}
+
+static int compareRows(uint32_t rowA, uint32_t rowB, const uint32_t** ranks, const BOOL* ascending, NSUInteger keyCount)
+{
+    for (NSUInteger i = 0; i < keyCount; i++) {
+        uint32_t rankA = ranks[i][rowA];
+        uint32_t rankB = ranks[i][rowB];
+        if (rankA != rankB) {
+            return (rankA < rankB) == ascending[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/// Stable, like sorting the items themselves.
+static void sortRows(uint32_t* rows, size_t count, const uint32_t** ranks, const BOOL* ascending, NSUInteger keyCount)
+{
+    mergesort_b(rows, count, sizeof(uint32_t), ^int(const void* a, const void* b) {
+        return compareRows(*(const uint32_t*) a, *(const uint32_t*) b, ranks, ascending, keyCount);
+    });
+}
+
+/// Order of all rows by some sort descriptors.
+@interface LibrarySortPermutation : NSObject
+@property (copy, nonatomic) NSArray<NSSortDescriptor*>* descriptors;
+@property (strong, nonatomic) NSData* rows;
+@end
+
+@implementation LibrarySortPermutation
+@end
+
+/// Distinct values of a column, each handed out a code in order of appearance.
+@interface LibraryColumnDictionary : NSObject
+/// Values by code; code 0 stands for none.
+@property (strong, nonatomic) NSMutableArray<NSString*>* values;
+@property (strong, nonatomic) NSMutableDictionary<NSString*, NSNumber*>* codes;
+@end
+
+@implementation LibraryColumnDictionary
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _values = [NSMutableArray arrayWithObject:@""];
+        _codes = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (uint32_t)internValue:(NSString*)value
+{
+    if (value.length == 0) {
+        return kNoValue;
+    }
+    NSNumber* code = _codes[value];
+    if (code == nil) {
+        code = @(_values.count);
+        _codes[value] = code;
+        [_values addObject:[value copy]];
+    }
+    return code.unsignedIntValue;
+}
+
+@end
+
+@implementation LibraryColumns {
+    NSUInteger _count;
+    NSArray<LibraryColumnDictionary*>* _dictionaries;
+    // Code per row of the single value columns.
+    uint32_t* _codes[kSingleValueColumnCount];
+    // Tag codes of row i are at _tagCodes[_tagOffsets[i]] up to _tagOffsets[i + 1].
+    uint32_t* _tagOffsets;
+    uint32_t* _tagCodes;
+    // Rank per row by sort descriptor key and selector.
+    NSMutableDictionary<NSString*, NSData*>* _sortKeys;
+    // Orders of all rows kept from recent sorts, most recent first.
+    NSMutableArray<LibrarySortPermutation*>* _permutations;
+    NSMapTable<MediaMetaData*, NSNumber*>* _rowsByItem;
+}
+
+- (instancetype)initWithItems:(NSArray<MediaMetaData*>*)items
+{
+    self = [super init];
+    if (self) {
+        _items = [items copy];
+        _count = _items.count;
+
+        NSMutableArray<LibraryColumnDictionary*>* dictionaries = [NSMutableArray arrayWithCapacity:kColumnCount];
+        for (NSUInteger column = 0; column < kColumnCount; column++) {
+            [dictionaries addObject:[LibraryColumnDictionary new]];
+        }
+        _dictionaries = dictionaries;
+        for (NSUInteger column = 0; column < kSingleValueColumnCount; column++) {
+            _codes[column] = calloc(MAX(_count, 1), sizeof(uint32_t));
+        }
+        _tagOffsets = calloc(_count + 1, sizeof(uint32_t));
+        NSMutableData* tagCodes = [NSMutableData data];
+        _rowsByItem = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality | NSPointerFunctionsStrongMemory
+                                            valueOptions:NSPointerFunctionsStrongMemory];
+
+        LibraryColumnDictionary* tags = _dictionaries[LibraryColumnTags];
+        for (NSUInteger row = 0; row < _count; row++) {
+            MediaMetaData* meta = _items[row];
+            [_rowsByItem setObject:@(row) forKey:meta];
+            for (NSUInteger column = 0; column < kSingleValueColumnCount; column++) {
+                _codes[column][row] = [_dictionaries[column] internValue:columnValue(meta, column)];
+            }
+            NSString* tagString = meta.tags;
+            if ([tagString hasPrefix:@"#"]) {
+                for (NSString* tag in [[tagString substringFromIndex:1] componentsSeparatedByString:@"#"]) {
+                    uint32_t code = [tags internValue:tag];
+                    if (code != kNoValue) {
+                        [tagCodes appendBytes:&code length:sizeof(code)];
+                    }
+                }
+            }
+            _tagOffsets[row + 1] = (uint32_t) (tagCodes.length / sizeof(uint32_t));
+        }
+        _tagCodes = malloc(MAX(tagCodes.length, 1));
+        memcpy(_tagCodes, tagCodes.bytes, tagCodes.length);
+
+        _sortKeys = [NSMutableDictionary dictionary];
+        _permutations = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    for (NSUInteger column = 0; column < kSingleValueColumnCount; column++) {
+        free(_codes[column]);
+    }
+    free(_tagOffsets);
+    free(_tagCodes);
+}
+
+- (size_t)footprint
+{
+    size_t bytes = (kSingleValueColumnCount + 1) * _count * sizeof(uint32_t) + _tagOffsets[_count] * sizeof(uint32_t);
+    for (LibraryColumnDictionary* dictionary in _dictionaries) {
+        for (NSString* value in dictionary.values) {
+            bytes += [value lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+        }
+    }
+    return bytes;
+}
+
+- (NSUInteger)valueCountOfColumn:(LibraryColumn)column
+{
+    return _dictionaries[column].values.count - 1;
+}
+
+- (BOOL)row:(NSUInteger)row hasTag:(uint32_t)code
+{
+    for (uint32_t i = _tagOffsets[row]; i < _tagOffsets[row + 1]; i++) {
+        if (_tagCodes[i] == code) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (NSIndexSet*)rowsMatchingValues:(NSDictionary<NSNumber*, NSString*>*)values
+{
+    NSMutableIndexSet* rows = [NSMutableIndexSet indexSet];
+    uint32_t wanted[kColumnCount];
+    BOOL constrained[kColumnCount] = {NO};
+    for (NSNumber* column in values) {
+        NSNumber* code = _dictionaries[column.integerValue].codes[values[column]];
+        if (code == nil) {
+            // No row holds that value.
+            return rows;
+        }
+        wanted[column.integerValue] = code.unsignedIntValue;
+        constrained[column.integerValue] = YES;
+    }
+
+    for (NSUInteger row = 0; row < _count; row++) {
+        BOOL match = YES;
+        for (NSUInteger column = 0; match && column < kSingleValueColumnCount; column++) {
+            match = !constrained[column] || _codes[column][row] == wanted[column];
+        }
+        if (match && constrained[LibraryColumnTags]) {
+            match = [self row:row hasTag:wanted[LibraryColumnTags]];
+        }
+        if (match) {
+            [rows addIndex:row];
+        }
+    }
+    return rows;
+}
+
+- (NSDictionary<NSString*, NSNumber*>*)valuesOfColumn:(LibraryColumn)column rows:(NSIndexSet* _Nullable)rows
+{
+    NSArray<NSString*>* values = _dictionaries[column].values;
+    NSMutableData* histogram = [NSMutableData dataWithLength:values.count * sizeof(uint32_t)];
+    uint32_t* counts = histogram.mutableBytes;
+    void (^count)(NSUInteger) = ^(NSUInteger row) {
+        if (column == LibraryColumnTags) {
+            for (uint32_t i = self->_tagOffsets[row]; i < self->_tagOffsets[row + 1]; i++) {
+                counts[self->_tagCodes[i]]++;
+            }
+        } else {
+            counts[self->_codes[column][row]]++;
+        }
+    };
+    if (rows == nil) {
+        for (NSUInteger row = 0; row < _count; row++) {
+            count(row);
+        }
+    } else {
+        [rows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL* stop) {
+            count(row);
+        }];
+    }
+
+    NSMutableDictionary<NSString*, NSNumber*>* result = [NSMutableDictionary dictionary];
+    for (uint32_t code = 1; code < values.count; code++) {
+        if (counts[code] > 0) {
+            result[values[code]] = @(counts[code]);
+        }
+    }
+    return result;
+}
+
+- (NSIndexSet* _Nullable)rowsOfItems:(NSArray<MediaMetaData*>*)items
+{
+    NSMutableIndexSet* rows = [NSMutableIndexSet indexSet];
+    for (MediaMetaData* item in items) {
+        NSNumber* row = [_rowsByItem objectForKey:item];
+        if (row == nil) {
+            return nil;
+        }
+        [rows addIndex:row.unsignedIntegerValue];
+    }
+    return rows;
+}
+
+- (NSArray<MediaMetaData*>*)itemsAtRows:(NSIndexSet*)rows
+{
+    return [_items objectsAtIndexes:rows];
+}
+
+- (NSArray<MediaMetaData*>* _Nullable)itemsAtRows:(NSIndexSet*)rows sortedUsingDescriptors:(NSArray<NSSortDescriptor*>*)descriptors
+{
+    const NSUInteger keyCount = descriptors.count;
+    const uint32_t* ranks[MAX(keyCount, 1)];
+    BOOL ascending[MAX(keyCount, 1)];
+    NSData* sorted = nil;
+    @synchronized(self) {
+        for (NSUInteger i = 0; i < keyCount; i++) {
+            NSData* sortKey = [self sortKeyForDescriptor:descriptors[i]];
+            if (sortKey == nil) {
+                return nil;
+            }
+            ranks[i] = sortKey.bytes;
+            ascending[i] = descriptors[i].ascending;
+        }
+
+        NSData* permutation = [self permutationForDescriptors:descriptors ranks:ranks];
+        if (permutation == nil && rows.count >= _count / kSubsetSortShare) {
+            NSMutableData* all = [NSMutableData dataWithLength:_count * sizeof(uint32_t)];
+            uint32_t* order = all.mutableBytes;
+            for (NSUInteger row = 0; row < _count; row++) {
+                order[row] = (uint32_t) row;
+            }
+            sortRows(order, _count, ranks, ascending, keyCount);
+            permutation = all;
+            [self keepPermutation:permutation descriptors:descriptors];
+        }
+
+        if (permutation != nil) {
+            // Walk the order of all rows, picking the ones asked for.
+            NSMutableData* wanted = [NSMutableData dataWithLength:_count];
+            uint8_t* isWanted = wanted.mutableBytes;
+            [rows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL* stop) {
+                isWanted[row] = 1;
+            }];
+            NSMutableData* picked = [NSMutableData dataWithCapacity:rows.count * sizeof(uint32_t)];
+            const uint32_t* order = permutation.bytes;
+            for (NSUInteger i = 0; i < _count; i++) {
+                if (isWanted[order[i]]) {
+                    [picked appendBytes:&order[i] length:sizeof(uint32_t)];
+                }
+            }
+            sorted = picked;
+        } else {
+            NSMutableData* some = [NSMutableData dataWithLength:rows.count * sizeof(uint32_t)];
+            uint32_t* order = some.mutableBytes;
+            __block NSUInteger fill = 0;
+            [rows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL* stop) {
+                order[fill++] = (uint32_t) row;
+            }];
+            sortRows(order, rows.count, ranks, ascending, keyCount);
+            sorted = some;
+        }
+    }
+
+    const uint32_t* order = sorted.bytes;
+    NSMutableArray<MediaMetaData*>* items = [NSMutableArray arrayWithCapacity:rows.count];
+    for (NSUInteger i = 0; i < rows.count; i++) {
+        [items addObject:_items[order[i]]];
+    }
+    return items;
+}
+
+/// Rank of each row's value for the key and selector of `descriptor`, taken on
+/// first use: rows compare by rank as their values compare by the selector,
+/// missing values ahead of all others. Nil when the values cannot be ranked.
+- (NSData* _Nullable)sortKeyForDescriptor:(NSSortDescriptor*)descriptor
+{
+    if (descriptor.key == nil || descriptor.selector == NULL) {
+        return nil;
+    }
+    NSString* identity = sortKeyIdentity(descriptor);
+    NSData* sortKey = _sortKeys[identity];
+    if (sortKey != nil) {
+        return sortKey;
+    }
+
+    NSMutableDictionary<id, NSNumber*>* codes = [NSMutableDictionary dictionary];
+    NSMutableArray* values = [NSMutableArray array];
+    NSMutableData* rowRanks = [NSMutableData dataWithLength:MAX(_count, 1) * sizeof(uint32_t)];
+    uint32_t* rankOfRow = rowRanks.mutableBytes;
+    for (NSUInteger row = 0; row < _count; row++) {
+        id value = [_items[row] valueForKeyPath:descriptor.key];
+        if (value == nil) {
+            continue;
+        }
+        NSNumber* code = codes[value];
+        if (code == nil) {
+            if (![value conformsToProtocol:@protocol(NSCopying)] || ![value respondsToSelector:descriptor.selector]) {
+                return nil;
+            }
+            [values addObject:value];
+            code = @(values.count);
+            codes[value] = code;
+        }
+        rankOfRow[row] = code.unsignedIntValue;
+    }
+
+    // Comparing the distinct values once is all the selector gets called for;
+    // values comparing the same share their rank.
+    NSSortDescriptor* comparison = [NSSortDescriptor sortDescriptorWithKey:@"self" ascending:YES selector:descriptor.selector];
+    NSArray* sortedValues = [values sortedArrayUsingDescriptors:@[ comparison ]];
+    NSMutableData* rankData = [NSMutableData dataWithLength:(values.count + 1) * sizeof(uint32_t)];
+    uint32_t* rankOfCode = rankData.mutableBytes;
+    uint32_t rank = 0;
+    for (NSUInteger i = 0; i < sortedValues.count; i++) {
+        if (i == 0 || [comparison compareObject:sortedValues[i - 1] toObject:sortedValues[i]] != NSOrderedSame) {
+            rank++;
+        }
+        rankOfCode[codes[sortedValues[i]].unsignedIntValue] = rank;
+    }
+    for (NSUInteger row = 0; row < _count; row++) {
+        rankOfRow[row] = rankOfCode[rankOfRow[row]];
+    }
+    _sortKeys[identity] = rowRanks;
+    return rowRanks;
+}
+
+/// Order of all rows by `descriptors` when kept from an earlier sort, or when
+/// one kept differs by the direction of the first descriptor only.
+- (NSData* _Nullable)permutationForDescriptors:(NSArray<NSSortDescriptor*>*)descriptors ranks:(const uint32_t**)ranks
+{
+    for (LibrarySortPermutation* kept in _permutations) {
+        if (kept.descriptors.count != descriptors.count) {
+            continue;
+        }
+        BOOL same = YES;
+        BOOL flipped = NO;
+        for (NSUInteger i = 0; same && i < descriptors.count; i++) {
+            same = [sortKeyIdentity(kept.descriptors[i]) isEqualToString:sortKeyIdentity(descriptors[i])];
+            if (kept.descriptors[i].ascending != descriptors[i].ascending) {
+                flipped = flipped || i == 0;
+                same = same && i == 0;
+            }
+        }
+        if (!same) {
+            continue;
+        }
+        NSData* permutation = kept.rows;
+        if (flipped) {
+            // Runs of equal first ranks are in order by the rest already; they
+            // just need to come in reverse.
+            NSMutableData* reversed = [NSMutableData dataWithLength:permutation.length];
+            const uint32_t* order = permutation.bytes;
+            uint32_t* reversedOrder = reversed.mutableBytes;
+            NSUInteger fill = 0;
+            NSUInteger end = _count;
+            while (end > 0) {
+                NSUInteger start = end - 1;
+                while (start > 0 && ranks[0][order[start - 1]] == ranks[0][order[end - 1]]) {
+                    start--;
+                }
+                memcpy(&reversedOrder[fill], &order[start], (end - start) * sizeof(uint32_t));
+                fill += end - start;
+                end = start;
+            }
+            permutation = reversed;
+        }
+        [self keepPermutation:permutation descriptors:descriptors];
+        return permutation;
+    }
+    return nil;
+}
+
+- (void)keepPermutation:(NSData*)permutation descriptors:(NSArray<NSSortDescriptor*>*)descriptors
+{
+    NSIndexSet* outdated = [_permutations indexesOfObjectsPassingTest:^BOOL(LibrarySortPermutation* kept, NSUInteger idx, BOOL* stop) {
+        return kept.rows == permutation || [kept.descriptors isEqualToArray:descriptors];
+    }];
+    [_permutations removeObjectsAtIndexes:outdated];
+    LibrarySortPermutation* kept = [LibrarySortPermutation new];
+    kept.descriptors = descriptors;
+    kept.rows = permutation;
+    [_permutations insertObject:kept atIndex:0];
+    if (_permutations.count > kSortPermutationLimit) {
+        [_permutations removeLastObject];
+    }
+}
+
+@end
@@ -0,0 +1,56 @@
+//
+//  LibraryFilter.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class CancelableBlockOperation;
+@class MediaMetaData;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// What the browser narrows the library down to: the values selected in the
+/// column browser and a search needle. Nil values match everything.
+@interface LibraryFilter : NSObject
+
+/// Build the search keys of the given items up front, spread over all cores,
+/// so that the first search does not have to.
++ (void)prepareSearchKeysOfItems:(NSArray<MediaMetaData*>*)items;
+
+@property (copy, nonatomic, nullable) NSString* genre;
+@property (copy, nonatomic, nullable) NSString* artist;
+@property (copy, nonatomic, nullable) NSString* album;
+@property (copy, nonatomic, nullable) NSString* tempo;
+@property (copy, nonatomic, nullable) NSString* key;
+@property (copy, nonatomic, nullable) NSString* rating;
+@property (copy, nonatomic, nullable) NSString* tag;
+@property (copy, nonatomic, nullable) NSString* needle;
+
+/// URLs (as absolute strings) the library store found for `needle`, or any
+/// superset of those. Items outside of it skip matching their text fields and
+/// only match through their key, rating, tags or tempo; nil checks them all.
+/// Either way the text fields match at word prefixes, as the index does.
+@property (strong, nonatomic, nullable) NSSet<NSString*>* indexedURLs;
+
+/// YES when every item matching the receiver matches `filter` as well, so
+/// that `filter`'s result can be narrowed down instead of filtering all over.
+/// That holds when the selections are the same and the needle got extended.
+- (BOOL)narrows:(LibraryFilter*)filter;
+
+- (BOOL)matchesItem:(MediaMetaData*)item;
+
+/// Items matching, in the order given. Returns nil once `operation` got
+/// cancelled. `firstMatches` gets called with the first `firstMatchCount`
+/// matches as soon as those are known, ahead of the rest.
+- (NSArray<MediaMetaData*>* _Nullable)filterItems:(NSArray<MediaMetaData*>*)items
+                                        operation:(CancelableBlockOperation* _Nullable)operation
+                                  firstMatchCount:(NSUInteger)firstMatchCount
+                                     firstMatches:(void (^_Nullable)(NSArray<MediaMetaData*>* matches))firstMatches;
+
+@end
+
+NS_ASSUME_NONNULL_END
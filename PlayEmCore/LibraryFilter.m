@@ -0,0 +1,140 @@
+//
+//  LibraryFilter.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "LibraryFilter.h"
+
+#import "CancelableBlockOperation.h"
+#import "MediaMetaData.h"
+#import "MediaSearchKey.h"
+
+/// Items checked between looks at the operation getting cancelled.
+static const NSUInteger kFilterCancelCheckInterval = 1024;
+/// Items whose search keys get built per block when preparing.
+static const NSUInteger kSearchKeyPrepareBatchSize = 4096;
+
+static BOOL isEqualOrBothNil(NSString* a, NSString* b)
+{
+    return a == b || [a isEqualToString:b];
+}
+
+@implementation LibraryFilter {
+    // Needle as matched against the short fields; folded unless it carries diacritics.
+    NSString* _matchNeedle;
+    // Same, as UTF-8 to search for in the items' search keys.
+    NSData* _keyNeedle;
+    // Its words, for matching the genre, title, artist and album.
+    NSArray<NSData*>* _keyWords;
+    BOOL _exactNeedle;
+}
+
++ (void)prepareSearchKeysOfItems:(NSArray<MediaMetaData*>*)items
+{
+    const size_t batches = (items.count + kSearchKeyPrepareBatchSize - 1) / kSearchKeyPrepareBatchSize;
+    dispatch_apply(batches, DISPATCH_APPLY_AUTO, ^(size_t batch) {
+        NSUInteger end = MIN((batch + 1) * kSearchKeyPrepareBatchSize, items.count);
+        for (NSUInteger i = batch * kSearchKeyPrepareBatchSize; i < end; i++) {
+            __unused MediaSearchKey* key = items[i].searchKey;
+        }
+    });
+}
+
+- (void)setNeedle:(NSString*)needle
+{
+    _needle = [needle copy];
+    if (_needle.length == 0) {
+        return;
+    }
+
+    // We need to match a bit more elaborately here. The challenge is that ie on a US-
+    // keyboard entering a U-umlaut will be hard. If now the song of desire happens to
+    // be using that letter, how shall the user ever find it? On the other hand, maybe
+    // that user actually uses a German keyboard layout and has no issue entering U-umlaut.
+    // For those users, the assumption is that a perfect match is desired and no diacritic
+    // variants should match, but the one entered.
+    //
+    // The solution is dynamically chosen matching: When entering without diacritics the
+    // diacritics-insensitive matcher is used (U matches U-umlaut). When searching for a
+    // needly with diacritics the plain matcher is used (U-umlaut only matches U-umlaut).
+    NSLocale* locale = [NSLocale currentLocale];
+    // Does the folded version equal the unfolded one? -> that baby has no diacritics.
+    NSString* folded = [_needle stringByFoldingWithOptions:NSDiacriticInsensitiveSearch locale:locale];
+    _exactNeedle = ![_needle isEqualToString:folded];
+    _matchNeedle = _exactNeedle ? _needle
+                                : [_needle stringByFoldingWithOptions:(NSDiacriticInsensitiveSearch | NSCaseInsensitiveSearch | NSWidthInsensitiveSearch)
+                                                               locale:locale];
+    _keyNeedle = [MediaSearchKey foldedNeedle:_needle exact:_exactNeedle];
+    _keyWords = [MediaSearchKey foldedWordsOfNeedle:_needle exact:_exactNeedle];
+}
+
+- (BOOL)narrows:(LibraryFilter*)filter
+{
+    return isEqualOrBothNil(_genre, filter.genre) && isEqualOrBothNil(_artist, filter.artist) && isEqualOrBothNil(_album, filter.album) &&
+           isEqualOrBothNil(_tempo, filter.tempo) && isEqualOrBothNil(_key, filter.key) && isEqualOrBothNil(_rating, filter.rating) &&
+           isEqualOrBothNil(_tag, filter.tag) && (filter.needle.length == 0 || [_needle hasPrefix:filter.needle]);
+}
+
+- (BOOL)matchesItem:(MediaMetaData*)d
+{
+    // Filter per column browser first.
+    if (!((_genre == nil || (d.genre.length && [d.genre isEqualToString:_genre])) &&
+          (_artist == nil || (d.artist.length && [d.artist isEqualToString:_artist])) &&
+          (_album == nil || (d.album.length && [d.album isEqualToString:_album])) && (_key == nil || (d.key.length && [d.key isEqualToString:_key])) &&
+          (_rating == nil || (d.rating && d.stars.length && [d.stars isEqualToString:_rating])) &&
+          (_tag == nil || [d.searchKey.tagSet containsObject:_tag]) && (_tempo == nil || (d.tempo && [[d.tempo stringValue] isEqualToString:_tempo])))) {
+        return NO;
+    }
+    // When the user entered a search needle, we additionally filter for that.
+    if (_needle.length == 0) {
+        return YES;
+    }
+    MediaSearchKey* searchKey = d.searchKey;
+    // The text fields match at word prefixes, just like the library index.
+    // The search key decides, so that the result never depends on the index
+    // being there; the index just rules out items up front.
+    BOOL textMatch = NO;
+    if (_keyWords.count == 0) {
+        textMatch = [searchKey fieldsContainNeedle:_keyNeedle exact:_exactNeedle];
+    } else if (_indexedURLs == nil || [_indexedURLs containsObject:d.location.absoluteString]) {
+        textMatch = [searchKey fieldsContainWordPrefixes:_keyWords exact:_exactNeedle];
+    }
+    // Tags match by what they contain, so that a longer needle never matches
+    // more than a shorter one did.
+    return textMatch || [searchKey tagsContainNeedle:_keyNeedle exact:_exactNeedle] ||
+           (d.key.length && [d.key localizedCaseInsensitiveContainsString:_matchNeedle]) ||
+           (d.rating && d.stars.length && [d.stars localizedCaseInsensitiveContainsString:_matchNeedle]) ||
+           [[d.tempo stringValue] localizedCaseInsensitiveContainsString:_matchNeedle];
+}
+
+- (NSArray<MediaMetaData*>* _Nullable)filterItems:(NSArray<MediaMetaData*>*)items
+                                        operation:(CancelableBlockOperation* _Nullable)operation
+                                  firstMatchCount:(NSUInteger)firstMatchCount
+                                     firstMatches:(void (^_Nullable)(NSArray<MediaMetaData*>* matches))firstMatches
+{
+    NSMutableArray<MediaMetaData*>* filtered = [NSMutableArray array];
+    BOOL firstMatchesReported = firstMatches == nil;
+    NSUInteger checked = 0;
+    for (MediaMetaData* item in items) {
+        if (++checked % kFilterCancelCheckInterval == 0 && operation.isCancelled) {
+            return nil;
+        }
+        if (![self matchesItem:item]) {
+            continue;
+        }
+        [filtered addObject:item];
+        if (!firstMatchesReported && filtered.count == firstMatchCount) {
+            firstMatches([filtered copy]);
+            firstMatchesReported = YES;
+        }
+    }
+    if (operation.isCancelled) {
+        return nil;
+    }
+    return filtered;
+}
+
+@end
@@ -9,13 +9,61 @@
 #import <Foundation/Foundation.h>
 
 @class MediaMetaData;
+@class TrackList;
 
 NS_ASSUME_NONNULL_BEGIN
 
+/// Name the duration resolution is tracked under, next to the `SampleAnalyzer` names.
+extern NSString* const LibraryStoreDurationAnalyzer;
+
+/// Browser columns the store can list the values of.
+typedef NS_ENUM(NSInteger, LibraryFacet) {
+    LibraryFacetGenre,
+    LibraryFacetArtist,
+    LibraryFacetAlbum,
+    LibraryFacetTempo,
+    LibraryFacetKey,
+};
+
+extern NSErrorDomain const LibraryStoreErrorDomain;
+
+/// Codes of errors the store raises itself; SQLite failures carry the SQLite result code.
+typedef NS_ENUM(NSInteger, LibraryStoreError) {
+    /// The change log got pruned past the requested revision; reload everything.
+    LibraryStoreErrorChangesExpired = -1,
+};
+
+typedef NS_ENUM(NSInteger, LibraryChangeKind) {
+    LibraryChangeKindInsert = 1,
+    LibraryChangeKindUpdate,
+    LibraryChangeKindDelete,
+};
+
+/// A track that changed since a given revision, all its changes folded into one.
+@interface LibraryChange : NSObject
+@property (readonly, nonatomic) LibraryChangeKind kind;
+@property (readonly, nonatomic) NSURL* url;
+/// `MediaMetaData` keys that changed; all of them for inserts, none for deletes.
+@property (readonly, nonatomic) NSSet<NSString*>* keys;
+/// The track as stored now; nil for deletes.
+@property (readonly, nonatomic, nullable) MediaMetaData* meta;
+@end
+
 /// Lightweight persistence wrapper for caching `MediaMetaData` in SQLite.
 /// Keeps the existing in-memory model; intended as a backing store/cache.
+///
+/// Writes go through one connection, one transaction at a time. Reads run on
+/// a few read-only connections next to it and see the latest commit.
 @interface LibraryStore : NSObject
 
+/// Current result version per analyzer name. Results stored by an older
+/// version get the track queued for a deep scan running just that analyzer.
++ (NSDictionary<NSString*, NSNumber*>*)analyzerVersions;
+
+/// Size and a hash of a few blocks from the middle of the file, telling files
+/// apart by content without reading all of it. nil when it can't be read.
++ (NSString* _Nullable)fingerprintOfURL:(NSURL*)url;
+
 /// Designated initializer.
 - (instancetype)initWithDatabaseURL:(NSURL*)url;
 
@@ -23,23 +71,110 @@ NS_ASSUME_NONNULL_BEGIN
 - (BOOL)open:(NSError**)error;
 
 /// Import a batch of media items (e.g., from ITLibrary) into the store.
-/// Existing rows are replaced based on URL.
+/// Existing rows are replaced based on URL. Rows get written in transactions
+/// of bounded size.
 - (BOOL)importMediaItems:(NSArray<MediaMetaData*>*)items error:(NSError**)error;
 - (BOOL)importMediaItems:(NSArray<MediaMetaData*>*)items preferExisting:(BOOL)preferExisting error:(NSError**)error;
 
+/// Queue items for an upsert like `importMediaItems:error:` does. Queued items
+/// get written in transactions of a bounded number of rows, at most half a
+/// second after being queued.
+- (void)queueImportOfMediaItems:(NSArray<MediaMetaData*>*)items;
+
+/// Write all queued items now. Reports the first error any queued write ran
+/// into since the previous flush.
+- (BOOL)flushQueuedImports:(NSError**)error;
+
 /// Asynchronous file import. Completion is invoked on the main queue.
+///
+/// Files the store has no entry for get matched by content against entries
+/// whose files are gone; matching entries move over with their analysis
+/// results instead of getting imported as new tracks.
 - (void)importFileURLs:(NSArray<NSURL*>*)urls completion:(void (^)(NSArray<MediaMetaData*>* _Nullable metas, NSError* _Nullable error))completion;
 
 /// Reconcile the current library: refresh metadata from disk for existing files,
 /// report missing files, track entries that changed, and update the store. Completion on main queue.
+///
+/// Only files whose size, modification time or inode differ from what was
+/// recorded when their tags were last read get parsed again; `refreshedMetas`
+/// holds just those.
 - (void)reconcileLibraryWithCompletion:(void (^)(NSArray<MediaMetaData*>* _Nullable refreshedMetas,
                                                  NSArray<MediaMetaData*>* _Nullable changedMetas,
                                                  NSArray<NSURL*>* missingFiles,
                                                  NSError* _Nullable error))completion;
 
-/// Load all cached media items as `MediaMetaData` instances.
+/// Same as `reconcileLibraryWithCompletion:`, limited to the tracks at the
+/// given URLs; URLs not in the store are ignored.
+- (void)reconcileFileURLs:(NSArray<NSURL*>*)urls
+               completion:(void (^)(NSArray<MediaMetaData*>* _Nullable refreshedMetas,
+                                    NSArray<MediaMetaData*>* _Nullable changedMetas,
+                                    NSArray<NSURL*>* missingFiles,
+                                    NSError* _Nullable error))completion;
+
+/// Files checked by the last reconciliation.
+@property (nonatomic, assign, readonly) NSUInteger lastReconcileStatCount;
+/// Files whose tags the last reconciliation had to read again.
+@property (nonatomic, assign, readonly) NSUInteger lastReconcileParseCount;
+/// Write transactions committed since the store got opened.
+@property (assign, readonly) NSUInteger committedTransactionCount;
+
+/// Load all cached media items as `MediaMetaData` instances. Artwork is not
+/// loaded; items refer to it by hash and fetch it from this store on access.
 - (NSArray<MediaMetaData*>* _Nullable)loadAllMediaItems:(NSError**)error;
 
+/// URLs (as absolute strings) of the tracks whose title, artist, album, genre
+/// or tags contain every word of the needle as a word prefix, ignoring case and
+/// diacritics. Returns nil when the search index is unavailable or the needle
+/// has nothing to search for.
+- (NSSet<NSString*>* _Nullable)searchURLsMatchingNeedle:(NSString*)needle error:(NSError**)error;
+
+/// Distinct values of `facet` with the number of tracks holding each, counting
+/// only tracks that match the values `filter` gives for the other facets. Empty
+/// values and tempos below 1 BPM are left out; tempos are keyed the way
+/// `NSNumber.stringValue` renders them.
+- (NSDictionary<NSString*, NSNumber*>* _Nullable)valuesOfFacet:(LibraryFacet)facet
+                                                        filter:(NSDictionary<NSNumber*, NSString*>*)filter
+                                                         error:(NSError**)error;
+
+/// Artwork data for the given hashes in as few queries as possible; hashes
+/// without artwork are left out. Fetched artwork gets cached.
+- (NSDictionary<NSString*, NSData*>* _Nullable)artworkDataForHashes:(NSArray<NSString*>*)hashes error:(NSError**)error;
+
+/// Warm the artwork cache for the given items in the background, e.g. for the
+/// rows about to become visible.
+- (void)prefetchArtworkForMetas:(NSArray<MediaMetaData*>*)metas;
+
+/// Replace the tracklist stored for the set at `url`; an empty list removes it.
+/// Sets do not need to be part of the library.
+- (BOOL)storeTrackList:(TrackList*)trackList forURL:(NSURL*)url error:(NSError**)error;
+
+/// Tracklist stored for the set at `url`, built from its entries without
+/// touching any archive. Empty when none got stored.
+- (TrackList* _Nullable)trackListForURL:(NSURL*)url error:(NSError**)error;
+
+/// Sets whose tracklists contain the track, matched by its location or by
+/// artist and title ignoring case, mapped to the frames the track starts at.
+- (NSDictionary<NSURL*, NSArray<NSNumber*>*>* _Nullable)setsContainingTrack:(MediaMetaData*)track error:(NSError**)error;
+
+/// Revision of the latest change to any track; 0 before the first. Take it
+/// before loading items to catch up from with `changesSinceRevision:`.
+- (int64_t)currentRevision:(NSError**)error;
+
+/// Tracks inserted, updated or deleted after `revision`, in the order they
+/// first changed. Only changes of what `loadAllMediaItems:` reads count.
+/// `latest` receives the revision to ask from next time. Changes are kept
+/// for a week; asking for older ones fails with `LibraryStoreErrorChangesExpired`.
+- (NSArray<LibraryChange*>* _Nullable)changesSinceRevision:(int64_t)revision
+                                                    latest:(int64_t* _Nullable)latest
+                                                     error:(NSError**)error;
+
+/// Move entries of files that are gone to the given URLs where the content
+/// matches, keeping their analysis results, ratings and tracklists. Only URLs
+/// the store has no entry for get matched, by size and a hash of a few blocks
+/// from the middle of the file. Returns the previous URL of every moved entry,
+/// keyed by its new one.
+- (NSDictionary<NSURL*, NSURL*>* _Nullable)relocateEntriesToURLs:(NSArray<NSURL*>*)urls error:(NSError**)error;
+
 /// Returns YES if a track with the given URL already exists in the store.
 - (BOOL)hasEntryForURL:(NSURL*)url error:(NSError**)error;
 
@@ -52,19 +187,55 @@ NS_ASSUME_NONNULL_BEGIN
 /// Mark URLs for deep scan with optional priority (0 = low, 1 = high).
 - (BOOL)enqueueDeepScanForURLs:(NSArray<NSURL*>*)urls priority:(NSInteger)priority error:(NSError**)error;
 
+/// Raise the priority of URLs already waiting for a deep scan without touching their state.
+- (BOOL)prioritizeDeepScanForURLs:(NSArray<NSURL*>*)urls error:(NSError**)error;
+
 /// Returns the next URL that needs deep scanning, or nil when none are pending.
+/// Does not claim it.
 - (NSURL* _Nullable)nextDeepScanURL:(NSError**)error;
+/// Same as `nextDeepScanURL:`, also telling the priority the URL was queued with.
+- (NSURL* _Nullable)nextDeepScanURLWithPriority:(NSInteger* _Nullable)priority error:(NSError**)error;
+
+/// Atomically take up to `limit` URLs of at least `minimumPriority` off the
+/// deep scan queue and mark them running, highest priority and longest waiting
+/// first. `priorities` receives the priority each URL was queued with. Costs
+/// the same regardless of library size.
+- (NSArray<NSURL*>* _Nullable)claimDeepScanURLs:(NSUInteger)limit
+                                 minimumPriority:(NSInteger)minimumPriority
+                                      priorities:(NSArray<NSNumber*>* _Nullable* _Nullable)priorities
+                                           error:(NSError**)error;
 
 /// Mark a URL as actively being scanned.
 - (BOOL)markDeepScanRunningForURL:(NSURL*)url error:(NSError**)error;
 
 /// Update deep scan results for a URL and mark completed.
+///
+/// Whether the URL gets queued again is decided here, from the analyzer
+/// versions recorded at that time; record the analyzers that ran first.
 - (BOOL)completeDeepScanForURL:(NSURL*)url
                       duration:(NSNumber* _Nullable)duration
                          tempo:(NSNumber* _Nullable)tempo
                            key:(NSString* _Nullable)key
                          error:(NSError**)error;
 
+/// Store signal-level analysis results for a URL; nil values keep what is stored.
+- (BOOL)updateAnalysisForURL:(NSURL*)url
+                    loudness:(NSNumber* _Nullable)loudness
+                        peak:(NSNumber* _Nullable)peak
+                 contentHash:(NSString* _Nullable)contentHash
+                       error:(NSError**)error;
+
+/// Versions of the analyzers whose results got stored for the URL, keyed by
+/// analyzer name. Analyzers that never ran on the URL are not listed.
+- (NSDictionary<NSString*, NSNumber*>* _Nullable)recordedAnalyzerVersionsForURL:(NSURL*)url error:(NSError**)error;
+
+/// Record that the named analyzers ran on the URL at their current version.
+- (BOOL)recordAnalyzers:(NSArray<NSString*>*)names forURL:(NSURL*)url error:(NSError**)error;
+
+/// Drop the recorded versions of the named analyzers, e.g. after they failed.
+/// Their stored results stay, like those an analyzer never produced.
+- (BOOL)forgetAnalyzers:(NSArray<NSString*>*)names forURL:(NSURL*)url error:(NSError**)error;
+
 /// Mark a deep scan as failed for the given URL.
 - (BOOL)markDeepScanFailedForURL:(NSURL*)url reason:(NSString*)reason error:(NSError**)error;
 - (NSInteger)deepScanOutstandingCount:(NSError**)error;
@@ -8,13 +8,21 @@
 
 #import "LibraryStore.h"
 
+#import <fcntl.h>
 #import <sqlite3.h>
+#import <sys/stat.h>
+#import <unistd.h>
 
-#import "KeyTrackedSample.h"
+#import "BeatAnalyzer.h"
+#import "ContentHashAnalyzer.h"
+#import "KeyAnalyzer.h"
+#import "LoudnessAnalyzer.h"
 #import "MediaMetaData.h"
 #import "NSString+Sanitized.h"
 #import "MetaController.h"
 #import "NSData+Hashing.h"
+#import "TimedMediaMetaData.h"
+#import "TrackList.h"
 
 static const NSInteger kDeepScanVersion = 1;
 static const int kDeepScanStateNever = 0;
@@ -24,6 +32,28 @@ static const int kDeepScanStateDone = 3;
 static const int kDeepScanStateFailed = 4;
 static const int kDeepScanPriorityLow = 0;
 static const int kDeepScanPriorityHigh = 1;
+static const NSInteger kDurationResolverVersion = 1;
+/// Files parsed per batch during reconciliation; bounds the metadata held in flight.
+static const NSUInteger kReconcileReadBatchSize = 256;
+/// Artwork kept in memory once fetched, in bytes.
+static const NSUInteger kArtworkCacheLimit = 64 * 1024 * 1024;
+/// Hashes bound per artwork query.
+static const NSUInteger kArtworkFetchBatchSize = 64;
+/// Rows written per transaction; bounds how long other writers wait for the lock.
+static const NSUInteger kWriteBatchSize = 512;
+/// Longest time queued writes wait for their batch to fill up, in seconds.
+static const NSTimeInterval kWriteBatchLatency = 0.5;
+/// How long changes stay in the change log, in seconds.
+static const NSTimeInterval kChangeLogRetention = 7 * 24 * 60 * 60;
+/// Bytes hashed per block of a content fingerprint.
+static const size_t kFingerprintBlockSize = 16 * 1024;
+/// Blocks of a content fingerprint.
+static const int kFingerprintBlockCount = 3;
+/// Read-only connections reads get spread over, next to the one writing.
+static const long kReadConnectionLimit = 4;
+
+NSString* const LibraryStoreDurationAnalyzer = @"duration";
+NSErrorDomain const LibraryStoreErrorDomain = @"LibraryStore";
 
 static NSString* const kLibrarySchema =
     @"CREATE TABLE IF NOT EXISTS tracks ("
@@ -54,17 +84,380 @@ static NSString* const kLibrarySchema =
     @" deepScanPriority INTEGER,"
     @" deepScanVersion INTEGER,"
     @" deepScanUpdatedAt REAL,"
-    @" deepScanError TEXT"
+    @" deepScanError TEXT,"
+    @" loudness REAL,"
+    @" peak REAL,"
+    @" contentHash TEXT"
     @");"
     @"CREATE TABLE IF NOT EXISTS artwork ("
     @" hash TEXT PRIMARY KEY,"
     @" format INTEGER,"
     @" data BLOB"
-    @");";
+    @");"
+    @"CREATE TABLE IF NOT EXISTS analyzer_versions ("
+    @" url TEXT NOT NULL,"
+    @" analyzer TEXT NOT NULL,"
+    @" version INTEGER NOT NULL,"
+    @" updatedAt REAL,"
+    @" PRIMARY KEY (url, analyzer)"
+    @") WITHOUT ROWID;"
+    @"CREATE TRIGGER IF NOT EXISTS tracks_delete_analyzer_versions AFTER DELETE ON tracks BEGIN"
+    @" DELETE FROM analyzer_versions WHERE url = old.url;"
+    @" END;"
+    @"CREATE INDEX IF NOT EXISTS tracks_genre ON tracks(genre);"
+    @"CREATE INDEX IF NOT EXISTS tracks_artist ON tracks(artist);"
+    @"CREATE INDEX IF NOT EXISTS tracks_album ON tracks(album);"
+    @"CREATE INDEX IF NOT EXISTS tracks_bpm ON tracks(bpm);"
+    @"CREATE INDEX IF NOT EXISTS tracks_key ON tracks(key);"
+    // Tracks wanting a deep scan, in claim order; filled by triggers.
+    @"CREATE TABLE IF NOT EXISTS deep_scan_queue ("
+    @" url TEXT PRIMARY KEY,"
+    @" priority INTEGER NOT NULL,"
+    @" queuedAt REAL NOT NULL"
+    @") WITHOUT ROWID;"
+    @"CREATE INDEX IF NOT EXISTS deep_scan_queue_order ON deep_scan_queue(priority DESC, queuedAt);"
+    @"CREATE TRIGGER IF NOT EXISTS tracks_delete_deep_scan_queue AFTER DELETE ON tracks BEGIN"
+    @" DELETE FROM deep_scan_queue WHERE url = old.url;"
+    @" END;"
+    @"CREATE INDEX IF NOT EXISTS tracks_deep_scan_running ON tracks(deepScanState) WHERE deepScanState = 2;"
+    // Inserted, updated and deleted tracks in the order they changed; filled by triggers.
+    @"CREATE TABLE IF NOT EXISTS track_changes ("
+    @" revision INTEGER PRIMARY KEY AUTOINCREMENT,"
+    @" url TEXT NOT NULL,"
+    @" kind INTEGER NOT NULL,"
+    @" columns TEXT,"
+    @" changedAt REAL NOT NULL"
+    @");"
+    // Tracklist entries of sets (mixes); sets need not be part of the library.
+    @"CREATE TABLE IF NOT EXISTS tracklist_entries ("
+    @" setURL TEXT NOT NULL,"
+    @" frame INTEGER NOT NULL,"
+    @" endFrame INTEGER,"
+    @" confidence REAL,"
+    @" score REAL,"
+    @" supportCount INTEGER,"
+    @" title TEXT COLLATE NOCASE,"
+    @" artist TEXT COLLATE NOCASE,"
+    @" album TEXT,"
+    @" genre TEXT,"
+    @" key TEXT,"
+    @" trackURL TEXT,"
+    @" artworkLocation TEXT,"
+    @" appleLocation TEXT,"
+    @" PRIMARY KEY (setURL, frame)"
+    @") WITHOUT ROWID;"
+    @"CREATE INDEX IF NOT EXISTS tracklist_entries_track ON tracklist_entries(trackURL) WHERE trackURL IS NOT NULL;"
+    @"CREATE INDEX IF NOT EXISTS tracklist_entries_artist_title ON tracklist_entries(artist, title);"
+    // Moved tracks take what refers to them along. A tracklist stored for a set
+    // at the new location already is the one to keep.
+    @"CREATE TRIGGER IF NOT EXISTS tracks_relocate AFTER UPDATE OF url ON tracks WHEN old.url IS NOT new.url BEGIN"
+    @" UPDATE analyzer_versions SET url = new.url WHERE url = old.url;"
+    @" UPDATE deep_scan_queue SET url = new.url WHERE url = old.url;"
+    @" UPDATE tracklist_entries SET trackURL = new.url WHERE trackURL = old.url;"
+    @" DELETE FROM tracklist_entries WHERE setURL = old.url AND EXISTS (SELECT 1 FROM tracklist_entries WHERE setURL = new.url);"
+    @" UPDATE tracklist_entries SET setURL = new.url WHERE setURL = old.url;"
+    @" END;";
+
+/// Indices on columns of `libraryMigratedColumns()`, created once those exist.
+static NSString* const kLibraryMigratedSchema =
+    @"CREATE INDEX IF NOT EXISTS tracks_fingerprint ON tracks(fingerprint) WHERE fingerprint IS NOT NULL;";
+
+/// `tracks` columns `metaFromTrackRow:` reads, in order.
+#define LIBRARY_TRACK_COLUMNS \
+    "url,title,artist,album,albumArtist,genre,year,trackNumber,trackCount,discNumber,discCount,duration,bpm,key,rating,comment,tags," \
+    "compilation,artworkHash,artworkLocation,addedAt,lastSeen,appleLocation,(SELECT format FROM artwork WHERE artwork.hash = tracks.artworkHash)"
+
+/// `tracks` column holding the values of a facet.
+static const char* libraryFacetColumn(LibraryFacet facet)
+{
+    switch (facet) {
+    case LibraryFacetGenre:
+        return "genre";
+    case LibraryFacetArtist:
+        return "artist";
+    case LibraryFacetAlbum:
+        return "album";
+    case LibraryFacetTempo:
+        return "bpm";
+    case LibraryFacetKey:
+        return "key";
+    }
+    return NULL;
+}
+
+/// Columns added after the initial schema, as `{name, type}` pairs. Databases
+/// created by older builds get them appended on open.
+static NSArray<NSArray<NSString*>*>* libraryMigratedColumns(void)
+{
+    return @[
+        @[ @"loudness", @"REAL" ],
+        @[ @"peak", @"REAL" ],
+        @[ @"contentHash", @"TEXT" ],
+        @[ @"fileSize", @"INTEGER" ],
+        @[ @"fileModified", @"REAL" ],
+        @[ @"fileInode", @"INTEGER" ],
+        @[ @"fingerprint", @"TEXT" ],
+    ];
+}
+
+/// SQL condition matching `tracks` rows, referred to as `row`, holding a
+/// result of an analyzer older than its current version.
+static NSString* staleAnalyzerCondition(NSString* row)
+{
+    NSMutableString* versions = [NSMutableString string];
+    [[LibraryStore analyzerVersions] enumerateKeysAndObjectsUsingBlock:^(NSString* name, NSNumber* version, BOOL* stop) {
+        [versions appendFormat:@" WHEN '%@' THEN %ld", name, (long) version.integerValue];
+    }];
+    return [NSString stringWithFormat:@"EXISTS (SELECT 1 FROM analyzer_versions a WHERE a.url = %@.url "
+                                      @"AND a.version < CASE a.analyzer%@ ELSE a.version END)",
+                                      row, versions];
+}
+
+/// SQL condition matching `tracks` rows, referred to as `row`, that want a
+/// deep scan: those missing results, plus those where only some analyzers are
+/// outdated.
+static NSString* deepScanWantedCondition(NSString* row)
+{
+    return [NSString stringWithFormat:@"((((%1$@.duration IS NULL OR %1$@.duration <= 0 OR %1$@.bpm IS NULL OR %1$@.bpm <= 0 OR %1$@.key IS NULL OR %1$@.key = '') "
+                                      @"AND (COALESCE(%1$@.deepScanState, 0) IN (0, 1) OR (%1$@.deepScanState = 4 AND COALESCE(%1$@.deepScanVersion, 0) < %2$ld))) "
+                                      @"OR (COALESCE(%1$@.deepScanState, 0) <> 2 AND %3$@)))",
+                                      row, (long) kDeepScanVersion, staleAnalyzerCondition(row)];
+}
+
+/// Keeps `deep_scan_queue` holding exactly the tracks that want a deep scan.
+/// The condition bakes in the current analyzer versions, so the triggers get
+/// replaced on every open.
+static NSString* deepScanQueueTriggers(void)
+{
+    NSString* wanted = deepScanWantedCondition(@"new");
+    return [NSString stringWithFormat:
+                         @"DROP TRIGGER IF EXISTS tracks_deep_scan_queue_insert;"
+                         @"DROP TRIGGER IF EXISTS tracks_deep_scan_queue_update;"
+                         @"CREATE TRIGGER tracks_deep_scan_queue_insert AFTER INSERT ON tracks WHEN %1$@ BEGIN"
+                         @" INSERT OR IGNORE INTO deep_scan_queue (url, priority, queuedAt)"
+                         @" VALUES (new.url, COALESCE(new.deepScanPriority, 0), COALESCE(new.deepScanUpdatedAt, 0));"
+                         @" END;"
+                         @"CREATE TRIGGER tracks_deep_scan_queue_update"
+                         @" AFTER UPDATE OF duration, bpm, key, deepScanState, deepScanPriority, deepScanVersion, deepScanUpdatedAt ON tracks BEGIN"
+                         @" DELETE FROM deep_scan_queue WHERE url = new.url AND NOT %1$@;"
+                         @" INSERT INTO deep_scan_queue (url, priority, queuedAt)"
+                         @" SELECT new.url, COALESCE(new.deepScanPriority, 0), COALESCE(new.deepScanUpdatedAt, 0) WHERE %1$@"
+                         @" ON CONFLICT(url) DO UPDATE SET priority = excluded.priority, queuedAt = excluded.queuedAt;"
+                         @" END;"
+                         // Catch up with rows written by builds with other analyzer versions.
+                         @"DELETE FROM deep_scan_queue;"
+                         @"INSERT INTO deep_scan_queue (url, priority, queuedAt)"
+                         @" SELECT url, COALESCE(deepScanPriority, 0), COALESCE(deepScanUpdatedAt, 0) FROM tracks WHERE %2$@;",
+                         wanted, deepScanWantedCondition(@"tracks")];
+}
+
+/// Current time in seconds since 1970 as SQL expression.
+static NSString* const kSQLiteNow = @"((julianday('now') - 2440587.5) * 86400.0)";
+
+/// `tracks` columns whose changes get logged, mapped to the `MediaMetaData`
+/// keys they load into. Bookkeeping columns are left out.
+static NSDictionary<NSString*, NSString*>* trackChangeKeysByColumn(void)
+{
+    return @{
+        @"title" : @"title",
+        @"artist" : @"artist",
+        @"album" : @"album",
+        @"albumArtist" : @"albumArtist",
+        @"genre" : @"genre",
+        @"year" : @"year",
+        @"trackNumber" : @"track",
+        @"trackCount" : @"tracks",
+        @"discNumber" : @"disk",
+        @"discCount" : @"disks",
+        @"duration" : @"duration",
+        @"bpm" : @"tempo",
+        @"key" : @"key",
+        @"rating" : @"rating",
+        @"comment" : @"comment",
+        @"tags" : @"tags",
+        @"compilation" : @"compilation",
+        @"artworkHash" : @"artwork",
+        @"artworkLocation" : @"artworkLocation",
+        @"appleLocation" : @"appleLocation",
+    };
+}
+
+/// Keeps `track_changes` logging every change of the watched columns, and
+/// drops what is older than the retention. Replaced on every open, so the
+/// watched columns can change between builds.
+static NSString* trackChangeTriggers(void)
+{
+    NSMutableArray<NSString*>* terms = [NSMutableArray array];
+    NSArray<NSString*>* columns = [trackChangeKeysByColumn().allKeys sortedArrayUsingSelector:@selector(compare:)];
+    for (NSString* column in columns) {
+        [terms addObject:[NSString stringWithFormat:@"CASE WHEN old.%1$@ IS NOT new.%1$@ THEN ',%1$@' ELSE '' END", column]];
+    }
+    NSString* changed = [terms componentsJoinedByString:@" || "];
+    double horizon = [NSDate date].timeIntervalSince1970 - kChangeLogRetention;
+    return [NSString stringWithFormat:
+                         @"DROP TRIGGER IF EXISTS tracks_change_insert;"
+                         @"DROP TRIGGER IF EXISTS tracks_change_update;"
+                         @"DROP TRIGGER IF EXISTS tracks_change_delete;"
+                         @"DROP TRIGGER IF EXISTS tracks_change_relocate;"
+                         @"CREATE TRIGGER tracks_change_insert AFTER INSERT ON tracks BEGIN"
+                         @" INSERT INTO track_changes (url, kind, changedAt) VALUES (new.url, %2$ld, %6$@);"
+                         @" END;"
+                         @"CREATE TRIGGER tracks_change_update AFTER UPDATE ON tracks WHEN (%1$@) <> '' BEGIN"
+                         @" INSERT INTO track_changes (url, kind, columns, changedAt) VALUES (new.url, %3$ld, substr(%1$@, 2), %6$@);"
+                         @" END;"
+                         @"CREATE TRIGGER tracks_change_delete AFTER DELETE ON tracks BEGIN"
+                         @" INSERT INTO track_changes (url, kind, changedAt) VALUES (old.url, %4$ld, %6$@);"
+                         @" END;"
+                         // A moved track is gone from where it was and new where it is.
+                         @"CREATE TRIGGER tracks_change_relocate AFTER UPDATE OF url ON tracks WHEN old.url IS NOT new.url BEGIN"
+                         @" INSERT INTO track_changes (url, kind, changedAt) VALUES (old.url, %4$ld, %6$@);"
+                         @" INSERT INTO track_changes (url, kind, changedAt) VALUES (new.url, %2$ld, %6$@);"
+                         @" END;"
+                         @"DELETE FROM track_changes WHERE changedAt < %5$f;",
+                         changed, (long) LibraryChangeKindInsert, (long) LibraryChangeKindUpdate, (long) LibraryChangeKindDelete, horizon,
+                         kSQLiteNow];
+}
+
+/// Full-text index over the searchable columns of `tracks`, sharing their
+/// rowids. Case and diacritics get folded by the tokenizer; short prefixes
+/// are indexed to keep as-you-type queries cheap. Created apart from the main
+/// schema so that an SQLite lacking FTS5 just goes without.
+static NSString* const kLibrarySearchSchema =
+    @"CREATE VIRTUAL TABLE tracks_search USING fts5("
+    @" title, artist, album, genre, tags,"
+    @" tokenize = 'unicode61 remove_diacritics 2',"
+    @" prefix = '1 2 3'"
+    @");"
+    @"CREATE TRIGGER tracks_search_insert AFTER INSERT ON tracks BEGIN"
+    @" INSERT INTO tracks_search (rowid, title, artist, album, genre, tags)"
+    @" VALUES (new.rowid, new.title, new.artist, new.album, new.genre, new.tags);"
+    @" END;"
+    @"CREATE TRIGGER tracks_search_delete AFTER DELETE ON tracks BEGIN"
+    @" DELETE FROM tracks_search WHERE rowid = old.rowid;"
+    @" END;"
+    @"CREATE TRIGGER tracks_search_update AFTER UPDATE OF title, artist, album, genre, tags ON tracks BEGIN"
+    @" DELETE FROM tracks_search WHERE rowid = old.rowid;"
+    @" INSERT INTO tracks_search (rowid, title, artist, album, genre, tags)"
+    @" VALUES (new.rowid, new.title, new.artist, new.album, new.genre, new.tags);"
+    @" END;"
+    @"INSERT INTO tracks_search (rowid, title, artist, album, genre, tags)"
+    @" SELECT rowid, title, artist, album, genre, tags FROM tracks;";
+
+/// What a file looked like when its tags were last read. Reconciliation only
+/// parses files whose stamp changed since.
+typedef struct {
+    long long size;
+    double modified;
+    long long inode;
+} LibraryFileStamp;
+
+static BOOL libraryFileStampOfURL(NSURL* url, LibraryFileStamp* stamp, BOOL* isDirectory)
+{
+    struct stat st;
+    if (stat(url.fileSystemRepresentation, &st) != 0) {
+        return NO;
+    }
+    *isDirectory = S_ISDIR(st.st_mode);
+    stamp->size = (long long) st.st_size;
+    stamp->modified = (double) st.st_mtimespec.tv_sec + (double) st.st_mtimespec.tv_nsec / 1e9;
+    stamp->inode = (long long) st.st_ino;
+    return YES;
+}
+
+/// Cheap content fingerprint of a regular file: its size and a hash of a few
+/// blocks spread over the middle of the file, away from the tags at either
+/// end, so it survives moves and most tag edits. Small files get hashed whole.
+static NSString* _Nullable libraryFingerprintOfURL(NSURL* url)
+{
+    int fd = open(url.fileSystemRepresentation, O_RDONLY);
+    if (fd < 0) {
+        return nil;
+    }
+    // Read once; no point in keeping the blocks in the page cache.
+    fcntl(fd, F_NOCACHE, 1);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return nil;
+    }
+    const long long size = (long long) st.st_size;
+    // Blocks centered on 3/8, 5/8 and 7/8 of the file need it to be eight blocks long.
+    const BOOL whole = size <= (long long) (8 * kFingerprintBlockSize);
+    const size_t length = whole ? (size_t) size : kFingerprintBlockSize;
+    const int blocks = whole ? 1 : kFingerprintBlockCount;
+
+    NSMutableData* content = [NSMutableData dataWithLength:length * blocks];
+    BOOL complete = YES;
+    for (int block = 0; complete && block < blocks; block++) {
+        off_t offset = whole ? 0 : (off_t) (size / 8 * (2 * block + 3)) - (off_t) (length / 2);
+        complete = pread(fd, (uint8_t*) content.mutableBytes + block * length, length, offset) == (ssize_t) length;
+    }
+    close(fd);
+    if (!complete) {
+        return nil;
+    }
+    return [NSString stringWithFormat:@"%lld-%@", size, content.shortSHA256];
+}
+
+@interface LibraryChange ()
+@property (nonatomic, assign, readwrite) LibraryChangeKind kind;
+@property (nonatomic, strong, readwrite) NSURL* url;
+@property (nonatomic, copy, readwrite) NSSet<NSString*>* keys;
+@property (nonatomic, strong, readwrite, nullable) MediaMetaData* meta;
+@end
+
+@implementation LibraryChange
+@end
+
+/// A read-only connection with the statements prepared on it. Used by one
+/// thread at a time.
+@interface LibraryReadConnection : NSObject
+@property (nonatomic) sqlite3* db;
+/// Prepared statements not in use right now, keyed by their SQL.
+@property (nonatomic, strong) NSMutableDictionary<NSString*, NSValue*>* statementCache;
+@end
 
-@interface LibraryStore ()
+@implementation LibraryReadConnection
+@end
+
+/// What a thread holds of a store: the read connection its statements run on
+/// and how deep into a write transaction it is.
+@interface LibraryThreadState : NSObject
+@property (nonatomic, strong, nullable) LibraryReadConnection* reader;
+/// Statements prepared on `reader` and not released yet.
+@property (nonatomic, assign) NSUInteger readerStatementCount;
+@property (nonatomic, assign) NSUInteger transactionDepth;
+@end
+
+@implementation LibraryThreadState
+@end
+
+@interface LibraryStore () <MediaMetaDataArtworkSource>
 @property (nonatomic, strong) NSURL* databaseURL;
+@property (nonatomic, assign, readwrite) NSUInteger lastReconcileStatCount;
+@property (nonatomic, assign, readwrite) NSUInteger lastReconcileParseCount;
+@property (assign, readwrite) NSUInteger committedTransactionCount;
 @property (nonatomic) sqlite3* db;
+@property (nonatomic, assign) BOOL searchIndexAvailable;
+@property (nonatomic, strong) NSCache<NSString*, NSData*>* artworkCache;
+/// Prepared statements not in use right now, keyed by their SQL.
+@property (nonatomic, strong) NSMutableDictionary<NSString*, NSValue*>* statementCache;
+/// Serializes transactions on the shared connection. Every write runs in one,
+/// so that it never lands in a transaction another thread holds open.
+@property (nonatomic, strong) NSRecursiveLock* transactionLock;
+/// Set when the database is in WAL mode, so reads can run next to a writer.
+@property (nonatomic, assign) BOOL readConnectionsAvailable;
+/// Read connections no thread holds right now.
+@property (nonatomic, strong) NSMutableArray<LibraryReadConnection*>* idleReaders;
+/// Bounds the read connections open at once.
+@property (nonatomic, strong) dispatch_semaphore_t readerSlots;
+/// Key of this store's `LibraryThreadState` in thread dictionaries.
+@property (nonatomic, copy) NSString* threadStateKey;
+@property (nonatomic, strong) dispatch_queue_t writeQueue;
+@property (nonatomic, strong) NSMutableArray<MediaMetaData*>* pendingWrites;
+@property (nonatomic, assign) BOOL pendingWriteScheduled;
+@property (nonatomic, strong, nullable) NSError* pendingWriteError;
 @end
 
 @implementation LibraryStore
@@ -85,16 +478,69 @@ static BOOL isLikelyMojibakeString(NSString* s)
     return NO;
 }
 
++ (NSDictionary<NSString*, NSNumber*>*)analyzerVersions
+{
+    return @{
+        LibraryStoreDurationAnalyzer : @(kDurationResolverVersion),
+        @"beats" : @(BeatAnalyzer.version),
+        @"key" : @(KeyAnalyzer.version),
+        @"loudness" : @(LoudnessAnalyzer.version),
+        @"contentHash" : @(ContentHashAnalyzer.version),
+    };
+}
+
++ (NSString*)fingerprintOfURL:(NSURL*)url
+{
+    return libraryFingerprintOfURL(url);
+}
+
 - (instancetype)initWithDatabaseURL:(NSURL*)url
 {
     self = [super init];
     if (self) {
         _databaseURL = url;
+        _artworkCache = [NSCache new];
+        _artworkCache.totalCostLimit = kArtworkCacheLimit;
+        _statementCache = [NSMutableDictionary dictionary];
+        _transactionLock = [NSRecursiveLock new];
+        _idleReaders = [NSMutableArray array];
+        _readerSlots = dispatch_semaphore_create(kReadConnectionLimit);
+        _threadStateKey = [NSString stringWithFormat:@"LibraryStore.%p", self];
+        _writeQueue = dispatch_queue_create("PlayEm.LibraryStore.Writes", DISPATCH_QUEUE_SERIAL);
+        _pendingWrites = [NSMutableArray array];
     }
     return self;
 }
 
+- (void)dealloc
+{
+    for (NSValue* value in _statementCache.allValues) {
+        sqlite3_finalize(value.pointerValue);
+    }
+    for (LibraryReadConnection* reader in _idleReaders) {
+        for (NSValue* value in reader.statementCache.allValues) {
+            sqlite3_finalize(value.pointerValue);
+        }
+        sqlite3_close_v2(reader.db);
+    }
+    if (_db) {
+        sqlite3_close_v2(_db);
+    }
+}
+
 - (BOOL)open:(NSError**)error
+{
+    if (self.db) {
+        return YES;
+    }
+    // Set up once, and not next to a write.
+    [self.transactionLock lock];
+    BOOL opened = [self openDatabase:error];
+    [self.transactionLock unlock];
+    return opened;
+}
+
+- (BOOL)openDatabase:(NSError**)error
 {
     if (self.db) {
         return YES;
@@ -117,7 +563,21 @@ static BOOL isLikelyMojibakeString(NSString* s)
         return NO;
     }
 
+    // Readers keep going while a batch gets written, and commits need no fsync
+    // of the database itself. Volumes without shared memory stay on the
+    // rollback journal.
     char* errmsg = NULL;
+    rc = sqlite3_exec(self.db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;", NULL, NULL, &errmsg);
+    if (rc != SQLITE_OK) {
+        NSLog(@"LibraryStore: WAL journaling unavailable: %s", errmsg ? errmsg : "unknown error");
+    }
+    if (errmsg) {
+        sqlite3_free(errmsg);
+        errmsg = NULL;
+    }
+    sqlite3_busy_timeout(self.db, 5000);
+    self.readConnectionsAvailable = [self journalModeIsWAL];
+
     rc = sqlite3_exec(self.db, kLibrarySchema.UTF8String, NULL, NULL, &errmsg);
     if (rc != SQLITE_OK) {
         if (error) {
@@ -129,6 +589,332 @@ static BOOL isLikelyMojibakeString(NSString* s)
         }
         return NO;
     }
+
+    if (![self migrateColumnsOfTable:@"tracks" columns:libraryMigratedColumns() error:error]) {
+        return NO;
+    }
+    // Keys detected per tracklist entry came after the table.
+    if (![self migrateColumnsOfTable:@"tracklist_entries" columns:@[ @[ @"key", @"TEXT" ] ] error:error]) {
+        return NO;
+    }
+    self.searchIndexAvailable = [self openSearchIndex];
+
+    NSString* queueSQL = [@[ kLibraryMigratedSchema, deepScanQueueTriggers(), trackChangeTriggers() ] componentsJoinedByString:@""];
+    return [self performTransaction:^BOOL {
+        char* queueErrmsg = NULL;
+        int queueRc = sqlite3_exec(self.db, queueSQL.UTF8String, NULL, NULL, &queueErrmsg);
+        if (queueRc != SQLITE_OK && error) {
+            NSString* msg = queueErrmsg ? [NSString stringWithUTF8String:queueErrmsg] : @"Failed to set up deep scan queue";
+            *error = [NSError errorWithDomain:@"LibraryStore" code:queueRc userInfo:@{NSLocalizedDescriptionKey : msg}];
+        }
+        if (queueErrmsg) {
+            sqlite3_free(queueErrmsg);
+        }
+        return queueRc == SQLITE_OK;
+    }
+                              error:error];
+}
+
+#pragma mark - Statements & Transactions
+
+- (BOOL)journalModeIsWAL
+{
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(self.db, "PRAGMA journal_mode", -1, &stmt, NULL) != SQLITE_OK) {
+        return NO;
+    }
+    BOOL wal = NO;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* mode = (const char*) sqlite3_column_text(stmt, 0);
+        wal = mode != NULL && strcasecmp(mode, "wal") == 0;
+    }
+    sqlite3_finalize(stmt);
+    return wal;
+}
+
+/// State of the calling thread; created on demand when `create` is set.
+- (LibraryThreadState* _Nullable)threadState:(BOOL)create
+{
+    NSMutableDictionary* threadDictionary = NSThread.currentThread.threadDictionary;
+    LibraryThreadState* state = threadDictionary[self.threadStateKey];
+    if (state == nil && create) {
+        state = [LibraryThreadState new];
+        threadDictionary[self.threadStateKey] = state;
+    }
+    return state;
+}
+
+- (void)dropThreadStateIfIdle:(LibraryThreadState*)state
+{
+    if (state.reader == nil && state.transactionDepth == 0) {
+        [NSThread.currentThread.threadDictionary removeObjectForKey:self.threadStateKey];
+    }
+}
+
+/// Read connection for the calling thread. A thread keeps the connection it
+/// holds until all statements prepared on it got released, so nested reads
+/// never wait for a second one. Nil when none can be opened.
+- (LibraryReadConnection* _Nullable)acquireReader
+{
+    LibraryThreadState* state = [self threadState:YES];
+    if (state.reader != nil) {
+        state.readerStatementCount++;
+        return state.reader;
+    }
+
+    dispatch_semaphore_wait(self.readerSlots, DISPATCH_TIME_FOREVER);
+    LibraryReadConnection* reader = nil;
+    @synchronized(self.idleReaders) {
+        reader = self.idleReaders.lastObject;
+        [self.idleReaders removeLastObject];
+    }
+    if (reader == nil) {
+        sqlite3* db = NULL;
+        int rc = sqlite3_open_v2(self.databaseURL.fileSystemRepresentation, &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+        if (rc != SQLITE_OK) {
+            NSLog(@"LibraryStore: failed to open read connection: %s", db ? sqlite3_errmsg(db) : sqlite3_errstr(rc));
+            sqlite3_close_v2(db);
+            dispatch_semaphore_signal(self.readerSlots);
+            [self dropThreadStateIfIdle:state];
+            return nil;
+        }
+        sqlite3_busy_timeout(db, 5000);
+        reader = [LibraryReadConnection new];
+        reader.db = db;
+        reader.statementCache = [NSMutableDictionary dictionary];
+    }
+    state.reader = reader;
+    state.readerStatementCount = 1;
+    return reader;
+}
+
+- (void)relinquishReader:(LibraryThreadState*)state
+{
+    if (--state.readerStatementCount > 0) {
+        return;
+    }
+    LibraryReadConnection* reader = state.reader;
+    state.reader = nil;
+    [self dropThreadStateIfIdle:state];
+    @synchronized(self.idleReaders) {
+        [self.idleReaders addObject:reader];
+    }
+    dispatch_semaphore_signal(self.readerSlots);
+}
+
+/// Prepare `sql`, reusing a statement prepared by an earlier call when one is
+/// idle. Hand the statement back with `-releaseStatement:` rather than
+/// finalizing it.
+///
+/// Queries outside of a write transaction run on a read-only connection, so
+/// they neither wait for writers nor hold them up. They see what was committed
+/// when they first stepped.
+- (int)prepareStatement:(const char*)sql statement:(sqlite3_stmt**)stmt
+{
+    if (!self.readConnectionsAvailable || strncasecmp(sql, "SELECT", 6) != 0 || [self threadState:NO].transactionDepth > 0) {
+        return [self prepareWriterStatement:sql statement:stmt];
+    }
+    LibraryReadConnection* reader = [self acquireReader];
+    if (reader == nil) {
+        return [self prepareWriterStatement:sql statement:stmt];
+    }
+    // Only the thread holding the reader touches its cache.
+    NSString* key = @(sql);
+    NSValue* cached = reader.statementCache[key];
+    if (cached != nil) {
+        [reader.statementCache removeObjectForKey:key];
+        *stmt = cached.pointerValue;
+        return SQLITE_OK;
+    }
+    int rc = sqlite3_prepare_v3(reader.db, sql, -1, SQLITE_PREPARE_PERSISTENT, stmt, NULL);
+    if (rc != SQLITE_OK) {
+        [self relinquishReader:[self threadState:NO]];
+    }
+    return rc;
+}
+
+/// Same as `-prepareStatement:statement:`, always on the writing connection.
+/// For queries prepared ahead of the write transaction they get stepped in.
+- (int)prepareWriterStatement:(const char*)sql statement:(sqlite3_stmt**)stmt
+{
+    NSString* key = @(sql);
+    @synchronized(self.statementCache) {
+        NSValue* cached = self.statementCache[key];
+        if (cached != nil) {
+            [self.statementCache removeObjectForKey:key];
+            *stmt = cached.pointerValue;
+            return SQLITE_OK;
+        }
+    }
+    return sqlite3_prepare_v3(self.db, sql, -1, SQLITE_PREPARE_PERSISTENT, stmt, NULL);
+}
+
+- (void)releaseStatement:(sqlite3_stmt*)stmt
+{
+    if (stmt == NULL) {
+        return;
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    NSString* key = @(sqlite3_sql(stmt));
+
+    if (sqlite3_db_handle(stmt) != self.db) {
+        LibraryThreadState* state = [self threadState:NO];
+        LibraryReadConnection* reader = state.reader;
+        if (reader == nil || reader.db != sqlite3_db_handle(stmt)) {
+            NSAssert(NO, @"Read statement released on a thread not holding its connection");
+            sqlite3_finalize(stmt);
+            return;
+        }
+        if (reader.statementCache[key] == nil) {
+            reader.statementCache[key] = [NSValue valueWithPointer:stmt];
+        } else {
+            sqlite3_finalize(stmt);
+        }
+        [self relinquishReader:state];
+        return;
+    }
+
+    @synchronized(self.statementCache) {
+        if (self.statementCache[key] == nil) {
+            self.statementCache[key] = [NSValue valueWithPointer:stmt];
+            return;
+        }
+    }
+    // Another caller used the same statement concurrently and returned it first.
+    sqlite3_finalize(stmt);
+}
+
+/// Step `stmt` through its rows, or, given URLs, through the rows of each URL
+/// bound as its first parameter. Returns the result code stepping ended with.
+- (int)stepStatement:(sqlite3_stmt*)stmt forURLs:(NSArray<NSURL*>* _Nullable)urls row:(void (^)(sqlite3_stmt* stmt))row
+{
+    int rc = SQLITE_DONE;
+    if (urls == nil) {
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            row(stmt);
+        }
+        return rc;
+    }
+    for (NSURL* url in urls) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            row(stmt);
+        }
+        if (rc != SQLITE_DONE) {
+            break;
+        }
+    }
+    return rc;
+}
+
+/// Run `block` in a write transaction, committing when it returns YES and
+/// rolling back otherwise. Nests: inner calls join the outer transaction.
+- (BOOL)performTransaction:(BOOL (^)(void))block error:(NSError**)error
+{
+    [self.transactionLock lock];
+    // Queries within see the transaction's own writes.
+    LibraryThreadState* state = [self threadState:YES];
+    state.transactionDepth++;
+    BOOL outermost = sqlite3_get_autocommit(self.db) != 0;
+    if (outermost) {
+        int rc = sqlite3_exec(self.db, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+        if (rc != SQLITE_OK) {
+            state.transactionDepth--;
+            [self dropThreadStateIfIdle:state];
+            [self.transactionLock unlock];
+            if (error) {
+                *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to begin transaction"}];
+            }
+            return NO;
+        }
+    }
+    BOOL success = block();
+    if (outermost) {
+        int rc = sqlite3_exec(self.db, success ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL);
+        if (success && rc != SQLITE_OK) {
+            sqlite3_exec(self.db, "ROLLBACK", NULL, NULL, NULL);
+            if (error) {
+                *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to commit transaction"}];
+            }
+            success = NO;
+        }
+        if (success) {
+            self.committedTransactionCount++;
+        }
+    }
+    state.transactionDepth--;
+    [self dropThreadStateIfIdle:state];
+    [self.transactionLock unlock];
+    return success;
+}
+
+- (BOOL)openSearchIndex
+{
+    sqlite3_stmt* stmt = NULL;
+    if (sqlite3_prepare_v2(self.db, "SELECT 1 FROM sqlite_master WHERE name = 'tracks_search'", -1, &stmt, NULL) != SQLITE_OK) {
+        return NO;
+    }
+    BOOL exists = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    if (exists) {
+        return YES;
+    }
+
+    // Created and filled from the existing rows in one go, or not at all.
+    char* errmsg = NULL;
+    NSString* sql = [NSString stringWithFormat:@"BEGIN;%@COMMIT;", kLibrarySearchSchema];
+    int rc = sqlite3_exec(self.db, sql.UTF8String, NULL, NULL, &errmsg);
+    if (rc != SQLITE_OK) {
+        NSLog(@"LibraryStore: search index unavailable: %s", errmsg ? errmsg : "unknown error");
+        sqlite3_exec(self.db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    if (errmsg) {
+        sqlite3_free(errmsg);
+    }
+    return rc == SQLITE_OK;
+}
+
+- (BOOL)migrateColumnsOfTable:(NSString*)table columns:(NSArray<NSArray<NSString*>*>*)columns error:(NSError**)error
+{
+    NSString* infoSQL = [NSString stringWithFormat:@"PRAGMA table_info(%@)", table];
+    sqlite3_stmt* stmt = NULL;
+    int rc = sqlite3_prepare_v2(self.db, infoSQL.UTF8String, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare table info"}];
+        }
+        return NO;
+    }
+
+    NSMutableSet<NSString*>* existing = [NSMutableSet set];
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* name = sqlite3_column_text(stmt, 1);
+        if (name) {
+            [existing addObject:[NSString stringWithUTF8String:(const char*) name]];
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    for (NSArray<NSString*>* column in columns) {
+        if ([existing containsObject:column[0]]) {
+            continue;
+        }
+        NSString* alterSQL = [NSString stringWithFormat:@"ALTER TABLE %@ ADD COLUMN %@ %@", table, column[0], column[1]];
+        char* errmsg = NULL;
+        rc = sqlite3_exec(self.db, alterSQL.UTF8String, NULL, NULL, &errmsg);
+        if (rc != SQLITE_OK) {
+            if (error) {
+                NSString* msg = errmsg ? [NSString stringWithUTF8String:errmsg] : @"Failed to migrate schema";
+                *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : msg}];
+            }
+            if (errmsg) {
+                sqlite3_free(errmsg);
+            }
+            return NO;
+        }
+    }
     return YES;
 }
 
@@ -144,10 +930,12 @@ static BOOL isLikelyMojibakeString(NSString* s)
     }
 
     // preferExisting == YES keeps DB/file-derived metadata and only updates bookkeeping fields.
+    // File stamps describe the file the stored tags got read from, so they
+    // only get written along with those.
     const char* sqlPreferExisting =
                       "INSERT INTO tracks "
-                      "(url,title,artist,album,albumArtist,genre,year,trackNumber,trackCount,discNumber,discCount,duration,bpm,key,rating,comment,tags,compilation,artworkHash,artworkLocation,addedAt,lastSeen,appleLocation,deepScanState,deepScanPriority,deepScanVersion,deepScanUpdatedAt,deepScanError) "
-                      "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?) "
+                      "(url,title,artist,album,albumArtist,genre,year,trackNumber,trackCount,discNumber,discCount,duration,bpm,key,rating,comment,tags,compilation,artworkHash,artworkLocation,addedAt,lastSeen,appleLocation,deepScanState,deepScanPriority,deepScanVersion,deepScanUpdatedAt,deepScanError,fileSize,fileModified,fileInode) "
+                      "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?) "
                       "ON CONFLICT(url) DO UPDATE SET "
                         // keep existing metadata; only update bookkeeping.
                       "addedAt=COALESCE(tracks.addedAt, excluded.addedAt),"
@@ -155,8 +943,8 @@ static BOOL isLikelyMojibakeString(NSString* s)
 
     const char* sqlOverwrite =
                       "INSERT INTO tracks "
-                      "(url,title,artist,album,albumArtist,genre,year,trackNumber,trackCount,discNumber,discCount,duration,bpm,key,rating,comment,tags,compilation,artworkHash,artworkLocation,addedAt,lastSeen,appleLocation,deepScanState,deepScanPriority,deepScanVersion,deepScanUpdatedAt,deepScanError) "
-                      "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?) "
+                      "(url,title,artist,album,albumArtist,genre,year,trackNumber,trackCount,discNumber,discCount,duration,bpm,key,rating,comment,tags,compilation,artworkHash,artworkLocation,addedAt,lastSeen,appleLocation,deepScanState,deepScanPriority,deepScanVersion,deepScanUpdatedAt,deepScanError,fileSize,fileModified,fileInode) "
+                      "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?) "
                       "ON CONFLICT(url) DO UPDATE SET "
                       "title=excluded.title,"
                       "artist=excluded.artist,"
@@ -184,7 +972,10 @@ static BOOL isLikelyMojibakeString(NSString* s)
                       "deepScanPriority=excluded.deepScanPriority,"
                       "deepScanVersion=excluded.deepScanVersion,"
                       "deepScanUpdatedAt=excluded.deepScanUpdatedAt,"
-                      "deepScanError=excluded.deepScanError";
+                      "deepScanError=excluded.deepScanError,"
+                      "fileSize=excluded.fileSize,"
+                      "fileModified=excluded.fileModified,"
+                      "fileInode=excluded.fileInode";
 
     const char* sql = preferExisting ? sqlPreferExisting : sqlOverwrite;
 
@@ -195,7 +986,7 @@ static BOOL isLikelyMojibakeString(NSString* s)
                          "data=excluded.data";
 
     sqlite3_stmt* stmt = NULL;
-    int rc = sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL);
+    int rc = [self prepareStatement:sql statement:&stmt];
     if (rc != SQLITE_OK) {
         if (error) {
             *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare insert"}];
@@ -204,194 +995,415 @@ static BOOL isLikelyMojibakeString(NSString* s)
     }
 
     sqlite3_stmt* artStmt = NULL;
-    rc = sqlite3_prepare_v2(self.db, artSql, -1, &artStmt, NULL);
+    rc = [self prepareStatement:artSql statement:&artStmt];
     if (rc != SQLITE_OK) {
         if (error) {
             *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare artwork insert"}];
         }
-        sqlite3_finalize(stmt);
+        [self releaseStatement:stmt];
         return NO;
     }
 
-    for (MediaMetaData* meta in items) {
-        sqlite3_reset(stmt);
-        sqlite3_clear_bindings(stmt);
-
-        sqlite3_bind_text(stmt, 1, meta.location.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, (meta.title ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 3, (meta.artist ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 4, (meta.album ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 5, (meta.albumArtist ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 6, (meta.genre ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int(stmt, 7, meta.year.intValue);
-        sqlite3_bind_int(stmt, 8, meta.track.intValue);
-        sqlite3_bind_int(stmt, 9, meta.tracks.intValue);
-        sqlite3_bind_int(stmt, 10, meta.disk.intValue);
-        sqlite3_bind_int(stmt, 11, meta.disks.intValue);
-        sqlite3_bind_double(stmt, 12, meta.duration.doubleValue);
-        sqlite3_bind_double(stmt, 13, meta.tempo.doubleValue);
-        sqlite3_bind_text(stmt, 14, (meta.key ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int(stmt, 15, meta.rating.intValue);
-        sqlite3_bind_text(stmt, 16, (meta.comment ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 17, (meta.tags ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int(stmt, 18, meta.compilation.boolValue ? 1 : 0);
-
-        // artworkHash matches the ImageController cache key for the same data blob.
-        NSString* artworkHash = meta.artworkHash;
-        if (meta.artwork != nil && artworkHash.length > 0) {
-            NSString* defaultHash = [MediaMetaData defaultArtworkData].shortSHA256;
-            NSAssert(![artworkHash isEqualToString:defaultHash], @"LibraryStore: default artwork should not be persisted for %@", meta.location);
-            if ([artworkHash isEqualToString:defaultHash]) {
-                artworkHash = nil;
-            }
-        }
-
-        if (meta.artwork != nil && artworkHash.length > 0) {
-            sqlite3_reset(artStmt);
-            sqlite3_clear_bindings(artStmt);
-            sqlite3_bind_text(artStmt, 1, artworkHash.UTF8String, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int(artStmt, 2, meta.artworkFormat.intValue);
-            sqlite3_bind_blob(artStmt, 3, meta.artwork.bytes, (int) meta.artwork.length, SQLITE_TRANSIENT);
-            int artRc = sqlite3_step(artStmt);
-            if (artRc != SQLITE_DONE) {
-                if (error) {
-                    *error = [NSError errorWithDomain:@"LibraryStore" code:artRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to insert artwork"}];
-                }
-                sqlite3_finalize(stmt);
-                sqlite3_finalize(artStmt);
-                return NO;
+    // One transaction per batch instead of a synced autocommit per row.
+    BOOL success = YES;
+    for (NSUInteger start = 0; success && start < items.count; start += kWriteBatchSize) {
+        NSArray<MediaMetaData*>* batch = [items subarrayWithRange:NSMakeRange(start, MIN(kWriteBatchSize, items.count - start))];
+        // Stamped ahead of the transaction, keeping the file system out of it.
+        LibraryFileStamp* stamps = (LibraryFileStamp*) calloc(batch.count, sizeof(LibraryFileStamp));
+        for (NSUInteger index = 0; index < batch.count; index++) {
+            NSURL* url = batch[index].location;
+            BOOL isDir = NO;
+            if (!url.isFileURL || !libraryFileStampOfURL(url, &stamps[index], &isDir) || isDir) {
+                stamps[index].size = -1;
             }
         }
-
-        sqlite3_bind_text(stmt, 19, artworkHash.UTF8String, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 20, meta.artworkLocation.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
-        double now = [NSDate date].timeIntervalSince1970;
-        double addedAt = meta.added ? meta.added.timeIntervalSince1970 : now;
-        // addedAt bind is at index 21; lastSeen is 22.
-        sqlite3_bind_double(stmt, 21, addedAt);
-        sqlite3_bind_double(stmt, 22, now);
-        sqlite3_bind_text(stmt, 23, meta.appleLocation.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
-        double durationSeconds = meta.duration != nil ? (meta.duration.doubleValue / 1000.0) : 0.0;
-        BOOL needsKey = (meta.key == nil || meta.key.length == 0) &&
-                        [KeyTrackedSample needsKeyForSampleDuration:durationSeconds];
-        BOOL needsDeepScan = (durationSeconds <= 0.0 ||
-                              meta.tempo == nil || meta.tempo.doubleValue <= 0.0 ||
-                              needsKey);
-        int deepScanState = needsDeepScan ? kDeepScanStatePending : kDeepScanStateDone;
-        int deepScanPriority = kDeepScanPriorityLow;
-        int deepScanVersion = needsDeepScan ? 0 : (int) kDeepScanVersion;
-        double deepScanUpdatedAt = needsDeepScan ? 0.0 : now;
-        sqlite3_bind_int(stmt, 24, deepScanState);
-        sqlite3_bind_int(stmt, 25, deepScanPriority);
-        sqlite3_bind_int(stmt, 26, deepScanVersion);
-        sqlite3_bind_double(stmt, 27, deepScanUpdatedAt);
-        sqlite3_bind_null(stmt, 28);
-
-        rc = sqlite3_step(stmt);
-        if (rc != SQLITE_DONE) {
-            if (error) {
-                *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to insert row"}];
+        success = [self performTransaction:^BOOL {
+            for (NSUInteger index = 0; index < batch.count; index++) {
+                const LibraryFileStamp* stamp = stamps[index].size >= 0 ? &stamps[index] : NULL;
+                if (![self bindAndStepMeta:batch[index] stamp:stamp statement:stmt artworkStatement:artStmt error:error]) {
+                    return NO;
+                }
             }
-            sqlite3_finalize(stmt);
-            sqlite3_finalize(artStmt);
-            return NO;
+            return YES;
         }
+                                     error:error];
+        free(stamps);
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_finalize(artStmt);
-    return YES;
+    [self releaseStatement:stmt];
+    [self releaseStatement:artStmt];
+    return success;
 }
 
-- (NSArray<MediaMetaData*>* _Nullable)loadAllMediaItems:(NSError**)error
+/// Upsert a single item through the prepared track and artwork statements.
+/// `stamp` is that of the item's file, NULL when unknown.
+- (BOOL)bindAndStepMeta:(MediaMetaData*)meta
+                  stamp:(const LibraryFileStamp*)stamp
+              statement:(sqlite3_stmt*)stmt
+       artworkStatement:(sqlite3_stmt*)artStmt
+                  error:(NSError**)error
 {
-    if (![self open:error]) {
-        return nil;
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    sqlite3_bind_text(stmt, 1, meta.location.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, (meta.title ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 3, (meta.artist ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 4, (meta.album ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 5, (meta.albumArtist ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 6, (meta.genre ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 7, meta.year.intValue);
+    sqlite3_bind_int(stmt, 8, meta.track.intValue);
+    sqlite3_bind_int(stmt, 9, meta.tracks.intValue);
+    sqlite3_bind_int(stmt, 10, meta.disk.intValue);
+    sqlite3_bind_int(stmt, 11, meta.disks.intValue);
+    sqlite3_bind_double(stmt, 12, meta.duration.doubleValue);
+    sqlite3_bind_double(stmt, 13, meta.tempo.doubleValue);
+    sqlite3_bind_text(stmt, 14, (meta.key ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 15, meta.rating.intValue);
+    sqlite3_bind_text(stmt, 16, (meta.comment ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 17, (meta.tags ?: @"").UTF8String, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 18, meta.compilation.boolValue ? 1 : 0);
+
+    // artworkHash matches the ImageController cache key for the same data blob.
+    NSString* artworkHash = meta.artworkHash;
+    // Artwork referenced from this store is in the artwork table already.
+    NSData* artwork = meta.artworkSource == self ? nil : meta.artwork;
+    if (artwork != nil && artworkHash.length > 0) {
+        NSString* defaultHash = [MediaMetaData defaultArtworkData].shortSHA256;
+        NSAssert(![artworkHash isEqualToString:defaultHash], @"LibraryStore: default artwork should not be persisted for %@", meta.location);
+        if ([artworkHash isEqualToString:defaultHash]) {
+            artworkHash = nil;
+        }
     }
 
-    const char* sql = "SELECT url,title,artist,album,albumArtist,genre,year,trackNumber,trackCount,discNumber,discCount,duration,bpm,key,rating,comment,tags,compilation,artworkHash,artworkLocation,addedAt,lastSeen,appleLocation FROM tracks";
-    sqlite3_stmt* stmt = NULL;
-    int rc = sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare select"}];
+    if (artwork != nil && artworkHash.length > 0) {
+        sqlite3_reset(artStmt);
+        sqlite3_clear_bindings(artStmt);
+        sqlite3_bind_text(artStmt, 1, artworkHash.UTF8String, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(artStmt, 2, meta.artworkFormat.intValue);
+        sqlite3_bind_blob(artStmt, 3, artwork.bytes, (int) artwork.length, SQLITE_TRANSIENT);
+        int artRc = sqlite3_step(artStmt);
+        if (artRc != SQLITE_DONE) {
+            if (error) {
+                *error = [NSError errorWithDomain:@"LibraryStore" code:artRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to insert artwork"}];
+            }
+            return NO;
         }
-        return nil;
     }
 
-    sqlite3_stmt* artStmt = NULL;
-    rc = sqlite3_prepare_v2(self.db, "SELECT data, format FROM artwork WHERE hash = ?", -1, &artStmt, NULL);
-    if (rc != SQLITE_OK) {
+    sqlite3_bind_text(stmt, 19, artworkHash.UTF8String, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 20, meta.artworkLocation.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+    double now = [NSDate date].timeIntervalSince1970;
+    double addedAt = meta.added ? meta.added.timeIntervalSince1970 : now;
+    // addedAt bind is at index 21; lastSeen is 22.
+    sqlite3_bind_double(stmt, 21, addedAt);
+    sqlite3_bind_double(stmt, 22, now);
+    sqlite3_bind_text(stmt, 23, meta.appleLocation.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+    double durationSeconds = meta.duration != nil ? (meta.duration.doubleValue / 1000.0) : 0.0;
+    BOOL needsKey = meta.key == nil || meta.key.length == 0;
+    BOOL needsDeepScan = (durationSeconds <= 0.0 ||
+                          meta.tempo == nil || meta.tempo.doubleValue <= 0.0 ||
+                          needsKey);
+    int deepScanState = needsDeepScan ? kDeepScanStatePending : kDeepScanStateDone;
+    int deepScanPriority = kDeepScanPriorityLow;
+    int deepScanVersion = needsDeepScan ? 0 : (int) kDeepScanVersion;
+    double deepScanUpdatedAt = needsDeepScan ? 0.0 : now;
+    sqlite3_bind_int(stmt, 24, deepScanState);
+    sqlite3_bind_int(stmt, 25, deepScanPriority);
+    sqlite3_bind_int(stmt, 26, deepScanVersion);
+    sqlite3_bind_double(stmt, 27, deepScanUpdatedAt);
+    sqlite3_bind_null(stmt, 28);
+    if (stamp != NULL) {
+        sqlite3_bind_int64(stmt, 29, stamp->size);
+        sqlite3_bind_double(stmt, 30, stamp->modified);
+        sqlite3_bind_int64(stmt, 31, stamp->inode);
+    }
+
+    int rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE) {
         if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare artwork select"}];
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to insert row"}];
         }
-        sqlite3_finalize(stmt);
-        return nil;
+        return NO;
     }
+    return YES;
+}
 
-    NSMutableArray<MediaMetaData*>* result = [NSMutableArray array];
-
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        MediaMetaData* meta = [MediaMetaData new];
+- (void)queueImportOfMediaItems:(NSArray<MediaMetaData*>*)items
+{
+    if (items.count == 0) {
+        return;
+    }
+    dispatch_async(self.writeQueue, ^{
+        [self.pendingWrites addObjectsFromArray:items];
+        if (self.pendingWrites.count >= kWriteBatchSize) {
+            [self writePendingItems];
+            return;
+        }
+        if (!self.pendingWriteScheduled) {
+            self.pendingWriteScheduled = YES;
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (kWriteBatchLatency * NSEC_PER_SEC)), self.writeQueue, ^{
+                [self writePendingItems];
+            });
+        }
+    });
+}
 
-        const char* url = (const char*) sqlite3_column_text(stmt, 0);
+- (BOOL)flushQueuedImports:(NSError**)error
+{
+    NSError* __block flushError = nil;
+    dispatch_sync(self.writeQueue, ^{
+        [self writePendingItems];
+        flushError = self.pendingWriteError;
+        self.pendingWriteError = nil;
+    });
+    if (flushError != nil && error) {
+        *error = flushError;
+    }
+    return flushError == nil;
+}
 
-        meta.location = url ? [NSURL URLWithString:@(url)] : nil;
-        meta.title = sqlite3_column_text(stmt, 1) ? @((const char*) sqlite3_column_text(stmt, 1)) : nil;
-        meta.artist = sqlite3_column_text(stmt, 2) ? @((const char*) sqlite3_column_text(stmt, 2)) : nil;
-        meta.album = sqlite3_column_text(stmt, 3) ? @((const char*) sqlite3_column_text(stmt, 3)) : nil;
-        meta.albumArtist = sqlite3_column_text(stmt, 4) ? @((const char*) sqlite3_column_text(stmt, 4)) : nil;
-        meta.genre = sqlite3_column_text(stmt, 5) ? @((const char*) sqlite3_column_text(stmt, 5)) : nil;
-        meta.year = @(sqlite3_column_int(stmt, 6));
-        meta.track = @(sqlite3_column_int(stmt, 7));
-        meta.tracks = @(sqlite3_column_int(stmt, 8));
-        meta.disk = @(sqlite3_column_int(stmt, 9));
-        meta.disks = @(sqlite3_column_int(stmt, 10));
-        meta.duration = @(sqlite3_column_double(stmt, 11));
-        meta.tempo = @(sqlite3_column_double(stmt, 12));
-        meta.key = sqlite3_column_text(stmt, 13) ? @((const char*) sqlite3_column_text(stmt, 13)) : nil;
-        meta.rating = @(sqlite3_column_int(stmt, 14));
-        meta.comment = sqlite3_column_text(stmt, 15) ? @((const char*) sqlite3_column_text(stmt, 15)) : nil;
-        meta.tags = sqlite3_column_text(stmt, 16) ? @((const char*) sqlite3_column_text(stmt, 16)) : nil;
-        meta.compilation = @(sqlite3_column_int(stmt, 17) != 0);
-        const char* artHash = (const char*) sqlite3_column_text(stmt, 18);
-        const char* artLoc = (const char*) sqlite3_column_text(stmt, 19);
-        meta.artworkLocation = artLoc ? [NSURL URLWithString:@(artLoc)] : nil;
-        double addedAt = sqlite3_column_double(stmt, 20);
-        if (addedAt > 0.0) {
-            meta.added = [NSDate dateWithTimeIntervalSince1970:addedAt];
-        }
-        const char* appleLoc = (const char*) sqlite3_column_text(stmt, 22);
-        meta.appleLocation = appleLoc ? [NSURL URLWithString:@(appleLoc)] : nil;
-
-        if (artHash) {
-            sqlite3_reset(artStmt);
-            sqlite3_clear_bindings(artStmt);
-            sqlite3_bind_text(artStmt, 1, artHash, -1, SQLITE_TRANSIENT);
-            int artRc = sqlite3_step(artStmt);
-            if (artRc == SQLITE_ROW) {
-                const void* data = sqlite3_column_blob(artStmt, 0);
-                int length = sqlite3_column_bytes(artStmt, 0);
-                if (data && length > 0) {
-                    meta.artwork = [NSData dataWithBytes:data length:length];
-                }
-                meta.artworkFormat = @(sqlite3_column_int(artStmt, 1));
-            }
+// Called on the write queue.
+- (void)writePendingItems
+{
+    self.pendingWriteScheduled = NO;
+    if (self.pendingWrites.count == 0) {
+        return;
+    }
+    NSArray<MediaMetaData*>* items = [self.pendingWrites copy];
+    [self.pendingWrites removeAllObjects];
+    NSError* error = nil;
+    if (![self importMediaItems:items preferExisting:NO error:&error]) {
+        NSLog(@"LibraryStore: queued import of %lu items failed: %@", (unsigned long) items.count, error);
+        if (self.pendingWriteError == nil) {
+            self.pendingWriteError = error;
         }
+    }
+}
 
-        [result addObject:meta];
+/// `MediaMetaData` of a row selected with `LIBRARY_TRACK_COLUMNS`.
+- (MediaMetaData*)metaFromTrackRow:(sqlite3_stmt*)stmt
+{
+    MediaMetaData* meta = [MediaMetaData new];
+
+    const char* url = (const char*) sqlite3_column_text(stmt, 0);
+
+    meta.location = url ? [NSURL URLWithString:@(url)] : nil;
+    meta.title = sqlite3_column_text(stmt, 1) ? @((const char*) sqlite3_column_text(stmt, 1)) : nil;
+    meta.artist = sqlite3_column_text(stmt, 2) ? @((const char*) sqlite3_column_text(stmt, 2)) : nil;
+    meta.album = sqlite3_column_text(stmt, 3) ? @((const char*) sqlite3_column_text(stmt, 3)) : nil;
+    meta.albumArtist = sqlite3_column_text(stmt, 4) ? @((const char*) sqlite3_column_text(stmt, 4)) : nil;
+    meta.genre = sqlite3_column_text(stmt, 5) ? @((const char*) sqlite3_column_text(stmt, 5)) : nil;
+    meta.year = @(sqlite3_column_int(stmt, 6));
+    meta.track = @(sqlite3_column_int(stmt, 7));
+    meta.tracks = @(sqlite3_column_int(stmt, 8));
+    meta.disk = @(sqlite3_column_int(stmt, 9));
+    meta.disks = @(sqlite3_column_int(stmt, 10));
+    meta.duration = @(sqlite3_column_double(stmt, 11));
+    meta.tempo = @(sqlite3_column_double(stmt, 12));
+    meta.key = sqlite3_column_text(stmt, 13) ? @((const char*) sqlite3_column_text(stmt, 13)) : nil;
+    meta.rating = @(sqlite3_column_int(stmt, 14));
+    meta.comment = sqlite3_column_text(stmt, 15) ? @((const char*) sqlite3_column_text(stmt, 15)) : nil;
+    meta.tags = sqlite3_column_text(stmt, 16) ? @((const char*) sqlite3_column_text(stmt, 16)) : nil;
+    meta.compilation = @(sqlite3_column_int(stmt, 17) != 0);
+    const char* artHash = (const char*) sqlite3_column_text(stmt, 18);
+    const char* artLoc = (const char*) sqlite3_column_text(stmt, 19);
+    meta.artworkLocation = artLoc ? [NSURL URLWithString:@(artLoc)] : nil;
+    double addedAt = sqlite3_column_double(stmt, 20);
+    if (addedAt > 0.0) {
+        meta.added = [NSDate dateWithTimeIntervalSince1970:addedAt];
+    }
+    const char* appleLoc = (const char*) sqlite3_column_text(stmt, 22);
+    meta.appleLocation = appleLoc ? [NSURL URLWithString:@(appleLoc)] : nil;
+
+    // Artwork stays on disk until somebody looks at it.
+    if (artHash) {
+        [meta setArtworkHash:@(artHash) source:self];
+        if (sqlite3_column_type(stmt, 23) != SQLITE_NULL) {
+            meta.artworkFormat = @(sqlite3_column_int(stmt, 23));
+        }
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_finalize(artStmt);
+    return meta;
+}
+
+- (NSArray<MediaMetaData*>* _Nullable)loadAllMediaItems:(NSError**)error
+{
+    if (![self open:error]) {
+        return nil;
+    }
 
+    const char* sql = "SELECT " LIBRARY_TRACK_COLUMNS " FROM tracks";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare select"}];
+        }
+        return nil;
+    }
+
+    NSMutableArray<MediaMetaData*>* result = [NSMutableArray array];
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        [result addObject:[self metaFromTrackRow:stmt]];
+    }
+
+    [self releaseStatement:stmt];
+
+    return result;
+}
+
+- (NSArray<MediaMetaData*>* _Nullable)loadMediaItemsForURLs:(NSArray<NSURL*>*)urls error:(NSError**)error
+{
+    if (![self open:error]) {
+        return nil;
+    }
+
+    const char* sql = "SELECT " LIBRARY_TRACK_COLUMNS " FROM tracks WHERE url = ?";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare select"}];
+        }
+        return nil;
+    }
+
+    NSMutableArray<MediaMetaData*>* result = [NSMutableArray arrayWithCapacity:urls.count];
+    rc = [self stepStatement:stmt
+                     forURLs:urls
+                         row:^(sqlite3_stmt* row) {
+                             [result addObject:[self metaFromTrackRow:row]];
+                         }];
+    [self releaseStatement:stmt];
+
+    if (rc != SQLITE_DONE) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to read tracks"}];
+        }
+        return nil;
+    }
     return result;
 }
 
+#pragma mark - Artwork
+
+- (NSData* _Nullable)artworkDataForHash:(NSString*)hash
+{
+    if (hash.length == 0) {
+        return nil;
+    }
+    NSData* data = [self.artworkCache objectForKey:hash];
+    if (data != nil) {
+        return data;
+    }
+    return [self artworkDataForHashes:@[ hash ] error:nil][hash];
+}
+
+- (NSDictionary<NSString*, NSData*>* _Nullable)artworkDataForHashes:(NSArray<NSString*>*)hashes error:(NSError**)error
+{
+    NSMutableDictionary<NSString*, NSData*>* found = [NSMutableDictionary dictionary];
+    NSMutableOrderedSet<NSString*>* missing = [NSMutableOrderedSet orderedSet];
+    for (NSString* hash in hashes) {
+        NSData* data = [self.artworkCache objectForKey:hash];
+        if (data != nil) {
+            found[hash] = data;
+        } else if (hash.length > 0) {
+            [missing addObject:hash];
+        }
+    }
+    if (missing.count == 0) {
+        return found;
+    }
+    if (![self open:error]) {
+        return nil;
+    }
+
+    // Always a full batch of placeholders, the unused ones left NULL, so that
+    // one statement gets prepared and reused on the read connections.
+    static NSString* sql = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSMutableArray<NSString*>* placeholders = [NSMutableArray arrayWithCapacity:kArtworkFetchBatchSize];
+        for (NSUInteger i = 0; i < kArtworkFetchBatchSize; i++) {
+            [placeholders addObject:@"?"];
+        }
+        sql = [NSString stringWithFormat:@"SELECT hash, data FROM artwork WHERE hash IN (%@)", [placeholders componentsJoinedByString:@","]];
+    });
+
+    for (NSUInteger start = 0; start < missing.count; start += kArtworkFetchBatchSize) {
+        NSUInteger count = MIN(kArtworkFetchBatchSize, missing.count - start);
+        sqlite3_stmt* stmt = NULL;
+        int rc = [self prepareStatement:sql.UTF8String statement:&stmt];
+        if (rc != SQLITE_OK) {
+            if (error) {
+                *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare artwork select"}];
+            }
+            return nil;
+        }
+        for (NSUInteger i = 0; i < count; i++) {
+            sqlite3_bind_text(stmt, (int) i + 1, missing[start + i].UTF8String, -1, SQLITE_TRANSIENT);
+        }
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            const char* hash = (const char*) sqlite3_column_text(stmt, 0);
+            const void* bytes = sqlite3_column_blob(stmt, 1);
+            int length = sqlite3_column_bytes(stmt, 1);
+            if (hash == NULL || bytes == NULL || length <= 0) {
+                continue;
+            }
+            NSData* data = [NSData dataWithBytes:bytes length:length];
+            NSString* key = @(hash);
+            [self.artworkCache setObject:data forKey:key cost:data.length];
+            found[key] = data;
+        }
+        [self releaseStatement:stmt];
+        if (rc != SQLITE_DONE) {
+            if (error) {
+                *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to read artwork"}];
+            }
+            return nil;
+        }
+    }
+
+    return found;
+}
+
+- (void)prefetchArtworkForMetas:(NSArray<MediaMetaData*>*)metas
+{
+    NSMutableArray<NSString*>* hashes = [NSMutableArray arrayWithCapacity:metas.count];
+    for (MediaMetaData* meta in metas) {
+        if (meta.artworkSource == self && meta.artworkHash.length > 0) {
+            [hashes addObject:meta.artworkHash];
+        }
+    }
+    if (hashes.count == 0) {
+        return;
+    }
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        NSError* error = nil;
+        if ([self artworkDataForHashes:hashes error:&error] == nil) {
+            NSLog(@"LibraryStore: artwork prefetch failed: %@", error);
+        }
+    });
+}
+
 - (void)importFileURLs:(NSArray<NSURL*>*)urls completion:(void (^)(NSArray<MediaMetaData*>* _Nullable metas, NSError* _Nullable error))completion
 {
     dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        // Moved files keep their entries instead of getting analyzed again.
+        NSMutableDictionary<NSString*, NSString*>* fingerprints = [NSMutableDictionary dictionary];
+        NSError* relocateError = nil;
+        NSDictionary<NSURL*, NSURL*>* relocated = [self relocateEntriesToURLs:urls fingerprints:fingerprints error:&relocateError];
+        if (relocated == nil) {
+            NSLog(@"LibraryStore: relocating moved files failed: %@", relocateError.localizedDescription);
+        } else if (relocated.count > 0) {
+            NSLog(@"LibraryStore: matched %lu imported files to moved entries", (unsigned long) relocated.count);
+        }
+
         NSMutableArray<MediaMetaData*>* metas = [NSMutableArray array];
+        NSMutableArray<MediaMetaData*>* relocatedMetas = [NSMutableArray array];
         MetaController* loader = [MetaController new];
         dispatch_group_t group = dispatch_group_create();
         dispatch_queue_t mergeQueue = dispatch_queue_create("PlayEm.LibraryStore.ImportMerge", DISPATCH_QUEUE_SERIAL);
@@ -404,9 +1416,17 @@ static BOOL isLikelyMojibakeString(NSString* s)
                                      if (meta.added == nil) {
                                          meta.added = [NSDate date];
                                      }
-                                     dispatch_async(mergeQueue, ^{
-                                         [metas addObject:meta];
-                                     });
+                                     if (relocated[url] != nil) {
+                                         dispatch_async(mergeQueue, ^{
+                                             [metas addObject:meta];
+                                             [relocatedMetas addObject:meta];
+                                         });
+                                     } else {
+                                         dispatch_async(mergeQueue, ^{
+                                             [metas addObject:meta];
+                                         });
+                                         [self queueImportOfMediaItems:@[ meta ]];
+                                     }
                                  } else {
                                      NSLog(@"LibraryStore: failed to read metadata for %@", url);
                                  }
@@ -418,11 +1438,18 @@ static BOOL isLikelyMojibakeString(NSString* s)
         dispatch_sync(mergeQueue, ^{});
 
         NSError* err = nil;
-        if (metas.count > 0) {
-            [self importMediaItems:metas preferExisting:NO error:&err];
+        [self flushQueuedImports:&err];
+        // Moved entries hold the same content; keep what got stored for it.
+        if (err == nil && relocatedMetas.count > 0) {
+            [self importMediaItems:relocatedMetas preferExisting:YES error:&err];
         }
         if (err) {
             NSLog(@"LibraryStore: importMediaItems failed: %@", err.localizedDescription);
+        } else {
+            NSError* fingerprintErr = nil;
+            if (![self storeFingerprints:fingerprints error:&fingerprintErr]) {
+                NSLog(@"LibraryStore: failed to store fingerprints: %@", fingerprintErr.localizedDescription);
+            }
         }
         dispatch_async(dispatch_get_main_queue(), ^{
             if (completion) {
@@ -432,50 +1459,224 @@ static BOOL isLikelyMojibakeString(NSString* s)
     });
 }
 
-// Read metadata from files without touching the database.
-- (void)readFileURLs:(NSArray<NSURL*>*)urls completion:(void (^)(NSArray<MediaMetaData*>* _Nullable metas, NSError* _Nullable error))completion
+// Read metadata from files without touching the database, a bounded number
+// of files at a time.
+- (NSArray<MediaMetaData*>*)readFileURLs:(NSArray<NSURL*>*)urls
 {
-    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
-        NSMutableArray<MediaMetaData*>* metas = [NSMutableArray array];
-        MetaController* loader = [MetaController new];
-        dispatch_group_t group = dispatch_group_create();
-        dispatch_queue_t mergeQueue = dispatch_queue_create("PlayEm.LibraryStore.ReadMerge", DISPATCH_QUEUE_SERIAL);
+    NSMutableArray<MediaMetaData*>* metas = [NSMutableArray arrayWithCapacity:urls.count];
+    for (NSUInteger start = 0; start < urls.count; start += kReconcileReadBatchSize) {
+        @autoreleasepool {
+            NSArray<NSURL*>* batch = [urls subarrayWithRange:NSMakeRange(start, MIN(kReconcileReadBatchSize, urls.count - start))];
+            __strong MediaMetaData** results = (__strong MediaMetaData**) calloc(batch.count, sizeof(MediaMetaData*));
+            dispatch_apply(batch.count, DISPATCH_APPLY_AUTO, ^(size_t index) {
+                NSURL* url = batch[index];
+                NSError* error = nil;
+                MediaMetaData* meta = [MediaMetaData mediaMetaDataWithURL:url error:&error];
+                if (meta == nil) {
+                    NSLog(@"LibraryStore: failed to read metadata for %@: %@", url, error);
+                }
+                results[index] = meta;
+            });
+            for (NSUInteger index = 0; index < batch.count; index++) {
+                if (results[index] != nil) {
+                    [metas addObject:results[index]];
+                }
+                results[index] = nil;
+            }
+            free(results);
+        }
+    }
+    return metas;
+}
 
-        for (NSURL* url in urls) {
-            dispatch_group_enter(group);
-            [loader loadAsyncWithPath:url.path
-                             callback:^(MediaMetaData* meta) {
-                                 if (meta) {
-                                     dispatch_async(mergeQueue, ^{
-                                         [metas addObject:meta];
-                                     });
-                                 } else {
-                                     NSLog(@"LibraryStore: failed to read metadata for %@", url);
-                                 }
-                                 dispatch_group_leave(group);
-                             }];
+/// File stamps of the given tracks, or of all tracks when `urls` is nil.
+- (NSDictionary<NSString*, NSValue*>* _Nullable)loadFileStampsForURLs:(NSArray<NSURL*>* _Nullable)urls error:(NSError**)error
+{
+    const char* sql = urls ? "SELECT url, fileSize, fileModified, fileInode FROM tracks WHERE url = ? AND fileSize IS NOT NULL"
+                           : "SELECT url, fileSize, fileModified, fileInode FROM tracks WHERE fileSize IS NOT NULL";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare file stamp select"}];
         }
+        return nil;
+    }
 
-        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
-        dispatch_sync(mergeQueue, ^{});
+    NSMutableDictionary<NSString*, NSValue*>* stamps = [NSMutableDictionary dictionary];
+    rc = [self stepStatement:stmt
+                     forURLs:urls
+                         row:^(sqlite3_stmt* row) {
+                             const char* url = (const char*) sqlite3_column_text(row, 0);
+                             if (url == NULL) {
+                                 return;
+                             }
+                             LibraryFileStamp stamp = {
+                                 .size = sqlite3_column_int64(row, 1),
+                                 .modified = sqlite3_column_double(row, 2),
+                                 .inode = sqlite3_column_int64(row, 3),
+                             };
+                             stamps[@(url)] = [NSValue valueWithBytes:&stamp objCType:@encode(LibraryFileStamp)];
+                         }];
+    [self releaseStatement:stmt];
 
-        dispatch_async(dispatch_get_main_queue(), ^{
-            if (completion) {
-                completion(metas.count > 0 ? [metas copy] : @[], nil);
+    if (rc != SQLITE_DONE) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to read file stamps"}];
+        }
+        return nil;
+    }
+    return stamps;
+}
+
+- (BOOL)storeFileStamps:(NSDictionary<NSString*, NSValue*>*)stamps error:(NSError**)error
+{
+    if (stamps.count == 0) {
+        return YES;
+    }
+
+    const char* sql = "UPDATE tracks SET fileSize = ?, fileModified = ?, fileInode = ? WHERE url = ?";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare file stamp update"}];
+        }
+        return NO;
+    }
+
+    BOOL success = [self performTransaction:^BOOL {
+        __block BOOL stored = YES;
+        [stamps enumerateKeysAndObjectsUsingBlock:^(NSString* url, NSValue* value, BOOL* stop) {
+            LibraryFileStamp stamp;
+            [value getValue:&stamp size:sizeof(stamp)];
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+            sqlite3_bind_int64(stmt, 1, stamp.size);
+            sqlite3_bind_double(stmt, 2, stamp.modified);
+            sqlite3_bind_int64(stmt, 3, stamp.inode);
+            sqlite3_bind_text(stmt, 4, url.UTF8String, -1, SQLITE_TRANSIENT);
+            int stepRc = sqlite3_step(stmt);
+            if (stepRc != SQLITE_DONE) {
+                if (error) {
+                    *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to store file stamp"}];
+                }
+                stored = NO;
+                *stop = YES;
             }
-        });
-    });
+        }];
+        return stored;
+    }
+                                      error:error];
+    [self releaseStatement:stmt];
+
+    return success;
+}
+
+/// Those of the given tracks, or of all tracks when `urls` is nil, that lack a fingerprint.
+- (NSSet<NSString*>* _Nullable)loadUnfingerprintedURLsForURLs:(NSArray<NSURL*>* _Nullable)urls error:(NSError**)error
+{
+    const char* sql = urls ? "SELECT url FROM tracks WHERE url = ? AND fingerprint IS NULL"
+                           : "SELECT url FROM tracks WHERE fingerprint IS NULL";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare fingerprint select"}];
+        }
+        return nil;
+    }
+
+    NSMutableSet<NSString*>* unfingerprinted = [NSMutableSet set];
+    rc = [self stepStatement:stmt
+                     forURLs:urls
+                         row:^(sqlite3_stmt* row) {
+                             const char* url = (const char*) sqlite3_column_text(row, 0);
+                             if (url != NULL) {
+                                 [unfingerprinted addObject:@(url)];
+                             }
+                         }];
+    [self releaseStatement:stmt];
+
+    if (rc != SQLITE_DONE) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to read fingerprints"}];
+        }
+        return nil;
+    }
+    return unfingerprinted;
+}
+
+- (BOOL)storeFingerprints:(NSDictionary<NSString*, NSString*>*)fingerprints error:(NSError**)error
+{
+    if (fingerprints.count == 0) {
+        return YES;
+    }
+
+    const char* sql = "UPDATE tracks SET fingerprint = ? WHERE url = ?";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare fingerprint update"}];
+        }
+        return NO;
+    }
+
+    BOOL success = [self performTransaction:^BOOL {
+        __block BOOL stored = YES;
+        [fingerprints enumerateKeysAndObjectsUsingBlock:^(NSString* url, NSString* fingerprint, BOOL* stop) {
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+            sqlite3_bind_text(stmt, 1, fingerprint.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 2, url.UTF8String, -1, SQLITE_TRANSIENT);
+            int stepRc = sqlite3_step(stmt);
+            if (stepRc != SQLITE_DONE) {
+                if (error) {
+                    *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to store fingerprint"}];
+                }
+                stored = NO;
+                *stop = YES;
+            }
+        }];
+        return stored;
+    }
+                                      error:error];
+    [self releaseStatement:stmt];
+
+    return success;
 }
 
 - (void)reconcileLibraryWithCompletion:(void (^)(NSArray<MediaMetaData*>* _Nullable refreshedMetas,
                                                  NSArray<MediaMetaData*>* _Nullable changedMetas,
                                                  NSArray<NSURL*>* missingFiles,
                                                  NSError* _Nullable error))completion
+{
+    [self reconcileURLs:nil completion:completion];
+}
+
+- (void)reconcileFileURLs:(NSArray<NSURL*>*)urls
+               completion:(void (^)(NSArray<MediaMetaData*>* _Nullable refreshedMetas,
+                                    NSArray<MediaMetaData*>* _Nullable changedMetas,
+                                    NSArray<NSURL*>* missingFiles,
+                                    NSError* _Nullable error))completion
+{
+    [self reconcileURLs:urls completion:completion];
+}
+
+/// Reconcile the given tracks, or all tracks when `urls` is nil.
+- (void)reconcileURLs:(NSArray<NSURL*>* _Nullable)urls
+           completion:(void (^)(NSArray<MediaMetaData*>* _Nullable refreshedMetas,
+                                NSArray<MediaMetaData*>* _Nullable changedMetas,
+                                NSArray<NSURL*>* missingFiles,
+                                NSError* _Nullable error))completion
 {
     dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
         NSError* loadError = nil;
-        NSArray<MediaMetaData*>* existing = [self loadAllMediaItems:&loadError];
-        if (!existing) {
+        NSArray<MediaMetaData*>* existing = urls ? [self loadMediaItemsForURLs:urls error:&loadError] : [self loadAllMediaItems:&loadError];
+        NSDictionary<NSString*, NSValue*>* stamps = existing ? [self loadFileStampsForURLs:urls error:&loadError] : nil;
+        NSSet<NSString*>* unfingerprinted = stamps ? [self loadUnfingerprintedURLsForURLs:urls error:&loadError] : nil;
+        if (!existing || !stamps || !unfingerprinted) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 if (completion) {
                     completion(nil, nil, @[], loadError);
@@ -484,136 +1685,311 @@ static BOOL isLikelyMojibakeString(NSString* s)
             return;
         }
 
+        // A single stat per file tells whether its tags need another look.
+        // Changed files get fingerprinted again, so they can be found once moved.
+        NSArray<MediaMetaData*>* located = [existing filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"location != nil"]];
+        const NSUInteger count = located.count;
+        LibraryFileStamp* current = (LibraryFileStamp*) calloc(MAX(count, 1), sizeof(LibraryFileStamp));
+        BOOL* present = (BOOL*) calloc(MAX(count, 1), sizeof(BOOL));
+        BOOL* unchanged = (BOOL*) calloc(MAX(count, 1), sizeof(BOOL));
+        __strong NSString** prints = (__strong NSString**) calloc(MAX(count, 1), sizeof(NSString*));
+        dispatch_apply(count, DISPATCH_APPLY_AUTO, ^(size_t index) {
+            NSURL* url = located[index].location;
+            BOOL isDir = NO;
+            if (!libraryFileStampOfURL(url, &current[index], &isDir) || isDir) {
+                return;
+            }
+            present[index] = YES;
+            NSValue* stored = stamps[url.absoluteString];
+            if (stored != nil) {
+                LibraryFileStamp previous;
+                [stored getValue:&previous size:sizeof(previous)];
+                unchanged[index] = (previous.size == current[index].size &&
+                                    previous.modified == current[index].modified &&
+                                    previous.inode == current[index].inode);
+            }
+            if (!unchanged[index] || [unfingerprinted containsObject:url.absoluteString]) {
+                prints[index] = libraryFingerprintOfURL(url);
+            }
+        });
+
         NSMutableDictionary<NSString*, MediaMetaData*>* existingByURL = [NSMutableDictionary dictionary];
-        NSMutableArray<NSURL*>* existingURLs = [NSMutableArray array];
+        NSMutableDictionary<NSString*, NSValue*>* changedStamps = [NSMutableDictionary dictionary];
+        NSMutableArray<NSURL*>* changedURLs = [NSMutableArray array];
         NSMutableArray<NSURL*>* missing = [NSMutableArray array];
-        NSFileManager* fm = [NSFileManager defaultManager];
-
-        for (MediaMetaData* meta in existing) {
+        NSMutableDictionary<NSString*, NSString*>* fingerprints = [NSMutableDictionary dictionary];
+        for (NSUInteger index = 0; index < count; index++) {
+            MediaMetaData* meta = located[index];
             NSURL* url = meta.location;
-            if (url == nil) {
-                continue;
+            if (prints[index] != nil) {
+                fingerprints[url.absoluteString] = prints[index];
+                prints[index] = nil;
             }
-            BOOL isDir = NO;
-            if (![fm fileExistsAtPath:url.path isDirectory:&isDir] || isDir) {
+            if (!present[index]) {
                 [missing addObject:url];
                 continue;
             }
+            if (unchanged[index]) {
+                continue;
+            }
             existingByURL[url.absoluteString] = meta;
-            [existingURLs addObject:url];
-        }
-
-        [self readFileURLs:existingURLs
-                  completion:^(NSArray<MediaMetaData*>* _Nullable metas, NSError* _Nullable importErr) {
-                      dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
-                          NSArray<MediaMetaData*>* refreshed = metas ?: @[];
-                          NSMutableArray<MediaMetaData*>* changed = [NSMutableArray array];
-                          NSMutableArray<MediaMetaData*>* toUpdate = [NSMutableArray array];
-                          if (importErr) {
-                              NSLog(@"LibraryStore: reconcile read error: %@", importErr.localizedDescription);
-                          }
-
-                          NSArray<NSString*>* writableKeys = @[
-                              @"title",
-                              @"artist",
-                              @"album",
-                              @"albumArtist",
-                              @"genre",
-                              @"comment",
-                              @"tags",
-                              @"key",
-                              @"year",
-                              @"track",
-                              @"tracks",
-                              @"disk",
-                              @"disks",
-                              @"tempo",
-                              @"rating",
-                              @"compilation",
-                              @"artwork",
-                              @"artworkFormat",
-                              @"artworkLocation",
-                              @"appleLocation",
-                          ];
-
-                          for (MediaMetaData* meta in refreshed) {
-                              MediaMetaData* old = existingByURL[meta.location.absoluteString];
-                              if (old && old.added) {
-                                  meta.added = old.added;
-                              }
-                              if (old && old.duration) {
-                                  meta.duration = old.duration;
-                              }
-                              // Avoid overwriting good metadata with obvious mojibake.
-                              if (old) {
-                                  NSArray<NSString*>* textKeys = @[ @"title", @"artist", @"album", @"albumArtist", @"genre", @"comment", @"tags", @"key" ];
-                                  for (NSString* key in textKeys) {
-                                      NSString* newVal = [meta valueForKey:key];
-                                      if (newVal.length > 0) {
-                                          NSString* sanitized = [newVal sanitizedMetadataString];
-                                          if (![sanitized isEqualToString:newVal]) {
-                                              [meta setValue:sanitized forKey:key];
-                                              newVal = sanitized;
-                                          }
-                                      }
-                                      NSString* oldVal = [old valueForKey:key];
-                                      if ([newVal isLikelyMojibakeMetadata]) {
-                                          if (oldVal.length > 0) {
-                                              [meta setValue:oldVal forKey:key];
-                                          } else {
-                                              [meta setValue:@"" forKey:key];
-                                          }
-                                      }
-                                  }
-                              }
-                              if (old && ![old isSemanticallyEqualToMeta:meta]) {
-                                  [changed addObject:meta];
-
-                                  MediaMetaData* merged = [old copy];
-                                  for (NSString* key in writableKeys) {
-                                      id newValue = [meta valueForKey:key];
-                                      if (newValue != nil) {
-                                          [merged setValue:newValue forKey:key];
-                                      }
-                                  }
-                                  [toUpdate addObject:merged];
-                              }
-                          }
-
-                          NSError* updateErr = nil;
-                          if (toUpdate.count > 0) {
-                              [self importMediaItems:toUpdate preferExisting:NO error:&updateErr];
-                          }
-
-                          dispatch_async(dispatch_get_main_queue(), ^{
-                              if (completion) {
-                                  completion(refreshed, changed, missing, updateErr ?: importErr);
-                              }
-                          });
-                      });
-                  }];
+            changedStamps[url.absoluteString] = [NSValue valueWithBytes:&current[index] objCType:@encode(LibraryFileStamp)];
+            [changedURLs addObject:url];
+        }
+        free(current);
+        free(present);
+        free(unchanged);
+        free(prints);
+
+        NSArray<MediaMetaData*>* refreshed = [self readFileURLs:changedURLs];
+        self.lastReconcileStatCount = count;
+        self.lastReconcileParseCount = changedURLs.count;
+        NSLog(@"LibraryStore: reconcile stat'd %lu files, re-parsed %lu, %lu missing",
+              (unsigned long) count, (unsigned long) changedURLs.count, (unsigned long) missing.count);
+
+        NSMutableArray<MediaMetaData*>* changed = [NSMutableArray array];
+        NSMutableArray<MediaMetaData*>* toUpdate = [NSMutableArray array];
+
+        NSArray<NSString*>* writableKeys = @[
+            @"title",
+            @"artist",
+            @"album",
+            @"albumArtist",
+            @"genre",
+            @"comment",
+            @"tags",
+            @"key",
+            @"year",
+            @"track",
+            @"tracks",
+            @"disk",
+            @"disks",
+            @"tempo",
+            @"rating",
+            @"compilation",
+            @"artwork",
+            @"artworkFormat",
+            @"artworkLocation",
+            @"appleLocation",
+        ];
+
+        for (MediaMetaData* meta in refreshed) {
+            MediaMetaData* old = existingByURL[meta.location.absoluteString];
+            if (old && old.added) {
+                meta.added = old.added;
+            }
+            if (old && old.duration) {
+                meta.duration = old.duration;
+            }
+            // Avoid overwriting good metadata with obvious mojibake.
+            if (old) {
+                NSArray<NSString*>* textKeys = @[ @"title", @"artist", @"album", @"albumArtist", @"genre", @"comment", @"tags", @"key" ];
+                for (NSString* key in textKeys) {
+                    NSString* newVal = [meta valueForKey:key];
+                    if (newVal.length > 0) {
+                        NSString* sanitized = [newVal sanitizedMetadataString];
+                        if (![sanitized isEqualToString:newVal]) {
+                            [meta setValue:sanitized forKey:key];
+                            newVal = sanitized;
+                        }
+                    }
+                    NSString* oldVal = [old valueForKey:key];
+                    if ([newVal isLikelyMojibakeMetadata]) {
+                        if (oldVal.length > 0) {
+                            [meta setValue:oldVal forKey:key];
+                        } else {
+                            [meta setValue:@"" forKey:key];
+                        }
+                    }
+                }
+            }
+            if (old && ![old isSemanticallyEqualToMeta:meta]) {
+                [changed addObject:meta];
+
+                MediaMetaData* merged = [old copy];
+                for (NSString* key in writableKeys) {
+                    id newValue = [meta valueForKey:key];
+                    if (newValue != nil) {
+                        [merged setValue:newValue forKey:key];
+                    }
+                }
+                [toUpdate addObject:merged];
+            }
+        }
+
+        NSError* updateErr = nil;
+        if (toUpdate.count > 0) {
+            [self importMediaItems:toUpdate preferExisting:NO error:&updateErr];
+        }
+        // Stamps of files that could not be parsed stay as they were, so the
+        // next reconcile tries them again.
+        NSMutableDictionary<NSString*, NSValue*>* parsedStamps = [NSMutableDictionary dictionary];
+        for (MediaMetaData* meta in refreshed) {
+            NSValue* stamp = changedStamps[meta.location.absoluteString];
+            if (stamp != nil) {
+                parsedStamps[meta.location.absoluteString] = stamp;
+            }
+        }
+        NSError* stampErr = nil;
+        if (updateErr == nil && ![self storeFileStamps:parsedStamps error:&stampErr]) {
+            NSLog(@"LibraryStore: failed to store file stamps: %@", stampErr.localizedDescription);
+        }
+        NSError* fingerprintErr = nil;
+        if (![self storeFingerprints:fingerprints error:&fingerprintErr]) {
+            NSLog(@"LibraryStore: failed to store fingerprints: %@", fingerprintErr.localizedDescription);
+        }
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (completion) {
+                completion(refreshed, changed, missing, updateErr);
+            }
+        });
     });
 }
 
-- (BOOL)hasEntryForURL:(NSURL*)url error:(NSError**)error
+/// FTS5 query requiring every word of the needle as a token prefix.
+static NSString* _Nullable librarySearchQuery(NSString* needle)
 {
-    if (![self open:error]) {
-        return NO;
-    }
-
-    const char* sql = "SELECT 1 FROM tracks WHERE url = ? LIMIT 1";
-    sqlite3_stmt* stmt = NULL;
-    int rc = sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare exists query"}];
+    NSMutableArray<NSString*>* terms = [NSMutableArray array];
+    for (NSString* word in [needle componentsSeparatedByCharactersInSet:NSCharacterSet.whitespaceAndNewlineCharacterSet]) {
+        if ([word rangeOfCharacterFromSet:NSCharacterSet.alphanumericCharacterSet].location == NSNotFound) {
+            continue;
         }
-        return NO;
+        NSString* quoted = [word stringByReplacingOccurrencesOfString:@"\"" withString:@"\"\""];
+        [terms addObject:[NSString stringWithFormat:@"\"%@\"*", quoted]];
+    }
+    return terms.count > 0 ? [terms componentsJoinedByString:@" AND "] : nil;
+}
+
+- (NSSet<NSString*>* _Nullable)searchURLsMatchingNeedle:(NSString*)needle error:(NSError**)error
+{
+    if (![self open:error]) {
+        return nil;
+    }
+    NSString* query = librarySearchQuery(needle);
+    if (!self.searchIndexAvailable || query == nil) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:SQLITE_MISUSE userInfo:@{NSLocalizedDescriptionKey : @"Search index cannot answer this query"}];
+        }
+        return nil;
+    }
+
+    const char* sql = "SELECT tracks.url FROM tracks_search JOIN tracks ON tracks.rowid = tracks_search.rowid WHERE tracks_search MATCH ?";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare search"}];
+        }
+        return nil;
+    }
+
+    sqlite3_bind_text(stmt, 1, query.UTF8String, -1, SQLITE_TRANSIENT);
+    NSMutableSet<NSString*>* urls = [NSMutableSet set];
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char* url = (const char*) sqlite3_column_text(stmt, 0);
+        if (url != NULL) {
+            [urls addObject:@(url)];
+        }
+    }
+    [self releaseStatement:stmt];
+
+    if (rc != SQLITE_DONE) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to run search"}];
+        }
+        return nil;
+    }
+    return urls;
+}
+
+- (NSDictionary<NSString*, NSNumber*>* _Nullable)valuesOfFacet:(LibraryFacet)facet
+                                                        filter:(NSDictionary<NSNumber*, NSString*>*)filter
+                                                         error:(NSError**)error
+{
+    if (![self open:error]) {
+        return nil;
+    }
+
+    const char* column = libraryFacetColumn(facet);
+    NSMutableString* sql = [NSMutableString string];
+    if (facet == LibraryFacetTempo) {
+        // Matches the browser listing only tempos of at least 1 BPM.
+        [sql appendFormat:@"SELECT %s, COUNT(*) FROM tracks WHERE %s >= 1", column, column];
+    } else {
+        [sql appendFormat:@"SELECT %s, COUNT(*) FROM tracks WHERE %s <> ''", column, column];
+    }
+    NSMutableArray<NSNumber*>* constrained = [NSMutableArray array];
+    for (NSNumber* other in filter) {
+        if (other.integerValue == facet) {
+            continue;
+        }
+        [sql appendFormat:@" AND %s = ?", libraryFacetColumn(other.integerValue)];
+        [constrained addObject:other];
+    }
+    [sql appendFormat:@" GROUP BY %s", column];
+
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql.UTF8String statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare facet query"}];
+        }
+        return nil;
+    }
+    for (NSUInteger i = 0; i < constrained.count; i++) {
+        NSString* value = filter[constrained[i]];
+        if (constrained[i].integerValue == LibraryFacetTempo) {
+            sqlite3_bind_double(stmt, (int) i + 1, value.doubleValue);
+        } else {
+            sqlite3_bind_text(stmt, (int) i + 1, value.UTF8String, -1, SQLITE_TRANSIENT);
+        }
+    }
+
+    NSMutableDictionary<NSString*, NSNumber*>* values = [NSMutableDictionary dictionary];
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        NSString* value = nil;
+        if (facet == LibraryFacetTempo) {
+            // Rendered like `MediaMetaData.tempo.stringValue`, which the browser filters by.
+            value = @(sqlite3_column_double(stmt, 0)).stringValue;
+        } else {
+            const char* text = (const char*) sqlite3_column_text(stmt, 0);
+            value = text ? @(text) : nil;
+        }
+        if (value != nil) {
+            values[value] = @(sqlite3_column_int64(stmt, 1));
+        }
+    }
+    [self releaseStatement:stmt];
+
+    if (rc != SQLITE_DONE) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to run facet query"}];
+        }
+        return nil;
+    }
+    return values;
+}
+
+- (BOOL)hasEntryForURL:(NSURL*)url error:(NSError**)error
+{
+    if (![self open:error]) {
+        return NO;
+    }
+
+    const char* sql = "SELECT 1 FROM tracks WHERE url = ? LIMIT 1";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare exists query"}];
+        }
+        return NO;
     }
     sqlite3_bind_text(stmt, 1, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
     rc = sqlite3_step(stmt);
     BOOL exists = (rc == SQLITE_ROW);
-    sqlite3_finalize(stmt);
+    [self releaseStatement:stmt];
     return exists;
 }
 
@@ -641,7 +2017,7 @@ static BOOL isLikelyMojibakeString(NSString* s)
 
         const char* sql = "DELETE FROM tracks WHERE url = ?";
         sqlite3_stmt* stmt = NULL;
-        int rc = sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL);
+        int rc = [self prepareStatement:sql statement:&stmt];
         if (rc != SQLITE_OK) {
             NSError* err = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare delete"}];
             dispatch_async(dispatch_get_main_queue(), ^{
@@ -652,309 +2028,1125 @@ static BOOL isLikelyMojibakeString(NSString* s)
             return;
         }
 
-        BOOL success = YES;
-        NSError* stmtError = nil;
+        NSError* __block stepError = nil;
+        NSError* transactionError = nil;
+        BOOL success = [self performTransaction:^BOOL {
+            for (NSURL* url in urls) {
+                sqlite3_reset(stmt);
+                sqlite3_clear_bindings(stmt);
+                sqlite3_bind_text(stmt, 1, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+                int stepRc = sqlite3_step(stmt);
+                if (stepRc != SQLITE_DONE) {
+                    stepError = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to delete row"}];
+                    return NO;
+                }
+            }
+            return YES;
+        }
+                                          error:&transactionError];
+        NSError* stmtError = stepError ?: transactionError;
+
+        [self releaseStatement:stmt];
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (completion) {
+                completion(success, stmtError);
+            }
+        });
+    });
+}
+
+- (BOOL)resetDeepScanRunningState:(NSError**)error
+{
+    if (![self open:error]) {
+        return NO;
+    }
+
+    const char* sql = "UPDATE tracks SET deepScanState = ? WHERE deepScanState = ?";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan reset"}];
+        }
+        return NO;
+    }
+
+    BOOL success = [self performTransaction:^BOOL {
+        sqlite3_bind_int(stmt, 1, kDeepScanStatePending);
+        sqlite3_bind_int(stmt, 2, kDeepScanStateRunning);
+        int stepRc = sqlite3_step(stmt);
+        if (stepRc != SQLITE_DONE) {
+            if (error) {
+                *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to reset deep scan state"}];
+            }
+            return NO;
+        }
+        return YES;
+    }
+                                      error:error];
+    [self releaseStatement:stmt];
+    return success;
+}
+
+- (BOOL)enqueueDeepScanForURLs:(NSArray<NSURL*>*)urls priority:(NSInteger)priority error:(NSError**)error
+{
+    if (urls.count == 0) {
+        return YES;
+    }
+    if (![self open:error]) {
+        return NO;
+    }
+
+    const char* sql = "UPDATE tracks "
+                      "SET deepScanState = ?, deepScanPriority = ?, deepScanUpdatedAt = 0, deepScanError = NULL "
+                      "WHERE url = ?";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan enqueue"}];
+        }
+        return NO;
+    }
+
+    BOOL ok = [self performTransaction:^BOOL {
+        for (NSURL* url in urls) {
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+            sqlite3_bind_int(stmt, 1, kDeepScanStatePending);
+            sqlite3_bind_int(stmt, 2, (int) priority);
+            sqlite3_bind_text(stmt, 3, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+            int stepRc = sqlite3_step(stmt);
+            if (stepRc != SQLITE_DONE) {
+                if (error) {
+                    *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to enqueue deep scan"}];
+                }
+                return NO;
+            }
+        }
+        return YES;
+    }
+                                 error:error];
+
+    [self releaseStatement:stmt];
+    return ok;
+}
+
+- (BOOL)prioritizeDeepScanForURLs:(NSArray<NSURL*>*)urls error:(NSError**)error
+{
+    if (urls.count == 0) {
+        return YES;
+    }
+    if (![self open:error]) {
+        return NO;
+    }
+
+    // Only raises the priority of queued entries; running, finished and failed
+    // ones keep their state.
+    const char* sql = "UPDATE tracks SET deepScanPriority = ? "
+                      "WHERE url = ? AND COALESCE(deepScanState, 0) IN (0, 1)";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan priority update"}];
+        }
+        return NO;
+    }
+
+    BOOL ok = [self performTransaction:^BOOL {
         for (NSURL* url in urls) {
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+            sqlite3_bind_int(stmt, 1, kDeepScanPriorityHigh);
+            sqlite3_bind_text(stmt, 2, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+            int stepRc = sqlite3_step(stmt);
+            if (stepRc != SQLITE_DONE) {
+                if (error) {
+                    *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to update deep scan priority"}];
+                }
+                return NO;
+            }
+        }
+        return YES;
+    }
+                                 error:error];
+
+    [self releaseStatement:stmt];
+    return ok;
+}
+
+- (NSURL* _Nullable)nextDeepScanURL:(NSError**)error
+{
+    return [self nextDeepScanURLWithPriority:NULL error:error];
+}
+
+- (NSURL* _Nullable)nextDeepScanURLWithPriority:(NSInteger* _Nullable)priority error:(NSError**)error
+{
+    if (![self open:error]) {
+        return nil;
+    }
+
+    const char* sql = "SELECT url, priority FROM deep_scan_queue ORDER BY priority DESC, queuedAt ASC LIMIT 1";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan select"}];
+        }
+        return nil;
+    }
+
+    NSURL* url = nil;
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        const char* urlText = (const char*) sqlite3_column_text(stmt, 0);
+        if (urlText) {
+            url = [NSURL URLWithString:@(urlText)];
+        }
+        if (priority) {
+            *priority = sqlite3_column_int(stmt, 1);
+        }
+    } else if (rc != SQLITE_DONE) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to select deep scan candidate"}];
+        }
+    }
+
+    [self releaseStatement:stmt];
+    return url;
+}
+
+- (NSArray<NSURL*>* _Nullable)claimDeepScanURLs:(NSUInteger)limit
+                                 minimumPriority:(NSInteger)minimumPriority
+                                      priorities:(NSArray<NSNumber*>* _Nullable* _Nullable)priorities
+                                           error:(NSError**)error
+{
+    if (![self open:error]) {
+        return nil;
+    }
+
+    const char* selectSql = "SELECT url, priority FROM deep_scan_queue WHERE priority >= ? ORDER BY priority DESC, queuedAt ASC LIMIT ?";
+    // Leaving the wanted state takes the row off the queue.
+    const char* claimSql = "UPDATE tracks SET deepScanState = ?, deepScanUpdatedAt = ? WHERE url = ?";
+    sqlite3_stmt* selectStmt = NULL;
+    sqlite3_stmt* claimStmt = NULL;
+    int rc = [self prepareWriterStatement:selectSql statement:&selectStmt];
+    if (rc == SQLITE_OK) {
+        rc = [self prepareStatement:claimSql statement:&claimStmt];
+    }
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan claim"}];
+        }
+        [self releaseStatement:selectStmt];
+        return nil;
+    }
+
+    NSMutableArray<NSURL*>* urls = [NSMutableArray array];
+    NSMutableArray<NSNumber*>* claimedPriorities = [NSMutableArray array];
+    BOOL success = [self performTransaction:^BOOL {
+        sqlite3_bind_int64(selectStmt, 1, minimumPriority);
+        sqlite3_bind_int64(selectStmt, 2, (sqlite3_int64) limit);
+        NSMutableArray<NSString*>* candidates = [NSMutableArray array];
+        int stepRc;
+        while ((stepRc = sqlite3_step(selectStmt)) == SQLITE_ROW) {
+            const char* urlText = (const char*) sqlite3_column_text(selectStmt, 0);
+            if (urlText) {
+                [candidates addObject:@(urlText)];
+                [claimedPriorities addObject:@(sqlite3_column_int(selectStmt, 1))];
+            }
+        }
+        sqlite3_reset(selectStmt);
+        if (stepRc != SQLITE_DONE) {
+            if (error) {
+                *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to select deep scan candidates"}];
+            }
+            return NO;
+        }
+
+        double now = [NSDate date].timeIntervalSince1970;
+        for (NSString* candidate in candidates) {
+            sqlite3_reset(claimStmt);
+            sqlite3_clear_bindings(claimStmt);
+            sqlite3_bind_int(claimStmt, 1, kDeepScanStateRunning);
+            sqlite3_bind_double(claimStmt, 2, now);
+            sqlite3_bind_text(claimStmt, 3, candidate.UTF8String, -1, SQLITE_TRANSIENT);
+            stepRc = sqlite3_step(claimStmt);
+            if (stepRc != SQLITE_DONE) {
+                if (error) {
+                    *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to claim deep scan"}];
+                }
+                return NO;
+            }
+            [urls addObject:[NSURL URLWithString:candidate]];
+        }
+        return YES;
+    }
+                                      error:error];
+    [self releaseStatement:selectStmt];
+    [self releaseStatement:claimStmt];
+
+    if (!success) {
+        return nil;
+    }
+    if (priorities) {
+        *priorities = claimedPriorities;
+    }
+    return urls;
+}
+
+- (BOOL)markDeepScanRunningForURL:(NSURL*)url error:(NSError**)error
+{
+    if (![self open:error]) {
+        return NO;
+    }
+
+    const char* sql = "UPDATE tracks SET deepScanState = ?, deepScanUpdatedAt = ? WHERE url = ?";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan running update"}];
+        }
+        return NO;
+    }
+
+    BOOL success = [self performTransaction:^BOOL {
+        sqlite3_bind_int(stmt, 1, kDeepScanStateRunning);
+        sqlite3_bind_double(stmt, 2, [NSDate date].timeIntervalSince1970);
+        sqlite3_bind_text(stmt, 3, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+        int stepRc = sqlite3_step(stmt);
+        if (stepRc != SQLITE_DONE) {
+            if (error) {
+                *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to mark deep scan running"}];
+            }
+            return NO;
+        }
+        return YES;
+    }
+                                      error:error];
+    [self releaseStatement:stmt];
+    return success;
+}
+
+- (BOOL)completeDeepScanForURL:(NSURL*)url
+                      duration:(NSNumber* _Nullable)duration
+                         tempo:(NSNumber* _Nullable)tempo
+                           key:(NSString* _Nullable)key
+                         error:(NSError**)error
+{
+    if (![self open:error]) {
+        return NO;
+    }
+
+    const char* sql = "UPDATE tracks SET "
+                      "duration = COALESCE(?, duration),"
+                      "bpm = COALESCE(?, bpm),"
+                      "key = COALESCE(?, key),"
+                      "deepScanState = ?,"
+                      "deepScanPriority = ?,"
+                      "deepScanVersion = ?,"
+                      "deepScanUpdatedAt = ?,"
+                      "deepScanError = NULL "
+                      "WHERE url = ?";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan completion update"}];
+        }
+        return NO;
+    }
+
+    BOOL success = [self performTransaction:^BOOL {
+        if (duration != nil) {
+            sqlite3_bind_double(stmt, 1, floor(duration.doubleValue));
+        } else {
+            sqlite3_bind_null(stmt, 1);
+        }
+        if (tempo != nil) {
+            sqlite3_bind_double(stmt, 2, floor(tempo.doubleValue));
+        } else {
+            sqlite3_bind_null(stmt, 2);
+        }
+        if (key != nil) {
+            sqlite3_bind_text(stmt, 3, key.UTF8String, -1, SQLITE_TRANSIENT);
+        } else {
+            sqlite3_bind_null(stmt, 3);
+        }
+        sqlite3_bind_int(stmt, 4, kDeepScanStateDone);
+        sqlite3_bind_int(stmt, 5, kDeepScanPriorityLow);
+        sqlite3_bind_int(stmt, 6, (int) kDeepScanVersion);
+        sqlite3_bind_double(stmt, 7, [NSDate date].timeIntervalSince1970);
+        sqlite3_bind_text(stmt, 8, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+        int stepRc = sqlite3_step(stmt);
+        if (stepRc != SQLITE_DONE) {
+            if (error) {
+                *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to mark deep scan completed"}];
+            }
+            return NO;
+        }
+        return YES;
+    }
+                                      error:error];
+    [self releaseStatement:stmt];
+    return success;
+}
+
+- (BOOL)updateAnalysisForURL:(NSURL*)url
+                    loudness:(NSNumber* _Nullable)loudness
+                        peak:(NSNumber* _Nullable)peak
+                 contentHash:(NSString* _Nullable)contentHash
+                       error:(NSError**)error
+{
+    if (![self open:error]) {
+        return NO;
+    }
+
+    const char* sql = "UPDATE tracks SET "
+                      "loudness = COALESCE(?, loudness),"
+                      "peak = COALESCE(?, peak),"
+                      "contentHash = COALESCE(?, contentHash) "
+                      "WHERE url = ?";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare analysis update"}];
+        }
+        return NO;
+    }
+
+    BOOL success = [self performTransaction:^BOOL {
+        if (loudness != nil) {
+            sqlite3_bind_double(stmt, 1, loudness.doubleValue);
+        } else {
+            sqlite3_bind_null(stmt, 1);
+        }
+        if (peak != nil) {
+            sqlite3_bind_double(stmt, 2, peak.doubleValue);
+        } else {
+            sqlite3_bind_null(stmt, 2);
+        }
+        if (contentHash != nil) {
+            sqlite3_bind_text(stmt, 3, contentHash.UTF8String, -1, SQLITE_TRANSIENT);
+        } else {
+            sqlite3_bind_null(stmt, 3);
+        }
+        sqlite3_bind_text(stmt, 4, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+        int stepRc = sqlite3_step(stmt);
+        if (stepRc != SQLITE_DONE) {
+            if (error) {
+                *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to update analysis results"}];
+            }
+            return NO;
+        }
+        return YES;
+    }
+                                      error:error];
+    [self releaseStatement:stmt];
+    return success;
+}
+
+- (NSDictionary<NSString*, NSNumber*>* _Nullable)recordedAnalyzerVersionsForURL:(NSURL*)url error:(NSError**)error
+{
+    if (![self open:error]) {
+        return nil;
+    }
+
+    const char* sql = "SELECT analyzer, version FROM analyzer_versions WHERE url = ?";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare analyzer version select"}];
+        }
+        return nil;
+    }
+
+    sqlite3_bind_text(stmt, 1, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+    NSMutableDictionary<NSString*, NSNumber*>* versions = [NSMutableDictionary dictionary];
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char* nameText = (const char*) sqlite3_column_text(stmt, 0);
+        if (nameText != NULL) {
+            versions[@(nameText)] = @(sqlite3_column_int64(stmt, 1));
+        }
+    }
+    [self releaseStatement:stmt];
+
+    if (rc != SQLITE_DONE) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to read analyzer versions"}];
+        }
+        return nil;
+    }
+
+    return versions;
+}
+
+- (BOOL)recordAnalyzers:(NSArray<NSString*>*)names forURL:(NSURL*)url error:(NSError**)error
+{
+    if (names.count == 0) {
+        return YES;
+    }
+    if (![self open:error]) {
+        return NO;
+    }
+
+    const char* sql = "INSERT INTO analyzer_versions (url, analyzer, version, updatedAt) VALUES (?, ?, ?, ?) "
+                      "ON CONFLICT(url, analyzer) DO UPDATE SET version = excluded.version, updatedAt = excluded.updatedAt";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare analyzer version update"}];
+        }
+        return NO;
+    }
+
+    NSDictionary<NSString*, NSNumber*>* current = [LibraryStore analyzerVersions];
+    double now = [NSDate date].timeIntervalSince1970;
+    BOOL success = [self performTransaction:^BOOL {
+        for (NSString* name in names) {
+            NSNumber* version = current[name];
+            if (version == nil) {
+                continue;
+            }
             sqlite3_reset(stmt);
             sqlite3_clear_bindings(stmt);
             sqlite3_bind_text(stmt, 1, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
-            rc = sqlite3_step(stmt);
-            if (rc != SQLITE_DONE) {
-                success = NO;
-                stmtError = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to delete row"}];
-                break;
+            sqlite3_bind_text(stmt, 2, name.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(stmt, 3, version.integerValue);
+            sqlite3_bind_double(stmt, 4, now);
+            int stepRc = sqlite3_step(stmt);
+            if (stepRc != SQLITE_DONE) {
+                if (error) {
+                    *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to record analyzer version"}];
+                }
+                return NO;
             }
         }
+        return YES;
+    }
+                                      error:error];
+    [self releaseStatement:stmt];
+
+    return success;
+}
+
+- (BOOL)forgetAnalyzers:(NSArray<NSString*>*)names forURL:(NSURL*)url error:(NSError**)error
+{
+    if (names.count == 0) {
+        return YES;
+    }
+    if (![self open:error]) {
+        return NO;
+    }
 
-        sqlite3_finalize(stmt);
+    const char* sql = "DELETE FROM analyzer_versions WHERE url = ? AND analyzer = ?";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare analyzer version removal"}];
+        }
+        return NO;
+    }
+
+    BOOL success = [self performTransaction:^BOOL {
+        for (NSString* name in names) {
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+            sqlite3_bind_text(stmt, 1, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 2, name.UTF8String, -1, SQLITE_TRANSIENT);
+            int stepRc = sqlite3_step(stmt);
+            if (stepRc != SQLITE_DONE) {
+                if (error) {
+                    *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to remove analyzer version"}];
+                }
+                return NO;
+            }
+        }
+        return YES;
+    }
+                                      error:error];
+    [self releaseStatement:stmt];
+
+    return success;
+}
+
+- (BOOL)markDeepScanFailedForURL:(NSURL*)url reason:(NSString*)reason error:(NSError**)error
+{
+    if (![self open:error]) {
+        return NO;
+    }
+
+    const char* sql = "UPDATE tracks SET "
+                      "deepScanState = ?,"
+                      "deepScanVersion = ?,"
+                      "deepScanUpdatedAt = ?,"
+                      "deepScanError = ? "
+                      "WHERE url = ?";
+    sqlite3_stmt* stmt = NULL;
+    int rc = [self prepareStatement:sql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan failure update"}];
+        }
+        return NO;
+    }
 
-        dispatch_async(dispatch_get_main_queue(), ^{
-            if (completion) {
-                completion(success, stmtError);
+    BOOL success = [self performTransaction:^BOOL {
+        sqlite3_bind_int(stmt, 1, kDeepScanStateFailed);
+        sqlite3_bind_int(stmt, 2, (int) kDeepScanVersion);
+        sqlite3_bind_double(stmt, 3, [NSDate date].timeIntervalSince1970);
+        sqlite3_bind_text(stmt, 4, reason.UTF8String, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 5, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+        int stepRc = sqlite3_step(stmt);
+        if (stepRc != SQLITE_DONE) {
+            if (error) {
+                *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to mark deep scan failed"}];
             }
-        });
-    });
+            return NO;
+        }
+        return YES;
+    }
+                                      error:error];
+    [self releaseStatement:stmt];
+    return success;
 }
 
-- (BOOL)resetDeepScanRunningState:(NSError**)error
+- (NSInteger)deepScanOutstandingCount:(NSError**)error
 {
     if (![self open:error]) {
-        return NO;
+        return -1;
     }
 
-    const char* sql = "UPDATE tracks SET deepScanState = ? WHERE deepScanState = ?";
+    // Running scans still count as outstanding.
+    const char* sql = "SELECT (SELECT COUNT(*) FROM deep_scan_queue) + (SELECT COUNT(*) FROM tracks WHERE deepScanState = 2)";
     sqlite3_stmt* stmt = NULL;
-    int rc = sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL);
+    int rc = [self prepareStatement:sql statement:&stmt];
     if (rc != SQLITE_OK) {
         if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan reset"}];
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan count"}];
         }
-        return NO;
+        return -1;
     }
 
-    sqlite3_bind_int(stmt, 1, kDeepScanStatePending);
-    sqlite3_bind_int(stmt, 2, kDeepScanStateRunning);
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    if (rc != SQLITE_DONE) {
+    NSInteger count = -1;
+    if (rc == SQLITE_ROW) {
+        count = (NSInteger) sqlite3_column_int(stmt, 0);
+    } else {
         if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to reset deep scan state"}];
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to read deep scan count"}];
         }
-        return NO;
     }
 
-    return YES;
+    [self releaseStatement:stmt];
+    return count;
 }
 
-- (BOOL)enqueueDeepScanForURLs:(NSArray<NSURL*>*)urls priority:(NSInteger)priority error:(NSError**)error
+#pragma mark - Changes
+
+- (int64_t)currentRevision:(NSError**)error
 {
-    if (urls.count == 0) {
-        return YES;
-    }
     if (![self open:error]) {
-        return NO;
+        return -1;
     }
 
-    const char* sql = "UPDATE tracks "
-                      "SET deepScanState = ?, deepScanPriority = ?, deepScanUpdatedAt = 0, deepScanError = NULL "
-                      "WHERE url = ?";
+    const char* sql = "SELECT seq FROM sqlite_sequence WHERE name = 'track_changes'";
     sqlite3_stmt* stmt = NULL;
-    int rc = sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL);
+    int rc = [self prepareStatement:sql statement:&stmt];
     if (rc != SQLITE_OK) {
         if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan enqueue"}];
+            *error = [NSError errorWithDomain:LibraryStoreErrorDomain code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare revision select"}];
         }
-        return NO;
+        return -1;
     }
 
-    BOOL ok = YES;
-    for (NSURL* url in urls) {
-        sqlite3_reset(stmt);
-        sqlite3_clear_bindings(stmt);
-        sqlite3_bind_int(stmt, 1, kDeepScanStatePending);
-        sqlite3_bind_int(stmt, 2, (int) priority);
-        sqlite3_bind_text(stmt, 3, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
-        rc = sqlite3_step(stmt);
-        if (rc != SQLITE_DONE) {
-            ok = NO;
-            if (error) {
-                *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to enqueue deep scan"}];
-            }
-            break;
+    int64_t revision = 0;
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        revision = sqlite3_column_int64(stmt, 0);
+    } else if (rc != SQLITE_DONE) {
+        if (error) {
+            *error = [NSError errorWithDomain:LibraryStoreErrorDomain code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to read revision"}];
         }
+        revision = -1;
     }
+    [self releaseStatement:stmt];
 
-    sqlite3_finalize(stmt);
-    return ok;
+    return revision;
 }
 
-- (NSURL* _Nullable)nextDeepScanURL:(NSError**)error
+- (NSArray<LibraryChange*>* _Nullable)changesSinceRevision:(int64_t)revision
+                                                    latest:(int64_t* _Nullable)latest
+                                                     error:(NSError**)error
 {
-    if (![self open:error]) {
+    int64_t current = [self currentRevision:error];
+    if (current < 0) {
         return nil;
     }
+    if (latest) {
+        *latest = current;
+    }
+    if (revision >= current) {
+        return @[];
+    }
 
-    const char* sql = "SELECT url FROM tracks "
-                      "WHERE (duration IS NULL OR duration <= 0 OR bpm IS NULL OR bpm <= 0 "
-                      "OR ((key IS NULL OR key = '') AND (duration IS NULL OR duration <= ?))) "
-                      "AND (COALESCE(deepScanState, 0) IN (0, 1) OR (deepScanState = 4 AND COALESCE(deepScanVersion, 0) < ?)) "
-                      "ORDER BY COALESCE(deepScanPriority, 0) DESC, COALESCE(deepScanUpdatedAt, 0) ASC "
-                      "LIMIT 1";
+    // Revisions have no gaps but those pruning leaves.
+    const char* sql = "SELECT revision, url, kind, columns FROM track_changes WHERE revision > ?1 AND revision <= ?2 ORDER BY revision";
     sqlite3_stmt* stmt = NULL;
-    int rc = sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL);
+    int rc = [self prepareStatement:sql statement:&stmt];
     if (rc != SQLITE_OK) {
         if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan select"}];
+            *error = [NSError errorWithDomain:LibraryStoreErrorDomain code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare change select"}];
         }
         return nil;
     }
 
-    sqlite3_bind_double(stmt, 1, kBeatSampleDurationThreshold * 1000.0);
-    sqlite3_bind_int(stmt, 2, (int) kDeepScanVersion);
-    NSURL* url = nil;
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_ROW) {
-        const char* urlText = (const char*) sqlite3_column_text(stmt, 0);
-        if (urlText) {
-            url = [NSURL URLWithString:@(urlText)];
+    sqlite3_bind_int64(stmt, 1, revision);
+    sqlite3_bind_int64(stmt, 2, current);
+    NSDictionary<NSString*, NSString*>* keysByColumn = trackChangeKeysByColumn();
+    NSSet<NSString*>* allKeys = [NSSet setWithArray:keysByColumn.allValues];
+    NSMutableArray<LibraryChange*>* changes = [NSMutableArray array];
+    NSMutableDictionary<NSString*, LibraryChange*>* changesByURL = [NSMutableDictionary dictionary];
+    BOOL first = YES;
+    BOOL expired = NO;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (first && sqlite3_column_int64(stmt, 0) != revision + 1) {
+            expired = YES;
+            break;
         }
-    } else if (rc != SQLITE_DONE) {
+        first = NO;
+
+        const char* urlText = (const char*) sqlite3_column_text(stmt, 1);
+        if (urlText == NULL) {
+            continue;
+        }
+        NSString* url = @(urlText);
+        LibraryChangeKind kind = (LibraryChangeKind) sqlite3_column_int(stmt, 2);
+        NSMutableSet<NSString*>* keys = [NSMutableSet set];
+        if (kind == LibraryChangeKindInsert) {
+            [keys unionSet:allKeys];
+        } else if (kind == LibraryChangeKindUpdate) {
+            const char* columnsText = (const char*) sqlite3_column_text(stmt, 3);
+            for (NSString* column in [(columnsText ? @(columnsText) : @"") componentsSeparatedByString:@","]) {
+                NSString* key = keysByColumn[column];
+                if (key != nil) {
+                    [keys addObject:key];
+                }
+            }
+        }
+
+        LibraryChange* change = changesByURL[url];
+        if (change == nil) {
+            change = [LibraryChange new];
+            change.url = [NSURL URLWithString:url];
+            change.kind = kind;
+            change.keys = keys;
+            changesByURL[url] = change;
+            [changes addObject:change];
+            continue;
+        }
+        // An update keeps what an earlier insert said; anything else takes over.
+        if (kind == LibraryChangeKindUpdate && change.kind != LibraryChangeKindDelete) {
+            change.keys = [change.keys setByAddingObjectsFromSet:keys];
+        } else {
+            change.kind = kind;
+            change.keys = keys;
+        }
+    }
+    [self releaseStatement:stmt];
+
+    if (expired || (first && rc == SQLITE_DONE)) {
         if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to select deep scan candidate"}];
+            *error = [NSError errorWithDomain:LibraryStoreErrorDomain
+                                         code:LibraryStoreErrorChangesExpired
+                                     userInfo:@{NSLocalizedDescriptionKey : @"Changes since the revision are no longer logged"}];
+        }
+        return nil;
+    }
+    if (rc != SQLITE_DONE) {
+        if (error) {
+            *error = [NSError errorWithDomain:LibraryStoreErrorDomain code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to read changes"}];
         }
+        return nil;
     }
 
-    sqlite3_finalize(stmt);
-    return url;
+    const char* metaSql = "SELECT " LIBRARY_TRACK_COLUMNS " FROM tracks WHERE url IN "
+                          "(SELECT url FROM track_changes WHERE revision > ?1 AND revision <= ?2)";
+    rc = [self prepareStatement:metaSql statement:&stmt];
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = [NSError errorWithDomain:LibraryStoreErrorDomain code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare changed track select"}];
+        }
+        return nil;
+    }
+    sqlite3_bind_int64(stmt, 1, revision);
+    sqlite3_bind_int64(stmt, 2, current);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        MediaMetaData* meta = [self metaFromTrackRow:stmt];
+        LibraryChange* change = changesByURL[meta.location.absoluteString];
+        if (change.kind != LibraryChangeKindDelete) {
+            change.meta = meta;
+        }
+    }
+    [self releaseStatement:stmt];
+
+    if (rc != SQLITE_DONE) {
+        if (error) {
+            *error = [NSError errorWithDomain:LibraryStoreErrorDomain code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to read changed tracks"}];
+        }
+        return nil;
+    }
+
+    // Rows deleted since the change log got read.
+    for (LibraryChange* change in changes) {
+        if (change.meta == nil && change.kind != LibraryChangeKindDelete) {
+            change.kind = LibraryChangeKindDelete;
+            change.keys = [NSSet set];
+        }
+    }
+
+    return changes;
 }
 
-- (BOOL)markDeepScanRunningForURL:(NSURL*)url error:(NSError**)error
+#pragma mark - Tracklists
+
+static void bindOptionalInt64(sqlite3_stmt* stmt, int index, NSNumber* _Nullable value)
+{
+    if (value != nil) {
+        sqlite3_bind_int64(stmt, index, value.longLongValue);
+    } else {
+        sqlite3_bind_null(stmt, index);
+    }
+}
+
+static void bindOptionalDouble(sqlite3_stmt* stmt, int index, NSNumber* _Nullable value)
+{
+    if (value != nil) {
+        sqlite3_bind_double(stmt, index, value.doubleValue);
+    } else {
+        sqlite3_bind_null(stmt, index);
+    }
+}
+
+static NSString* _Nullable columnString(sqlite3_stmt* stmt, int index)
+{
+    const char* text = (const char*) sqlite3_column_text(stmt, index);
+    return text ? @(text) : nil;
+}
+
+static NSURL* _Nullable columnURL(sqlite3_stmt* stmt, int index)
+{
+    const char* text = (const char*) sqlite3_column_text(stmt, index);
+    return text ? [NSURL URLWithString:@(text)] : nil;
+}
+
+- (BOOL)storeTrackList:(TrackList*)trackList forURL:(NSURL*)url error:(NSError**)error
 {
     if (![self open:error]) {
         return NO;
     }
 
-    const char* sql = "UPDATE tracks SET deepScanState = ?, deepScanUpdatedAt = ? WHERE url = ?";
-    sqlite3_stmt* stmt = NULL;
-    int rc = sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL);
+    const char* deleteSql = "DELETE FROM tracklist_entries WHERE setURL = ?";
+    const char* insertSql = "INSERT OR REPLACE INTO tracklist_entries "
+                            "(setURL, frame, endFrame, confidence, score, supportCount, title, artist, album, genre, trackURL, artworkLocation, appleLocation, key) "
+                            "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    sqlite3_stmt* deleteStmt = NULL;
+    sqlite3_stmt* insertStmt = NULL;
+    int rc = [self prepareStatement:deleteSql statement:&deleteStmt];
+    if (rc == SQLITE_OK) {
+        rc = [self prepareStatement:insertSql statement:&insertStmt];
+    }
     if (rc != SQLITE_OK) {
         if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan running update"}];
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare tracklist update"}];
         }
+        [self releaseStatement:deleteStmt];
         return NO;
     }
 
-    sqlite3_bind_int(stmt, 1, kDeepScanStateRunning);
-    sqlite3_bind_double(stmt, 2, [NSDate date].timeIntervalSince1970);
-    sqlite3_bind_text(stmt, 3, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    if (rc != SQLITE_DONE) {
-        if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to mark deep scan running"}];
+    const char* setURL = url.absoluteString.UTF8String;
+    NSArray<TimedMediaMetaData*>* tracks = trackList.tracks;
+    BOOL success = [self performTransaction:^BOOL {
+        sqlite3_bind_text(deleteStmt, 1, setURL, -1, SQLITE_TRANSIENT);
+        int stepRc = sqlite3_step(deleteStmt);
+        if (stepRc != SQLITE_DONE) {
+            if (error) {
+                *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to remove tracklist entries"}];
+            }
+            return NO;
         }
-        return NO;
+        for (TimedMediaMetaData* track in tracks) {
+            if (track.frame == nil) {
+                continue;
+            }
+            MediaMetaData* meta = track.meta;
+            sqlite3_reset(insertStmt);
+            sqlite3_clear_bindings(insertStmt);
+            sqlite3_bind_text(insertStmt, 1, setURL, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(insertStmt, 2, track.frame.longLongValue);
+            bindOptionalInt64(insertStmt, 3, track.endFrame);
+            bindOptionalDouble(insertStmt, 4, track.confidence);
+            bindOptionalDouble(insertStmt, 5, track.score);
+            bindOptionalInt64(insertStmt, 6, track.supportCount);
+            sqlite3_bind_text(insertStmt, 7, meta.title.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(insertStmt, 8, meta.artist.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(insertStmt, 9, meta.album.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(insertStmt, 10, meta.genre.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(insertStmt, 11, meta.location.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(insertStmt, 12, meta.artworkLocation.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(insertStmt, 13, meta.appleLocation.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(insertStmt, 14, meta.key.length > 0 ? meta.key.UTF8String : NULL, -1, SQLITE_TRANSIENT);
+            stepRc = sqlite3_step(insertStmt);
+            if (stepRc != SQLITE_DONE) {
+                if (error) {
+                    *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to store tracklist entry"}];
+                }
+                return NO;
+            }
+        }
+        return YES;
     }
+                                      error:error];
+    [self releaseStatement:insertStmt];
+    [self releaseStatement:deleteStmt];
 
-    return YES;
+    return success;
 }
 
-- (BOOL)completeDeepScanForURL:(NSURL*)url
-                      duration:(NSNumber* _Nullable)duration
-                         tempo:(NSNumber* _Nullable)tempo
-                           key:(NSString* _Nullable)key
-                         error:(NSError**)error
+- (TrackList* _Nullable)trackListForURL:(NSURL*)url error:(NSError**)error
 {
     if (![self open:error]) {
-        return NO;
+        return nil;
     }
 
-    const char* sql = "UPDATE tracks SET "
-                      "duration = COALESCE(?, duration),"
-                      "bpm = COALESCE(?, bpm),"
-                      "key = COALESCE(?, key),"
-                      "deepScanState = ?,"
-                      "deepScanPriority = ?,"
-                      "deepScanVersion = ?,"
-                      "deepScanUpdatedAt = ?,"
-                      "deepScanError = NULL "
-                      "WHERE url = ?";
+    const char* sql = "SELECT frame, endFrame, confidence, score, supportCount, title, artist, album, genre, trackURL, artworkLocation, appleLocation, key "
+                      "FROM tracklist_entries WHERE setURL = ?";
     sqlite3_stmt* stmt = NULL;
-    int rc = sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL);
+    int rc = [self prepareStatement:sql statement:&stmt];
     if (rc != SQLITE_OK) {
         if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan completion update"}];
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare tracklist select"}];
         }
-        return NO;
+        return nil;
     }
 
-    if (duration != nil) {
-        sqlite3_bind_double(stmt, 1, floor(duration.doubleValue));
-    } else {
-        sqlite3_bind_null(stmt, 1);
-    }
-    if (tempo != nil) {
-        sqlite3_bind_double(stmt, 2, floor(tempo.doubleValue));
-    } else {
-        sqlite3_bind_null(stmt, 2);
-    }
-    if (key != nil) {
-        sqlite3_bind_text(stmt, 3, key.UTF8String, -1, SQLITE_TRANSIENT);
-    } else {
-        sqlite3_bind_null(stmt, 3);
+    sqlite3_bind_text(stmt, 1, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+    TrackList* trackList = [TrackList new];
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        TimedMediaMetaData* track = [TimedMediaMetaData new];
+        track.frame = @(sqlite3_column_int64(stmt, 0));
+        if (sqlite3_column_type(stmt, 1) != SQLITE_NULL) {
+            track.endFrame = @(sqlite3_column_int64(stmt, 1));
+        }
+        if (sqlite3_column_type(stmt, 2) != SQLITE_NULL) {
+            track.confidence = @(sqlite3_column_double(stmt, 2));
+        }
+        if (sqlite3_column_type(stmt, 3) != SQLITE_NULL) {
+            track.score = @(sqlite3_column_double(stmt, 3));
+        }
+        if (sqlite3_column_type(stmt, 4) != SQLITE_NULL) {
+            track.supportCount = @(sqlite3_column_int64(stmt, 4));
+        }
+
+        MediaMetaData* meta = [MediaMetaData new];
+        meta.title = columnString(stmt, 5);
+        meta.artist = columnString(stmt, 6);
+        meta.album = columnString(stmt, 7);
+        meta.genre = columnString(stmt, 8);
+        meta.location = columnURL(stmt, 9);
+        meta.artworkLocation = columnURL(stmt, 10);
+        meta.appleLocation = columnURL(stmt, 11);
+        meta.key = columnString(stmt, 12);
+        track.meta = meta;
+
+        [trackList addTrack:track];
     }
-    sqlite3_bind_int(stmt, 4, kDeepScanStateDone);
-    sqlite3_bind_int(stmt, 5, kDeepScanPriorityLow);
-    sqlite3_bind_int(stmt, 6, (int) kDeepScanVersion);
-    sqlite3_bind_double(stmt, 7, [NSDate date].timeIntervalSince1970);
-    sqlite3_bind_text(stmt, 8, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    [self releaseStatement:stmt];
 
     if (rc != SQLITE_DONE) {
         if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to mark deep scan completed"}];
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to read tracklist"}];
         }
-        return NO;
+        return nil;
     }
 
-    return YES;
+    return trackList;
 }
 
-- (BOOL)markDeepScanFailedForURL:(NSURL*)url reason:(NSString*)reason error:(NSError**)error
+- (NSDictionary<NSURL*, NSArray<NSNumber*>*>* _Nullable)setsContainingTrack:(MediaMetaData*)track error:(NSError**)error
 {
     if (![self open:error]) {
-        return NO;
+        return nil;
     }
 
-    const char* sql = "UPDATE tracks SET "
-                      "deepScanState = ?,"
-                      "deepScanVersion = ?,"
-                      "deepScanUpdatedAt = ?,"
-                      "deepScanError = ? "
-                      "WHERE url = ?";
+    // Either term is served by its own index.
+    const char* sql = "SELECT setURL, frame FROM tracklist_entries "
+                      "WHERE trackURL = ?1 OR (artist = ?2 AND title = ?3) "
+                      "ORDER BY setURL, frame";
     sqlite3_stmt* stmt = NULL;
-    int rc = sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL);
+    int rc = [self prepareStatement:sql statement:&stmt];
     if (rc != SQLITE_OK) {
         if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan failure update"}];
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare tracklist lookup"}];
         }
-        return NO;
+        return nil;
     }
 
-    sqlite3_bind_int(stmt, 1, kDeepScanStateFailed);
-    sqlite3_bind_int(stmt, 2, (int) kDeepScanVersion);
-    sqlite3_bind_double(stmt, 3, [NSDate date].timeIntervalSince1970);
-    sqlite3_bind_text(stmt, 4, reason.UTF8String, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 5, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    sqlite3_bind_text(stmt, 1, track.location.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+    if (track.artist.length > 0 && track.title.length > 0) {
+        sqlite3_bind_text(stmt, 2, track.artist.UTF8String, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, track.title.UTF8String, -1, SQLITE_TRANSIENT);
+    }
+    NSMutableDictionary<NSURL*, NSMutableArray<NSNumber*>*>* sets = [NSMutableDictionary dictionary];
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        NSURL* setURL = columnURL(stmt, 0);
+        if (setURL == nil) {
+            continue;
+        }
+        NSMutableArray<NSNumber*>* frames = sets[setURL];
+        if (frames == nil) {
+            frames = [NSMutableArray array];
+            sets[setURL] = frames;
+        }
+        [frames addObject:@(sqlite3_column_int64(stmt, 1))];
+    }
+    [self releaseStatement:stmt];
 
     if (rc != SQLITE_DONE) {
         if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to mark deep scan failed"}];
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to look up tracklists"}];
         }
-        return NO;
+        return nil;
     }
 
-    return YES;
+    return sets;
 }
 
-- (NSInteger)deepScanOutstandingCount:(NSError**)error
+#pragma mark - Relocation
+
+- (NSDictionary<NSURL*, NSURL*>* _Nullable)relocateEntriesToURLs:(NSArray<NSURL*>*)urls error:(NSError**)error
+{
+    return [self relocateEntriesToURLs:urls fingerprints:nil error:error];
+}
+
+/// `fingerprints` receives the fingerprints taken of files the store had no
+/// entry for, keyed by absolute URL string.
+- (NSDictionary<NSURL*, NSURL*>* _Nullable)relocateEntriesToURLs:(NSArray<NSURL*>*)urls
+                                                     fingerprints:(NSMutableDictionary<NSString*, NSString*>* _Nullable)fingerprints
+                                                            error:(NSError**)error
 {
     if (![self open:error]) {
-        return -1;
+        return nil;
     }
 
-    const char* sql = "SELECT COUNT(*) FROM tracks "
-                      "WHERE (duration IS NULL OR duration <= 0 OR bpm IS NULL OR bpm <= 0 "
-                      "OR ((key IS NULL OR key = '') AND (duration IS NULL OR duration <= ?))) "
-                      "AND (COALESCE(deepScanState, 0) IN (0, 1, 2) OR (deepScanState = 4 AND COALESCE(deepScanVersion, 0) < ?))";
-    sqlite3_stmt* stmt = NULL;
-    int rc = sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL);
+    NSMutableArray<NSURL*>* unknown = [NSMutableArray array];
+    for (NSURL* url in urls) {
+        NSError* lookupError = nil;
+        if ([self hasEntryForURL:url error:&lookupError]) {
+            continue;
+        }
+        if (lookupError != nil) {
+            if (error) {
+                *error = lookupError;
+            }
+            return nil;
+        }
+        [unknown addObject:url];
+    }
+    if (unknown.count == 0) {
+        return @{};
+    }
+
+    const NSUInteger count = unknown.count;
+    __strong NSString** prints = (__strong NSString**) calloc(count, sizeof(NSString*));
+    dispatch_apply(count, DISPATCH_APPLY_AUTO, ^(size_t index) {
+        prints[index] = libraryFingerprintOfURL(unknown[index]);
+    });
+    NSMutableDictionary<NSString*, NSString*>* printsByURL = [NSMutableDictionary dictionaryWithCapacity:count];
+    for (NSUInteger index = 0; index < count; index++) {
+        if (prints[index] != nil) {
+            printsByURL[unknown[index].absoluteString] = prints[index];
+        }
+        prints[index] = nil;
+    }
+    free(prints);
+    [fingerprints addEntriesFromDictionary:printsByURL];
+
+    const char* findSql = "SELECT url FROM tracks WHERE fingerprint = ? ORDER BY url";
+    const char* moveSql = "UPDATE tracks SET url = ? WHERE url = ?";
+    sqlite3_stmt* findStmt = NULL;
+    sqlite3_stmt* moveStmt = NULL;
+    int rc = [self prepareWriterStatement:findSql statement:&findStmt];
+    if (rc == SQLITE_OK) {
+        rc = [self prepareStatement:moveSql statement:&moveStmt];
+    }
     if (rc != SQLITE_OK) {
         if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare deep scan count"}];
+            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to prepare relocation"}];
         }
-        return -1;
+        [self releaseStatement:findStmt];
+        return nil;
     }
 
-    sqlite3_bind_double(stmt, 1, kBeatSampleDurationThreshold * 1000.0);
-    sqlite3_bind_int(stmt, 2, (int) kDeepScanVersion);
-    rc = sqlite3_step(stmt);
-    NSInteger count = -1;
-    if (rc == SQLITE_ROW) {
-        count = (NSInteger) sqlite3_column_int(stmt, 0);
-    } else {
-        if (error) {
-            *error = [NSError errorWithDomain:@"LibraryStore" code:rc userInfo:@{NSLocalizedDescriptionKey : @"Failed to read deep scan count"}];
+    NSMutableDictionary<NSURL*, NSURL*>* relocated = [NSMutableDictionary dictionary];
+    BOOL success = [self performTransaction:^BOOL {
+        for (NSURL* url in unknown) {
+            NSString* print = printsByURL[url.absoluteString];
+            if (print == nil) {
+                continue;
+            }
+            // Entries sharing the content whose file is still around are copies,
+            // not the one that moved. Entries moved earlier in this batch point
+            // at existing files by now.
+            sqlite3_reset(findStmt);
+            sqlite3_bind_text(findStmt, 1, print.UTF8String, -1, SQLITE_TRANSIENT);
+            NSURL* previous = nil;
+            int stepRc;
+            while ((stepRc = sqlite3_step(findStmt)) == SQLITE_ROW) {
+                NSURL* candidate = columnURL(findStmt, 0);
+                struct stat st;
+                if (candidate.isFileURL && stat(candidate.fileSystemRepresentation, &st) != 0) {
+                    previous = candidate;
+                    break;
+                }
+            }
+            sqlite3_reset(findStmt);
+            if (stepRc != SQLITE_ROW && stepRc != SQLITE_DONE) {
+                if (error) {
+                    *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to look up fingerprint"}];
+                }
+                return NO;
+            }
+            if (previous == nil) {
+                continue;
+            }
+
+            sqlite3_reset(moveStmt);
+            sqlite3_bind_text(moveStmt, 1, url.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(moveStmt, 2, previous.absoluteString.UTF8String, -1, SQLITE_TRANSIENT);
+            stepRc = sqlite3_step(moveStmt);
+            if (stepRc != SQLITE_DONE) {
+                if (error) {
+                    *error = [NSError errorWithDomain:@"LibraryStore" code:stepRc userInfo:@{NSLocalizedDescriptionKey : @"Failed to relocate track"}];
+                }
+                return NO;
+            }
+            relocated[url] = previous;
         }
+        return YES;
     }
+                                      error:error];
+    [self releaseStatement:findStmt];
+    [self releaseStatement:moveStmt];
 
-    sqlite3_finalize(stmt);
-    return count;
+    return success ? relocated : nil;
 }
 
 @end
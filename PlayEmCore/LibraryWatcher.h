@@ -0,0 +1,68 @@
+//
+//  LibraryWatcher.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Event ID to start watching from when there is nothing to catch up with.
+extern const uint64_t LibraryWatcherSinceNow;
+
+/// Paths that changed on disk during a burst of activity. Each path is
+/// reported once, by what it turned out to be once the burst settled.
+@interface LibraryWatcherBatch : NSObject
+
+/// Regular files that got created, written or renamed into place.
+@property (readonly, nonatomic) NSSet<NSURL*>* changedFiles;
+/// Paths that are gone. May be directories, the files below went with them.
+@property (readonly, nonatomic) NSSet<NSURL*>* removedPaths;
+/// Directories whose contents need a full look: moved in as a whole, or
+/// where the file system dropped events.
+@property (readonly, nonatomic) NSSet<NSURL*>* scannedDirectories;
+/// Events folded into this batch.
+@property (readonly, nonatomic) NSUInteger eventCount;
+/// ID of the latest event folded into this batch; resume from here.
+@property (readonly, nonatomic) uint64_t lastEventId;
+
+@end
+
+typedef void (^LibraryWatcherHandler)(LibraryWatcherBatch* batch);
+
+/// Watches the folders holding the library through FSEvents and reports what
+/// changed in coalesced batches, so that just the touched files need a look.
+///
+/// A batch gets reported once no event arrived for `latency`, or, while
+/// events keep coming, every ten times `latency`. Events for the same path
+/// within a batch fold into one.
+@interface LibraryWatcher : NSObject
+
+/// Few folders holding all the given files. Folders get joined into a common
+/// one only below a home folder's or a volume's top level, never into the home
+/// folder or the volume as a whole.
++ (NSArray<NSURL*>*)rootsCoveringURLs:(NSArray<NSURL*>*)urls;
+
+@property (readonly, nonatomic) NSArray<NSURL*>* roots;
+@property (readonly, nonatomic) NSTimeInterval latency;
+/// ID of the latest event reported; `LibraryWatcherSinceNow` before the first.
+@property (readonly) uint64_t lastEventId;
+
+/// `handler` gets invoked on a private serial queue.
+- (instancetype)initWithRoots:(NSArray<NSURL*>*)roots latency:(NSTimeInterval)latency handler:(LibraryWatcherHandler)handler;
+
+/// Start watching. Given the `lastEventId` of an earlier run, what changed in
+/// between gets reported first.
+- (BOOL)startSinceEventId:(uint64_t)eventId;
+- (void)stop;
+
+/// Fold an event for `path` into the pending batch, the way file system
+/// events get folded. `scan` asks for a full look at a directory.
+- (void)noteEventAtPath:(NSString*)path scanDirectory:(BOOL)scan eventId:(uint64_t)eventId;
+
+@end
+
+NS_ASSUME_NONNULL_END
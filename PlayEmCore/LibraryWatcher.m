@@ -0,0 +1,276 @@
+//
+//  LibraryWatcher.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "LibraryWatcher.h"
+
+#import <CoreServices/CoreServices.h>
+#import <sys/stat.h>
+
+const uint64_t LibraryWatcherSinceNow = kFSEventStreamEventIdSinceNow;
+
+/// Longest a batch gets held back while events keep coming, in multiples of the latency.
+static const double kLibraryWatcherMaximumDelayFactor = 10.0;
+
+@interface LibraryWatcherBatch ()
+@property (strong, nonatomic) NSSet<NSURL*>* changedFiles;
+@property (strong, nonatomic) NSSet<NSURL*>* removedPaths;
+@property (strong, nonatomic) NSSet<NSURL*>* scannedDirectories;
+@property (assign, nonatomic) NSUInteger eventCount;
+@property (assign, nonatomic) uint64_t lastEventId;
+@end
+
+@implementation LibraryWatcherBatch
+@end
+
+@interface LibraryWatcher ()
+@property (strong, nonatomic) NSArray<NSURL*>* roots;
+@property (assign, nonatomic) NSTimeInterval latency;
+@property (assign) uint64_t lastEventId;
+@property (copy, nonatomic) LibraryWatcherHandler handler;
+@property (strong, nonatomic) dispatch_queue_t queue;
+@end
+
+@implementation LibraryWatcher {
+    FSEventStreamRef _stream;
+
+    // Pending batch; only touched on `_queue`.
+    NSMutableDictionary<NSString*, NSNumber*>* _pending;
+    NSUInteger _pendingEventCount;
+    uint64_t _pendingEventId;
+    CFAbsoluteTime _firstEventTime;
+    CFAbsoluteTime _lastEventTime;
+    BOOL _flushScheduled;
+}
+
+/// Fewest leading path components a root made up of several folders keeps.
+/// Below a home folder, the one within it (`/Users/dj/Music`); below a volume,
+/// the one on it (`/Volumes/Crate/Sets`). A home folder or a volume as a whole
+/// changes all the time for reasons of no concern to the library.
+static NSUInteger libraryWatcherRootFloor(NSArray<NSString*>* components)
+{
+    if (components.count > 2 && ([components[1] isEqualToString:@"Volumes"] || [components[1] isEqualToString:@"Users"])) {
+        return 4;
+    }
+    return 2;
+}
+
++ (NSArray<NSURL*>*)rootsCoveringURLs:(NSArray<NSURL*>*)urls
+{
+    NSMutableSet<NSArray<NSString*>*>* folders = [NSMutableSet set];
+    for (NSURL* url in urls) {
+        if (url.isFileURL) {
+            NSArray<NSString*>* components = url.URLByDeletingLastPathComponent.standardizedURL.pathComponents;
+            if (components.count > 0) {
+                [folders addObject:components];
+            }
+        }
+    }
+    NSArray<NSArray<NSString*>*>* sorted = [folders.allObjects sortedArrayUsingComparator:^NSComparisonResult(NSArray<NSString*>* a, NSArray<NSString*>* b) {
+        for (NSUInteger i = 0; i < MIN(a.count, b.count); i++) {
+            NSComparisonResult result = [a[i] compare:b[i]];
+            if (result != NSOrderedSame) {
+                return result;
+            }
+        }
+        return a.count < b.count ? NSOrderedAscending : (a.count > b.count ? NSOrderedDescending : NSOrderedSame);
+    }];
+
+    // Sorted by component, folders sharing a parent come next to each other and
+    // nested ones right after their parent; each either lands in the root
+    // before it or starts one of its own.
+    NSMutableArray<NSArray<NSString*>*>* roots = [NSMutableArray array];
+    for (NSArray<NSString*>* components in sorted) {
+        NSArray<NSString*>* last = roots.lastObject;
+        if (last != nil) {
+            NSUInteger common = 0;
+            while (common < last.count && common < components.count && [last[common] isEqualToString:components[common]]) {
+                common++;
+            }
+            if (common == last.count) {
+                continue;
+            }
+            if (common >= MAX(libraryWatcherRootFloor(last), libraryWatcherRootFloor(components))) {
+                roots[roots.count - 1] = [last subarrayWithRange:NSMakeRange(0, common)];
+                continue;
+            }
+        }
+        [roots addObject:components];
+    }
+
+    NSMutableArray<NSURL*>* urlsOfRoots = [NSMutableArray arrayWithCapacity:roots.count];
+    for (NSArray<NSString*>* root in roots) {
+        [urlsOfRoots addObject:[NSURL fileURLWithPath:[NSString pathWithComponents:root] isDirectory:YES]];
+    }
+    return urlsOfRoots;
+}
+
+- (instancetype)initWithRoots:(NSArray<NSURL*>*)roots latency:(NSTimeInterval)latency handler:(LibraryWatcherHandler)handler
+{
+    self = [super init];
+    if (self) {
+        _roots = [roots copy];
+        _latency = latency;
+        _handler = [handler copy];
+        _lastEventId = LibraryWatcherSinceNow;
+        _queue = dispatch_queue_create("PlayEm.LibraryWatcher", DISPATCH_QUEUE_SERIAL);
+        _pending = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self stop];
+}
+
+static void libraryWatcherCallback(ConstFSEventStreamRef stream,
+                                   void* info,
+                                   size_t count,
+                                   void* paths,
+                                   const FSEventStreamEventFlags flags[],
+                                   const FSEventStreamEventId ids[])
+{
+    LibraryWatcher* watcher = (__bridge LibraryWatcher*) info;
+    NSArray<NSString*>* eventPaths = (__bridge NSArray<NSString*>*) paths;
+    for (size_t i = 0; i < count; i++) {
+        if (flags[i] & kFSEventStreamEventFlagHistoryDone) {
+            continue;
+        }
+        const FSEventStreamEventFlags movedIn = kFSEventStreamEventFlagItemCreated | kFSEventStreamEventFlagItemRenamed;
+        BOOL scan = (flags[i] & kFSEventStreamEventFlagMustScanSubDirs) != 0 ||
+                    ((flags[i] & kFSEventStreamEventFlagItemIsDir) != 0 && (flags[i] & movedIn) != 0);
+        [watcher foldEventAtPath:eventPaths[i] scanDirectory:scan eventId:ids[i]];
+    }
+}
+
+- (BOOL)startSinceEventId:(uint64_t)eventId
+{
+    if (_stream != NULL) {
+        return YES;
+    }
+    if (_roots.count == 0) {
+        return NO;
+    }
+
+    NSMutableArray<NSString*>* paths = [NSMutableArray arrayWithCapacity:_roots.count];
+    for (NSURL* root in _roots) {
+        [paths addObject:root.path];
+    }
+    FSEventStreamContext context = {.version = 0, .info = (__bridge void*) self};
+    _stream = FSEventStreamCreate(kCFAllocatorDefault,
+                                  libraryWatcherCallback,
+                                  &context,
+                                  (__bridge CFArrayRef) paths,
+                                  eventId,
+                                  _latency,
+                                  kFSEventStreamCreateFlagUseCFTypes | kFSEventStreamCreateFlagFileEvents | kFSEventStreamCreateFlagWatchRoot);
+    if (_stream == NULL) {
+        NSLog(@"Library watcher: failed to create event stream for %@", paths);
+        return NO;
+    }
+    FSEventStreamSetDispatchQueue(_stream, _queue);
+    if (!FSEventStreamStart(_stream)) {
+        NSLog(@"Library watcher: failed to start event stream for %@", paths);
+        FSEventStreamInvalidate(_stream);
+        FSEventStreamRelease(_stream);
+        _stream = NULL;
+        return NO;
+    }
+    NSLog(@"Library watcher: watching %@", paths);
+    return YES;
+}
+
+- (void)stop
+{
+    if (_stream == NULL) {
+        return;
+    }
+    FSEventStreamStop(_stream);
+    FSEventStreamInvalidate(_stream);
+    FSEventStreamRelease(_stream);
+    _stream = NULL;
+}
+
+- (void)noteEventAtPath:(NSString*)path scanDirectory:(BOOL)scan eventId:(uint64_t)eventId
+{
+    dispatch_async(_queue, ^{
+        [self foldEventAtPath:path scanDirectory:scan eventId:eventId];
+    });
+}
+
+/// Runs on `_queue`.
+- (void)foldEventAtPath:(NSString*)path scanDirectory:(BOOL)scan eventId:(uint64_t)eventId
+{
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    if (_pendingEventCount == 0) {
+        _firstEventTime = now;
+    }
+    _lastEventTime = now;
+    _pendingEventCount++;
+    _pendingEventId = MAX(_pendingEventId, eventId);
+    if (scan || _pending[path] == nil) {
+        _pending[path] = @(scan || _pending[path].boolValue);
+    }
+    [self scheduleFlushAfter:_latency];
+}
+
+- (void)scheduleFlushAfter:(NSTimeInterval)delay
+{
+    if (_flushScheduled) {
+        return;
+    }
+    _flushScheduled = YES;
+    LibraryWatcher* __weak weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (delay * NSEC_PER_SEC)), _queue, ^{
+        [weakSelf flushIfSettled];
+    });
+}
+
+- (void)flushIfSettled
+{
+    _flushScheduled = NO;
+    if (_pendingEventCount == 0) {
+        return;
+    }
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    NSTimeInterval quiet = now - _lastEventTime;
+    if (quiet < _latency && now - _firstEventTime < _latency * kLibraryWatcherMaximumDelayFactor) {
+        [self scheduleFlushAfter:_latency - quiet];
+        return;
+    }
+
+    // What a path turned out to be matters, not how it got there.
+    NSMutableSet<NSURL*>* changed = [NSMutableSet set];
+    NSMutableSet<NSURL*>* removed = [NSMutableSet set];
+    NSMutableSet<NSURL*>* scanned = [NSMutableSet set];
+    [_pending enumerateKeysAndObjectsUsingBlock:^(NSString* path, NSNumber* scan, BOOL* stop) {
+        struct stat st;
+        if (stat(path.fileSystemRepresentation, &st) != 0) {
+            [removed addObject:[NSURL fileURLWithPath:path]];
+        } else if (S_ISREG(st.st_mode)) {
+            [changed addObject:[NSURL fileURLWithPath:path isDirectory:NO]];
+        } else if (S_ISDIR(st.st_mode) && scan.boolValue) {
+            [scanned addObject:[NSURL fileURLWithPath:path isDirectory:YES]];
+        }
+    }];
+
+    LibraryWatcherBatch* batch = [LibraryWatcherBatch new];
+    batch.changedFiles = changed;
+    batch.removedPaths = removed;
+    batch.scannedDirectories = scanned;
+    batch.eventCount = _pendingEventCount;
+    batch.lastEventId = _pendingEventId;
+
+    [_pending removeAllObjects];
+    _pendingEventCount = 0;
+
+    _handler(batch);
+    self.lastEventId = batch.lastEventId;
+}
+
+@end
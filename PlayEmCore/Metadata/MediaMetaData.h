@@ -17,6 +17,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 typedef double (^FrameToSeconds)(unsigned long long frame);
 
+@class MediaSearchKey;
 @class SHMatchedMediaItem;
 
 ///
@@ -55,6 +56,11 @@ extern NSString* const kMediaMetaDataMapTypeNumber;
 
 // extern NSString* const kStarSymbol;
 
+/// Holds artwork data for metadata that only keeps the artwork hash around.
+@protocol MediaMetaDataArtworkSource <NSObject>
+- (NSData* _Nullable)artworkDataForHash:(NSString*)hash;
+@end
+
 @interface MediaMetaData : NSObject <NSCopying, NSSecureCoding>
 @property (strong, nonatomic) ITLibMediaItem* shadow;
 @property (copy, nonatomic, nullable) NSString* title;
@@ -77,7 +83,12 @@ extern NSString* const kMediaMetaDataMapTypeNumber;
 @property (copy, nonatomic, nullable) NSNumber* disks;
 @property (copy, nonatomic, nullable) NSNumber* locationType;
 @property (readonly, nonatomic, nullable) NSString* artworkHash;
+/// Artwork data; fetched from `artworkSource` on every access when only the
+/// hash is known.
 @property (strong, nonatomic, nullable) NSData* artwork;
+/// Where artwork known by hash only gets fetched from. Cleared when `artwork`
+/// gets set.
+@property (readonly, weak, nonatomic, nullable) id<MediaMetaDataArtworkSource> artworkSource;
 @property (readonly, nonatomic, nullable) NSData* artworkWithDefault;
 @property (copy, nonatomic, nullable) NSURL* artworkLocation;
 @property (copy, nonatomic, nullable) NSNumber* artworkFormat;
@@ -101,6 +112,10 @@ extern NSString* const kMediaMetaDataMapTypeNumber;
 
 @property (strong, nonatomic, nullable) TrackList* trackList;
 
+/// Genre, title, artist, album and tags folded for searching; built on first
+/// use and again after any of them changed.
+@property (readonly, nonatomic) MediaSearchKey* searchKey;
+
 - (void)setArtworkFromImage:(NSImage*)image;
 
 + (MediaMetaDataFileFormatType)fileTypeWithURL:(NSURL*)url error:(NSError**)error;
@@ -126,6 +141,9 @@ extern NSString* const kMediaMetaDataMapTypeNumber;
 - (BOOL)isEqualToMediaMetaData:(MediaMetaData*)other atKey:key;
 - (BOOL)isSemanticallyEqualToMeta:(MediaMetaData*)other;
 
+/// Refer to artwork held by `source` instead of holding its data.
+- (void)setArtworkHash:(NSString*)hash source:(id<MediaMetaDataArtworkSource>)source;
+
 - (NSString* _Nullable)stringForKey:(NSString*)key;
 - (void)updateWithKey:(NSString*)key string:(NSString*)string;
 
@@ -22,6 +22,7 @@
 #import "MediaMetaData+AVAsset.h"
 #import "MediaMetaData+TagLib.h"
 #import "MediaMetaData+MixWheel.h"
+#import "MediaSearchKey.h"
 
 #import "NSString+BeautifulPast.h"
 #import "NSString+OccurenceCount.h"
@@ -57,10 +58,18 @@ NSString* const kMediaMetaDataMapTypeNumber = @"number";
 @interface MediaMetaData ()
 @property (readonly, nonatomic, nullable) NSDictionary* starsQuantums;
 @property (copy, nonatomic, nullable) NSString* artworkHashKey;
+/// Dropped whenever text it covers changes; searches read it concurrently.
+/// Use both while synchronized on self.
+@property (strong, nonatomic, nullable) MediaSearchKey* cachedSearchKey;
+/// Bumped with every drop, so that a key built from text changed meanwhile
+/// does not get kept.
+@property (assign, nonatomic) NSUInteger searchKeyGeneration;
 @end
 
 @implementation MediaMetaData
 
+@synthesize artwork = _artwork;
+
 + (NSDictionary*)starsQuantums
 {
     static NSDictionary* quantums = nil;
@@ -538,6 +547,12 @@ NSString* const kMediaMetaDataMapTypeNumber = @"number";
     return _title;
 }
 
+- (void)setTitle:(NSString* _Nullable)title
+{
+    _title = [title copy];
+    [self invalidateSearchKey];
+}
+
 - (NSString* _Nullable)size
 {
     if (_shadow == nil) {
@@ -643,6 +658,12 @@ NSString* const kMediaMetaDataMapTypeNumber = @"number";
     return _artist;
 }
 
+- (void)setArtist:(NSString* _Nullable)artist
+{
+    _artist = [artist copy];
+    [self invalidateSearchKey];
+}
+
 - (NSString* _Nullable)album
 {
     if (_shadow == nil) {
@@ -656,6 +677,12 @@ NSString* const kMediaMetaDataMapTypeNumber = @"number";
     return _album;
 }
 
+- (void)setAlbum:(NSString* _Nullable)album
+{
+    _album = [album copy];
+    [self invalidateSearchKey];
+}
+
 - (NSString* _Nullable)albumArtist
 {
     if (_shadow == nil) {
@@ -682,6 +709,12 @@ NSString* const kMediaMetaDataMapTypeNumber = @"number";
     return _genre;
 }
 
+- (void)setGenre:(NSString* _Nullable)genre
+{
+    _genre = [genre copy];
+    [self invalidateSearchKey];
+}
+
 - (NSString* _Nullable)composer
 {
     if (_shadow == nil) {
@@ -780,6 +813,12 @@ NSString* const kMediaMetaDataMapTypeNumber = @"number";
     return _tags;
 }
 
+- (void)setTags:(NSString* _Nullable)tags
+{
+    _tags = [tags copy];
+    [self invalidateSearchKey];
+}
+
 - (NSNumber* _Nullable)year
 {
     if (_shadow == nil) {
@@ -900,6 +939,10 @@ NSString* const kMediaMetaDataMapTypeNumber = @"number";
 - (NSData* _Nullable)artwork
 {
     if (_shadow == nil) {
+        if (_artwork == nil && _artworkSource != nil && _artworkHashKey.length > 0) {
+            // Not retained, the source does the caching.
+            return [_artworkSource artworkDataForHash:_artworkHashKey];
+        }
         return _artwork;
     }
 
@@ -912,6 +955,20 @@ NSString* const kMediaMetaDataMapTypeNumber = @"number";
     return _artwork;
 }
 
+- (void)setArtwork:(NSData* _Nullable)artwork
+{
+    _artwork = artwork;
+    _artworkSource = nil;
+    _artworkHashKey = nil;
+}
+
+- (void)setArtworkHash:(NSString*)hash source:(id<MediaMetaDataArtworkSource>)source
+{
+    _artwork = nil;
+    _artworkHashKey = [hash copy];
+    _artworkSource = source;
+}
+
 + (NSData*)defaultArtworkData
 {
     NSBundle* bundle = [NSBundle mainBundle];
@@ -925,7 +982,7 @@ NSString* const kMediaMetaDataMapTypeNumber = @"number";
     NSData* data = nil;
 
     if (_shadow == nil) {
-        data = _artwork;
+        data = self.artwork;
     }
 
     if (data == nil) {
@@ -1060,7 +1117,7 @@ NSString* const kMediaMetaDataMapTypeNumber = @"number";
     [coder encodeObject:_disk forKey:@"disk"];
     [coder encodeObject:_disks forKey:@"disks"];
     [coder encodeObject:_locationType forKey:@"locationType"];
-    [coder encodeObject:_artwork forKey:@"artwork"];
+    [coder encodeObject:self.artwork forKey:@"artwork"];
     [coder encodeObject:_artworkFormat forKey:@"artworkFormat"];
     [coder encodeObject:_location forKey:@"location"];
     [coder encodeObject:_added forKey:@"added"];
@@ -1100,6 +1157,9 @@ NSString* const kMediaMetaDataMapTypeNumber = @"number";
         copy.disks = [_disks copyWithZone:zone];
         copy.locationType = [_locationType copyWithZone:zone];
         copy.artwork = [_artwork copyWithZone:zone];
+        if (_artwork == nil && _artworkSource != nil) {
+            [copy setArtworkHash:_artworkHashKey source:_artworkSource];
+        }
         copy.artworkFormat = [_artworkFormat copyWithZone:zone];
         copy.location = [_location copyWithZone:zone];
         copy.added = [_added copyWithZone:zone];
@@ -1305,8 +1365,41 @@ NSString* const kMediaMetaDataMapTypeNumber = @"number";
 }
 
 
+- (void)invalidateSearchKey
+{
+    @synchronized(self) {
+        self.cachedSearchKey = nil;
+        self.searchKeyGeneration++;
+    }
+}
+
+- (MediaSearchKey*)searchKey
+{
+    MediaSearchKey* key = nil;
+    NSUInteger generation = 0;
+    @synchronized(self) {
+        key = self.cachedSearchKey;
+        generation = self.searchKeyGeneration;
+    }
+    if (key != nil) {
+        return key;
+    }
+    // Built outside the lock; it reads the text through the getters.
+    key = [[MediaSearchKey alloc] initWithMeta:self];
+    @synchronized(self) {
+        if (generation == self.searchKeyGeneration) {
+            self.cachedSearchKey = key;
+        }
+    }
+    return key;
+}
+
 - (NSString*)artworkHash
 {
+    if (_artwork == nil && _artworkSource != nil) {
+        // The source knows the artwork by this hash.
+        return _artworkHashKey;
+    }
     // Assert that without data we also have no hash.
     if (self.artwork != nil) {
         // Assert we calculate that hash dynamically.
@@ -0,0 +1,45 @@
+//
+//  MediaSearchKey.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class MediaMetaData;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Text of a library item that search needles get matched against, folded
+/// once up front into a single buffer of UTF-8: genre, title, artist and album,
+/// then the tags. Held in two foldings, one ignoring case, diacritics and width,
+/// one ignoring case only.
+@interface MediaSearchKey : NSObject
+
+/// UTF-8 of `string` folded like the item text; with `exact` set, just its case
+/// gets folded.
++ (NSData*)foldedNeedle:(NSString*)string exact:(BOOL)exact;
+/// Words of `string`, split at whitespace and stripped of surrounding
+/// punctuation, folded like `+foldedNeedle:exact:`. Matches how the library
+/// index splits a needle.
++ (NSArray<NSData*>*)foldedWordsOfNeedle:(NSString*)string exact:(BOOL)exact;
+
+- (instancetype)initWithMeta:(MediaMetaData*)meta;
+
+/// Tags parsed from their "#house#deep" form.
+@property (readonly, nonatomic) NSSet<NSString*>* tagSet;
+
+/// Whether a needle folded by `+foldedNeedle:exact:` occurs in the genre,
+/// title, artist or album.
+- (BOOL)fieldsContainNeedle:(NSData*)needle exact:(BOOL)exact;
+/// Same, for the tags.
+- (BOOL)tagsContainNeedle:(NSData*)needle exact:(BOOL)exact;
+/// Whether each of the words, folded by `+foldedWordsOfNeedle:exact:`, starts
+/// a word in the genre, title, artist or album. Matches like the library index.
+- (BOOL)fieldsContainWordPrefixes:(NSArray<NSData*>*)words exact:(BOOL)exact;
+
+@end
+
+NS_ASSUME_NONNULL_END
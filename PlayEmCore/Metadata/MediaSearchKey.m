@@ -0,0 +1,147 @@
+//
+//  MediaSearchKey.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "MediaSearchKey.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#import "MediaMetaData.h"
+
+static const NSStringCompareOptions kLooseFoldingOptions = NSDiacriticInsensitiveSearch | NSCaseInsensitiveSearch | NSWidthInsensitiveSearch;
+
+/// Parts of the buffer; a needle never spans two of them.
+typedef NS_ENUM(NSUInteger, MediaSearchKeyPart) {
+    MediaSearchKeyPartLooseFields,
+    MediaSearchKeyPartLooseTags,
+    MediaSearchKeyPartExactFields,
+    MediaSearchKeyPartExactTags,
+    MediaSearchKeyPartCount,
+};
+
+static NSString* foldedString(NSString* string, BOOL exact)
+{
+    if (exact) {
+        return [string.precomposedStringWithCanonicalMapping stringByFoldingWithOptions:NSCaseInsensitiveSearch locale:[NSLocale currentLocale]];
+    }
+    return [string stringByFoldingWithOptions:kLooseFoldingOptions locale:[NSLocale currentLocale]];
+}
+
+/// Whether the byte belongs to a word; anything beyond ASCII is taken as a
+/// letter, like the index tokenizer does for the scripts it knows.
+static BOOL isWordByte(char c)
+{
+    unsigned char byte = (unsigned char) c;
+    return byte >= 0x80 || isalnum(byte);
+}
+
+@implementation MediaSearchKey {
+    NSData* _buffer;
+    NSRange _parts[MediaSearchKeyPartCount];
+}
+
++ (NSData*)foldedNeedle:(NSString*)string exact:(BOOL)exact
+{
+    return [foldedString(string, exact) dataUsingEncoding:NSUTF8StringEncoding];
+}
+
++ (NSArray<NSData*>*)foldedWordsOfNeedle:(NSString*)string exact:(BOOL)exact
+{
+    NSCharacterSet* separators = NSCharacterSet.alphanumericCharacterSet.invertedSet;
+    NSMutableArray<NSData*>* words = [NSMutableArray array];
+    for (NSString* word in [string componentsSeparatedByCharactersInSet:NSCharacterSet.whitespaceAndNewlineCharacterSet]) {
+        // The index drops punctuation around a word as well.
+        NSString* trimmed = [word stringByTrimmingCharactersInSet:separators];
+        if (trimmed.length == 0) {
+            continue;
+        }
+        [words addObject:[self foldedNeedle:trimmed exact:exact]];
+    }
+    return words;
+}
+
+- (instancetype)initWithMeta:(MediaMetaData*)meta
+{
+    self = [super init];
+    if (self) {
+        NSString* tags = meta.tags ?: @"";
+        if ([tags hasPrefix:@"#"]) {
+            _tagSet = [NSSet setWithArray:[[tags substringFromIndex:1] componentsSeparatedByString:@"#"]];
+        } else {
+            _tagSet = [NSSet set];
+        }
+
+        // Newlines keep needles from matching across fields.
+        NSString* fields = [@[ meta.genre ?: @"", meta.title ?: @"", meta.artist ?: @"", meta.album ?: @"" ] componentsJoinedByString:@"\n"];
+        NSArray<NSString*>* parts = @[ foldedString(fields, NO), foldedString(tags, NO), foldedString(fields, YES), foldedString(tags, YES) ];
+        NSMutableData* buffer = [NSMutableData dataWithCapacity:(fields.length + tags.length) * 2 + MediaSearchKeyPartCount];
+        for (NSUInteger part = 0; part < MediaSearchKeyPartCount; part++) {
+            const char* utf8 = parts[part].UTF8String;
+            size_t length = strlen(utf8);
+            _parts[part] = NSMakeRange(buffer.length, length);
+            [buffer appendBytes:utf8 length:length];
+            [buffer appendBytes:"\n" length:1];
+        }
+        _buffer = buffer;
+    }
+    return self;
+}
+
+- (BOOL)part:(MediaSearchKeyPart)part containsNeedle:(NSData*)needle
+{
+    NSRange range = _parts[part];
+    if (needle.length == 0 || needle.length > range.length) {
+        return NO;
+    }
+    return memmem((const char*) _buffer.bytes + range.location, range.length, needle.bytes, needle.length) != NULL;
+}
+
+- (BOOL)part:(MediaSearchKeyPart)part containsWordPrefix:(NSData*)word
+{
+    NSRange range = _parts[part];
+    if (word.length == 0 || word.length > range.length) {
+        return NO;
+    }
+    const char* start = (const char*) _buffer.bytes + range.location;
+    const char* end = start + range.length;
+    const char* from = start;
+    while ((size_t) (end - from) >= word.length) {
+        const char* found = memmem(from, (size_t) (end - from), word.bytes, word.length);
+        if (found == NULL) {
+            return NO;
+        }
+        if (found == start || !isWordByte(found[-1])) {
+            return YES;
+        }
+        from = found + 1;
+    }
+    return NO;
+}
+
+- (BOOL)fieldsContainNeedle:(NSData*)needle exact:(BOOL)exact
+{
+    return [self part:exact ? MediaSearchKeyPartExactFields : MediaSearchKeyPartLooseFields containsNeedle:needle];
+}
+
+- (BOOL)tagsContainNeedle:(NSData*)needle exact:(BOOL)exact
+{
+    return [self part:exact ? MediaSearchKeyPartExactTags : MediaSearchKeyPartLooseTags containsNeedle:needle];
+}
+
+- (BOOL)fieldsContainWordPrefixes:(NSArray<NSData*>*)words exact:(BOOL)exact
+{
+    MediaSearchKeyPart part = exact ? MediaSearchKeyPartExactFields : MediaSearchKeyPartLooseFields;
+    for (NSData* word in words) {
+        if (![self part:part containsWordPrefix:word]) {
+            return NO;
+        }
+    }
+    return words.count > 0;
+}
+
+@end
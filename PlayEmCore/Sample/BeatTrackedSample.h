@@ -64,6 +64,18 @@ typedef struct _BeatsParserContext BeatsParserContext;
 - (void)trackBeatsAsyncWithCompletionQueue:(dispatch_queue_t _Nullable)queue
                                   callback:(void (^)(BOOL))callback;
 
+/// Page-fed tracking for callers that get handed the decoded pages, e.g. an
+/// `AnalysisPipeline`. Same result as the asynchronous tracking, but runs on
+/// the caller's thread and never waits for pages, so a held decoder leaves
+/// nothing blocked.
+///
+/// `beginPageTracking` once the rendered format is known, then every page in
+/// order, then `finishPageTracking`, all from the same serial queue.
+- (void)beginPageTracking;
+- (void)trackPageWithFrames:(unsigned long long)frames offset:(unsigned long long)offset channels:(NSArray<NSData*>*)channels;
+/// Derives the beat grid and tempo. Returns NO when aborted.
+- (BOOL)finishPageTracking;
+
 - (unsigned long long)seekToFirstBeat:(nonnull BeatEventIterator*)iterator;
 - (unsigned long long)seekToNextBeat:(nonnull BeatEventIterator*)iterator;
 - (unsigned long long)seekToPreviousBeat:(nonnull BeatEventIterator*)iterator;
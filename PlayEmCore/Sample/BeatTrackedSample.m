@@ -8,6 +8,7 @@
 #import "BeatTrackedSample.h"
 
 #import <Foundation/Foundation.h>
+#include <stdatomic.h>
 
 #import "../Audio/AudioProcessing.h"
 #import "ActivityManager.h"
@@ -56,6 +57,17 @@ static const float kParamFilterDefaultValue = 270.0f;
 
 static const float kSilenceThreshold = 0.1;
 
+// Frames measured per beat for its energy and peak.
+static const unsigned long long kBeatEnergyWindowFrames = 4096;
+// Resolution of the energy summary kept while streaming.
+static const unsigned long long kEnergyBlockFrames = 1024;
+
+/// Energy summary of `kEnergyBlockFrames` frames of the mono mix.
+typedef struct {
+    float squares;
+    float peak;
+} EnergyBlock;
+
 NSString* const kBeatTrackedSampleTempoChangeNotification = @"BeatTrackedSampleTempoChange";
 NSString* const kBeatTrackedSampleBeatNotification = @"BeatTrackedSampleBeat";
 
@@ -106,6 +118,23 @@ const NSUInteger BeatEventMaskMarkers = BeatEventStyleMarkIntro | BeatEventStyle
     fvec_t* _aubio_output_buffer;
 
     aubio_tempo_t* _aubio_tempo;
+
+    // Position registered with the sample while tracking.
+    NSUInteger _sampleReader;
+
+    // Filled during the first pass when the sample drops consumed pages, as
+    // those are gone by the time beat energies get measured.
+    NSMutableData* _energyBlocks;
+    EnergyBlock _energyBlock;
+    unsigned long long _energyBlockFrames;
+
+    // First pass state, carried across pages.
+    BOOL _initialSilenceEnded;
+    BOOL _inTrailingSilence;
+    size_t _hopFrames;
+    unsigned long long _trackedFrames;
+
+    atomic_bool _trackingAborted;
 }
 
 - (void)clearBpmHistory
@@ -125,6 +154,7 @@ const NSUInteger BeatEventMaskMarkers = BeatEventStyleMarkIntro | BeatEventStyle
         _aubio_input_buffer = NULL;
         _aubio_output_buffer = NULL;
         _aubio_tempo = NULL;
+        atomic_init(&_trackingAborted, false);
 
         _beats = [NSMutableDictionary dictionary];
         _sampleRate = (sample.renderedSampleRate > 0.0 ? sample.renderedSampleRate :
@@ -197,6 +227,139 @@ void beatsContextReset(BeatsParserContext* context)
     context->eventIndex = 0;
 }
 
+/// Whether the running tracking got aborted, pulled or page-fed.
+- (BOOL)trackingAborted
+{
+    if (atomic_load(&_trackingAborted)) {
+        return YES;
+    }
+    return _queueOperation != NULL && dispatch_block_testcancel(_queueOperation) != 0;
+}
+
+/// Sets up the first pass, shared by pulled and page-fed tracking.
+- (void)beginFirstPass
+{
+    [self setupTracking];
+
+    _coarseBeats = [NSMutableData data];
+    _energyBlocks = _sample.discardsConsumedPages ? [NSMutableData data] : nil;
+    _energyBlock = (EnergyBlock){0.0f, 0.0f};
+    _energyBlockFrames = 0;
+
+    // We need to track heading amd trailing silence to correct the beat-grid.
+    _initialSilenceEnded = NO;
+    _inTrailingSilence = NO;
+    _initialSilenceEndsAtFrame = 0LL;
+    _trailingSilenceStartsAtFrame = 0LL;
+
+    _hopFrames = 0;
+    _trackedFrames = 0LL;
+}
+
+/// Runs aubio on the filled input hop.
+- (void)trackHop
+{
+    aubio_tempo_do(_aubio_tempo, _aubio_input_buffer, _aubio_output_buffer);
+    const bool beat = fvec_get_sample(_aubio_output_buffer, 0) != 0.f;
+    if (beat) {
+        unsigned long long frame = aubio_tempo_get_last(_aubio_tempo);
+        [_coarseBeats appendBytes:&frame length:sizeof(unsigned long long)];
+    }
+    _hopFrames = 0;
+}
+
+/// First pass over the given frames, which have to follow the ones tracked
+/// so far. The mono mix gets handed to aubio one hop at a time. Returns NO
+/// when aborted.
+- (BOOL)trackFrames:(unsigned long long)frames offset:(unsigned long long)offset data:(const float* const*)data
+{
+    const int channels = _sample.sampleFormat.channels;
+    for (unsigned long long frame = 0; frame < frames; frame++) {
+        double s = 0.0;
+        for (int channel = 0; channel < channels; channel++) {
+            s += data[channel][frame];
+        }
+        s /= (float) channels;
+
+        [_energy addFrame:s];
+
+        if (_energyBlocks != nil) {
+            _energyBlock.squares += s * s;
+            _energyBlock.peak = MAX(_energyBlock.peak, (float) fabs(s));
+            if (++_energyBlockFrames == kEnergyBlockFrames) {
+                [_energyBlocks appendBytes:&_energyBlock length:sizeof(EnergyBlock)];
+                _energyBlock = (EnergyBlock){0.0f, 0.0f};
+                _energyBlockFrames = 0;
+            }
+        }
+
+        // We need to track heading and trailing silence to correct the
+        // beat-grid.
+        if (fabs(s) > kSilenceThreshold && !_initialSilenceEnded) {
+            _initialSilenceEnded = YES;
+            _initialSilenceEndsAtFrame = offset + frame;
+        }
+        if (fabs(s) < kSilenceThreshold) {
+            if (!_inTrailingSilence) {
+                _inTrailingSilence = YES;
+                _trailingSilenceStartsAtFrame = offset + frame;
+            }
+        } else {
+            _inTrailingSilence = NO;
+        }
+
+        if (_filterEnabled) {
+            // For improving results on beat-detection for modern electronic
+            // music, we apply a basic lowpass filter (feedback).
+            // FIXME(tillt): We should really use the HW accellerated lowpass we
+            // already have.
+            _filterOutput += (s - _filterOutput) / _filterConstant;
+            s = _filterOutput;
+        }
+
+        _aubio_input_buffer->data[_hopFrames++] = s;
+        if (_hopFrames == _hopSize) {
+            if ([self trackingAborted]) {
+                return NO;
+            }
+            [self trackHop];
+        }
+    }
+    _trackedFrames = offset + frames;
+    return YES;
+}
+
+/// Flushes the first pass and derives the beat grid from it.
+- (void)finishFirstPass
+{
+    if (_hopFrames > 0) {
+        [self trackHop];
+    }
+    if (_energyBlockFrames > 0) {
+        [_energyBlocks appendBytes:&_energyBlock length:sizeof(EnergyBlock)];
+    }
+    if (!_inTrailingSilence) {
+        _trailingSilenceStartsAtFrame = _trackedFrames;
+    }
+    [self cleanupTracking];
+
+    NSLog(@"initial silence ends at %lld frames after start of sample", _initialSilenceEndsAtFrame);
+    NSLog(@"trailing silence starts %lld frames before end of sample", _trackedFrames - _trailingSilenceStartsAtFrame);
+
+    // Generate a constant grid pattern out of the detected beats.
+    NSData* constantRegions = [self retrieveConstantRegions];
+    _constantBeats = [self makeConstantBeats:constantRegions];
+
+    // The pages around each beat are long gone when streaming.
+    if (_energyBlocks != nil) {
+        [self measureEnergyAtBeatsFromBlocks];
+        _energyBlocks = nil;
+    } else {
+        [self measureEnergyAtBeats];
+    }
+    [self updateAverageTempo];
+}
+
 - (BOOL)trackBeatsWithToken:(ActivityToken*)token
 {
     NSLog(@"beats tracking...");
@@ -205,7 +368,7 @@ void beatsContextReset(BeatsParserContext* context)
         [[ActivityManager shared] updateActivity:token progress:0.0 detail:PECLocalizedString(@"activity.beat_detection.initializing", @"Detail when initializing beat detection")];
     }
 
-    [self setupTracking];
+    [self beginFirstPass];
 
     float* data[self->_sample.sampleFormat.channels];
     const int channels = self->_sample.sampleFormat.channels;
@@ -213,15 +376,8 @@ void beatsContextReset(BeatsParserContext* context)
         data[channel] = (float*) ((NSMutableData*) self->_sampleBuffers[channel]).bytes;
     }
 
-    _coarseBeats = [NSMutableData data];
-
     NSLog(@"beat detect pass one: libaubio");
 
-    // We need to track heading amd trailing silence to correct the beat-grid.
-    BOOL initialSilenceEnded = NO;
-    _initialSilenceEndsAtFrame = 0LL;
-    _trailingSilenceStartsAtFrame = self->_sample.frames;
-
     // Here we go, all the way through our entire sample.
     unsigned long long sourceWindowFrameOffset = 0LL;
     while (sourceWindowFrameOffset < self->_sample.frames) {
@@ -230,7 +386,7 @@ void beatsContextReset(BeatsParserContext* context)
             [[ActivityManager shared] updateActivity:token progress:progress detail:PECLocalizedString(@"activity.beat_detection.detecting", @"Detail while detecting beats")];
         }
 
-        if (dispatch_block_testcancel(self.queueOperation) != 0) {
+        if ([self trackingAborted]) {
             NSLog(@"aborted beat detection");
             [self cleanupTracking];
             return NO;
@@ -238,83 +394,21 @@ void beatsContextReset(BeatsParserContext* context)
         unsigned long long sourceWindowFrameCount = MIN(self->_hopSize * 1024, self->_sample.frames - sourceWindowFrameOffset);
         // This may block for a loooooong time!
         unsigned long long received = [self->_sample rawSampleFromFrameOffset:sourceWindowFrameOffset frames:sourceWindowFrameCount outputs:data];
+        [self->_sample advanceReader:_sampleReader toFrame:sourceWindowFrameOffset + received];
 
-        unsigned long int sourceFrameIndex = 0;
-        BeatEvent event;
-        while (sourceFrameIndex < received) {
-            if (dispatch_block_testcancel(self.queueOperation) != 0) {
-                NSLog(@"aborted beat detection");
-                [self cleanupTracking];
-                return NO;
-            }
-
-            assert(((struct debug_aubio_tempo_t*) self->_aubio_tempo)->total_frames == sourceWindowFrameOffset + sourceFrameIndex);
-
-            const unsigned long int inputWindowFrameCount = MIN(self->_hopSize, self->_sample.frames - (sourceWindowFrameOffset + sourceFrameIndex));
-            for (unsigned long int inputFrameIndex = 0; inputFrameIndex < inputWindowFrameCount; inputFrameIndex++) {
-                double s = 0.0;
-                for (int channel = 0; channel < channels; channel++) {
-                    s += data[channel][sourceFrameIndex];
-                }
-                s /= (float) channels;
-
-                [_energy addFrame:s];
-
-                // We need to track heading and trailing silence to correct the
-                // beat-grid.
-                if (!initialSilenceEnded) {
-                    if (fabs(s) > kSilenceThreshold) {
-                        initialSilenceEnded = YES;
-                        _initialSilenceEndsAtFrame = sourceWindowFrameOffset + sourceFrameIndex;
-                    }
-                }
-
-                if (fabs(s) < kSilenceThreshold) {
-                    if (_trailingSilenceStartsAtFrame == self->_sample.frames) {
-                        _trailingSilenceStartsAtFrame = sourceWindowFrameOffset + sourceFrameIndex;
-                    }
-                } else {
-                    _trailingSilenceStartsAtFrame = self->_sample.frames;
-                }
-
-                if (self->_filterEnabled) {
-                    // For improving results on beat-detection for modern electronic
-                    // music, we apply a basic lowpass filter (feedback).
-                    // FIXME(tillt): We should really use the HW accellerated lowpass we
-                    // already have.
-                    self->_filterOutput += (s - self->_filterOutput) / self->_filterConstant;
-                    s = self->_filterOutput;
-                }
-
-                self->_aubio_input_buffer->data[inputFrameIndex] = s;
-                sourceFrameIndex++;
-            }
-
-            aubio_tempo_do(self->_aubio_tempo, self->_aubio_input_buffer, self->_aubio_output_buffer);
-            const bool beat = fvec_get_sample(self->_aubio_output_buffer, 0) != 0.f;
-            if (beat) {
-                event.frame = aubio_tempo_get_last(self->_aubio_tempo);
-                [self->_coarseBeats appendBytes:&event.frame length:sizeof(unsigned long long)];
-            }
-        };
-
+        if (![self trackFrames:received offset:sourceWindowFrameOffset data:(const float* const*) data]) {
+            NSLog(@"aborted beat detection");
+            [self cleanupTracking];
+            return NO;
+        }
         sourceWindowFrameOffset += received;
     };
-    [self cleanupTracking];
-
-    NSLog(@"initial silence ends at %lld frames after start of sample", _initialSilenceEndsAtFrame);
-    NSLog(@"trailing silence starts %lld frames before end of sample", _sample.frames - _trailingSilenceStartsAtFrame);
 
     if (token != nil) {
         [[ActivityManager shared] updateActivity:token progress:1.0 detail:PECLocalizedString(@"activity.beat_detection.refining", @"Detail while refining beats")];
     }
 
-    // Generate a constant grid pattern out of the detected beats.
-    NSData* constantRegions = [self retrieveConstantRegions];
-    _constantBeats = [self makeConstantBeats:constantRegions];
-
-    [self measureEnergyAtBeats];
-    [self updateAverageTempo];
+    [self finishFirstPass];
 
     NSLog(@"...beats tracking done - total beats: %lld", [self beatCount]);
     if (token != nil) {
@@ -324,6 +418,53 @@ void beatsContextReset(BeatsParserContext* context)
     return YES;
 }
 
+- (void)beginPageTracking
+{
+    atomic_store(&_trackingAborted, false);
+    [self beginFirstPass];
+}
+
+- (void)trackPageWithFrames:(unsigned long long)frames offset:(unsigned long long)offset channels:(NSArray<NSData*>*)channels
+{
+    if (_aubio_tempo == NULL || [self trackingAborted]) {
+        return;
+    }
+    NSAssert(offset == _trackedFrames, @"pages have to arrive in order");
+
+    const int channelCount = _sample.sampleFormat.channels;
+    if ((int) channels.count < channelCount) {
+        NSLog(@"page with %lu channels where %d are needed, skipping", (unsigned long) channels.count, channelCount);
+        return;
+    }
+    const float* data[channelCount];
+    for (int channel = 0; channel < channelCount; channel++) {
+        data[channel] = (const float*) channels[channel].bytes;
+    }
+
+    if (![self trackFrames:frames offset:offset data:data]) {
+        NSLog(@"aborted beat detection");
+        [self cleanupTracking];
+    }
+}
+
+- (BOOL)finishPageTracking
+{
+    if (_aubio_tempo == NULL || [self trackingAborted]) {
+        NSLog(@"aborted beat detection");
+        [self cleanupTracking];
+        return NO;
+    }
+    [self finishFirstPass];
+    if ([self trackingAborted]) {
+        NSLog(@"aborted beat detection");
+        return NO;
+    }
+    _ready = YES;
+
+    NSLog(@"...beats tracking done - total beats: %lld", [self beatCount]);
+    return YES;
+}
+
 - (void)updateAverageTempo
 {
     const unsigned long long count = [self beatCount];
@@ -338,9 +479,43 @@ void beatsContextReset(BeatsParserContext* context)
     }
 }
 
+/// Same as `measureEnergyAtBeats`, from the energy summary gathered during the
+/// first pass. Windows get rounded to whole blocks.
+- (void)measureEnergyAtBeatsFromBlocks
+{
+    const EnergyBlock* blocks = (const EnergyBlock*) _energyBlocks.bytes;
+    const unsigned long long blockCount = _energyBlocks.length / sizeof(EnergyBlock);
+    const unsigned long long totalFrames = self->_sample.frames;
+
+    const unsigned long long beatCount = [self beatCount];
+    for (unsigned long long beatIndex = 0; beatIndex < beatCount; beatIndex++) {
+        if ([self trackingAborted]) {
+            NSLog(@"aborted beat detection during peak calculations");
+            return;
+        }
+        BeatEvent currentEvent;
+        [self getBeat:&currentEvent at:beatIndex];
+
+        const unsigned long long first = currentEvent.frame / kEnergyBlockFrames;
+        const unsigned long long end = MIN(blockCount, (MIN(currentEvent.frame + kBeatEnergyWindowFrames, totalFrames) + kEnergyBlockFrames - 1) / kEnergyBlockFrames);
+        double squares = 0.0;
+        double peak = 0.0;
+        unsigned long long frames = 0;
+        for (unsigned long long index = first; index < end; index++) {
+            squares += blocks[index].squares;
+            peak = MAX(peak, (double) blocks[index].peak);
+            frames += MIN(kEnergyBlockFrames, totalFrames - index * kEnergyBlockFrames);
+        }
+        currentEvent.energy = frames > 0 ? sqrt(squares / (double) frames) : 0.0;
+        currentEvent.peak = peak;
+
+        [self updateBeat:&currentEvent at:beatIndex];
+    }
+}
+
 - (void)measureEnergyAtBeats
 {
-    const unsigned long long windowSize = 4096;
+    const unsigned long long windowSize = kBeatEnergyWindowFrames;
 
     unsigned long long framesNeeded = windowSize;
     float* data[self->_sample.sampleFormat.channels];
@@ -359,7 +534,7 @@ void beatsContextReset(BeatsParserContext* context)
         [self getBeat:&currentEvent at:beatIndex];
 
         unsigned long long sourceWindowFrameOffset = currentEvent.frame;
-        if (dispatch_block_testcancel(self.queueOperation) != 0) {
+        if ([self trackingAborted]) {
             NSLog(@"aborted beat detection during peak calculations");
             return;
         }
@@ -369,7 +544,7 @@ void beatsContextReset(BeatsParserContext* context)
 
         unsigned long int sourceFrameIndex = 0;
         while (sourceFrameIndex < received) {
-            if (dispatch_block_testcancel(self.queueOperation) != 0) {
+            if ([self trackingAborted]) {
                 NSLog(@"aborted beat detection during peak calculations");
                 return;
             }
@@ -420,11 +595,16 @@ void beatsContextReset(BeatsParserContext* context)
                                                        cancelHandler:nil];
     }
 
+    atomic_store(&_trackingAborted, false);
+    // Registered right away so a streaming sample keeps its pages for us.
+    _sampleReader = [_sample addReaderAtFrame:0];
+
     _queueOperation = dispatch_block_create(DISPATCH_BLOCK_NO_QOS_CLASS, ^{
         done = [weakSelf trackBeatsWithToken:beatsToken];
     });
     dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), _queueOperation);
     dispatch_block_notify(_queueOperation, queue ?: dispatch_get_main_queue(), ^{
+        [self->_sample removeReader:self->_sampleReader];
         if (beatsToken != nil) {
             [[ActivityManager shared] completeActivity:beatsToken];
         }
@@ -445,6 +625,7 @@ void beatsContextReset(BeatsParserContext* context)
 
 - (void)abortWithCallback:(void (^)(void))callback
 {
+    atomic_store(&_trackingAborted, true);
     if (_queueOperation != NULL) {
         dispatch_block_cancel(_queueOperation);
         dispatch_block_notify(_queueOperation, dispatch_get_main_queue(), ^{
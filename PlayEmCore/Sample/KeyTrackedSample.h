@@ -14,13 +14,25 @@
 NS_ASSUME_NONNULL_BEGIN
 
 extern const double kBeatSampleDurationThreshold;
+extern const double kKeySegmentDuration;
 
 @class LazySample;
+@class TrackList;
+
+/// Key detected for a fixed-length stretch of a long sample.
+@interface KeySegment : NSObject
+
+@property (assign, nonatomic) unsigned long long frame;
+@property (assign, nonatomic) unsigned long long frames;
+@property (copy, nonatomic) NSString* key;
+@property (copy, nonatomic) NSString* hint;
+
+@end
 
 @interface KeyTrackedSample : NSObject
 
-// Central policy for deciding if key detection is meaningful for a duration.
-+ (BOOL)needsKeyForSampleDuration:(NSTimeInterval)duration;
+/// Samples beyond `kBeatSampleDurationThreshold` get analyzed in `kKeySegmentDuration` segments.
++ (BOOL)needsSegmentedKeyForSampleDuration:(NSTimeInterval)duration;
 
 @property (assign, nonatomic) BOOL suppressActivity;
 
@@ -28,6 +40,8 @@ extern const double kBeatSampleDurationThreshold;
 @property (assign, readonly, nonatomic) BOOL ready;
 @property (copy, nonatomic, nullable) NSString* key;
 @property (copy, nonatomic, nullable) NSString* hint;
+/// Per-segment key timeline, ordered by frame; empty unless the sample was segmented.
+@property (strong, readonly, nonatomic) NSArray<KeySegment*>* segments;
 
 - (void)abortWithCallback:(nonnull void (^)(void))block;
 
@@ -36,6 +50,34 @@ extern const double kBeatSampleDurationThreshold;
 - (void)trackKeyAsyncWithCompletionQueue:(dispatch_queue_t _Nullable)queue
                                 callback:(void (^)(BOOL))callback;
 
+/// Page-fed tracking for callers that get handed the decoded pages, e.g. an
+/// `AnalysisPipeline`. Segments long samples just like the asynchronous
+/// tracking, but runs on the caller's thread and never waits for pages, so a
+/// held decoder leaves nothing blocked.
+///
+/// `beginPageTracking` once the rendered length is known, then every page in
+/// order, then `finishPageTracking`, all from the same serial queue.
+- (void)beginPageTracking;
+- (void)trackPageWithFrames:(unsigned long long)frames offset:(unsigned long long)offset channels:(NSArray<NSData*>*)channels;
+/// Computes the key, and the segments when segmented. Returns NO when aborted.
+- (BOOL)finishPageTracking;
+
+/// Dominant key across all segments overlapping the given frame range.
+///
+/// - Parameters:
+///   - frame: First frame of the range.
+///   - endFrame: Frame past the end of the range.
+/// - Returns: Camelot key or nil when no segment with a key overlaps.
+- (NSString* _Nullable)keyFromFrame:(unsigned long long)frame toFrame:(unsigned long long)endFrame;
+
+/// Attach per-track keys to tracklist entries that have none yet.
+///
+/// - Parameters:
+///   - trackList: Tracklist of the analyzed sample.
+///   - frames: Total frames of the sample; bounds the last entry.
+/// - Returns: Number of entries that received a key.
+- (NSUInteger)applyKeysToTrackList:(TrackList*)trackList frames:(unsigned long long)frames;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -9,18 +9,146 @@
 
 #import <Foundation/Foundation.h>
 
+#include <atomic>
 #include <keyfinder/audiodata.h>
 #include <keyfinder/keyfinder.h>
+#include <memory>
+#include <vector>
 
 #import "ActivityManager.h"
 #import "../PECLocalization.h"
 #import "CancelableBlockOperation.h"
 #import "LazySample.h"
+#import "../Metadata/MediaMetaData.h"
+#import "../Metadata/TimedMediaMetaData.h"
+#import "../Metadata/TrackList.h"
 
-// Anything beyond 30mins playtime is not of interest for chroma tracking, I
-// declare hereby.
+// Anything beyond 30mins playtime is not of interest for a single chroma over
+// the entire sample, I declare hereby. Those get segmented instead.
 const double kBeatSampleDurationThreshold = 30.0 * 60.0;
 
+// Long enough for a stable chroma, short enough to resolve tracks in a DJ set.
+const double kKeySegmentDuration = 60.0;
+
+// Frames each segment worker pulls from the sample per read -- keeps memory
+// bounded by the number of concurrent workers, not by the sample length.
+static const unsigned long long kKeySegmentReadFrames = 1024 * 64;
+
+@implementation KeySegment
+
+- (NSString*)description
+{
+    return [NSString stringWithFormat:@"frame: %lld, frames: %lld, key: %@ (%@)", _frame, _frames, _key, _hint];
+}
+
+@end
+
+static void KeyNotation(KeyFinder::key_t key, NSString** camelot, NSString** hint)
+{
+    switch (key) {
+    case KeyFinder::D_FLAT_MINOR:
+        *camelot = @"12A";
+        *hint = @"D flat minor";
+        break;
+    case KeyFinder::E_MAJOR:
+        *camelot = @"12B";
+        *hint = @"E major";
+        break;
+    case KeyFinder::G_FLAT_MINOR:
+        *camelot = @"11A";
+        *hint = @"G flat minor";
+        break;
+    case KeyFinder::A_MAJOR:
+        *camelot = @"11B";
+        *hint = @"A major";
+        break;
+    case KeyFinder::B_MINOR:
+        *camelot = @"10A";
+        *hint = @"B minor";
+        break;
+    case KeyFinder::D_MAJOR:
+        *camelot = @"10B";
+        *hint = @"D major";
+        break;
+    case KeyFinder::E_MINOR:
+        *camelot = @"9A";
+        *hint = @"E minor";
+        break;
+    case KeyFinder::G_MAJOR:
+        *camelot = @"9B";
+        *hint = @"G major";
+        break;
+    case KeyFinder::A_MINOR:
+        *camelot = @"8A";
+        *hint = @"A minor";
+        break;
+    case KeyFinder::C_MAJOR:
+        *camelot = @"8B";
+        *hint = @"C major";
+        break;
+    case KeyFinder::D_MINOR:
+        *camelot = @"7A";
+        *hint = @"D minor";
+        break;
+    case KeyFinder::F_MAJOR:
+        *camelot = @"7B";
+        *hint = @"F major";
+        break;
+    case KeyFinder::G_MINOR:
+        *camelot = @"6A";
+        *hint = @"G minor";
+        break;
+    case KeyFinder::B_FLAT_MAJOR:
+        *camelot = @"6B";
+        *hint = @"B flat major";
+        break;
+    case KeyFinder::C_MINOR:
+        *camelot = @"5A";
+        *hint = @"C minor";
+        break;
+    case KeyFinder::E_FLAT_MAJOR:
+        *camelot = @"5B";
+        *hint = @"E flat major";
+        break;
+    case KeyFinder::F_MINOR:
+        *camelot = @"4A";
+        *hint = @"F minor";
+        break;
+    case KeyFinder::A_FLAT_MAJOR:
+        *camelot = @"4B";
+        *hint = @"A flat major";
+        break;
+    case KeyFinder::B_FLAT_MINOR:
+        *camelot = @"3A";
+        *hint = @"B flat minor";
+        break;
+    case KeyFinder::D_FLAT_MAJOR:
+        *camelot = @"3B";
+        *hint = @"D flat major";
+        break;
+    case KeyFinder::E_FLAT_MINOR:
+        *camelot = @"2A";
+        *hint = @"E flat minor";
+        break;
+    case KeyFinder::G_FLAT_MAJOR:
+        *camelot = @"2B";
+        *hint = @"G flat major";
+        break;
+    case KeyFinder::A_FLAT_MINOR:
+        *camelot = @"1A";
+        *hint = @"A flat minor";
+        break;
+    case KeyFinder::B_MAJOR:
+        *camelot = @"1B";
+        *hint = @"B major";
+        break;
+    case KeyFinder::SILENCE:
+    default:
+        *camelot = @"";
+        *hint = @"";
+    }
+}
+
 @interface KeyTrackedSample () {
 }
 
@@ -29,6 +157,7 @@ const double kBeatSampleDurationThreshold = 30.0 * 60.0;
 @property (strong, nonatomic) NSMutableDictionary* beatEventPages;
 @property (strong, nonatomic) NSMutableData* coarseBeats;
 @property (strong, nonatomic) dispatch_block_t queueOperation;
+@property (strong, nonatomic) NSArray<KeySegment*>* segments;
 
 @end
 
@@ -40,14 +169,26 @@ const double kBeatSampleDurationThreshold = 30.0 * 60.0;
     unsigned long long _currentFrame;
     unsigned long long _totalFrames;
     unsigned long long _maxFramesToProcess;
+
+    // Positions registered with the sample while tracking; one per segment
+    // when segmented.
+    std::vector<NSUInteger> _sampleReaders;
+
+    // Page-fed tracking; only the current segment has a workspace.
+    std::unique_ptr<KeyFinder::Workspace> _pageWorkspace;
+    KeyFinder::AudioData _pageWindow;
+    unsigned int _pageWindowFrames;
+    // 0 unless segmented.
+    unsigned long long _pageSegmentFrames;
+    unsigned long long _pageSegmentDone;
+    unsigned long long _pageFrames;
+    std::vector<KeyFinder::key_t> _pageKeys;
+    std::atomic<bool> _pageTrackingAborted;
 }
 
-+ (BOOL)needsKeyForSampleDuration:(NSTimeInterval)duration
++ (BOOL)needsSegmentedKeyForSampleDuration:(NSTimeInterval)duration
 {
-    if (duration <= 0.0) {
-        return YES;
-    }
-    return duration <= kBeatSampleDurationThreshold;
+    return duration > kBeatSampleDurationThreshold;
 }
 
 - (id)initWithSample:(LazySample*)sample
@@ -59,6 +200,7 @@ const double kBeatSampleDurationThreshold = 30.0 * 60.0;
         _sampleBuffers = [NSMutableArray array];
         _key = nil;
         _hint = nil;
+        _segments = @[];
 
         unsigned long long framesNeeded = _windowWidth * 1024;
         for (int channel = 0; channel < sample.sampleFormat.channels; channel++) {
@@ -92,26 +234,49 @@ const double kBeatSampleDurationThreshold = 30.0 * 60.0;
 
     KeyTrackedSample* __weak weakSelf = self;
 
+    // Registered right away so a streaming sample keeps its pages for us.
+    [self addSampleReaders];
+
     _queueOperation = dispatch_block_create(DISPATCH_BLOCK_NO_QOS_CLASS, ^{
         done = [weakSelf trackKey];
     });
     dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), _queueOperation);
     dispatch_block_notify(_queueOperation, queue ?: dispatch_get_main_queue(), ^{
+        [self removeSampleReaders];
         self->_ready = done;
         callback(done);
     });
 }
 
-- (BOOL)trackKey
+- (unsigned long long)segmentFrames
 {
-    NSLog(@"key tracking...");
+    return (unsigned long long) (kKeySegmentDuration * _sample.renderedSampleRate);
+}
 
-    if (![[self class] needsKeyForSampleDuration:_sample.duration]) {
-        NSLog(@"skipping key tracking - sample is too long to get any value out.");
-        _key = @"";
-        _hint = @"";
-        return YES;
+- (void)addSampleReaders
+{
+    _sampleReaders.clear();
+    const unsigned long long segmentFrames = [self segmentFrames];
+    if (![[self class] needsSegmentedKeyForSampleDuration:_sample.duration] || segmentFrames == 0) {
+        _sampleReaders.push_back([_sample addReaderAtFrame:0]);
+        return;
+    }
+    for (unsigned long long frame = 0; frame < _sample.frames; frame += segmentFrames) {
+        _sampleReaders.push_back([_sample addReaderAtFrame:frame]);
     }
+}
+
+- (void)removeSampleReaders
+{
+    for (NSUInteger reader : _sampleReaders) {
+        [_sample removeReader:reader];
+    }
+    _sampleReaders.clear();
+}
+
+- (BOOL)trackKey
+{
+    NSLog(@"key tracking...");
 
     ActivityToken* token = nil;
     if (!self.suppressActivity) {
@@ -121,6 +286,14 @@ const double kBeatSampleDurationThreshold = 30.0 * 60.0;
                                                   cancelHandler:nil];
     }
 
+    if ([[self class] needsSegmentedKeyForSampleDuration:_sample.duration]) {
+        BOOL done = [self trackSegmentedKeyWithToken:token];
+        if (token != nil) {
+            [[ActivityManager shared] completeActivity:token];
+        }
+        return done;
+    }
+
     const int channels = self->_sample.sampleFormat.channels;
 
     float* data[channels];
@@ -150,6 +323,9 @@ const double kBeatSampleDurationThreshold = 30.0 * 60.0;
         unsigned long long sourceWindowFrameCount = MIN(self->_windowWidth * 1024, self->_sample.frames - sourceWindowFrameOffset);
         // This may block for a loooooong time!
         unsigned long long received = [self->_sample rawSampleFromFrameOffset:sourceWindowFrameOffset frames:sourceWindowFrameCount outputs:data];
+        if (!_sampleReaders.empty()) {
+            [self->_sample advanceReader:_sampleReaders.front() toFrame:sourceWindowFrameOffset + received];
+        }
         unsigned long int sourceFrameIndex = 0;
         while (sourceFrameIndex < received) {
             if (dispatch_block_testcancel(self.queueOperation) != 0) {
@@ -178,108 +354,11 @@ const double kBeatSampleDurationThreshold = 30.0 * 60.0;
 
     KeyFinder::key_t key = _keyFinder.keyOfChromagram(_workspace);
 
-    switch (key) {
-    case KeyFinder::D_FLAT_MINOR:
-        _key = @"12A";
-        _hint = @"D flat minor";
-        break;
-    case KeyFinder::E_MAJOR:
-        _key = @"12B";
-        _hint = @"E major";
-        break;
-    case KeyFinder::G_FLAT_MINOR:
-        _key = @"11A";
-        _hint = @"G flat minor";
-        break;
-    case KeyFinder::A_MAJOR:
-        _key = @"11B";
-        _hint = @"A major";
-        break;
-    case KeyFinder::B_MINOR:
-        _key = @"10A";
-        _hint = @"B minor";
-        break;
-    case KeyFinder::D_MAJOR:
-        _key = @"10B";
-        _hint = @"D major";
-        break;
-    case KeyFinder::E_MINOR:
-        _key = @"9A";
-        _hint = @"E minor";
-        break;
-    case KeyFinder::G_MAJOR:
-        _key = @"9B";
-        _hint = @"G major";
-        break;
-    case KeyFinder::A_MINOR:
-        _key = @"8A";
-        _hint = @"A minor";
-        break;
-    case KeyFinder::C_MAJOR:
-        _key = @"8B";
-        _hint = @"C major";
-        break;
-    case KeyFinder::D_MINOR:
-        _key = @"7A";
-        _hint = @"D minor";
-        break;
-    case KeyFinder::F_MAJOR:
-        _key = @"7B";
-        _hint = @"F major";
-        break;
-    case KeyFinder::G_MINOR:
-        _key = @"6A";
-        _hint = @"G minor";
-        break;
-    case KeyFinder::B_FLAT_MAJOR:
-        _key = @"6B";
-        _hint = @"B flat major";
-        break;
-    case KeyFinder::C_MINOR:
-        _key = @"5A";
-        _hint = @"C minor";
-        break;
-    case KeyFinder::E_FLAT_MAJOR:
-        _key = @"5B";
-        _hint = @"E flat major";
-        break;
-    case KeyFinder::F_MINOR:
-        _key = @"4A";
-        _hint = @"F minor";
-        break;
-    case KeyFinder::A_FLAT_MAJOR:
-        _key = @"4B";
-        _hint = @"A flat major";
-        break;
-    case KeyFinder::B_FLAT_MINOR:
-        _key = @"3A";
-        _hint = @"B flat minor";
-        break;
-    case KeyFinder::D_FLAT_MAJOR:
-        _key = @"3B";
-        _hint = @"D flat major";
-        break;
-    case KeyFinder::E_FLAT_MINOR:
-        _key = @"2A";
-        _hint = @"E flat minor";
-        break;
-    case KeyFinder::G_FLAT_MAJOR:
-        _key = @"2B";
-        _hint = @"G flat major";
-        break;
-    case KeyFinder::A_FLAT_MINOR:
-        _key = @"1A";
-        _hint = @"A flat minor";
-        break;
-    case KeyFinder::B_MAJOR:
-        _key = @"1B";
-        _hint = @"B major";
-        break;
-    case KeyFinder::SILENCE:
-    default:
-        _key = @"";
-        _hint = @"";
-    }
+    NSString* camelot = nil;
+    NSString* hint = nil;
+    KeyNotation(key, &camelot, &hint);
+    _key = camelot;
+    _hint = hint;
 
     NSLog(@"key %d", key);
     [self cleanupTracking];
@@ -296,6 +375,348 @@ const double kBeatSampleDurationThreshold = 30.0 * 60.0;
     return YES;
 }
 
+/// Runs an independent chromagram per fixed-length segment, spread across all
+/// cores. Each worker only ever holds `kKeySegmentReadFrames` per channel.
+- (BOOL)trackSegmentedKeyWithToken:(ActivityToken*)token
+{
+    const unsigned long long totalFrames = _sample.frames;
+    const unsigned long long segmentFrames = [self segmentFrames];
+    if (totalFrames == 0 || segmentFrames == 0) {
+        _key = @"";
+        _hint = @"";
+        return YES;
+    }
+    const size_t segmentCount = (size_t) ((totalFrames + segmentFrames - 1) / segmentFrames);
+    const int channels = _sample.sampleFormat.channels;
+    const unsigned int rate = (unsigned int) _sample.renderedSampleRate;
+    const unsigned int windowWidth = (unsigned int) _windowWidth;
+
+    NSLog(@"segmented key tracking of %zu segments...", segmentCount);
+
+    std::vector<KeyFinder::key_t> keys(segmentCount, KeyFinder::SILENCE);
+    KeyFinder::key_t* results = keys.data();
+    std::atomic<unsigned long long> processedFrames(0);
+    std::atomic<unsigned long long>* processed = &processedFrames;
+    std::atomic<bool> cancelledFlag(false);
+    std::atomic<bool>* cancelled = &cancelledFlag;
+
+    LazySample* sample = _sample;
+    dispatch_block_t operation = self.queueOperation;
+    // Readers got registered per segment before the length was final, when
+    // the decoder had not set it yet. Without one per segment, a discarding
+    // sample would drop pages a segment has yet to read.
+    if (_sampleReaders.size() != segmentCount) {
+        // The new ones go in first, so nothing gets dropped in between.
+        const std::vector<NSUInteger> stale = _sampleReaders;
+        [self addSampleReaders];
+        for (NSUInteger reader : stale) {
+            [_sample removeReader:reader];
+        }
+    }
+    if (_sampleReaders.size() != segmentCount) {
+        NSLog(@"segmented key tracking needs %zu readers but got %zu", segmentCount, _sampleReaders.size());
+        return NO;
+    }
+    const std::vector<NSUInteger> readers = _sampleReaders;
+    const NSUInteger* segmentReaders = readers.data();
+
+    dispatch_apply(segmentCount, DISPATCH_APPLY_AUTO, ^(size_t index) {
+        if (cancelled->load()) {
+            return;
+        }
+
+        const unsigned long long segmentOffset = index * segmentFrames;
+        const unsigned long long segmentLength = MIN(segmentFrames, totalFrames - segmentOffset);
+
+        std::vector<std::vector<float>> buffers(channels, std::vector<float>(kKeySegmentReadFrames));
+        float* outputs[channels];
+        for (int channel = 0; channel < channels; channel++) {
+            outputs[channel] = buffers[channel].data();
+        }
+
+        KeyFinder::KeyFinder keyFinder;
+        KeyFinder::Workspace workspace;
+        KeyFinder::AudioData audioData;
+        audioData.setChannels(channels);
+        audioData.setFrameRate(rate);
+        audioData.addToSampleCount(windowWidth * channels);
+
+        unsigned long long segmentDone = 0;
+        while (segmentDone < segmentLength) {
+            if (operation != NULL && dispatch_block_testcancel(operation) != 0) {
+                cancelled->store(true);
+                return;
+            }
+            const unsigned long long count = MIN(kKeySegmentReadFrames, segmentLength - segmentDone);
+            // This may block until the decoder has reached this segment.
+            const unsigned long long received = [sample rawSampleFromFrameOffset:segmentOffset + segmentDone frames:count outputs:outputs];
+            if (received == 0) {
+                break;
+            }
+            [sample advanceReader:segmentReaders[index] toFrame:segmentOffset + segmentDone + received];
+
+            unsigned long long frameIndex = 0;
+            while (frameIndex < received) {
+                const unsigned long long windowFrames = MIN((unsigned long long) windowWidth, received - frameIndex);
+                for (unsigned int inputFrameIndex = 0; inputFrameIndex < windowFrames; inputFrameIndex++) {
+                    for (int channel = 0; channel < channels; channel++) {
+                        audioData.setSampleByFrame(inputFrameIndex, channel, outputs[channel][frameIndex]);
+                    }
+                    frameIndex++;
+                }
+                keyFinder.progressiveChromagram(audioData, workspace);
+            }
+
+            segmentDone += received;
+            const unsigned long long total = processed->fetch_add(received) + received;
+            if (token != nil) {
+                [[ActivityManager shared] updateActivity:token
+                                                progress:(double) total / (double) totalFrames
+                                                  detail:PECLocalizedString(@"activity.key_detection.detecting", @"Detail while detecting key")];
+            }
+        }
+
+        [sample removeReader:segmentReaders[index]];
+
+        keyFinder.finalChromagram(workspace);
+        results[index] = keyFinder.keyOfChromagram(workspace);
+    });
+
+    if (cancelled->load()) {
+        NSLog(@"aborted segmented key detection");
+        return NO;
+    }
+
+    [self adoptSegmentKeys:results count:segmentCount segmentFrames:segmentFrames totalFrames:totalFrames];
+
+    NSLog(@"...segmented key tracking done - dominant key: %@", _key);
+    return YES;
+}
+
+/// Turns per-segment keys into the segment timeline and picks the dominant
+/// key as the key of the whole sample.
+- (void)adoptSegmentKeys:(const KeyFinder::key_t*)keys
+                   count:(size_t)count
+           segmentFrames:(unsigned long long)segmentFrames
+             totalFrames:(unsigned long long)totalFrames
+{
+    NSMutableArray<KeySegment*>* segments = [NSMutableArray arrayWithCapacity:count];
+    for (size_t index = 0; index < count; index++) {
+        KeySegment* segment = [KeySegment new];
+        segment.frame = index * segmentFrames;
+        segment.frames = MIN(segmentFrames, totalFrames - segment.frame);
+        NSString* camelot = nil;
+        NSString* hint = nil;
+        KeyNotation(keys[index], &camelot, &hint);
+        segment.key = camelot;
+        segment.hint = hint;
+        [segments addObject:segment];
+    }
+    _segments = segments;
+
+    KeySegment* dominant = [self dominantSegmentFromFrame:0 toFrame:totalFrames];
+    _key = dominant != nil ? dominant.key : @"";
+    _hint = dominant != nil ? dominant.hint : @"";
+}
+
+#pragma mark - Page-fed tracking
+
+- (void)beginPageTracking
+{
+    _pageTrackingAborted.store(false);
+    _pageWorkspace.reset(new KeyFinder::Workspace());
+    _pageWindow = KeyFinder::AudioData();
+    _pageWindow.setChannels(_sample.sampleFormat.channels);
+    _pageWindow.setFrameRate((unsigned int) _sample.renderedSampleRate);
+    _pageWindow.addToSampleCount((unsigned int) _windowWidth * _sample.sampleFormat.channels);
+    _pageWindowFrames = 0;
+    _pageSegmentFrames = [[self class] needsSegmentedKeyForSampleDuration:_sample.duration] ? [self segmentFrames] : 0;
+    _pageSegmentDone = 0;
+    _pageFrames = 0;
+    _pageKeys.clear();
+    _segments = @[];
+}
+
+/// Hands a partially filled window to the chromagram.
+- (void)flushPageWindow
+{
+    if (_pageWindowFrames == 0) {
+        return;
+    }
+    if (_pageWindowFrames == _windowWidth) {
+        _keyFinder.progressiveChromagram(_pageWindow, *_pageWorkspace);
+    } else {
+        const int channels = _pageWindow.getChannels();
+        KeyFinder::AudioData partial;
+        partial.setChannels(channels);
+        partial.setFrameRate(_pageWindow.getFrameRate());
+        partial.addToSampleCount(_pageWindowFrames * channels);
+        for (unsigned int frame = 0; frame < _pageWindowFrames; frame++) {
+            for (int channel = 0; channel < channels; channel++) {
+                partial.setSampleByFrame(frame, channel, _pageWindow.getSampleByFrame(frame, channel));
+            }
+        }
+        _keyFinder.progressiveChromagram(partial, *_pageWorkspace);
+    }
+    _pageWindowFrames = 0;
+}
+
+/// Closes the current chromagram; returns its key.
+- (KeyFinder::key_t)finishPageChromagram
+{
+    KeyFinder::key_t key = KeyFinder::SILENCE;
+    if (_pageSegmentDone > 0) {
+        [self flushPageWindow];
+        _keyFinder.finalChromagram(*_pageWorkspace);
+        key = _keyFinder.keyOfChromagram(*_pageWorkspace);
+    }
+    _pageWorkspace.reset(new KeyFinder::Workspace());
+    _pageSegmentDone = 0;
+    return key;
+}
+
+- (void)trackPageWithFrames:(unsigned long long)frames offset:(unsigned long long)offset channels:(NSArray<NSData*>*)channels
+{
+    if (_pageWorkspace == nullptr || _pageTrackingAborted.load()) {
+        return;
+    }
+    NSAssert(offset == _pageFrames, @"pages have to arrive in order");
+
+    const int channelCount = _pageWindow.getChannels();
+    if ((int) channels.count < channelCount) {
+        NSLog(@"page with %lu channels where %d are needed, skipping", (unsigned long) channels.count, channelCount);
+        return;
+    }
+    const float* data[channelCount];
+    for (int channel = 0; channel < channelCount; channel++) {
+        data[channel] = (const float*) channels[channel].bytes;
+    }
+
+    for (unsigned long long frame = 0; frame < frames; frame++) {
+        if (_pageSegmentFrames > 0 && _pageSegmentDone == _pageSegmentFrames) {
+            _pageKeys.push_back([self finishPageChromagram]);
+        }
+        for (int channel = 0; channel < channelCount; channel++) {
+            _pageWindow.setSampleByFrame(_pageWindowFrames, channel, data[channel][frame]);
+        }
+        _pageWindowFrames++;
+        _pageSegmentDone++;
+        if (_pageWindowFrames == _windowWidth) {
+            [self flushPageWindow];
+        }
+    }
+    _pageFrames += frames;
+}
+
+- (BOOL)finishPageTracking
+{
+    if (_pageWorkspace == nullptr) {
+        return NO;
+    }
+    if (_pageTrackingAborted.load()) {
+        _pageWorkspace.reset();
+        _pageKeys.clear();
+        NSLog(@"aborted key detection");
+        return NO;
+    }
+
+    if (_pageSegmentFrames == 0) {
+        NSString* camelot = nil;
+        NSString* hint = nil;
+        KeyNotation([self finishPageChromagram], &camelot, &hint);
+        _key = camelot;
+        _hint = hint;
+    } else {
+        if (_pageSegmentDone > 0) {
+            _pageKeys.push_back([self finishPageChromagram]);
+        }
+        [self adoptSegmentKeys:_pageKeys.data() count:_pageKeys.size() segmentFrames:_pageSegmentFrames totalFrames:_pageFrames];
+    }
+    _pageWorkspace.reset();
+    _pageKeys.clear();
+    _ready = YES;
+
+    NSLog(@"...key tracking done - key: %@", _key);
+    return YES;
+}
+
+/// Picks the key covering the most frames within the range, returned as a
+/// representative segment of that key.
+- (KeySegment* _Nullable)dominantSegmentFromFrame:(unsigned long long)frame toFrame:(unsigned long long)endFrame
+{
+    NSMutableDictionary<NSString*, NSNumber*>* weights = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSString*, KeySegment*>* representatives = [NSMutableDictionary dictionary];
+
+    for (KeySegment* segment in _segments) {
+        unsigned long long segmentEnd = segment.frame + segment.frames;
+        if (segmentEnd <= frame) {
+            continue;
+        }
+        if (segment.frame >= endFrame) {
+            break;
+        }
+        if (segment.key.length == 0) {
+            continue;
+        }
+        unsigned long long overlap = MIN(segmentEnd, endFrame) - MAX(segment.frame, frame);
+        weights[segment.key] = @(weights[segment.key].unsignedLongLongValue + overlap);
+        if (representatives[segment.key] == nil) {
+            representatives[segment.key] = segment;
+        }
+    }
+
+    NSString* best = nil;
+    unsigned long long bestWeight = 0;
+    for (NSString* key in weights) {
+        unsigned long long weight = weights[key].unsignedLongLongValue;
+        if (weight > bestWeight) {
+            bestWeight = weight;
+            best = key;
+        }
+    }
+    return best != nil ? representatives[best] : nil;
+}
+
+- (NSString* _Nullable)keyFromFrame:(unsigned long long)frame toFrame:(unsigned long long)endFrame
+{
+    return [self dominantSegmentFromFrame:frame toFrame:endFrame].key;
+}
+
+- (NSUInteger)applyKeysToTrackList:(TrackList*)trackList frames:(unsigned long long)frames
+{
+    if (_segments.count == 0 || trackList == nil) {
+        return 0;
+    }
+
+    NSUInteger applied = 0;
+    NSArray<TimedMediaMetaData*>* tracks = [[trackList tracks] sortedArrayUsingComparator:^NSComparisonResult(TimedMediaMetaData* a, TimedMediaMetaData* b) {
+        return [a.frame compare:b.frame];
+    }];
+    for (NSUInteger index = 0; index < tracks.count; index++) {
+        TimedMediaMetaData* track = tracks[index];
+        if (track.meta == nil || track.meta.key.length > 0) {
+            continue;
+        }
+        unsigned long long start = track.frame.unsignedLongLongValue;
+        unsigned long long end = frames;
+        if (track.endFrame != nil) {
+            end = track.endFrame.unsignedLongLongValue;
+        } else if (index + 1 < tracks.count) {
+            end = tracks[index + 1].frame.unsignedLongLongValue;
+        }
+        if (end <= start) {
+            continue;
+        }
+        NSString* key = [self keyFromFrame:start toFrame:end];
+        if (key.length == 0) {
+            continue;
+        }
+        track.meta.key = key;
+        applied++;
+    }
+    return applied;
+}
+
 - (NSString*)description
 {
     return [NSString stringWithFormat:@"key: %.0f BPM", 0.0];
@@ -304,6 +725,7 @@ const double kBeatSampleDurationThreshold = 30.0 * 60.0;
 - (void)abortWithCallback:(void (^)(void))callback
 {
     NSLog(@"abort of key detection ongoing..");
+    _pageTrackingAborted.store(true);
     if (_queueOperation != NULL) {
         dispatch_block_cancel(_queueOperation);
         dispatch_block_notify(_queueOperation, dispatch_get_main_queue(), ^{
@@ -13,6 +13,7 @@ NS_ASSUME_NONNULL_BEGIN
 
 @class AVAudioFormat;
 @class AVAudioFile;
+@class WaveformPyramid;
 
 @interface LazySample : NSObject
 
@@ -30,6 +31,17 @@ NS_ASSUME_NONNULL_BEGIN
 @property (assign, nonatomic, readonly) unsigned long long frames;
 @property (assign, nonatomic, readonly) unsigned int frameSize;
 
+/// Streaming mode for analysis: pages every registered reader has moved past
+/// get dropped, so memory stays bounded by how far readers lag behind the
+/// decoder. Reading dropped pages returns short. Has to be set before decoding.
+@property (assign, nonatomic) BOOL discardsConsumedPages;
+/// With `discardsConsumedPages`, the decoder gets held back while more than
+/// this many frames are retained for lagging readers. 0 means no limit.
+@property (assign, nonatomic) unsigned long long retainedFramesLimit;
+/// Gets the decoded pages appended as they come in, when set before decoding.
+/// A finished one, as restored from a `WaveformCache`, stays as it is.
+@property (strong, atomic, nullable) WaveformPyramid* waveformPyramid;
+
 - (id)initWithPath:(NSString*)path error:(NSError**)error;
 
 - (unsigned long long)rawSampleFromFrameOffset:(unsigned long long)offset frames:(unsigned long long)frames outputs:(float* const _Nonnull* _Nullable)outputs;
@@ -42,6 +54,15 @@ NS_ASSUME_NONNULL_BEGIN
 - (NSString*)cueTimeWithFrame:(unsigned long long)frame;
 
 - (void)addLazyPageIndex:(unsigned long long)pageIndex channels:(NSArray<NSData*>*)channels;
+
+/// Register a reader that will consume frames from `frame` onwards.
+///
+/// Only relevant with `discardsConsumedPages`; pages at or after the lowest
+/// reader position are retained.
+- (NSUInteger)addReaderAtFrame:(unsigned long long)frame;
+/// Tell that a reader no longer needs anything before `frame`.
+- (void)advanceReader:(NSUInteger)reader toFrame:(unsigned long long)frame;
+- (void)removeReader:(NSUInteger)reader;
 - (void)markDecodingComplete;
 - (void)setRenderedLength:(unsigned long long)frames;
 - (void)setRenderedLength:(unsigned long long)frames;
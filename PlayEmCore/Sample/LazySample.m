@@ -15,6 +15,7 @@
 #include <stdatomic.h>
 
 #import "ProfilingPointsOfInterest.h"
+#import "WaveformPyramid.h"
 
 const size_t kMaxFramesPerBuffer = 16384;
 
@@ -30,19 +31,46 @@ const size_t kMaxFramesPerBuffer = 16384;
 @implementation LazySample {
     atomic_bool _decodingComplete;
     atomic_uint _waiters;
+    atomic_ullong _decodedPages;
+    // Reader positions keyed by reader id; guarded by `buffersQueue`.
+    NSMutableDictionary<NSNumber*, NSNumber*>* _readers;
+    NSUInteger _nextReader;
+    // Pages below this index got dropped; guarded by `buffersQueue`.
+    unsigned long long _discardedPages;
+    dispatch_semaphore_t _pagesConsumed;
 }
 
-- (id)initWithPath:(NSString*)path error:(NSError**)error
+/// Page and reader bookkeeping only; without a source, pages have to be added
+/// by whoever creates the sample.
+- (instancetype)init
 {
     self = [super init];
+    if (self) {
+        _buffersQueue = dispatch_queue_create("PlayEm.LazySample.Buffers", DISPATCH_QUEUE_CONCURRENT);
+        _tileAvailable = dispatch_semaphore_create(0);
+        _renderedSampleRate = 0;
+        _buffers = [NSMutableDictionary dictionary];
+        atomic_init(&_decodingComplete, false);
+        atomic_init(&_waiters, 0);
+        atomic_init(&_decodedPages, 0);
+        _readers = [NSMutableDictionary dictionary];
+        _nextReader = 0;
+        _discardedPages = 0;
+        _pagesConsumed = dispatch_semaphore_create(0);
+        _renderedLength = 0;
+    }
+    return self;
+}
+
+- (id)initWithPath:(NSString*)path error:(NSError**)error
+{
+    self = [self init];
     if (self) {
         NSLog(@"init source file for reading");
 
         NSURL* url = [NSURL fileURLWithPath:path];
         NSAssert(url != nil, @"invalid file path: %@", path);
         _source = [[AVAudioFile alloc] initForReading:url error:error];
-        _buffersQueue = dispatch_queue_create("PlayEm.LazySample.Buffers", DISPATCH_QUEUE_CONCURRENT);
-        _tileAvailable = dispatch_semaphore_create(0);
 
         if (_source == nil) {
             NSLog(@"AVAudioFile initForReading failed");
@@ -56,12 +84,7 @@ const size_t kMaxFramesPerBuffer = 16384;
         _sampleFormat.rate = format.sampleRate;
         _sampleFormat.channels = format.channelCount;
         _fileSampleRate = format.sampleRate;
-        _renderedSampleRate = 0;
         _frameSize = format.channelCount * sizeof(float);
-        _buffers = [NSMutableDictionary dictionary];
-        atomic_init(&_decodingComplete, false);
-        atomic_init(&_waiters, 0);
-        _renderedLength = 0;
         NSLog(@"...lazy sample %p initialized", self);
     }
     return self;
@@ -76,11 +99,8 @@ const size_t kMaxFramesPerBuffer = 16384;
 
 - (unsigned long long)decodedFrames
 {
-    __block NSUInteger buffers = 0;
-    dispatch_sync(_buffersQueue, ^{
-        buffers = _buffers.count;
-    });
-    return buffers * kMaxFramesPerBuffer;
+    // Counted separately as dropped pages have been decoded nonetheless.
+    return atomic_load(&_decodedPages) * kMaxFramesPerBuffer;
 }
 
 - (void)dealloc
@@ -93,12 +113,102 @@ const size_t kMaxFramesPerBuffer = 16384;
     NSNumber* key = [NSNumber numberWithUnsignedLongLong:pageIndex];
     dispatch_barrier_sync(_buffersQueue, ^{
         _buffers[key] = channels;
+        if (_discardsConsumedPages) {
+            [self discardConsumedPages];
+        }
     });
-    dispatch_semaphore_signal(_tileAvailable);
+    [self.waveformPyramid appendPageAtFrame:pageIndex * kMaxFramesPerBuffer channels:channels];
+    atomic_fetch_add(&_decodedPages, 1);
+    // Wake every waiter -- with several concurrent readers a single signal may
+    // reach one that waits for a different page, stalling the others.
+    unsigned int waiters = MAX(atomic_load(&_waiters), 1u);
+    for (unsigned int i = 0; i < waiters; i++) {
+        dispatch_semaphore_signal(_tileAvailable);
+    }
+    if (_discardsConsumedPages && _retainedFramesLimit > 0) {
+        [self waitForReadersToCatchUp];
+    }
+}
+
+#pragma mark - Readers
+
+/// Has to run as a barrier on `buffersQueue`.
+- (void)discardConsumedPages
+{
+    unsigned long long lowest = ULLONG_MAX;
+    for (NSNumber* position in _readers.objectEnumerator) {
+        lowest = MIN(lowest, position.unsignedLongLongValue);
+    }
+    // Without readers only the pages handed to the decoder's page handler are
+    // of any use, and those are retained by their receivers.
+    unsigned long long keepFrom = lowest == ULLONG_MAX ? ULLONG_MAX : lowest / kMaxFramesPerBuffer;
+    NSMutableArray<NSNumber*>* discard = [NSMutableArray array];
+    for (NSNumber* key in _buffers) {
+        if (key.unsignedLongLongValue < keepFrom) {
+            [discard addObject:key];
+        }
+    }
+    for (NSNumber* key in discard) {
+        _discardedPages = MAX(_discardedPages, key.unsignedLongLongValue + 1);
+    }
+    [_buffers removeObjectsForKeys:discard];
+}
+
+/// Holds the decoder back while lagging readers keep too many pages alive.
+- (void)waitForReadersToCatchUp
+{
+    while (true) {
+        __block BOOL exceeded = NO;
+        dispatch_sync(_buffersQueue, ^{
+            exceeded = _readers.count > 0 && _buffers.count * kMaxFramesPerBuffer > _retainedFramesLimit;
+        });
+        if (!exceeded) {
+            return;
+        }
+        // Polling as well, readers going away signal only once.
+        dispatch_semaphore_wait(_pagesConsumed, dispatch_time(DISPATCH_TIME_NOW, 100 * NSEC_PER_MSEC));
+    }
+}
+
+- (NSUInteger)addReaderAtFrame:(unsigned long long)frame
+{
+    __block NSUInteger reader = 0;
+    dispatch_barrier_sync(_buffersQueue, ^{
+        reader = _nextReader++;
+        _readers[@(reader)] = @(frame);
+    });
+    return reader;
+}
+
+- (void)advanceReader:(NSUInteger)reader toFrame:(unsigned long long)frame
+{
+    dispatch_barrier_sync(_buffersQueue, ^{
+        NSNumber* key = @(reader);
+        if (_readers[key] == nil) {
+            return;
+        }
+        _readers[key] = @(frame);
+        if (_discardsConsumedPages) {
+            [self discardConsumedPages];
+        }
+    });
+    dispatch_semaphore_signal(_pagesConsumed);
+}
+
+- (void)removeReader:(NSUInteger)reader
+{
+    dispatch_barrier_sync(_buffersQueue, ^{
+        [_readers removeObjectForKey:@(reader)];
+        if (_discardsConsumedPages) {
+            [self discardConsumedPages];
+        }
+    });
+    dispatch_semaphore_signal(_pagesConsumed);
 }
 
 - (void)markDecodingComplete
 {
+    [self.waveformPyramid finish];
     atomic_store(&_decodingComplete, true);
     unsigned int waiters = atomic_load(&_waiters);
     for (unsigned int i = 0; i < waiters; i++) {
@@ -131,14 +241,21 @@ const size_t kMaxFramesPerBuffer = 16384;
         size_t pageOffset = offset - (pageIndex * kMaxFramesPerBuffer);
 
         __block NSArray* channels = nil;
+        __block BOOL discarded = NO;
         NSNumber* key = [NSNumber numberWithUnsignedLongLong:pageIndex];
         while (channels == nil) {
             dispatch_sync(_buffersQueue, ^{
                 channels = _buffers[key];
+                discarded = pageIndex < _discardedPages;
             });
             if (channels != nil) {
                 break;
             }
+            if (discarded) {
+                // Streaming reader went back behind its own position.
+                NSLog(@"LazySample: page %llu was already discarded", pageIndex);
+                return orderedFrames - frames;
+            }
             if (atomic_load(&_decodingComplete)) {
                 return orderedFrames - frames;
             }
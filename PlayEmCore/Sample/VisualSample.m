@@ -15,11 +15,7 @@
 #import "ProfilingPointsOfInterest.h"
 #import "VisualPair.h"
 #import "VisualPairContext.h"
-// TODO: Implement DynamicReducedVisualSample
-// Implementation does two things at the same time - it immediately produces the
-// requested tiles while additionally reducing the total amount of source
-// samples towards something resembling a biggest possible visual representation
-// width - ie 8192 pairs.
+#import "WaveformPyramid.h"
 
 @interface VisualSample () {
     // FIXME: losing the error from the previous window
@@ -57,6 +53,11 @@
         _energy = [EnergyDetector new];
         assert(_framesPerPixel >= 1.0);
         _sampleBuffers = [NSMutableArray array];
+        // Shared by all visuals of the sample; tiles of coarse zoom levels get
+        // summarized from it instead of the raw sample.
+        if (sample.waveformPyramid == nil) {
+            sample.waveformPyramid = [WaveformPyramid new];
+        }
 
         unsigned long long framesNeeded = tileWidth * _framesPerPixel;
         for (int channel = 0; channel < sample.sampleFormat.channels; channel++) {
@@ -216,45 +217,6 @@
     // "PrepareVisualsFromOrigin");
 }
 
-// TODO(tillt): Generalize this to reuse for both, the quick-render as well as
-// the initial render.
-//- (void)appendToReducedSampleWithValue:(double)s
-//context:(VisualPairContext*)context
-//{
-//    // Store once we get a complete window done.
-//    if (_reductionWindowFrame >= _framesPerReducedValue) {
-//        VisualPair pair = {
-//            .negativeAverage = context->negativeCount > 0 ?
-//            context->negativeSum / context->negativeCount : 0.0,
-//            .positiveAverage = context->positiveSum > 0 ? context->positiveSum
-//            / context->positiveCount : 0.0
-//        };
-//
-//        [context->reductionBuffer appendBytes:&pair
-//        length:sizeof(VisualPair)];
-//
-//        *context = (VisualPairContext){
-//            .negativeSum = 0.0,
-//            .positiveSum = 0.0,
-//            .negativeCount = 0,
-//            .positiveCount = 0
-//        };
-//
-//        _reductionWindowFrame = 0;
-//    }
-//
-//    // Put value into either positive or negative bin.
-//    if (s >= 0) {
-//        context->positiveSum += s;
-//        context->positiveCount++;
-//    } else {
-//        context->negativeSum += s;
-//        context->negativeCount++;
-//    }
-//
-//    _reductionWindowFrame++;
-//}
-
 - (CancelableBlockOperation*)runOperationWithOrigin:(size_t)origin pairs:(size_t)pairsCount callback:(nonnull void (^)(void))callback
 {
     assert(origin < self.width);
@@ -273,21 +235,6 @@
     CancelableBlockOperation* __weak weakOperation = blockOperation;
     VisualSample* __weak weakSample = self;
 
-    //    VisualPairContext* reductionPairContext = &_reductionPairContext;
-    //    BOOL reduce = NO;
-    //    BOOL fromReduced = NO;
-    //    if (_reducedTotalWidth > 0) {
-    //        if (reductionPairContext->reductionBuffer.length <
-    //        _reducedTotalWidth) {
-    //            reduce = YES;
-    //        } else {
-    //            NSLog(@"from reduced!");
-    //            fromReduced = YES;
-    //        }
-    //        reduce = reductionPairContext->reductionBuffer.length <
-    //        _reducedTotalWidth;
-    //    }
-
     [_operations setObject:blockOperation forKey:[NSNumber numberWithLong:pageIndex]];
     // NSLog(@"asking for operation on tile %ld", pageIndex);
 
@@ -318,6 +265,17 @@
         if (displaySampleFrameIndexOffset >= weakSample.sample.frames) {
             return;
         }
+
+        // Coarse zoom levels come from the pyramid once it got that far,
+        // without touching the frames again.
+        WaveformPyramid* pyramid = weakSample.sample.waveformPyramid;
+        if ([pyramid visualPairs:storage count:pairsCount fromFrame:origin * weakSample.framesPerPixel framesPerPixel:weakSample.framesPerPixel] ==
+            pairsCount) {
+            weakOperation.data = buffer;
+            callback();
+            return;
+        }
+
         unsigned long long displayFrameCount = MIN(framesNeeded, weakSample.sample.frames - displaySampleFrameIndexOffset);
 
         // This may block for a loooooong time!
@@ -361,11 +319,6 @@
                     context.negativeCount++;
                 }
 
-                //                if (reduce) {
-                //                    [weakSample appendToReducedSampleWithValue:s
-                //                    context:reductionPairContext];
-                //                }
-
                 frameIndex++;
             } while ((frameIndex - frameOffset) < weakSample.framesPerPixel);
 
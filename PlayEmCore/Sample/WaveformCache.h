@@ -0,0 +1,46 @@
+//
+//  WaveformCache.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class WaveformPyramid;
+
+/// Finished waveform pyramids on disk, keyed by the content they were decoded
+/// from, so the overview of a track seen before shows up before its decoding
+/// even starts. Stays within a byte budget by dropping the least recently
+/// used pyramids.
+@interface WaveformCache : NSObject
+
+/// Within the user's caches directory.
++ (instancetype)shared;
+
+/// Key of the audio decoded from the file at `sampleRate`, derived from its
+/// content. nil when the file can't be read.
++ (NSString* _Nullable)keyForURL:(NSURL*)url sampleRate:(double)sampleRate;
+
+- (instancetype)initWithDirectoryURL:(NSURL*)url byteBudget:(unsigned long long)budget;
+
+@property (readonly, nonatomic) NSURL* directoryURL;
+@property (readonly, nonatomic) unsigned long long byteBudget;
+/// Bytes of all pyramids stored.
+@property (readonly, nonatomic) unsigned long long size;
+
+/// Pyramid stored for `key`, finished. nil when there is none or it is not
+/// usable anymore, in which case it gets removed.
+- (WaveformPyramid* _Nullable)pyramidForKey:(NSString*)key;
+- (BOOL)hasPyramidForKey:(NSString*)key;
+
+/// Stores a finished pyramid, then drops the least recently used ones until
+/// all fit the budget.
+- (BOOL)storePyramid:(WaveformPyramid*)pyramid forKey:(NSString*)key error:(NSError**)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
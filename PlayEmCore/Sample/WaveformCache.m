@@ -0,0 +1,160 @@
+//
+//  WaveformCache.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "WaveformCache.h"
+
+#import "LibraryStore.h"
+#import "WaveformPyramid.h"
+
+/// Some 200 tracks of five minutes.
+static const unsigned long long kSharedByteBudget = 256 * 1024 * 1024;
+static NSString* const kPathExtension = @"waveform";
+
+@implementation WaveformCache
+
++ (instancetype)shared
+{
+    static WaveformCache* cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSURL* caches = [[[NSFileManager defaultManager] URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask] firstObject];
+        NSURL* directory = [[caches URLByAppendingPathComponent:@"PlayEm" isDirectory:YES] URLByAppendingPathComponent:@"Waveforms" isDirectory:YES];
+        cache = [[WaveformCache alloc] initWithDirectoryURL:directory byteBudget:kSharedByteBudget];
+    });
+    return cache;
+}
+
++ (NSString*)keyForURL:(NSURL*)url sampleRate:(double)sampleRate
+{
+    NSString* fingerprint = [LibraryStore fingerprintOfURL:url];
+    if (fingerprint == nil) {
+        return nil;
+    }
+    return [NSString stringWithFormat:@"%@-%.0f", fingerprint, sampleRate];
+}
+
+- (instancetype)initWithDirectoryURL:(NSURL*)url byteBudget:(unsigned long long)budget
+{
+    self = [super init];
+    if (self) {
+        _directoryURL = url;
+        _byteBudget = budget;
+    }
+    return self;
+}
+
+- (NSURL*)fileURLForKey:(NSString*)key
+{
+    return [[_directoryURL URLByAppendingPathComponent:key isDirectory:NO] URLByAppendingPathExtension:kPathExtension];
+}
+
+- (BOOL)hasPyramidForKey:(NSString*)key
+{
+    return [[NSFileManager defaultManager] fileExistsAtPath:[self fileURLForKey:key].path];
+}
+
+- (WaveformPyramid*)pyramidForKey:(NSString*)key
+{
+    NSURL* url = [self fileURLForKey:key];
+    NSData* data = [NSData dataWithContentsOfURL:url options:NSDataReadingMappedIfSafe error:nil];
+    if (data == nil) {
+        return nil;
+    }
+    NSError* error = nil;
+    WaveformPyramid* pyramid = [[WaveformPyramid alloc] initWithData:data error:&error];
+    @synchronized(self) {
+        if (pyramid == nil) {
+            NSLog(@"dropping cached waveform %@: %@", key, error.localizedDescription);
+            [[NSFileManager defaultManager] removeItemAtURL:url error:nil];
+            return nil;
+        }
+        // Eviction goes by the modification date, so using counts as a change.
+        [[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate : [NSDate date]} ofItemAtPath:url.path error:nil];
+    }
+    return pyramid;
+}
+
+- (BOOL)storePyramid:(WaveformPyramid*)pyramid forKey:(NSString*)key error:(NSError**)error
+{
+    NSData* data = pyramid.dataRepresentation;
+    if (data == nil || data.length > _byteBudget) {
+        if (error) {
+            NSString* message = data == nil ? @"Waveform is not finished" : @"Waveform exceeds the cache budget";
+            *error = [NSError errorWithDomain:@"WaveformCache" code:-1 userInfo:@{NSLocalizedDescriptionKey : message}];
+        }
+        return NO;
+    }
+    @synchronized(self) {
+        if (![[NSFileManager defaultManager] createDirectoryAtURL:_directoryURL withIntermediateDirectories:YES attributes:nil error:error]) {
+            return NO;
+        }
+        if (![data writeToURL:[self fileURLForKey:key] options:NSDataWritingAtomic error:error]) {
+            return NO;
+        }
+        [self evictBeyondBudget];
+    }
+    return YES;
+}
+
+- (NSArray<NSURL*>*)storedFileURLs
+{
+    NSArray<NSURL*>* urls = [[NSFileManager defaultManager] contentsOfDirectoryAtURL:_directoryURL
+                                                          includingPropertiesForKeys:@[ NSURLFileSizeKey, NSURLContentModificationDateKey ]
+                                                                             options:NSDirectoryEnumerationSkipsHiddenFiles
+                                                                               error:nil];
+    return [urls filteredArrayUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(NSURL* url, NSDictionary* bindings) {
+                     return [url.pathExtension isEqualToString:kPathExtension];
+                 }]];
+}
+
+- (unsigned long long)size
+{
+    @synchronized(self) {
+        unsigned long long size = 0;
+        for (NSURL* url in [self storedFileURLs]) {
+            NSNumber* length = nil;
+            [url getResourceValue:&length forKey:NSURLFileSizeKey error:nil];
+            size += length.unsignedLongLongValue;
+        }
+        return size;
+    }
+}
+
+/// Has to run synchronized.
+- (void)evictBeyondBudget
+{
+    NSMutableArray<NSURL*>* urls = [[self storedFileURLs] mutableCopy];
+    unsigned long long size = 0;
+    NSMutableDictionary<NSURL*, NSDate*>* used = [NSMutableDictionary dictionary];
+    for (NSURL* url in urls) {
+        NSNumber* length = nil;
+        NSDate* date = nil;
+        [url getResourceValue:&length forKey:NSURLFileSizeKey error:nil];
+        [url getResourceValue:&date forKey:NSURLContentModificationDateKey error:nil];
+        size += length.unsignedLongLongValue;
+        used[url] = date ?: [NSDate distantPast];
+    }
+    if (size <= _byteBudget) {
+        return;
+    }
+    [urls sortUsingComparator:^NSComparisonResult(NSURL* a, NSURL* b) {
+        return [used[a] compare:used[b]];
+    }];
+    for (NSURL* url in urls) {
+        if (size <= _byteBudget) {
+            break;
+        }
+        NSNumber* length = nil;
+        [url getResourceValue:&length forKey:NSURLFileSizeKey error:nil];
+        if ([[NSFileManager defaultManager] removeItemAtURL:url error:nil]) {
+            size -= MIN(size, length.unsignedLongLongValue);
+        }
+    }
+}
+
+@end
@@ -0,0 +1,79 @@
+//
+//  WaveformPyramid.h
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "VisualPair.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Summary of a run of frames, mixed down to mono.
+typedef struct {
+    float minimum;
+    float maximum;
+    float positiveSum;
+    float negativeSum;
+    float squareSum;
+    uint32_t positiveCount;
+    uint32_t negativeCount;
+} WaveformBin;
+
+/// Positive and negative averages of a bin, as `VisualSample` draws them.
+static inline VisualPair WaveformBinVisualPair(WaveformBin bin)
+{
+    return (VisualPair) {.negativeAverage = bin.negativeCount > 0 ? bin.negativeSum / bin.negativeCount : 0.0f,
+                         .positiveAverage = bin.positiveCount > 0 ? bin.positiveSum / bin.positiveCount : 0.0f};
+}
+
+static inline float WaveformBinRMS(WaveformBin bin)
+{
+    const uint32_t count = bin.positiveCount + bin.negativeCount;
+    return count > 0 ? sqrtf(bin.squareSum / count) : 0.0f;
+}
+
+/// Min, max, RMS and averages of a sample at power of two reductions, from
+/// `baseFramesPerBin` frames per bin upwards, each level halving the one
+/// below. Gets built while the sample decodes, page by page in order; a zoom
+/// level then gets summarized from the closest level in time proportional to
+/// the pixels asked for rather than the frames they cover.
+@interface WaveformPyramid : NSObject
+
+@property (class, readonly, nonatomic) size_t baseFramesPerBin;
+
+/// Frames summarized so far.
+@property (readonly, nonatomic) unsigned long long frames;
+@property (readonly, nonatomic) NSUInteger levelCount;
+/// Set once all frames were appended.
+@property (readonly, nonatomic) BOOL finished;
+
+/// Adds the frames of a decoded page starting at `frame`. Pages have to come
+/// in order from the start; others are ignored.
+- (void)appendPageAtFrame:(unsigned long long)frame channels:(NSArray<NSData*>*)channels;
+/// Summarizes what is left over once decoding completed.
+- (void)finish;
+
+/// Restores a finished pyramid from `dataRepresentation`. Fails on data of
+/// another format version or a different base bin size.
+- (nullable instancetype)initWithData:(NSData*)data error:(NSError**)error;
+/// Compact, versioned form of a finished pyramid, nil before `finish`. Holds
+/// the base level; the levels above get rebuilt from it exactly on load.
+- (nullable NSData*)dataRepresentation;
+
+/// Fills `bins` with one bin per pixel of `framesPerPixel` frames, starting at
+/// `frame`. Returns how many pixels got filled, stopping at the first one not
+/// summarized yet; pixels past the end of a finished sample come out empty.
+/// Returns 0 when pixels are too narrow for the levels to summarize them
+/// faithfully.
+- (size_t)bins:(WaveformBin*)bins count:(size_t)count fromFrame:(double)frame framesPerPixel:(double)framesPerPixel;
+
+/// Same as above, as `VisualPair`s.
+- (size_t)visualPairs:(VisualPair*)pairs count:(size_t)count fromFrame:(double)frame framesPerPixel:(double)framesPerPixel;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,310 @@
+//
+//  WaveformPyramid.m
+//  PlayEm
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import "WaveformPyramid.h"
+
+/// Base level bins cover 2^kBaseFramesPerBinShift frames.
+static const size_t kBaseFramesPerBinShift = 8;
+/// Pixels get summarized from at least this many bins, keeping the error at
+/// their edges below a fraction of a pixel. Narrower pixels are left to the
+/// raw sample.
+static const size_t kMinBinsPerPixel = 8;
+
+/// Stored pyramids carry this version; bump it whenever bins change meaning.
+static const uint16_t kWaveformDataVersion = 1;
+static const uint32_t kWaveformDataMagic = 'PEWF';
+
+/// Followed by `binCount` base level bins, all in host byte order; data of
+/// the other byte order fails on the magic.
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t baseFramesPerBinShift;
+    uint64_t frames;
+    uint64_t binCount;
+} WaveformDataHeader;
+
+/// Base level bin as stored; its counts never exceed `baseFramesPerBin`.
+typedef struct __attribute__((packed)) {
+    float minimum;
+    float maximum;
+    float positiveSum;
+    float negativeSum;
+    float squareSum;
+    uint16_t positiveCount;
+    uint16_t negativeCount;
+} WaveformDataBin;
+
+static const WaveformBin kEmptyBin = {.minimum = INFINITY, .maximum = -INFINITY};
+
+static inline void mergeBin(WaveformBin* into, const WaveformBin* bin)
+{
+    into->minimum = MIN(into->minimum, bin->minimum);
+    into->maximum = MAX(into->maximum, bin->maximum);
+    into->positiveSum += bin->positiveSum;
+    into->negativeSum += bin->negativeSum;
+    into->squareSum += bin->squareSum;
+    into->positiveCount += bin->positiveCount;
+    into->negativeCount += bin->negativeCount;
+}
+
+@implementation WaveformPyramid {
+    // Bins per level, level 0 being the finest.
+    NSMutableArray<NSMutableData*>* _levels;
+    // Base level bin still collecting frames.
+    WaveformBin _pending;
+    size_t _pendingFrames;
+}
+
++ (size_t)baseFramesPerBin
+{
+    return (size_t) 1 << kBaseFramesPerBinShift;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _levels = [NSMutableArray array];
+        _pending = kEmptyBin;
+    }
+    return self;
+}
+
+- (instancetype)initWithData:(NSData*)data error:(NSError**)error
+{
+    self = [self init];
+    if (self == nil) {
+        return nil;
+    }
+    WaveformDataHeader header;
+    if (data.length < sizeof(header)) {
+        return [self failWithError:error message:@"Waveform data is truncated"];
+    }
+    memcpy(&header, data.bytes, sizeof(header));
+    if (header.magic != kWaveformDataMagic) {
+        return [self failWithError:error message:@"Not waveform data"];
+    }
+    if (header.version != kWaveformDataVersion || header.baseFramesPerBinShift != kBaseFramesPerBinShift) {
+        return [self failWithError:error message:@"Waveform data of another version"];
+    }
+    const size_t framesPerBin = WaveformPyramid.baseFramesPerBin;
+    const size_t storedLength = data.length - sizeof(header);
+    if (storedLength % sizeof(WaveformDataBin) != 0 || storedLength / sizeof(WaveformDataBin) != header.binCount ||
+        header.binCount != (header.frames + framesPerBin - 1) / framesPerBin) {
+        return [self failWithError:error message:@"Waveform data is inconsistent"];
+    }
+
+    const uint8_t* stored = (const uint8_t*) data.bytes + sizeof(header);
+    uint64_t counted = 0;
+    for (uint64_t i = 0; i < header.binCount; i++) {
+        WaveformDataBin s;
+        memcpy(&s, stored + i * sizeof(s), sizeof(s));
+        WaveformBin bin = {.minimum = s.minimum,
+                           .maximum = s.maximum,
+                           .positiveSum = s.positiveSum,
+                           .negativeSum = s.negativeSum,
+                           .squareSum = s.squareSum,
+                           .positiveCount = s.positiveCount,
+                           .negativeCount = s.negativeCount};
+        counted += bin.positiveCount + bin.negativeCount;
+        [self addBin:bin level:0];
+    }
+    if (counted != header.frames) {
+        return [self failWithError:error message:@"Waveform data is inconsistent"];
+    }
+    _frames = header.frames;
+    [self finish];
+    return self;
+}
+
+- (id)failWithError:(NSError**)error message:(NSString*)message
+{
+    if (error) {
+        *error = [NSError errorWithDomain:@"WaveformPyramid" code:-1 userInfo:@{NSLocalizedDescriptionKey : message}];
+    }
+    return nil;
+}
+
+- (NSData*)dataRepresentation
+{
+    @synchronized(self) {
+        if (!_finished) {
+            return nil;
+        }
+        const WaveformBin* bins = _levels.count > 0 ? _levels[0].bytes : NULL;
+        const uint64_t binCount = _levels.count > 0 ? _levels[0].length / sizeof(WaveformBin) : 0;
+
+        NSMutableData* data = [NSMutableData dataWithLength:sizeof(WaveformDataHeader) + binCount * sizeof(WaveformDataBin)];
+        const WaveformDataHeader header = {.magic = kWaveformDataMagic,
+                                           .version = kWaveformDataVersion,
+                                           .baseFramesPerBinShift = (uint16_t) kBaseFramesPerBinShift,
+                                           .frames = _frames,
+                                           .binCount = binCount};
+        memcpy(data.mutableBytes, &header, sizeof(header));
+
+        uint8_t* stored = (uint8_t*) data.mutableBytes + sizeof(header);
+        for (uint64_t i = 0; i < binCount; i++) {
+            const WaveformDataBin s = {.minimum = bins[i].minimum,
+                                       .maximum = bins[i].maximum,
+                                       .positiveSum = bins[i].positiveSum,
+                                       .negativeSum = bins[i].negativeSum,
+                                       .squareSum = bins[i].squareSum,
+                                       .positiveCount = (uint16_t) bins[i].positiveCount,
+                                       .negativeCount = (uint16_t) bins[i].negativeCount};
+            memcpy(stored + i * sizeof(s), &s, sizeof(s));
+        }
+        return data;
+    }
+}
+
+- (NSUInteger)levelCount
+{
+    @synchronized(self) {
+        return _levels.count;
+    }
+}
+
+/// Adds a complete bin, merging each pair it completes into the level above.
+- (void)addBin:(WaveformBin)bin level:(NSUInteger)level
+{
+    while (true) {
+        if (level == _levels.count) {
+            [_levels addObject:[NSMutableData data]];
+        }
+        NSMutableData* bins = _levels[level];
+        [bins appendBytes:&bin length:sizeof(WaveformBin)];
+        const size_t count = bins.length / sizeof(WaveformBin);
+        if (count % 2 == 1) {
+            return;
+        }
+        const WaveformBin* all = bins.bytes;
+        bin = all[count - 2];
+        mergeBin(&bin, &all[count - 1]);
+        level++;
+    }
+}
+
+- (void)appendPageAtFrame:(unsigned long long)frame channels:(NSArray<NSData*>*)channels
+{
+    const size_t channelCount = channels.count;
+    if (channelCount == 0) {
+        return;
+    }
+    const size_t frames = channels[0].length / sizeof(float);
+    const float* data[channelCount];
+    for (size_t channel = 0; channel < channelCount; channel++) {
+        data[channel] = channels[channel].bytes;
+    }
+    const size_t framesPerBin = WaveformPyramid.baseFramesPerBin;
+
+    @synchronized(self) {
+        if (_finished || frame != _frames) {
+            return;
+        }
+        for (size_t i = 0; i < frames; i++) {
+            float s = 0.0f;
+            for (size_t channel = 0; channel < channelCount; channel++) {
+                s += data[channel][i];
+            }
+            s /= channelCount;
+
+            _pending.minimum = MIN(_pending.minimum, s);
+            _pending.maximum = MAX(_pending.maximum, s);
+            _pending.squareSum += s * s;
+            if (s >= 0) {
+                _pending.positiveSum += s;
+                _pending.positiveCount++;
+            } else {
+                _pending.negativeSum += s;
+                _pending.negativeCount++;
+            }
+            if (++_pendingFrames == framesPerBin) {
+                [self addBin:_pending level:0];
+                _pending = kEmptyBin;
+                _pendingFrames = 0;
+            }
+        }
+        _frames += frames;
+    }
+}
+
+- (void)finish
+{
+    @synchronized(self) {
+        if (_finished) {
+            return;
+        }
+        if (_pendingFrames > 0) {
+            [self addBin:_pending level:0];
+            _pending = kEmptyBin;
+            _pendingFrames = 0;
+        }
+        // Bins left without a partner go up on their own, so that every level
+        // covers all frames.
+        for (NSUInteger level = 0; level < _levels.count; level++) {
+            const size_t count = _levels[level].length / sizeof(WaveformBin);
+            if (count % 2 == 1 && !(count == 1 && level + 1 == _levels.count)) {
+                [self addBin:((const WaveformBin*) _levels[level].bytes)[count - 1] level:level + 1];
+            }
+        }
+        _finished = YES;
+    }
+}
+
+- (size_t)bins:(WaveformBin*)bins count:(size_t)count fromFrame:(double)frame framesPerPixel:(double)framesPerPixel
+{
+    const double finest = (double) (WaveformPyramid.baseFramesPerBin * kMinBinsPerPixel);
+    if (framesPerPixel < finest) {
+        return 0;
+    }
+    NSUInteger level = (NSUInteger) floor(log2(framesPerPixel / finest));
+
+    @synchronized(self) {
+        if (_levels.count == 0) {
+            if (!_finished) {
+                return 0;
+            }
+            memset(bins, 0, count * sizeof(WaveformBin));
+            return count;
+        }
+        // Early on the coarser levels may not be there yet.
+        level = MIN(level, _levels.count - 1);
+        const double framesPerBin = (double) (WaveformPyramid.baseFramesPerBin << level);
+        const WaveformBin* all = _levels[level].bytes;
+        const size_t binCount = _levels[level].length / sizeof(WaveformBin);
+
+        for (size_t pixel = 0; pixel < count; pixel++) {
+            const double start = frame + pixel * framesPerPixel;
+            const size_t first = (size_t) (start / framesPerBin);
+            const size_t end = (size_t) ((start + framesPerPixel) / framesPerBin);
+            if (end > binCount && !_finished) {
+                return pixel;
+            }
+            WaveformBin bin = kEmptyBin;
+            for (size_t i = first; i < MIN(end, binCount); i++) {
+                mergeBin(&bin, &all[i]);
+            }
+            bins[pixel] = bin.positiveCount + bin.negativeCount > 0 ? bin : (WaveformBin) {0};
+        }
+    }
+    return count;
+}
+
+- (size_t)visualPairs:(VisualPair*)pairs count:(size_t)count fromFrame:(double)frame framesPerPixel:(double)framesPerPixel
+{
+    WaveformBin* bins = malloc(MAX(count, 1) * sizeof(WaveformBin));
+    const size_t filled = [self bins:bins count:count fromFrame:frame framesPerPixel:framesPerPixel];
+    for (size_t pixel = 0; pixel < filled; pixel++) {
+        pairs[pixel] = WaveformBinVisualPair(bins[pixel]);
+    }
+    free(bins);
+    return filled;
+}
+
+@end
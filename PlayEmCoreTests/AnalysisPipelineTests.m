@@ -0,0 +1,355 @@
+//
+//  AnalysisPipelineTests.m
+//  PlayEmCoreTests
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <AVFoundation/AVFoundation.h>
+#import <XCTest/XCTest.h>
+
+#import "AnalysisPipeline.h"
+#import "BeatAnalyzer.h"
+#import "BeatTrackedSample.h"
+#import "ContentHashAnalyzer.h"
+#import "FileSampleDecoder.h"
+#import "KeyAnalyzer.h"
+#import "KeyTrackedSample.h"
+#import "LazySample.h"
+#import "LoudnessAnalyzer.h"
+#import "MockLazySample.h"
+
+static const unsigned long long kPageFrames = 16384;
+
+/// Remembers every call it gets, in order.
+@interface RecordingAnalyzer : NSObject <SampleAnalyzer>
+@property (assign, nonatomic) NSUInteger begun;
+@property (assign, nonatomic) NSUInteger finished;
+/// Offset and length of every page, as pairs.
+@property (strong, nonatomic) NSMutableArray<NSArray<NSNumber*>*>* pages;
+@property (assign, nonatomic) BOOL fails;
+@property (strong, nonatomic, nullable) NSError* error;
+@end
+
+@implementation RecordingAnalyzer
+
++ (NSInteger)version
+{
+    return 1;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _pages = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (NSString*)name
+{
+    return _fails ? @"failing" : @"recording";
+}
+
+- (void)beginWithSample:(LazySample*)sample
+{
+    _begun++;
+}
+
+- (void)processFrames:(unsigned long long)frames offset:(unsigned long long)offset channels:(NSArray<NSData*>*)channels
+{
+    [_pages addObject:@[ @(offset), @(frames) ]];
+}
+
+- (void)finish
+{
+    _finished++;
+    if (_fails) {
+        _error = [NSError errorWithDomain:SampleAnalyzerErrorDomain code:SampleAnalyzerErrorFailed userInfo:nil];
+    }
+}
+
+@end
+
+@interface AnalysisPipelineTests : XCTestCase
+@end
+
+@implementation AnalysisPipelineTests
+
+/// 16 bit stereo WAV of a half scale sine.
+- (NSURL*)writeFileWithFrames:(AVAudioFrameCount)frames
+{
+    NSString* name = [NSString stringWithFormat:@"playem_pipeline_%@.wav", [NSUUID UUID].UUIDString];
+    NSURL* url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name]];
+    [self addTeardownBlock:^{
+        [[NSFileManager defaultManager] removeItemAtURL:url error:nil];
+    }];
+
+    const double sampleRate = 44100.0;
+    AVAudioFormat* format = [[AVAudioFormat alloc] initStandardFormatWithSampleRate:sampleRate channels:2];
+    AVAudioPCMBuffer* buffer = [[AVAudioPCMBuffer alloc] initWithPCMFormat:format frameCapacity:frames];
+    buffer.frameLength = frames;
+    for (AVAudioFrameCount i = 0; i < frames; i++) {
+        float s = (float) (0.5 * sin(2.0 * M_PI * 440.0 * i / sampleRate));
+        buffer.floatChannelData[0][i] = s;
+        buffer.floatChannelData[1][i] = s;
+    }
+
+    @autoreleasepool {
+        NSDictionary* settings = @{
+            AVFormatIDKey : @(kAudioFormatLinearPCM),
+            AVSampleRateKey : @(sampleRate),
+            AVNumberOfChannelsKey : @2,
+            AVLinearPCMBitDepthKey : @16,
+            AVLinearPCMIsFloatKey : @NO,
+        };
+        NSError* error = nil;
+        AVAudioFile* file = [[AVAudioFile alloc] initForWriting:url
+                                                       settings:settings
+                                                   commonFormat:AVAudioPCMFormatFloat32
+                                                    interleaved:NO
+                                                          error:&error];
+        XCTAssertNotNil(file, @"%@", error);
+        XCTAssertTrue([file writeFromBuffer:buffer error:&error], @"%@", error);
+        // The file gets finalized when released.
+        file = nil;
+    }
+    return url;
+}
+
+- (LazySample*)sampleWithURL:(NSURL*)url
+{
+    NSError* error = nil;
+    LazySample* sample = [[LazySample alloc] initWithPath:url.path error:&error];
+    XCTAssertNotNil(sample, @"%@", error);
+    return sample;
+}
+
+- (void)testEveryAnalyzerSeesEveryPageOnce
+{
+    const AVAudioFrameCount frames = 5 * kPageFrames + 100;
+    LazySample* sample = [self sampleWithURL:[self writeFileWithFrames:frames]];
+
+    AnalysisPipeline* pipeline = [[AnalysisPipeline alloc] initWithSample:sample];
+    RecordingAnalyzer* recording = [RecordingAnalyzer new];
+    LoudnessAnalyzer* loudness = [LoudnessAnalyzer new];
+    ContentHashAnalyzer* contentHash = [ContentHashAnalyzer new];
+    [pipeline addAnalyzer:recording];
+    [pipeline addAnalyzer:loudness];
+    [pipeline addAnalyzer:contentHash];
+
+    NSError* error = nil;
+    XCTAssertTrue([pipeline runWithDecoder:[FileSampleDecoder new] timeout:30.0 error:&error], @"%@", error);
+    XCTAssertEqual(pipeline.errors.count, 0u);
+
+    XCTAssertEqual(recording.begun, 1u);
+    XCTAssertEqual(recording.finished, 1u);
+    unsigned long long expectedOffset = 0;
+    for (NSArray<NSNumber*>* page in recording.pages) {
+        XCTAssertEqual(page[0].unsignedLongLongValue, expectedOffset, @"Pages should arrive in order, without gaps");
+        expectedOffset += page[1].unsignedLongLongValue;
+    }
+    XCTAssertEqual(expectedOffset, (unsigned long long) frames);
+    XCTAssertEqual(recording.pages.count, 6u);
+
+    XCTAssertEqualWithAccuracy(loudness.peak, 0.5, 1e-3);
+    XCTAssertEqualWithAccuracy(loudness.rms, 0.5 / sqrt(2.0), 1e-3);
+    XCTAssertEqual(contentHash.contentHash.length, 24u);
+
+    XCTAssertNotNil(pipeline.timings[kAnalysisPipelineDecodeStage]);
+    XCTAssertNotNil(pipeline.timings[loudness.name]);
+    XCTAssertNotNil(pipeline.timings[contentHash.name]);
+}
+
+- (void)testStreamingMatchesRetainingTheSample
+{
+    NSURL* url = [self writeFileWithFrames:12 * kPageFrames + 7];
+    NSMutableArray<NSString*>* hashes = [NSMutableArray array];
+    NSMutableArray<NSNumber*>* levels = [NSMutableArray array];
+
+    for (NSNumber* streaming in @[ @NO, @YES ]) {
+        AnalysisPipeline* pipeline = [[AnalysisPipeline alloc] initWithSample:[self sampleWithURL:url]];
+        pipeline.streaming = streaming.boolValue;
+        LoudnessAnalyzer* loudness = [LoudnessAnalyzer new];
+        ContentHashAnalyzer* contentHash = [ContentHashAnalyzer new];
+        [pipeline addAnalyzer:loudness];
+        [pipeline addAnalyzer:contentHash];
+
+        NSError* error = nil;
+        XCTAssertTrue([pipeline runWithDecoder:[FileSampleDecoder new] timeout:30.0 error:&error], @"%@", error);
+        XCTAssertNotNil(contentHash.contentHash);
+        [hashes addObject:contentHash.contentHash ?: @""];
+        [levels addObject:@(loudness.loudness)];
+    }
+    XCTAssertEqualObjects(hashes[0], hashes[1]);
+    XCTAssertEqualWithAccuracy(levels[0].doubleValue, levels[1].doubleValue, 1e-9);
+}
+
+- (void)testFailingAnalyzerLeavesTheOthersAlone
+{
+    LazySample* sample = [self sampleWithURL:[self writeFileWithFrames:2 * kPageFrames]];
+
+    AnalysisPipeline* pipeline = [[AnalysisPipeline alloc] initWithSample:sample];
+    RecordingAnalyzer* failing = [RecordingAnalyzer new];
+    failing.fails = YES;
+    LoudnessAnalyzer* loudness = [LoudnessAnalyzer new];
+    [pipeline addAnalyzer:failing];
+    [pipeline addAnalyzer:loudness];
+
+    NSError* error = nil;
+    XCTAssertTrue([pipeline runWithDecoder:[FileSampleDecoder new] timeout:30.0 error:&error], @"%@", error);
+    XCTAssertEqual(pipeline.errors.count, 1u);
+    XCTAssertNotNil(pipeline.errors[@"failing"]);
+    XCTAssertEqualWithAccuracy(loudness.peak, 0.5, 1e-3);
+}
+
+- (void)testSuspendedRunWaitsWithoutTimingOut
+{
+    const AVAudioFrameCount frames = 4 * kPageFrames;
+    LazySample* sample = [self sampleWithURL:[self writeFileWithFrames:frames]];
+
+    AnalysisPipeline* pipeline = [[AnalysisPipeline alloc] initWithSample:sample];
+    RecordingAnalyzer* recording = [RecordingAnalyzer new];
+    [pipeline addAnalyzer:recording];
+
+    [pipeline suspend];
+    XCTAssertTrue(pipeline.suspended);
+
+    XCTestExpectation* ran = [self expectationWithDescription:@"run"];
+    __block BOOL success = NO;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        success = [pipeline runWithDecoder:[FileSampleDecoder new] timeout:2.0 error:nil];
+        [ran fulfill];
+    });
+
+    // Longer than the timeout; time spent suspended does not count.
+    [NSThread sleepForTimeInterval:2.5];
+    XCTAssertEqual(recording.begun, 0u, @"Nothing gets handed out while suspended");
+
+    [pipeline resume];
+    XCTAssertFalse(pipeline.suspended);
+    [self waitForExpectations:@[ ran ] timeout:30];
+
+    XCTAssertTrue(success);
+    XCTAssertEqual(recording.finished, 1u);
+    XCTAssertEqual(recording.pages.count, 4u);
+}
+
+- (void)testPageFedKeyMatchesPulledKey
+{
+    // A multiple of the key window, so both see the very same windows.
+    NSURL* url = [self writeFileWithFrames:10 * kPageFrames];
+
+    AnalysisPipeline* pipeline = [[AnalysisPipeline alloc] initWithSample:[self sampleWithURL:url]];
+    pipeline.streaming = YES;
+    KeyAnalyzer* keyAnalyzer = [KeyAnalyzer new];
+    [pipeline addAnalyzer:keyAnalyzer];
+    NSError* error = nil;
+    XCTAssertTrue([pipeline runWithDecoder:[FileSampleDecoder new] timeout:30.0 error:&error], @"%@", error);
+    XCTAssertNil(keyAnalyzer.error);
+
+    LazySample* sample = [self sampleWithURL:url];
+    dispatch_semaphore_t decoded = dispatch_semaphore_create(0);
+    [[FileSampleDecoder new] decodeAsyncForAnalysisWithSample:sample
+                                                  pageHandler:nil
+                                              completionQueue:nil
+                                                     callback:^(BOOL success) {
+                                                         dispatch_semaphore_signal(decoded);
+                                                     }];
+    dispatch_semaphore_wait(decoded, DISPATCH_TIME_FOREVER);
+    KeyTrackedSample* pulled = [[KeyTrackedSample alloc] initWithSample:sample];
+    pulled.suppressActivity = YES;
+    XCTestExpectation* tracked = [self expectationWithDescription:@"tracked"];
+    [pulled trackKeyAsyncWithCompletionQueue:dispatch_get_global_queue(QOS_CLASS_UTILITY, 0)
+                                    callback:^(BOOL done) {
+                                        [tracked fulfill];
+                                    }];
+    [self waitForExpectations:@[ tracked ] timeout:30];
+
+    XCTAssertGreaterThan(pulled.key.length, 0u);
+    XCTAssertEqualObjects(keyAnalyzer.key, pulled.key);
+}
+
+- (void)testPageFedBeatsMatchPulledBeats
+{
+    NSURL* url = [self writeFileWithFrames:10 * kPageFrames + 1000];
+
+    AnalysisPipeline* pipeline = [[AnalysisPipeline alloc] initWithSample:[self sampleWithURL:url]];
+    pipeline.streaming = YES;
+    BeatAnalyzer* beatAnalyzer = [BeatAnalyzer new];
+    [pipeline addAnalyzer:beatAnalyzer];
+    NSError* error = nil;
+    XCTAssertTrue([pipeline runWithDecoder:[FileSampleDecoder new] timeout:30.0 error:&error], @"%@", error);
+    XCTAssertNotEqual(beatAnalyzer.error.code, SampleAnalyzerErrorCancelled);
+    XCTAssertTrue(beatAnalyzer.beatSample.ready);
+
+    LazySample* sample = [self sampleWithURL:url];
+    dispatch_semaphore_t decoded = dispatch_semaphore_create(0);
+    [[FileSampleDecoder new] decodeAsyncForAnalysisWithSample:sample
+                                                  pageHandler:nil
+                                              completionQueue:nil
+                                                     callback:^(BOOL success) {
+                                                         dispatch_semaphore_signal(decoded);
+                                                     }];
+    dispatch_semaphore_wait(decoded, DISPATCH_TIME_FOREVER);
+    BeatTrackedSample* pulled = [[BeatTrackedSample alloc] initWithSample:sample];
+    pulled.suppressActivity = YES;
+    XCTestExpectation* tracked = [self expectationWithDescription:@"tracked"];
+    [pulled trackBeatsAsyncWithCompletionQueue:dispatch_get_global_queue(QOS_CLASS_UTILITY, 0)
+                                      callback:^(BOOL done) {
+                                          [tracked fulfill];
+                                      }];
+    [self waitForExpectations:@[ tracked ] timeout:30];
+
+    // Pages of any size end up as the same hops.
+    XCTAssertEqualObjects(beatAnalyzer.beatSample.coarseBeats, pulled.coarseBeats);
+    XCTAssertEqual(beatAnalyzer.beatSample.initialSilenceEndsAtFrame, pulled.initialSilenceEndsAtFrame);
+    XCTAssertEqual(beatAnalyzer.beatSample.trailingSilenceStartsAtFrame, pulled.trailingSilenceStartsAtFrame);
+    XCTAssertEqual(beatAnalyzer.beatSample.averageTempo, pulled.averageTempo);
+}
+
+- (void)testCancelledBeatAnalyzerFinishesRightAway
+{
+    MockLazySample* sample = [[MockLazySample alloc] initWithChannels:2];
+    sample.renderedSampleRate = 44100.0;
+    [sample setRenderedLength:4 * kPageFrames];
+
+    NSMutableData* silence = [NSMutableData dataWithLength:kPageFrames * sizeof(float)];
+    NSArray<NSData*>* page = @[ silence, silence ];
+
+    BeatAnalyzer* beatAnalyzer = [BeatAnalyzer new];
+    [beatAnalyzer beginWithSample:sample];
+    [beatAnalyzer processFrames:kPageFrames offset:0 channels:page];
+    [beatAnalyzer cancel];
+    // Pages arriving after the cancel get ignored.
+    [beatAnalyzer processFrames:kPageFrames offset:kPageFrames channels:page];
+    [beatAnalyzer finish];
+
+    XCTAssertEqual(beatAnalyzer.error.code, SampleAnalyzerErrorCancelled);
+    XCTAssertNil(beatAnalyzer.tempo);
+}
+
+- (void)testCancelledKeyAnalyzerFinishesRightAway
+{
+    MockLazySample* sample = [[MockLazySample alloc] initWithChannels:2];
+    sample.renderedSampleRate = 44100.0;
+    [sample setRenderedLength:4 * kPageFrames];
+
+    NSMutableData* silence = [NSMutableData dataWithLength:kPageFrames * sizeof(float)];
+    NSArray<NSData*>* page = @[ silence, silence ];
+
+    KeyAnalyzer* keyAnalyzer = [KeyAnalyzer new];
+    [keyAnalyzer beginWithSample:sample];
+    [keyAnalyzer processFrames:kPageFrames offset:0 channels:page];
+    [keyAnalyzer cancel];
+    // Pages arriving after the cancel get ignored.
+    [keyAnalyzer processFrames:kPageFrames offset:kPageFrames channels:page];
+    [keyAnalyzer finish];
+
+    XCTAssertEqual(keyAnalyzer.error.code, SampleAnalyzerErrorCancelled);
+    XCTAssertNil(keyAnalyzer.key);
+}
+
+@end
@@ -0,0 +1,273 @@
+//
+//  AudioDurationTests.m
+//  PlayEmCoreTests
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <AVFoundation/AVFoundation.h>
+#import <XCTest/XCTest.h>
+
+#import "AudioDuration.h"
+
+@interface AudioDurationTests : XCTestCase
+@end
+
+@implementation AudioDurationTests
+
+#pragma mark - Generated files
+
+- (NSURL*)temporaryURLWithExtension:(NSString*)extension
+{
+    NSString* name = [NSString stringWithFormat:@"playem_duration_%@.%@", [NSUUID UUID].UUIDString, extension];
+    NSURL* url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name]];
+    [self addTeardownBlock:^{
+        [[NSFileManager defaultManager] removeItemAtURL:url error:nil];
+    }];
+    return url;
+}
+
+/// Writes a sine of `frames` length through AVAudioFile, the container picked
+/// by extension.
+- (NSURL*)writeFileWithExtension:(NSString*)extension settings:(NSDictionary*)settings frames:(AVAudioFrameCount)frames
+{
+    NSURL* url = [self temporaryURLWithExtension:extension];
+    double sampleRate = [settings[AVSampleRateKey] doubleValue];
+    AVAudioFormat* format = [[AVAudioFormat alloc] initStandardFormatWithSampleRate:sampleRate channels:2];
+    AVAudioPCMBuffer* buffer = [[AVAudioPCMBuffer alloc] initWithPCMFormat:format frameCapacity:frames];
+    buffer.frameLength = frames;
+    for (AVAudioFrameCount i = 0; i < frames; i++) {
+        float s = (float) (0.5 * sin(2.0 * M_PI * 440.0 * i / sampleRate));
+        buffer.floatChannelData[0][i] = s;
+        buffer.floatChannelData[1][i] = s;
+    }
+
+    @autoreleasepool {
+        NSError* error = nil;
+        AVAudioFile* file = [[AVAudioFile alloc] initForWriting:url
+                                                       settings:settings
+                                                   commonFormat:AVAudioPCMFormatFloat32
+                                                    interleaved:NO
+                                                          error:&error];
+        XCTAssertNotNil(file, @"%@", error);
+        XCTAssertTrue([file writeFromBuffer:buffer error:&error], @"%@", error);
+        // The file gets finalized when released.
+        file = nil;
+    }
+    return url;
+}
+
+- (AVAudioFramePosition)decodedLengthOfURL:(NSURL*)url
+{
+    AVAudioFile* file = [[AVAudioFile alloc] initForReading:url error:nil];
+    return file.length;
+}
+
+#pragma mark - Synthetic MPEG audio
+
+/// MPEG-1 layer III, 128 kbit/s, 44.1 kHz, stereo -- 417 bytes per frame.
+static const uint8_t kMPEG1Header[4] = {0xFF, 0xFB, 0x90, 0x00};
+static const size_t kMPEG1FrameLength = 417;
+/// MPEG-2 layer III, 64 kbit/s, 22.05 kHz, stereo -- 208 bytes per frame.
+static const uint8_t kMPEG2Header[4] = {0xFF, 0xF3, 0x80, 0x00};
+static const size_t kMPEG2FrameLength = 208;
+
+- (void)appendFrames:(NSUInteger)count header:(const uint8_t*)header length:(size_t)length to:(NSMutableData*)data
+{
+    NSMutableData* frame = [NSMutableData dataWithLength:length];
+    memcpy(frame.mutableBytes, header, 4);
+    for (NSUInteger i = 0; i < count; i++) {
+        [data appendData:frame];
+    }
+}
+
+- (void)appendID3TagTo:(NSMutableData*)data
+{
+    const uint8_t tag[10] = {'I', 'D', '3', 4, 0, 0, 0, 0, 0x01, 0x00};
+    [data appendBytes:tag length:sizeof(tag)];
+    [data increaseLengthBy:128];
+}
+
+static void writeBE32(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t) (value >> 24);
+    p[1] = (uint8_t) (value >> 16);
+    p[2] = (uint8_t) (value >> 8);
+    p[3] = (uint8_t) value;
+}
+
+- (NSData*)xingFrameWithFrames:(uint32_t)frames delay:(uint16_t)delay padding:(uint16_t)padding
+{
+    NSMutableData* frame = [NSMutableData dataWithLength:kMPEG1FrameLength];
+    uint8_t* p = frame.mutableBytes;
+    memcpy(p, kMPEG1Header, 4);
+    uint8_t* xing = p + 4 + 32;
+    memcpy(xing, "Info", 4);
+    // Frames, bytes, TOC and quality present.
+    writeBE32(xing + 4, 0x0F);
+    writeBE32(xing + 8, frames);
+    writeBE32(xing + 12, (uint32_t) (frames * kMPEG1FrameLength));
+    uint8_t* lame = xing + 8 + 4 + 4 + 100 + 4;
+    memcpy(lame, "LAME3.100", 9);
+    lame[21] = (uint8_t) (delay >> 4);
+    lame[22] = (uint8_t) (((delay & 0x0F) << 4) | (padding >> 8));
+    lame[23] = (uint8_t) (padding & 0xFF);
+    return frame;
+}
+
+#pragma mark - Tests
+
+- (void)testPCMWave
+{
+    const AVAudioFrameCount frames = 44100 * 3 + 123;
+    NSURL* url = [self writeFileWithExtension:@"wav"
+                                     settings:@{AVFormatIDKey : @(kAudioFormatLinearPCM),
+                                                AVSampleRateKey : @44100.0,
+                                                AVNumberOfChannelsKey : @2,
+                                                AVLinearPCMBitDepthKey : @16,
+                                                AVLinearPCMIsFloatKey : @NO,
+                                                AVLinearPCMIsBigEndianKey : @NO}
+                                       frames:frames];
+    NSError* error = nil;
+    AudioDuration* duration = [AudioDuration durationOfURL:url error:&error];
+    XCTAssertNotNil(duration, @"%@", error);
+    XCTAssertEqual(duration.source, AudioDurationSourceWAVEFormat);
+    XCTAssertEqual(duration.frames, (unsigned long long) frames);
+    XCTAssertEqual(duration.sampleRate, 44100.0);
+    XCTAssertEqualWithAccuracy(duration.milliseconds, frames * 1000.0 / 44100.0, 0.001);
+}
+
+- (void)testFloatWave
+{
+    const AVAudioFrameCount frames = 48000 * 2 + 7;
+    NSURL* url = [self writeFileWithExtension:@"wav"
+                                     settings:@{AVFormatIDKey : @(kAudioFormatLinearPCM),
+                                                AVSampleRateKey : @48000.0,
+                                                AVNumberOfChannelsKey : @2,
+                                                AVLinearPCMBitDepthKey : @32,
+                                                AVLinearPCMIsFloatKey : @YES,
+                                                AVLinearPCMIsBigEndianKey : @NO}
+                                       frames:frames];
+    AudioDuration* duration = [AudioDuration durationOfURL:url error:nil];
+    XCTAssertEqual(duration.frames, (unsigned long long) frames);
+    XCTAssertEqual(duration.sampleRate, 48000.0);
+}
+
+- (void)testAIFF
+{
+    const AVAudioFrameCount frames = 96000 + 1;
+    NSURL* url = [self writeFileWithExtension:@"aif"
+                                     settings:@{AVFormatIDKey : @(kAudioFormatLinearPCM),
+                                                AVSampleRateKey : @96000.0,
+                                                AVNumberOfChannelsKey : @2,
+                                                AVLinearPCMBitDepthKey : @24,
+                                                AVLinearPCMIsFloatKey : @NO,
+                                                AVLinearPCMIsBigEndianKey : @YES}
+                                       frames:frames];
+    AudioDuration* duration = [AudioDuration durationOfURL:url error:nil];
+    XCTAssertEqual(duration.source, AudioDurationSourceAIFFCommon);
+    XCTAssertEqual(duration.frames, (unsigned long long) frames);
+    XCTAssertEqual(duration.sampleRate, 96000.0);
+}
+
+- (void)testAACMatchesDecodedLength
+{
+    NSURL* url = [self writeFileWithExtension:@"m4a"
+                                     settings:@{AVFormatIDKey : @(kAudioFormatMPEG4AAC),
+                                                AVSampleRateKey : @44100.0,
+                                                AVNumberOfChannelsKey : @2,
+                                                AVEncoderBitRateKey : @128000}
+                                       frames:44100 * 4 + 333];
+    NSError* error = nil;
+    AudioDuration* duration = [AudioDuration durationOfURL:url error:&error];
+    XCTAssertNotNil(duration, @"%@", error);
+    XCTAssertEqual(duration.source, AudioDurationSourceMP4SampleTable);
+    XCTAssertEqual(duration.sampleRate, 44100.0);
+    // Priming and remainder get trimmed by the edit list, just like decoders do.
+    XCTAssertEqualWithAccuracy((double) duration.frames, (double) [self decodedLengthOfURL:url], 1.0);
+}
+
+- (void)testALACMatchesDecodedLength
+{
+    NSURL* url = [self writeFileWithExtension:@"m4a"
+                                     settings:@{AVFormatIDKey : @(kAudioFormatAppleLossless),
+                                                AVSampleRateKey : @48000.0,
+                                                AVNumberOfChannelsKey : @2,
+                                                AVEncoderBitDepthHintKey : @16}
+                                       frames:48000 * 3 + 5];
+    AudioDuration* duration = [AudioDuration durationOfURL:url error:nil];
+    XCTAssertNotNil(duration);
+    XCTAssertEqual(duration.sampleRate, 48000.0);
+    XCTAssertEqualWithAccuracy((double) duration.frames, (double) [self decodedLengthOfURL:url], 1.0);
+}
+
+- (void)testMP3XingWithLAMEGaplessInfo
+{
+    NSMutableData* data = [NSMutableData data];
+    [self appendID3TagTo:data];
+    [data appendData:[self xingFrameWithFrames:1000 delay:576 padding:1200]];
+    [self appendFrames:1000 header:kMPEG1Header length:kMPEG1FrameLength to:data];
+
+    NSError* error = nil;
+    AudioDuration* duration = [AudioDuration durationOfData:data error:&error];
+    XCTAssertNotNil(duration, @"%@", error);
+    XCTAssertEqual(duration.source, AudioDurationSourceXingHeader);
+    XCTAssertEqual(duration.frames, 1000ULL * 1152 - 576 - 1200);
+    XCTAssertEqual(duration.sampleRate, 44100.0);
+}
+
+- (void)testMP3VBRI
+{
+    NSMutableData* data = [NSMutableData data];
+    NSMutableData* first = [NSMutableData dataWithLength:kMPEG1FrameLength];
+    uint8_t* p = first.mutableBytes;
+    memcpy(p, kMPEG1Header, 4);
+    memcpy(p + 36, "VBRI", 4);
+    writeBE32(p + 36 + 14, 750);
+    [data appendData:first];
+    [self appendFrames:750 header:kMPEG1Header length:kMPEG1FrameLength to:data];
+
+    AudioDuration* duration = [AudioDuration durationOfData:data error:nil];
+    XCTAssertEqual(duration.source, AudioDurationSourceVBRIHeader);
+    XCTAssertEqual(duration.frames, 750ULL * 1152);
+}
+
+- (void)testMP3FrameScan
+{
+    NSMutableData* data = [NSMutableData data];
+    [self appendID3TagTo:data];
+    [self appendFrames:300 header:kMPEG1Header length:kMPEG1FrameLength to:data];
+    // Junk between frames needs a resync.
+    [data increaseLengthBy:57];
+    [self appendFrames:200 header:kMPEG1Header length:kMPEG1FrameLength to:data];
+    // ID3v1 trailer.
+    NSMutableData* trailer = [NSMutableData dataWithLength:128];
+    memcpy(trailer.mutableBytes, "TAG", 3);
+    [data appendData:trailer];
+
+    AudioDuration* duration = [AudioDuration durationOfData:data error:nil];
+    XCTAssertEqual(duration.source, AudioDurationSourceFrameScan);
+    XCTAssertEqual(duration.frames, 500ULL * 1152);
+}
+
+- (void)testMPEG2FrameScan
+{
+    NSMutableData* data = [NSMutableData data];
+    [self appendFrames:400 header:kMPEG2Header length:kMPEG2FrameLength to:data];
+
+    AudioDuration* duration = [AudioDuration durationOfData:data error:nil];
+    XCTAssertEqual(duration.frames, 400ULL * 576);
+    XCTAssertEqual(duration.sampleRate, 22050.0);
+}
+
+- (void)testUnknownContainer
+{
+    NSMutableData* data = [NSMutableData dataWithLength:1024];
+    NSError* error = nil;
+    XCTAssertNil([AudioDuration durationOfData:data error:&error]);
+    XCTAssertEqualObjects(error.domain, AudioDurationErrorDomain);
+    XCTAssertEqual(error.code, AudioDurationErrorUnsupported);
+}
+
+@end
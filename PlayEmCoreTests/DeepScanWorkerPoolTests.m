@@ -0,0 +1,197 @@
+//
+//  DeepScanWorkerPoolTests.m
+//  PlayEmCoreTests
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <stdatomic.h>
+
+#import "DeepScanWorkerPool.h"
+#import "LibraryStore.h"
+#import "MediaMetaData.h"
+
+/// Files that do not exist cost the pool's base estimate of 32 MB each.
+static const unsigned long long kMissingFileCost = 32ULL * 1024ULL * 1024ULL;
+
+@interface DeepScanWorkerPoolTests : XCTestCase
+@end
+
+@implementation DeepScanWorkerPoolTests
+
+- (LibraryStore*)storeWithQueuedTracks:(NSUInteger)count
+{
+    NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"playem_workerpool_%@.sqlite", [NSUUID UUID].UUIDString]];
+    [self addTeardownBlock:^{
+        for (NSString* suffix in @[ @"", @"-wal", @"-shm" ]) {
+            [[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:suffix] error:nil];
+        }
+    }];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:[NSURL fileURLWithPath:path]];
+
+    NSMutableArray<MediaMetaData*>* metas = [NSMutableArray array];
+    for (NSUInteger i = 0; i < count; i++) {
+        MediaMetaData* meta = [MediaMetaData new];
+        meta.location = [NSURL fileURLWithPath:[NSString stringWithFormat:@"/tmp/playem_pool_missing%lu.mp3", (unsigned long) i]];
+        meta.title = [NSString stringWithFormat:@"Title %lu", (unsigned long) i];
+        meta.artist = @"Artist";
+        [metas addObject:meta];
+    }
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:metas error:&error], @"import failed: %@", error);
+    XCTAssertEqual([store deepScanOutstandingCount:&error], (NSInteger) count);
+    return store;
+}
+
+- (void)waitForPool:(DeepScanWorkerPool*)pool condition:(BOOL (^)(DeepScanWorkerPool* pool))condition timeout:(NSTimeInterval)timeout
+{
+    XCTNSPredicateExpectation* expectation = [[XCTNSPredicateExpectation alloc] initWithPredicate:[NSPredicate predicateWithBlock:^BOOL(id object, NSDictionary* bindings) {
+                                                                                       return condition(pool);
+                                                                                   }]
+                                                                                           object:nil];
+    [self waitForExpectations:@[ expectation ] timeout:timeout];
+}
+
+- (void)testRunningScansStayWithinWorkerCount
+{
+    const NSUInteger tracks = 12;
+    LibraryStore* store = [self storeWithQueuedTracks:tracks];
+
+    __block atomic_int running = 0;
+    __block atomic_int peak = 0;
+    DeepScanWorkerPool* pool = [[DeepScanWorkerPool alloc] initWithStore:store
+                                                             workerCount:3
+                                                            memoryBudget:tracks * kMissingFileCost
+                                                             workHandler:^BOOL(DeepScanJob* job) {
+                                                                 int now = atomic_fetch_add(&running, 1) + 1;
+                                                                 int seen = atomic_load(&peak);
+                                                                 while (now > seen && !atomic_compare_exchange_weak(&peak, &seen, now)) {
+                                                                 }
+                                                                 [NSThread sleepForTimeInterval:0.05];
+                                                                 atomic_fetch_sub(&running, 1);
+                                                                 return [store completeDeepScanForURL:job.url duration:nil tempo:@120.0 key:@"8A" error:nil];
+                                                             }];
+    [pool start];
+    [self waitForPool:pool
+            condition:^BOOL(DeepScanWorkerPool* pool) {
+                return pool.completedCount == tracks;
+            }
+              timeout:30];
+    [pool stop];
+
+    XCTAssertLessThanOrEqual(atomic_load(&peak), 3);
+    XCTAssertGreaterThan(atomic_load(&peak), 1, @"Scans should run side by side");
+    XCTAssertEqual(pool.failedCount, 0u);
+}
+
+- (void)testMemoryBudgetLimitsRunningScans
+{
+    const NSUInteger tracks = 8;
+    LibraryStore* store = [self storeWithQueuedTracks:tracks];
+
+    __block atomic_int running = 0;
+    __block atomic_int peak = 0;
+    DeepScanWorkerPool* pool = [[DeepScanWorkerPool alloc] initWithStore:store
+                                                             workerCount:4
+                                                            memoryBudget:2 * kMissingFileCost
+                                                             workHandler:^BOOL(DeepScanJob* job) {
+                                                                 int now = atomic_fetch_add(&running, 1) + 1;
+                                                                 int seen = atomic_load(&peak);
+                                                                 while (now > seen && !atomic_compare_exchange_weak(&peak, &seen, now)) {
+                                                                 }
+                                                                 [NSThread sleepForTimeInterval:0.05];
+                                                                 atomic_fetch_sub(&running, 1);
+                                                                 return [store completeDeepScanForURL:job.url duration:nil tempo:@120.0 key:@"8A" error:nil];
+                                                             }];
+    [pool start];
+    [self waitForPool:pool
+            condition:^BOOL(DeepScanWorkerPool* pool) {
+                return pool.completedCount == tracks;
+            }
+              timeout:30];
+    [pool stop];
+
+    XCTAssertLessThanOrEqual(atomic_load(&peak), 2, @"Only two scans fit into the budget");
+    XCTAssertEqual(pool.memoryInUse, 0u);
+}
+
+- (void)testStopLeavesUnclaimedURLsQueued
+{
+    const NSUInteger tracks = 6;
+    LibraryStore* store = [self storeWithQueuedTracks:tracks];
+
+    dispatch_semaphore_t release = dispatch_semaphore_create(0);
+    DeepScanWorkerPool* pool = [[DeepScanWorkerPool alloc] initWithStore:store
+                                                             workerCount:2
+                                                            memoryBudget:tracks * kMissingFileCost
+                                                             workHandler:^BOOL(DeepScanJob* job) {
+                                                                 dispatch_semaphore_wait(release, DISPATCH_TIME_FOREVER);
+                                                                 return [store completeDeepScanForURL:job.url duration:nil tempo:@120.0 key:@"8A" error:nil];
+                                                             }];
+    [pool start];
+    [self waitForPool:pool
+            condition:^BOOL(DeepScanWorkerPool* pool) {
+                return pool.activeCount == 2;
+            }
+              timeout:10];
+
+    [pool stop];
+    // Running scans complete after a stop.
+    dispatch_semaphore_signal(release);
+    dispatch_semaphore_signal(release);
+    [self waitForPool:pool
+            condition:^BOOL(DeepScanWorkerPool* pool) {
+                return pool.completedCount == 2 && pool.activeCount == 0;
+            }
+              timeout:10];
+
+    // Give a dispatcher that did not stop the chance to claim more.
+    [NSThread sleepForTimeInterval:0.5];
+    XCTAssertEqual(pool.completedCount, 2u, @"Nothing gets claimed after a stop");
+    NSError* error = nil;
+    XCTAssertEqual([store deepScanOutstandingCount:&error], (NSInteger) tracks - 2);
+    XCTAssertEqual(pool.queueDepth, (NSInteger) tracks - 2);
+}
+
+- (void)testPausedPoolDrainsOnceResumed
+{
+    const NSUInteger tracks = 10;
+    LibraryStore* store = [self storeWithQueuedTracks:tracks];
+
+    __block atomic_int calls = 0;
+    DeepScanWorkerPool* pool = [[DeepScanWorkerPool alloc] initWithStore:store
+                                                             workerCount:2
+                                                            memoryBudget:tracks * kMissingFileCost
+                                                             workHandler:^BOOL(DeepScanJob* job) {
+                                                                 atomic_fetch_add(&calls, 1);
+                                                                 // Two of the scans fail; those count as drained too.
+                                                                 if ([job.url.lastPathComponent hasSuffix:@"1.mp3"] || [job.url.lastPathComponent hasSuffix:@"3.mp3"]) {
+                                                                     [store markDeepScanFailedForURL:job.url reason:@"test" error:nil];
+                                                                     return NO;
+                                                                 }
+                                                                 return [store completeDeepScanForURL:job.url duration:nil tempo:@120.0 key:@"8A" error:nil];
+                                                             }];
+    pool.paused = YES;
+    [pool start];
+    [NSThread sleepForTimeInterval:0.3];
+    XCTAssertEqual(atomic_load(&calls), 0, @"A paused pool starts nothing");
+
+    pool.paused = NO;
+    [self waitForPool:pool
+            condition:^BOOL(DeepScanWorkerPool* pool) {
+                return pool.completedCount + pool.failedCount == tracks;
+            }
+              timeout:30];
+    [pool stop];
+
+    XCTAssertEqual(atomic_load(&calls), (int) tracks, @"Every URL gets scanned exactly once");
+    XCTAssertEqual(pool.failedCount, 2u);
+    XCTAssertEqualWithAccuracy(pool.throughput, (double) (tracks - 2), 0.001, @"Failed scans should not count as throughput");
+    XCTAssertEqual(pool.queueDepth, 0);
+    XCTAssertEqual(pool.activeCount, 0u);
+    XCTAssertEqual(pool.suspendedCount, 0u);
+}
+
+@end
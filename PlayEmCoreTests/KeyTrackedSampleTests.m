@@ -0,0 +1,108 @@
+//
+//  KeyTrackedSampleTests.m
+//  PlayEmCoreTests
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "KeyTrackedSample.h"
+#import "MediaMetaData.h"
+#import "MockLazySample.h"
+#import "TimedMediaMetaData.h"
+#import "TrackList.h"
+
+@interface KeyTrackedSampleTests : XCTestCase
+@end
+
+@implementation KeyTrackedSampleTests
+
+/// Key tracker holding the given timeline, one segment per key of
+/// `frames` frames each.
+- (KeyTrackedSample*)keySampleWithKeys:(NSArray<NSString*>*)keys frames:(unsigned long long)frames
+{
+    NSMutableArray<KeySegment*>* segments = [NSMutableArray array];
+    for (NSUInteger index = 0; index < keys.count; index++) {
+        KeySegment* segment = [KeySegment new];
+        segment.frame = index * frames;
+        segment.frames = frames;
+        segment.key = keys[index];
+        segment.hint = @"";
+        [segments addObject:segment];
+    }
+    KeyTrackedSample* keySample = [[KeyTrackedSample alloc] initWithSample:[[MockLazySample alloc] initWithChannels:2]];
+    // Set as segmented tracking would.
+    [keySample setValue:segments forKey:@"segments"];
+    return keySample;
+}
+
+- (TimedMediaMetaData*)trackAtFrame:(unsigned long long)frame
+{
+    TimedMediaMetaData* track = [TimedMediaMetaData new];
+    track.frame = @(frame);
+    track.meta = [MediaMetaData new];
+    return track;
+}
+
+- (void)testTracksGetTheKeyCoveringMostOfThem
+{
+    KeyTrackedSample* keySample = [self keySampleWithKeys:@[ @"8A", @"9A", @"9A", @"1B" ] frames:1000];
+
+    TrackList* trackList = [TrackList new];
+    // Added out of order; each track runs up to the next one.
+    TimedMediaMetaData* third = [self trackAtFrame:3600];
+    TimedMediaMetaData* first = [self trackAtFrame:0];
+    TimedMediaMetaData* second = [self trackAtFrame:1200];
+    [trackList addTrack:third];
+    [trackList addTrack:first];
+    [trackList addTrack:second];
+
+    XCTAssertEqual([keySample applyKeysToTrackList:trackList frames:4000], 3u);
+    // 1000 frames of 8A against 200 of 9A.
+    XCTAssertEqualObjects(first.meta.key, @"8A");
+    // 1800 frames of 9A against 600 of 1B.
+    XCTAssertEqualObjects(second.meta.key, @"9A");
+    // The last track ends with the sample.
+    XCTAssertEqualObjects(third.meta.key, @"1B");
+}
+
+- (void)testTrackBoundariesAreRespected
+{
+    KeyTrackedSample* keySample = [self keySampleWithKeys:@[ @"8A", @"9A", @"1B" ] frames:1000];
+
+    TrackList* trackList = [TrackList new];
+    // Ends early, right at a segment boundary, so the segment after it counts for nothing.
+    TimedMediaMetaData* ending = [self trackAtFrame:500];
+    ending.endFrame = @1000;
+    // Already has a key that stays.
+    TimedMediaMetaData* keyed = [self trackAtFrame:1000];
+    keyed.meta.key = @"12B";
+    // Starts right at a boundary.
+    TimedMediaMetaData* boundary = [self trackAtFrame:2000];
+    // Starts past the end of the sample.
+    TimedMediaMetaData* beyond = [self trackAtFrame:5000];
+    for (TimedMediaMetaData* track in @[ ending, keyed, boundary, beyond ]) {
+        [trackList addTrack:track];
+    }
+
+    XCTAssertEqual([keySample applyKeysToTrackList:trackList frames:3000], 2u);
+    XCTAssertEqualObjects(ending.meta.key, @"8A");
+    XCTAssertEqualObjects(keyed.meta.key, @"12B");
+    XCTAssertEqualObjects(boundary.meta.key, @"1B");
+    XCTAssertNil(beyond.meta.key);
+}
+
+- (void)testUnsegmentedTrackingLeavesTracksAlone
+{
+    KeyTrackedSample* keySample = [[KeyTrackedSample alloc] initWithSample:[[MockLazySample alloc] initWithChannels:2]];
+    TrackList* trackList = [TrackList new];
+    TimedMediaMetaData* track = [self trackAtFrame:0];
+    [trackList addTrack:track];
+
+    XCTAssertEqual([keySample applyKeysToTrackList:trackList frames:4000], 0u);
+    XCTAssertNil(track.meta.key);
+}
+
+@end
@@ -0,0 +1,143 @@
+//
+//  LazySampleTests.m
+//  PlayEmCoreTests
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "MockLazySample.h"
+
+static const unsigned long long kPageFrames = 16384;
+
+@interface LazySampleTests : XCTestCase
+@end
+
+@implementation LazySampleTests
+
+/// Stereo sample of `pages` pages, every frame of a page holding the page index.
+- (MockLazySample*)sampleWithPages:(unsigned long long)pages discarding:(BOOL)discarding
+{
+    MockLazySample* sample = [[MockLazySample alloc] initWithChannels:2];
+    sample.discardsConsumedPages = discarding;
+    [sample setRenderedLength:pages * kPageFrames];
+    return sample;
+}
+
+- (void)addPage:(unsigned long long)index toSample:(LazySample*)sample
+{
+    NSMutableData* data = [NSMutableData dataWithLength:kPageFrames * sizeof(float)];
+    float* frames = (float*) data.mutableBytes;
+    for (unsigned long long frame = 0; frame < kPageFrames; frame++) {
+        frames[frame] = (float) index;
+    }
+    [sample addLazyPageIndex:index channels:@[ data, [data copy] ]];
+}
+
+/// Reads a page worth of frames; returns the frames received and the value of
+/// the first one.
+- (unsigned long long)readPage:(unsigned long long)index fromSample:(LazySample*)sample value:(float*)value
+{
+    NSMutableData* left = [NSMutableData dataWithLength:kPageFrames * sizeof(float)];
+    NSMutableData* right = [NSMutableData dataWithLength:kPageFrames * sizeof(float)];
+    float* outputs[2] = {(float*) left.mutableBytes, (float*) right.mutableBytes};
+    unsigned long long received = [sample rawSampleFromFrameOffset:index * kPageFrames frames:kPageFrames outputs:outputs];
+    if (value != NULL) {
+        *value = received > 0 ? outputs[1][0] : -1.0f;
+    }
+    return received;
+}
+
+- (void)testRegisteredReaderKeepsPagesFromItsPosition
+{
+    MockLazySample* sample = [self sampleWithPages:4 discarding:YES];
+    NSUInteger reader = [sample addReaderAtFrame:kPageFrames];
+    for (unsigned long long index = 0; index < 4; index++) {
+        [self addPage:index toSample:sample];
+    }
+    [sample markDecodingComplete];
+
+    float value = 0.0f;
+    XCTAssertEqual([self readPage:1 fromSample:sample value:&value], kPageFrames);
+    XCTAssertEqual(value, 1.0f);
+    XCTAssertEqual([self readPage:3 fromSample:sample value:&value], kPageFrames);
+    XCTAssertEqual(value, 3.0f);
+    XCTAssertEqual(sample.decodedFrames, 4 * kPageFrames);
+
+    [sample removeReader:reader];
+}
+
+- (void)testAdvancingReadersDiscardsConsumedPages
+{
+    MockLazySample* sample = [self sampleWithPages:4 discarding:YES];
+    NSUInteger slow = [sample addReaderAtFrame:0];
+    NSUInteger fast = [sample addReaderAtFrame:0];
+    for (unsigned long long index = 0; index < 4; index++) {
+        [self addPage:index toSample:sample];
+    }
+    [sample markDecodingComplete];
+
+    // The slower reader still holds everything.
+    [sample advanceReader:fast toFrame:3 * kPageFrames];
+    XCTAssertEqual([self readPage:0 fromSample:sample value:NULL], kPageFrames);
+
+    // A position within a page keeps that page.
+    [sample advanceReader:slow toFrame:2 * kPageFrames + 100];
+    XCTAssertEqual([self readPage:1 fromSample:sample value:NULL], 0u);
+    float value = 0.0f;
+    XCTAssertEqual([self readPage:2 fromSample:sample value:&value], kPageFrames);
+    XCTAssertEqual(value, 2.0f);
+
+    [sample removeReader:slow];
+    XCTAssertEqual([self readPage:2 fromSample:sample value:NULL], 0u, @"Removing the slowest reader releases its pages");
+    XCTAssertEqual([self readPage:3 fromSample:sample value:&value], kPageFrames);
+    XCTAssertEqual(value, 3.0f);
+
+    [sample removeReader:fast];
+}
+
+- (void)testReadingDiscardedPagesReturnsShortWithoutBlocking
+{
+    MockLazySample* sample = [self sampleWithPages:3 discarding:YES];
+    NSUInteger reader = [sample addReaderAtFrame:0];
+    for (unsigned long long index = 0; index < 3; index++) {
+        [self addPage:index toSample:sample];
+    }
+    [sample advanceReader:reader toFrame:2 * kPageFrames];
+
+    // Decoding is not complete, so only the discard tells a reader to stop.
+    XCTAssertEqual([self readPage:0 fromSample:sample value:NULL], 0u);
+
+    // Starting in a discarded page, reaching into a kept one does not help.
+    NSMutableData* left = [NSMutableData dataWithLength:2 * kPageFrames * sizeof(float)];
+    NSMutableData* right = [NSMutableData dataWithLength:2 * kPageFrames * sizeof(float)];
+    float* outputs[2] = {(float*) left.mutableBytes, (float*) right.mutableBytes};
+    XCTAssertEqual([sample rawSampleFromFrameOffset:kPageFrames + 10 frames:kPageFrames outputs:outputs], 0u);
+
+    [sample removeReader:reader];
+    [sample markDecodingComplete];
+}
+
+- (void)testWithoutReadersOnlyTheRetainingSampleKeepsItsPages
+{
+    MockLazySample* discarding = [self sampleWithPages:2 discarding:YES];
+    MockLazySample* retaining = [self sampleWithPages:2 discarding:NO];
+    for (unsigned long long index = 0; index < 2; index++) {
+        [self addPage:index toSample:discarding];
+        [self addPage:index toSample:retaining];
+    }
+    [discarding markDecodingComplete];
+    [retaining markDecodingComplete];
+
+    XCTAssertEqual([self readPage:0 fromSample:discarding value:NULL], 0u, @"Pages without a reader are of no use");
+    XCTAssertEqual(discarding.decodedFrames, 2 * kPageFrames);
+
+    NSUInteger reader = [retaining addReaderAtFrame:0];
+    [retaining advanceReader:reader toFrame:2 * kPageFrames];
+    XCTAssertEqual([self readPage:0 fromSample:retaining value:NULL], kPageFrames);
+    [retaining removeReader:reader];
+}
+
+@end
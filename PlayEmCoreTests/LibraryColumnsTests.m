@@ -0,0 +1,265 @@
+//
+//  LibraryColumnsTests.m
+//  PlayEmCoreTests
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#include <malloc/malloc.h>
+
+#import "LibraryColumns.h"
+#import "LibraryFilter.h"
+#import "MediaMetaData.h"
+
+@interface LibraryColumnsTests : XCTestCase
+@end
+
+@implementation LibraryColumnsTests
+
+- (NSArray<MediaMetaData*>*)syntheticLibrary:(NSUInteger)count
+{
+    NSArray<NSString*>* genres = @[ @"House", @"Techno", @"Jazz", @"Soul", @"Disco", @"Ambient", @"Électronique" ];
+    NSArray<NSString*>* keys = @[ @"1A", @"2A", @"8B", @"11B", @"12A" ];
+    NSMutableArray<MediaMetaData*>* items = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        MediaMetaData* meta = [MediaMetaData new];
+        meta.location = [NSURL fileURLWithPath:[NSString stringWithFormat:@"/tmp/columns/%lu.mp3", (unsigned long) i]];
+        meta.title = [NSString stringWithFormat:@"Track %lu", (unsigned long) i];
+        meta.artist = [NSString stringWithFormat:@"Artist %lu", (unsigned long) ((i * 7919) % (count / 10 + 1))];
+        meta.album = [NSString stringWithFormat:@"Album %lu", (unsigned long) (i / 12)];
+        meta.genre = (i % 17 == 0) ? nil : genres[i % genres.count];
+        meta.key = keys[(i / 3) % keys.count];
+        meta.tempo = @(90 + i % 50);
+        meta.year = @(1970 + i % 55);
+        meta.rating = @((i % 6) * 20);
+        meta.tags = (i % 4 == 0) ? @"#warmup#vinyl" : (i % 4 == 1) ? @"#peak" : nil;
+        [items addObject:meta];
+    }
+    return items;
+}
+
+- (NSArray<MediaMetaData*>*)items:(NSArray<MediaMetaData*>*)items stablySortedUsingDescriptors:(NSArray<NSSortDescriptor*>*)descriptors
+{
+    return [items sortedArrayWithOptions:NSSortStable
+                         usingComparator:^NSComparisonResult(MediaMetaData* a, MediaMetaData* b) {
+                             for (NSSortDescriptor* descriptor in descriptors) {
+                                 NSComparisonResult result = [descriptor compareObject:a toObject:b];
+                                 if (result != NSOrderedSame) {
+                                     return result;
+                                 }
+                             }
+                             return NSOrderedSame;
+                         }];
+}
+
+- (void)testRowsMatchWhatTheFilterFinds
+{
+    NSArray<MediaMetaData*>* library = [self syntheticLibrary:3000];
+    LibraryColumns* columns = [[LibraryColumns alloc] initWithItems:library];
+
+    LibraryFilter* filter = [LibraryFilter new];
+    filter.genre = @"House";
+    filter.key = @"8B";
+    filter.tag = @"vinyl";
+    NSIndexSet* rows = [columns rowsMatchingValues:@{@(LibraryColumnGenre) : @"House", @(LibraryColumnKey) : @"8B", @(LibraryColumnTags) : @"vinyl"}];
+    NSArray<MediaMetaData*>* expected = [filter filterItems:library operation:nil firstMatchCount:0 firstMatches:nil];
+    XCTAssertGreaterThan(expected.count, 0u);
+    XCTAssertEqualObjects([columns itemsAtRows:rows], expected);
+
+    XCTAssertEqual([columns rowsMatchingValues:@{@(LibraryColumnGenre) : @"Polka"}].count, 0u, @"Unknown values should match nothing");
+    XCTAssertEqual([columns rowsMatchingValues:@{}].count, library.count);
+}
+
+- (void)testValuesCountWhatTheItemsHold
+{
+    NSArray<MediaMetaData*>* library = [self syntheticLibrary:3000];
+    LibraryColumns* columns = [[LibraryColumns alloc] initWithItems:library];
+    NSArray<MediaMetaData*>* subset = [library subarrayWithRange:NSMakeRange(100, 500)];
+    NSIndexSet* rows = [columns rowsOfItems:subset];
+    XCTAssertEqual(rows.count, subset.count);
+
+    NSMutableDictionary<NSString*, NSNumber*>* artists = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSString*, NSNumber*>* tempos = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSString*, NSNumber*>* ratings = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSString*, NSNumber*>* tags = [NSMutableDictionary dictionary];
+    for (MediaMetaData* meta in subset) {
+        artists[meta.artist] = @(artists[meta.artist].unsignedIntegerValue + 1);
+        tempos[meta.tempo.stringValue] = @(tempos[meta.tempo.stringValue].unsignedIntegerValue + 1);
+        if (meta.rating.intValue > 0) {
+            ratings[meta.stars] = @(ratings[meta.stars].unsignedIntegerValue + 1);
+        }
+        if (meta.tags != nil) {
+            for (NSString* tag in [[meta.tags substringFromIndex:1] componentsSeparatedByString:@"#"]) {
+                tags[tag] = @(tags[tag].unsignedIntegerValue + 1);
+            }
+        }
+    }
+    XCTAssertEqualObjects([columns valuesOfColumn:LibraryColumnArtist rows:rows], artists);
+    XCTAssertEqualObjects([columns valuesOfColumn:LibraryColumnTempo rows:rows], tempos);
+    XCTAssertEqualObjects([columns valuesOfColumn:LibraryColumnRating rows:rows], ratings);
+    XCTAssertEqualObjects([columns valuesOfColumn:LibraryColumnTags rows:rows], tags);
+    XCTAssertEqual([columns valueCountOfColumn:LibraryColumnTags], 3u);
+
+    XCTAssertNil([columns rowsOfItems:@[ [MediaMetaData new] ]], @"Items outside of the snapshot have no rows");
+}
+
+- (void)testSortingMatchesSortingTheItems
+{
+    NSArray<MediaMetaData*>* library = [self syntheticLibrary:3000];
+    LibraryColumns* columns = [[LibraryColumns alloc] initWithItems:library];
+    NSIndexSet* rows = [columns rowsMatchingValues:@{@(LibraryColumnKey) : @"2A"}];
+    NSArray<MediaMetaData*>* items = [columns itemsAtRows:rows];
+
+    NSArray<NSSortDescriptor*>* descriptors = @[
+        [NSSortDescriptor sortDescriptorWithKey:@"genre" ascending:NO], [NSSortDescriptor sortDescriptorWithKey:@"artist" ascending:YES],
+        [NSSortDescriptor sortDescriptorWithKey:@"album" ascending:YES]
+    ];
+    NSArray<MediaMetaData*>* sorted = [columns itemsAtRows:rows sortedUsingDescriptors:descriptors];
+    XCTAssertEqualObjects(sorted, [self items:items stablySortedUsingDescriptors:descriptors]);
+
+    NSSortDescriptor* byBlock = [NSSortDescriptor sortDescriptorWithKey:@"artist"
+                                                               ascending:YES
+                                                              comparator:^NSComparisonResult(NSString* a, NSString* b) {
+                                                                  return [a compare:b];
+                                                              }];
+    XCTAssertNil([columns itemsAtRows:rows sortedUsingDescriptors:@[ byBlock ]], @"Comparator blocks cannot be ranked");
+}
+
+- (void)testSortingAgainMatchesSortingTheItems
+{
+    NSMutableArray<MediaMetaData*>* library = [[self syntheticLibrary:3000] mutableCopy];
+    // Titles comparing the same keep their order.
+    library[10].title = @"track 5";
+    library[20].title = @"TRACK 5";
+    library[30].title = nil;
+    LibraryColumns* columns = [[LibraryColumns alloc] initWithItems:library];
+    NSIndexSet* all = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, library.count)];
+    NSIndexSet* some = [columns rowsMatchingValues:@{@(LibraryColumnGenre) : @"Soul"}];
+
+    NSArray<NSArray<NSSortDescriptor*>*>* sorts = @[
+        @[ [NSSortDescriptor sortDescriptorWithKey:@"title" ascending:YES selector:@selector(localizedStandardCompare:)] ],
+        @[ [NSSortDescriptor sortDescriptorWithKey:@"title" ascending:NO selector:@selector(localizedStandardCompare:)] ],
+        @[
+            [NSSortDescriptor sortDescriptorWithKey:@"tempo" ascending:YES selector:@selector(compare:)],
+            [NSSortDescriptor sortDescriptorWithKey:@"key" ascending:YES selector:@selector(localizedStandardCompare:)]
+        ],
+        @[
+            [NSSortDescriptor sortDescriptorWithKey:@"tempo" ascending:NO selector:@selector(compare:)],
+            [NSSortDescriptor sortDescriptorWithKey:@"key" ascending:YES selector:@selector(localizedStandardCompare:)]
+        ],
+    ];
+    // Sorting all rows keeps the order; the other direction and the subset
+    // get picked from it.
+    for (NSArray<NSSortDescriptor*>* descriptors in sorts) {
+        XCTAssertEqualObjects([columns itemsAtRows:all sortedUsingDescriptors:descriptors], [self items:library stablySortedUsingDescriptors:descriptors]);
+        XCTAssertEqualObjects([columns itemsAtRows:some sortedUsingDescriptors:descriptors],
+                              [self items:[library objectsAtIndexes:some] stablySortedUsingDescriptors:descriptors]);
+    }
+}
+
+- (void)testFootprintAndSpeedOnLargeLibrary
+{
+#ifndef ENABLE_LIBRARY_COLUMNS_BENCH
+    XCTSkip(@"Library columns benchmark skipped unless ENABLE_LIBRARY_COLUMNS_BENCH is defined.");
+#else
+    const NSUInteger itemCount = 200000;
+    NSArray<MediaMetaData*>* library = [self syntheticLibrary:itemCount];
+
+    // What the strings columns get taken from occupy in the items.
+    size_t itemBytes = 0;
+    for (MediaMetaData* meta in library) {
+        for (NSString* value in @[ meta.genre ?: @"", meta.artist, meta.album, meta.key, meta.tags ?: @"" ]) {
+            itemBytes += malloc_size((__bridge const void*) value);
+        }
+        itemBytes += malloc_size((__bridge const void*) meta.tempo) + malloc_size((__bridge const void*) meta.year) +
+                     malloc_size((__bridge const void*) meta.rating);
+    }
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    LibraryColumns* columns = [[LibraryColumns alloc] initWithItems:library];
+    NSLog(@"library columns: %lu items taken in %.0fms, %.1fMB in columns against %.1fMB in the items",
+          (unsigned long) itemCount,
+          (CFAbsoluteTimeGetCurrent() - start) * 1000.0,
+          columns.footprint / 1048576.0,
+          itemBytes / 1048576.0);
+
+    LibraryFilter* filter = [LibraryFilter new];
+    filter.genre = @"Jazz";
+    filter.tag = @"vinyl";
+    start = CFAbsoluteTimeGetCurrent();
+    NSArray<MediaMetaData*>* walked = [filter filterItems:library operation:nil firstMatchCount:0 firstMatches:nil];
+    double walking = CFAbsoluteTimeGetCurrent() - start;
+    start = CFAbsoluteTimeGetCurrent();
+    NSIndexSet* rows = [columns rowsMatchingValues:@{@(LibraryColumnGenre) : @"Jazz", @(LibraryColumnTags) : @"vinyl"}];
+    double scanning = CFAbsoluteTimeGetCurrent() - start;
+    XCTAssertEqual(rows.count, walked.count);
+    NSLog(@"library columns: filter %.1fms walking items, %.1fms scanning columns", walking * 1000.0, scanning * 1000.0);
+
+    start = CFAbsoluteTimeGetCurrent();
+    NSMutableSet<NSString*>* artists = [NSMutableSet set];
+    for (MediaMetaData* meta in library) {
+        [artists addObject:meta.artist];
+    }
+    walking = CFAbsoluteTimeGetCurrent() - start;
+    start = CFAbsoluteTimeGetCurrent();
+    XCTAssertEqual([columns valuesOfColumn:LibraryColumnArtist rows:nil].count, artists.count);
+    scanning = CFAbsoluteTimeGetCurrent() - start;
+    NSLog(@"library columns: facet %.1fms walking items, %.1fms scanning columns", walking * 1000.0, scanning * 1000.0);
+
+    NSArray<NSSortDescriptor*>* descriptors =
+        @[ [NSSortDescriptor sortDescriptorWithKey:@"artist" ascending:YES], [NSSortDescriptor sortDescriptorWithKey:@"album" ascending:YES] ];
+    start = CFAbsoluteTimeGetCurrent();
+    NSArray<MediaMetaData*>* sorted = [library sortedArrayUsingDescriptors:descriptors];
+    walking = CFAbsoluteTimeGetCurrent() - start;
+    start = CFAbsoluteTimeGetCurrent();
+    XCTAssertEqualObjects([columns itemsAtRows:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, itemCount)] sortedUsingDescriptors:descriptors],
+                          sorted);
+    scanning = CFAbsoluteTimeGetCurrent() - start;
+    NSLog(@"library columns: sort %.0fms comparing items, %.0fms comparing ranks", walking * 1000.0, scanning * 1000.0);
+#endif
+}
+
+- (void)testSortingSpeedOnLargeLibrary
+{
+#ifndef ENABLE_LIBRARY_COLUMNS_BENCH
+    XCTSkip(@"Library columns benchmark skipped unless ENABLE_LIBRARY_COLUMNS_BENCH is defined.");
+#else
+    const NSUInteger itemCount = 100000;
+    NSArray<MediaMetaData*>* library = [self syntheticLibrary:itemCount];
+    LibraryColumns* columns = [[LibraryColumns alloc] initWithItems:library];
+    NSIndexSet* all = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, itemCount)];
+    NSIndexSet* some = [columns rowsMatchingValues:@{@(LibraryColumnGenre) : @"Jazz"}];
+    NSSortDescriptor* up = [NSSortDescriptor sortDescriptorWithKey:@"title" ascending:YES selector:@selector(localizedStandardCompare:)];
+    NSSortDescriptor* down = [NSSortDescriptor sortDescriptorWithKey:@"title" ascending:NO selector:@selector(localizedStandardCompare:)];
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    [library sortedArrayUsingDescriptors:@[ up ]];
+    [library sortedArrayUsingDescriptors:@[ down ]];
+    [[library objectsAtIndexes:some] sortedArrayUsingDescriptors:@[ down ]];
+    double comparing = CFAbsoluteTimeGetCurrent() - start;
+
+    start = CFAbsoluteTimeGetCurrent();
+    [columns itemsAtRows:all sortedUsingDescriptors:@[ up ]];
+    double first = CFAbsoluteTimeGetCurrent() - start;
+    start = CFAbsoluteTimeGetCurrent();
+    [columns itemsAtRows:all sortedUsingDescriptors:@[ down ]];
+    double toggled = CFAbsoluteTimeGetCurrent() - start;
+    start = CFAbsoluteTimeGetCurrent();
+    [columns itemsAtRows:some sortedUsingDescriptors:@[ down ]];
+    double refiltered = CFAbsoluteTimeGetCurrent() - start;
+
+    NSLog(@"library sort: %.0fms comparing items for sort, toggle and filter; "
+          @"%.0fms ranking and sorting, %.1fms toggling, %.1fms filtering %lu of %lu items",
+          comparing * 1000.0,
+          first * 1000.0,
+          toggled * 1000.0,
+          refiltered * 1000.0,
+          (unsigned long) some.count,
+          (unsigned long) itemCount);
+#endif
+}
+
+@end
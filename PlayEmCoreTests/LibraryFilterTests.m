@@ -0,0 +1,214 @@
+//
+//  LibraryFilterTests.m
+//  PlayEmCoreTests
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "CancelableBlockOperation.h"
+#import "LibraryFilter.h"
+#import "MediaMetaData.h"
+#import "MediaSearchKey.h"
+
+@interface LibraryFilterTests : XCTestCase
+@end
+
+@implementation LibraryFilterTests
+
+- (NSArray<MediaMetaData*>*)syntheticLibrary:(NSUInteger)count
+{
+    NSArray<NSString*>* words = @[ @"Daft", @"Punk", @"Über", @"night", @"Café", @"dream", @"Straße", @"pun", @"Señor", @"fire" ];
+    NSMutableArray<MediaMetaData*>* items = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        MediaMetaData* meta = [MediaMetaData new];
+        meta.location = [NSURL fileURLWithPath:[NSString stringWithFormat:@"/tmp/filter/%lu.mp3", (unsigned long) i]];
+        meta.title = [NSString stringWithFormat:@"%@ %@ %lu", words[i % words.count], words[(i / 7) % words.count], (unsigned long) i];
+        meta.artist = [NSString stringWithFormat:@"%@ %@", words[(i / 3) % words.count], words[(i / 13) % words.count]];
+        meta.album = [NSString stringWithFormat:@"Album %lu", (unsigned long) (i % 900)];
+        meta.genre = words[(i / 11) % words.count];
+        meta.tags = (i % 5 == 0) ? @"#house#daft" : nil;
+        meta.tempo = @(100 + i % 40);
+        [items addObject:meta];
+    }
+    return items;
+}
+
+- (LibraryFilter*)filterWithNeedle:(NSString*)needle
+{
+    LibraryFilter* filter = [LibraryFilter new];
+    filter.needle = needle;
+    return filter;
+}
+
+- (void)testNarrowingMatchesFilteringEverything
+{
+    NSArray<MediaMetaData*>* library = [self syntheticLibrary:5000];
+    NSString* typed = @"daft pun";
+    LibraryFilter* previous = [self filterWithNeedle:@""];
+    NSArray<MediaMetaData*>* narrowed = library;
+    for (NSUInteger length = 1; length <= typed.length; length++) {
+        LibraryFilter* filter = [self filterWithNeedle:[typed substringToIndex:length]];
+        XCTAssertTrue([filter narrows:previous]);
+        narrowed = [filter filterItems:narrowed operation:nil firstMatchCount:0 firstMatches:nil];
+        NSArray<MediaMetaData*>* everything = [filter filterItems:library operation:nil firstMatchCount:0 firstMatches:nil];
+        XCTAssertEqualObjects(narrowed, everything, @"Narrowing \"%@\" should find what filtering all does", filter.needle);
+        previous = filter;
+    }
+    XCTAssertGreaterThan(narrowed.count, 0u);
+    XCTAssertLessThan(narrowed.count, library.count);
+}
+
+- (void)testNarrowsOnlyExtendedNeedlesOfTheSameSelection
+{
+    LibraryFilter* daft = [self filterWithNeedle:@"daft"];
+    LibraryFilter* daftPunk = [self filterWithNeedle:@"daft punk"];
+    XCTAssertTrue([daftPunk narrows:daft]);
+    XCTAssertFalse([daft narrows:daftPunk], @"A shorter needle matches more");
+    XCTAssertFalse([[self filterWithNeedle:@"dafp"] narrows:daftPunk]);
+
+    daftPunk.genre = @"House";
+    XCTAssertFalse([daftPunk narrows:daft], @"Another selection filters other items");
+    daft.genre = @"House";
+    XCTAssertTrue([daftPunk narrows:daft]);
+}
+
+- (void)testFirstMatchesComeAheadOfTheRest
+{
+    NSArray<MediaMetaData*>* library = [self syntheticLibrary:5000];
+    LibraryFilter* filter = [self filterWithNeedle:@"night"];
+    __block NSArray<MediaMetaData*>* first = nil;
+    NSArray<MediaMetaData*>* all = [filter filterItems:library
+                                             operation:nil
+                                       firstMatchCount:20
+                                          firstMatches:^(NSArray<MediaMetaData*>* matches) {
+                                              XCTAssertNil(first, @"First matches should be reported once");
+                                              first = matches;
+                                          }];
+    XCTAssertEqual(first.count, 20u);
+    XCTAssertEqualObjects(first, [all subarrayWithRange:NSMakeRange(0, 20)]);
+}
+
+- (void)testCancelledFilterGivesNoResult
+{
+    NSArray<MediaMetaData*>* library = [self syntheticLibrary:5000];
+    CancelableBlockOperation* operation = [CancelableBlockOperation new];
+    [operation cancel];
+    XCTAssertNil([[self filterWithNeedle:@"daft"] filterItems:library operation:operation firstMatchCount:0 firstMatches:nil]);
+}
+
+- (void)testKeystrokeLatencyOnLargeLibrary
+{
+#ifndef ENABLE_LIBRARY_FILTER_BENCH
+    XCTSkip(@"Library filter benchmark skipped unless ENABLE_LIBRARY_FILTER_BENCH is defined.");
+#else
+    const NSUInteger itemCount = 100000;
+    NSArray<MediaMetaData*>* library = [self syntheticLibrary:itemCount];
+    NSArray<NSSortDescriptor*>* descriptors = @[ [NSSortDescriptor sortDescriptorWithKey:@"title" ascending:YES] ];
+
+    // The first keystroke filters everything, the ones after narrow down.
+    NSString* typed = @"daft pun";
+    LibraryFilter* previous = nil;
+    NSArray<MediaMetaData*>* result = nil;
+    double worst = 0.0;
+    double worstNarrowing = 0.0;
+    for (NSUInteger length = 1; length <= typed.length; length++) {
+        LibraryFilter* filter = [self filterWithNeedle:[typed substringToIndex:length]];
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        if (previous != nil && [filter narrows:previous]) {
+            result = [filter filterItems:result operation:nil firstMatchCount:0 firstMatches:nil];
+            worstNarrowing = MAX(worstNarrowing, CFAbsoluteTimeGetCurrent() - start);
+        } else {
+            result = [[filter filterItems:library operation:nil firstMatchCount:0 firstMatches:nil] sortedArrayUsingDescriptors:descriptors];
+        }
+        worst = MAX(worst, CFAbsoluteTimeGetCurrent() - start);
+        previous = filter;
+    }
+    NSLog(@"library filter: worst keystroke %.0fms, worst narrowing keystroke %.0fms on %lu items",
+          worst * 1000.0,
+          worstNarrowing * 1000.0,
+          (unsigned long) itemCount);
+
+    // A cancelled search stops within a cancel check interval.
+    CancelableBlockOperation* operation = [CancelableBlockOperation new];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (0.01 * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        [operation cancel];
+    });
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    XCTAssertNil([[self filterWithNeedle:@"d"] filterItems:library operation:operation firstMatchCount:0 firstMatches:nil]);
+    NSLog(@"library filter: cancelled after %.0fms", (CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+#endif
+}
+
+- (void)testSearchKeyFoldsTextAndFollowsChanges
+{
+    MediaMetaData* meta = [MediaMetaData new];
+    meta.title = @"Déjà Vu";
+    meta.artist = @"ＣＡＦＥ";
+    meta.tags = @"#house#deep";
+
+    MediaSearchKey* key = meta.searchKey;
+    XCTAssertTrue([key fieldsContainNeedle:[MediaSearchKey foldedNeedle:@"deja v" exact:NO] exact:NO]);
+    XCTAssertTrue([key fieldsContainNeedle:[MediaSearchKey foldedNeedle:@"cafe" exact:NO] exact:NO], @"Width should be folded");
+    XCTAssertTrue([key fieldsContainNeedle:[MediaSearchKey foldedNeedle:@"DÉJÀ" exact:YES] exact:YES]);
+    XCTAssertFalse([key fieldsContainNeedle:[MediaSearchKey foldedNeedle:@"dejà" exact:YES] exact:YES], @"Diacritics entered should match as entered");
+    XCTAssertFalse([key fieldsContainNeedle:[MediaSearchKey foldedNeedle:@"vucafe" exact:NO] exact:NO], @"Needles should not span fields");
+    XCTAssertTrue([key tagsContainNeedle:[MediaSearchKey foldedNeedle:@"dee" exact:NO] exact:NO]);
+    XCTAssertFalse([key fieldsContainNeedle:[MediaSearchKey foldedNeedle:@"house" exact:NO] exact:NO]);
+    XCTAssertEqualObjects(key.tagSet, ([NSSet setWithObjects:@"house", @"deep", nil]));
+    XCTAssertEqual(meta.searchKey, key, @"Keys should be built once");
+
+    meta.title = @"Night";
+    XCTAssertNotEqual(meta.searchKey, key, @"Changed text should get a new key");
+    XCTAssertTrue([meta.searchKey fieldsContainNeedle:[MediaSearchKey foldedNeedle:@"nig" exact:NO] exact:NO]);
+}
+
+- (void)testTextFieldsMatchAtWordPrefixes
+{
+    MediaMetaData* meta = [MediaMetaData new];
+    meta.location = [NSURL fileURLWithPath:@"/tmp/filter/words.mp3"];
+    meta.title = @"Über den Wolken";
+    meta.artist = @"Reinhard Mey";
+    meta.tags = @"#schlager";
+
+    XCTAssertTrue([[self filterWithNeedle:@"wol"] matchesItem:meta]);
+    XCTAssertTrue([[self filterWithNeedle:@"mey uber"] matchesItem:meta], @"Words may come from any field, in any order");
+    XCTAssertTrue([[self filterWithNeedle:@"(wolken)"] matchesItem:meta], @"Punctuation around a word gets dropped");
+    XCTAssertFalse([[self filterWithNeedle:@"olken"] matchesItem:meta], @"Only word prefixes match");
+    XCTAssertFalse([[self filterWithNeedle:@"wolken zzz"] matchesItem:meta], @"Every word has to match");
+    XCTAssertTrue([[self filterWithNeedle:@"lager"] matchesItem:meta], @"Tags still match anywhere");
+
+    // The index only rules out items; those it found still have to match.
+    LibraryFilter* indexed = [self filterWithNeedle:@"olken"];
+    indexed.indexedURLs = [NSSet setWithObject:meta.location.absoluteString];
+    XCTAssertFalse([indexed matchesItem:meta]);
+    indexed = [self filterWithNeedle:@"wol"];
+    indexed.indexedURLs = [NSSet set];
+    XCTAssertFalse([indexed matchesItem:meta]);
+}
+
+- (void)testFilterThroughputOnLargeLibrary
+{
+#ifndef ENABLE_LIBRARY_FILTER_BENCH
+    XCTSkip(@"Library filter benchmark skipped unless ENABLE_LIBRARY_FILTER_BENCH is defined.");
+#else
+    const NSUInteger itemCount = 100000;
+    NSArray<MediaMetaData*>* library = [self syntheticLibrary:itemCount];
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    [LibraryFilter prepareSearchKeysOfItems:library];
+    NSLog(@"library filter: search keys of %lu items built in %.0fms", (unsigned long) itemCount, (CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+
+    NSArray<NSString*>* needles = @[ @"d", @"night", @"strasse", @"Café", @"zzz" ];
+    start = CFAbsoluteTimeGetCurrent();
+    for (NSString* needle in needles) {
+        XCTAssertNotNil([[self filterWithNeedle:needle] filterItems:library operation:nil firstMatchCount:0 firstMatches:nil]);
+    }
+    double elapsed = CFAbsoluteTimeGetCurrent() - start;
+    NSLog(@"library filter: %.1fM items per second", (double) (itemCount * needles.count) / elapsed / 1000000.0);
+#endif
+}
+
+@end
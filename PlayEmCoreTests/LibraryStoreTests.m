@@ -7,10 +7,21 @@
 //
 
 #import <XCTest/XCTest.h>
+#import <mach/mach.h>
+#import <objc/runtime.h>
+#import <stdatomic.h>
 
+#import "KeyAnalyzer.h"
+#import "LibraryFilter.h"
 #import "LibraryStore.h"
 #import "MediaMetaData.h"
 #import "MediaMetaData+TagLib.h"
+#import "TimedMediaMetaData.h"
+#import "TrackList.h"
+
+@interface LibraryStore (Testing)
+- (BOOL)performTransaction:(BOOL (^)(void))block error:(NSError**)error;
+@end
 
 @interface LibraryStoreTests : XCTestCase
 @end
@@ -20,7 +31,9 @@
 - (NSURL*)temporaryDatabaseURL
 {
     NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"playem_librarystore_test.sqlite"];
-    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    for (NSString* suffix in @[ @"", @"-wal", @"-shm" ]) {
+        [[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:suffix] error:nil];
+    }
     return [NSURL fileURLWithPath:path];
 }
 
@@ -57,6 +70,16 @@
     return meta;
 }
 
+- (size_t)residentSize
+{
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return info.resident_size;
+}
+
 - (void)testImportAndLoadRoundTrip
 {
     NSURL* dbURL = [self temporaryDatabaseURL];
@@ -219,4 +242,898 @@
     [self waitForExpectationsWithTimeout:5 handler:nil];
 }
 
+- (void)reconcileStore:(LibraryStore*)store
+{
+    XCTestExpectation* exp = [self expectationWithDescription:@"reconcile"];
+    [store reconcileLibraryWithCompletion:^(NSArray<MediaMetaData*>* _Nullable refreshedMetas,
+                                            NSArray<MediaMetaData*>* _Nullable changedMetas,
+                                            NSArray<NSURL*>* missingFiles,
+                                            NSError* _Nullable error) {
+        XCTAssertNil(error, @"reconcile error: %@", error);
+        XCTAssertEqual(refreshedMetas.count, store.lastReconcileParseCount);
+        [exp fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testReconcileParsesChangedFilesOnly
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+
+    NSURL* srcURL = [self testMP3URL];
+    if (!srcURL || ![[NSFileManager defaultManager] fileExistsAtPath:srcURL.path]) {
+        XCTSkip(@"TagLib test file missing; set PLAYEM_TAGLIB_TEST_FILE to a valid MP3 path.");
+        return;
+    }
+
+    NSString* tmpDir = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    [[NSFileManager defaultManager] createDirectoryAtPath:tmpDir withIntermediateDirectories:YES attributes:nil error:nil];
+    NSString* dstPath = [tmpDir stringByAppendingPathComponent:srcURL.lastPathComponent];
+    NSError* error = nil;
+    XCTAssertTrue([[NSFileManager defaultManager] copyItemAtPath:srcURL.path toPath:dstPath error:&error], @"copy failed: %@", error);
+    NSURL* dstURL = [NSURL fileURLWithPath:dstPath];
+
+    MediaMetaData* meta = [MediaMetaData emptyMediaDataWithURL:dstURL];
+    XCTAssertTrue([meta readFromFileWithError:&error], @"read failed: %@", error);
+    XCTAssertTrue([store importMediaItems:@[ meta ] error:&error], @"import failed: %@", error);
+
+    // The import stamped the file, so the tags just read stay trusted.
+    [self reconcileStore:store];
+    XCTAssertEqual(store.lastReconcileStatCount, 1u);
+    XCTAssertEqual(store.lastReconcileParseCount, 0u, @"Freshly imported files should not be parsed again");
+
+    NSDate* touched = [NSDate dateWithTimeIntervalSinceNow:60];
+    XCTAssertTrue([[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate : touched} ofItemAtPath:dstPath error:&error],
+                  @"touch failed: %@", error);
+    [self reconcileStore:store];
+    XCTAssertEqual(store.lastReconcileParseCount, 1u, @"A new modification time should get the file parsed");
+
+    [self reconcileStore:store];
+    XCTAssertEqual(store.lastReconcileStatCount, 1u);
+    XCTAssertEqual(store.lastReconcileParseCount, 0u, @"Unchanged files should not be parsed");
+
+    // Importing without overwriting keeps the stamp of what is stored.
+    touched = [NSDate dateWithTimeIntervalSinceNow:120];
+    XCTAssertTrue([[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate : touched} ofItemAtPath:dstPath error:&error],
+                  @"touch failed: %@", error);
+    XCTAssertTrue([store importMediaItems:@[ meta ] preferExisting:YES error:&error], @"import failed: %@", error);
+    [self reconcileStore:store];
+    XCTAssertEqual(store.lastReconcileParseCount, 1u, @"Kept tags should still get compared with the file");
+}
+
+- (void)testQueuedImportsAreWrittenInBatches
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+
+    NSError* error = nil;
+    XCTAssertTrue([store open:&error], @"open failed: %@", error);
+    NSUInteger commitsBefore = store.committedTransactionCount;
+
+    const NSUInteger count = 1200;
+    for (NSUInteger i = 0; i < count; i++) {
+        MediaMetaData* meta = [self sampleMeta];
+        meta.location = [NSURL fileURLWithPath:[NSString stringWithFormat:@"/tmp/queued%lu.mp3", (unsigned long) i]];
+        [store queueImportOfMediaItems:@[ meta ]];
+    }
+    XCTAssertTrue([store flushQueuedImports:&error], @"flush failed: %@", error);
+    XCTAssertEqual([store loadAllMediaItems:&error].count, count, @"load failed: %@", error);
+    // Batches of 512 at most; the latency timer may cut one short.
+    NSUInteger commits = store.committedTransactionCount - commitsBefore;
+    XCTAssertGreaterThanOrEqual(commits, 3u);
+    XCTAssertLessThanOrEqual(commits, 6u, @"Queued imports should be committed in batches, not one by one");
+
+    NSString* walPath = [dbURL.path stringByAppendingString:@"-wal"];
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:walPath], @"The store should journal ahead");
+
+    // Late stragglers still make it without an explicit flush.
+    MediaMetaData* late = [self sampleMeta];
+    late.location = [NSURL fileURLWithPath:@"/tmp/late.mp3"];
+    [store queueImportOfMediaItems:@[ late ]];
+    XCTNSPredicateExpectation* written = [[XCTNSPredicateExpectation alloc] initWithPredicate:[NSPredicate predicateWithBlock:^BOOL(id object, NSDictionary* bindings) {
+        return [store hasEntryForURL:late.location error:nil];
+    }]
+                                                                                       object:nil];
+    [self waitForExpectations:@[ written ] timeout:5];
+}
+
+- (void)testWritesWaitForAnotherThreadsTransaction
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+    MediaMetaData* meta = [self sampleMeta];
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:@[ meta ] error:&error], @"import failed: %@", error);
+
+    dispatch_semaphore_t held = dispatch_semaphore_create(0);
+    dispatch_semaphore_t release = dispatch_semaphore_create(0);
+    dispatch_group_t transaction = dispatch_group_create();
+    dispatch_group_async(transaction, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        [store performTransaction:^BOOL {
+            dispatch_semaphore_signal(held);
+            dispatch_semaphore_wait(release, DISPATCH_TIME_FOREVER);
+            return NO;
+        } error:nil];
+    });
+    dispatch_semaphore_wait(held, DISPATCH_TIME_FOREVER);
+
+    __block BOOL marked = NO;
+    dispatch_group_t write = dispatch_group_create();
+    dispatch_group_async(write, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        marked = [store markDeepScanFailedForURL:meta.location reason:@"test" error:nil];
+    });
+    long waited = dispatch_group_wait(write, dispatch_time(DISPATCH_TIME_NOW, 300 * NSEC_PER_MSEC));
+    dispatch_semaphore_signal(release);
+    dispatch_group_wait(transaction, DISPATCH_TIME_FOREVER);
+    dispatch_group_wait(write, DISPATCH_TIME_FOREVER);
+
+    XCTAssertNotEqual(waited, 0, @"The write should wait for the open transaction");
+    XCTAssertTrue(marked);
+    // Had it joined the transaction, the rollback would have taken it along.
+    XCTAssertEqual([store deepScanOutstandingCount:&error], 0, @"The failure should be stored");
+}
+
+- (void)testImportThroughputOnGeneratedTree
+{
+#ifndef ENABLE_LIBRARY_IMPORT_BENCH
+    XCTSkip(@"Library import benchmark skipped unless ENABLE_LIBRARY_IMPORT_BENCH is defined.");
+#else
+    NSURL* srcURL = [self testMP3URL];
+    if (!srcURL || ![[NSFileManager defaultManager] fileExistsAtPath:srcURL.path]) {
+        XCTSkip(@"TagLib test file missing; set PLAYEM_TAGLIB_TEST_FILE to a valid MP3 path.");
+        return;
+    }
+
+    // 10k copies of the sample spread over 100 album folders.
+    const NSUInteger folderCount = 100;
+    const NSUInteger filesPerFolder = 100;
+    NSString* root = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    NSMutableArray<NSURL*>* urls = [NSMutableArray arrayWithCapacity:folderCount * filesPerFolder];
+    NSError* error = nil;
+    for (NSUInteger folder = 0; folder < folderCount; folder++) {
+        NSString* dir = [root stringByAppendingPathComponent:[NSString stringWithFormat:@"Artist %lu/Album %lu", (unsigned long) (folder / 10), (unsigned long) folder]];
+        XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:dir withIntermediateDirectories:YES attributes:nil error:&error], @"mkdir failed: %@", error);
+        for (NSUInteger file = 0; file < filesPerFolder; file++) {
+            NSString* path = [dir stringByAppendingPathComponent:[NSString stringWithFormat:@"%02lu Track.mp3", (unsigned long) file]];
+            XCTAssertTrue([[NSFileManager defaultManager] copyItemAtPath:srcURL.path toPath:path error:&error], @"copy failed: %@", error);
+            [urls addObject:[NSURL fileURLWithPath:path]];
+        }
+    }
+
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:[self temporaryDatabaseURL]];
+    XCTestExpectation* exp = [self expectationWithDescription:@"import"];
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    [store importFileURLs:urls
+               completion:^(NSArray<MediaMetaData*>* _Nullable metas, NSError* _Nullable importError) {
+                   XCTAssertNil(importError, @"import failed: %@", importError);
+                   XCTAssertEqual(metas.count, urls.count);
+                   [exp fulfill];
+               }];
+    [self waitForExpectationsWithTimeout:600 handler:nil];
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+    NSLog(@"library import: %.0fms for %lu files, %.0f files/s", elapsed * 1000.0, (unsigned long) urls.count, urls.count / elapsed);
+
+    [[NSFileManager defaultManager] removeItemAtPath:root error:nil];
+#endif
+}
+
+- (void)importURLs:(NSArray<NSURL*>*)urls intoStore:(LibraryStore*)store
+{
+    XCTestExpectation* exp = [self expectationWithDescription:@"import"];
+    [store importFileURLs:urls
+               completion:^(NSArray<MediaMetaData*>* _Nullable metas, NSError* _Nullable error) {
+                   XCTAssertNil(error, @"import failed: %@", error);
+                   XCTAssertEqual(metas.count, urls.count);
+                   [exp fulfill];
+               }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+}
+
+- (void)testMovedLibraryKeepsItsEntriesWithoutRescans
+{
+    NSURL* srcURL = [self testMP3URL];
+    if (!srcURL || ![[NSFileManager defaultManager] fileExistsAtPath:srcURL.path]) {
+        XCTSkip(@"TagLib test file missing; set PLAYEM_TAGLIB_TEST_FILE to a valid MP3 path.");
+        return;
+    }
+    NSData* sample = [NSData dataWithContentsOfURL:srcURL];
+
+    // Copies of the sample differing in their audio payload only.
+    const NSUInteger fileCount = 8;
+    NSString* root = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    NSString* crate = [root stringByAppendingPathComponent:@"Crate"];
+    NSError* error = nil;
+    XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath:crate withIntermediateDirectories:YES attributes:nil error:&error],
+                  @"mkdir failed: %@", error);
+    NSMutableArray<NSString*>* names = [NSMutableArray array];
+    NSMutableArray<NSURL*>* urls = [NSMutableArray array];
+    for (NSUInteger file = 0; file < fileCount; file++) {
+        NSMutableData* content = [sample mutableCopy];
+        uint32_t marker = (uint32_t) file + 1;
+        [content replaceBytesInRange:NSMakeRange(content.length / 8 * 5, sizeof(marker)) withBytes:&marker];
+        NSString* name = [NSString stringWithFormat:@"%02lu Track.mp3", (unsigned long) file];
+        XCTAssertTrue([content writeToFile:[crate stringByAppendingPathComponent:name] options:0 error:&error], @"write failed: %@", error);
+        [names addObject:name];
+        [urls addObject:[NSURL fileURLWithPath:[crate stringByAppendingPathComponent:name]]];
+    }
+
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:[self temporaryDatabaseURL]];
+    [self importURLs:urls intoStore:store];
+    for (NSUInteger file = 0; file < fileCount; file++) {
+        XCTAssertTrue([store completeDeepScanForURL:urls[file] duration:@200000.0 tempo:@(120.0 + file) key:@"8A" error:&error],
+                      @"complete failed: %@", error);
+    }
+    XCTAssertEqual([store deepScanOutstandingCount:&error], 0);
+    int64_t revision = [store currentRevision:&error];
+
+    NSString* moved = [root stringByAppendingPathComponent:@"Moved Crate"];
+    XCTAssertTrue([[NSFileManager defaultManager] moveItemAtPath:crate toPath:moved error:&error], @"move failed: %@", error);
+    NSMutableArray<NSURL*>* movedURLs = [NSMutableArray array];
+    for (NSString* name in names) {
+        [movedURLs addObject:[NSURL fileURLWithPath:[moved stringByAppendingPathComponent:name]]];
+    }
+    [self importURLs:movedURLs intoStore:store];
+
+    XCTAssertEqual([store deepScanOutstandingCount:&error], 0, @"Moved files should not get scanned again");
+    XCTAssertNil([store nextDeepScanURL:&error]);
+    NSArray<MediaMetaData*>* loaded = [store loadAllMediaItems:&error];
+    XCTAssertEqual(loaded.count, fileCount, @"Moved files should not get imported as new tracks");
+    NSDictionary<NSURL*, MediaMetaData*>* loadedByURL = [NSDictionary dictionaryWithObjects:loaded forKeys:[loaded valueForKey:@"location"]];
+    for (NSUInteger file = 0; file < fileCount; file++) {
+        XCTAssertFalse([store hasEntryForURL:urls[file] error:&error]);
+        XCTAssertEqualObjects(loadedByURL[movedURLs[file]].tempo, @(120.0 + file), @"Entries should move with their content");
+    }
+
+    // The browser learns about the move as removals plus insertions.
+    NSArray<LibraryChange*>* changes = [store changesSinceRevision:revision latest:NULL error:&error];
+    XCTAssertEqual(changes.count, 2 * fileCount, @"changes failed: %@", error);
+    XCTAssertEqual([changes filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"kind == %ld", (long) LibraryChangeKindDelete]].count, fileCount);
+
+    [[NSFileManager defaultManager] removeItemAtPath:root error:nil];
+}
+
+- (void)testDeepScanQueueClaimsBatchesInPriorityOrder
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+
+    NSMutableArray<MediaMetaData*>* metas = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 4; i++) {
+        MediaMetaData* meta = [self sampleMeta];
+        meta.location = [NSURL fileURLWithPath:[NSString stringWithFormat:@"/tmp/unscanned%lu.mp3", (unsigned long) i]];
+        meta.tempo = nil;
+        [metas addObject:meta];
+    }
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:metas error:&error], @"import failed: %@", error);
+    XCTAssertEqual([store deepScanOutstandingCount:&error], 4);
+
+    NSURL* boosted = metas[2].location;
+    XCTAssertTrue([store prioritizeDeepScanForURLs:@[ boosted ] error:&error], @"prioritize failed: %@", error);
+    XCTAssertEqualObjects([store nextDeepScanURL:&error], boosted);
+
+    NSArray<NSNumber*>* priorities = nil;
+    NSArray<NSURL*>* claimed = [store claimDeepScanURLs:2 minimumPriority:0 priorities:&priorities error:&error];
+    XCTAssertEqual(claimed.count, 2u, @"claim failed: %@", error);
+    XCTAssertEqualObjects(claimed.firstObject, boosted);
+    XCTAssertEqualObjects(priorities, (@[ @1, @0 ]));
+    XCTAssertEqual([store deepScanOutstandingCount:&error], 4, @"Running scans are still outstanding");
+
+    XCTAssertEqual([store claimDeepScanURLs:2 minimumPriority:1 priorities:nil error:&error].count, 0u, @"Nothing urgent left");
+    NSArray<NSURL*>* rest = [store claimDeepScanURLs:10 minimumPriority:0 priorities:nil error:&error];
+    XCTAssertEqual(rest.count, 2u);
+    XCTAssertFalse([rest containsObject:claimed[0]] || [rest containsObject:claimed[1]], @"No URL gets handed out twice");
+    XCTAssertNil([store nextDeepScanURL:&error]);
+
+    XCTAssertTrue([store resetDeepScanRunningState:&error], @"reset failed: %@", error);
+    XCTAssertEqual([store claimDeepScanURLs:10 minimumPriority:0 priorities:nil error:&error].count, 4u, @"Interrupted scans get queued again");
+
+    XCTAssertTrue([store completeDeepScanForURL:boosted duration:@200000.0 tempo:@120.0 key:@"8A" error:&error], @"complete failed: %@", error);
+    XCTAssertEqual([store deepScanOutstandingCount:&error], 3);
+}
+
+- (void)testChangesSinceRevisionFoldChangesPerTrack
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+
+    MediaMetaData* kept = [self sampleMeta];
+    MediaMetaData* removed = [self sampleMeta];
+    removed.location = [NSURL fileURLWithPath:@"/tmp/removed.mp3"];
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:@[ kept, removed ] error:&error], @"import failed: %@", error);
+    int64_t revision = [store currentRevision:&error];
+    XCTAssertGreaterThan(revision, 0, @"revision read failed: %@", error);
+
+    // Bookkeeping alone is no change.
+    XCTAssertTrue([store markDeepScanRunningForURL:kept.location error:&error], @"mark failed: %@", error);
+    XCTAssertEqual([store currentRevision:&error], revision);
+
+    kept.title = @"Retitled";
+    XCTAssertTrue([store importMediaItems:@[ kept ] error:&error], @"import failed: %@", error);
+    XCTAssertTrue([store completeDeepScanForURL:kept.location duration:nil tempo:@(124.0) key:nil error:&error], @"complete failed: %@", error);
+    MediaMetaData* added = [self sampleMeta];
+    added.location = [NSURL fileURLWithPath:@"/tmp/added.mp3"];
+    XCTAssertTrue([store importMediaItems:@[ added ] error:&error], @"import failed: %@", error);
+    XCTestExpectation* exp = [self expectationWithDescription:@"remove"];
+    [store removeEntriesForURLs:@[ removed.location ]
+                     completion:^(BOOL success, NSError* _Nullable removeError) {
+                         XCTAssertTrue(success, @"remove failed: %@", removeError);
+                         [exp fulfill];
+                     }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    int64_t latest = 0;
+    NSArray<LibraryChange*>* changes = [store changesSinceRevision:revision latest:&latest error:&error];
+    XCTAssertNotNil(changes, @"change read failed: %@", error);
+    XCTAssertEqual(latest, [store currentRevision:&error]);
+    XCTAssertEqual(changes.count, 3u);
+
+    XCTAssertEqual(changes[0].kind, LibraryChangeKindUpdate);
+    XCTAssertEqualObjects(changes[0].url, kept.location);
+    XCTAssertEqualObjects(changes[0].keys, ([NSSet setWithObjects:@"title", @"tempo", nil]));
+    XCTAssertEqualObjects(changes[0].meta.title, @"Retitled");
+    XCTAssertEqualObjects(changes[0].meta.tempo, @(124.0));
+
+    XCTAssertEqual(changes[1].kind, LibraryChangeKindInsert);
+    XCTAssertEqualObjects(changes[1].url, added.location);
+    XCTAssertTrue([changes[1].keys containsObject:@"artist"]);
+    XCTAssertEqualObjects(changes[1].meta.artist, added.artist);
+
+    XCTAssertEqual(changes[2].kind, LibraryChangeKindDelete);
+    XCTAssertEqualObjects(changes[2].url, removed.location);
+    XCTAssertNil(changes[2].meta);
+
+    XCTAssertEqual([store changesSinceRevision:latest latest:NULL error:&error].count, 0u);
+}
+
+- (void)testAnalyzerVersionsRecordedPerTrack
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+
+    MediaMetaData* meta = [self sampleMeta];
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:@[ meta ] error:&error], @"import failed: %@", error);
+
+    NSDictionary<NSString*, NSNumber*>* recorded = [store recordedAnalyzerVersionsForURL:meta.location error:&error];
+    XCTAssertNotNil(recorded, @"version read failed: %@", error);
+    XCTAssertEqual(recorded.count, 0u, @"Tag values are no analyzer results");
+
+    XCTAssertTrue([store recordAnalyzers:@[ @"key", @"unknown" ] forURL:meta.location error:&error], @"record failed: %@", error);
+    recorded = [store recordedAnalyzerVersionsForURL:meta.location error:&error];
+    XCTAssertEqualObjects(recorded, (@{@"key" : [LibraryStore analyzerVersions][@"key"]}));
+
+    // Current results do not queue the track again.
+    XCTAssertNil([store nextDeepScanURL:&error]);
+    XCTAssertEqual([store deepScanOutstandingCount:&error], 0);
+
+    XCTestExpectation* exp = [self expectationWithDescription:@"remove"];
+    [store removeEntriesForURLs:@[ meta.location ]
+                     completion:^(BOOL success, NSError* _Nullable removeError) {
+                         XCTAssertTrue(success, @"remove failed: %@", removeError);
+                         [exp fulfill];
+                     }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    recorded = [store recordedAnalyzerVersionsForURL:meta.location error:&error];
+    XCTAssertEqual(recorded.count, 0u, @"Versions go along with their track");
+}
+
+/// Pretends the analyzer got a new version, as a newer build would have it.
+- (void)bumpVersionOfAnalyzer:(Class)analyzerClass
+{
+    Method method = class_getClassMethod(analyzerClass, @selector(version));
+    NSInteger bumped = [analyzerClass version] + 1;
+    IMP original = method_setImplementation(method, imp_implementationWithBlock(^NSInteger(id analyzer) {
+        return bumped;
+    }));
+    [self addTeardownBlock:^{
+        method_setImplementation(method, original);
+    }];
+}
+
+- (void)testAnalyzerVersionBumpQueuesStaleTracksAgain
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+
+    MediaMetaData* keyed = [self sampleMeta];
+    MediaMetaData* measured = [self sampleMeta];
+    measured.location = [NSURL fileURLWithPath:@"/tmp/measured.mp3"];
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:@[ keyed, measured ] error:&error], @"import failed: %@", error);
+    XCTAssertTrue([store recordAnalyzers:@[ @"key" ] forURL:keyed.location error:&error], @"record failed: %@", error);
+    XCTAssertTrue([store recordAnalyzers:@[ @"loudness" ] forURL:measured.location error:&error], @"record failed: %@", error);
+    XCTAssertEqual([store deepScanOutstandingCount:&error], 0);
+
+    [self bumpVersionOfAnalyzer:[KeyAnalyzer class]];
+    // The queue catches up with the analyzer versions of the build opening it.
+    LibraryStore* bumped = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+    XCTAssertEqualObjects([bumped nextDeepScanURL:&error], keyed.location);
+    XCTAssertEqual([bumped deepScanOutstandingCount:&error], 1, @"Tracks the key analyzer never ran on stay done");
+
+    // Key detection failing again drops the stale record instead of queueing
+    // the track over and over.
+    XCTAssertEqual([bumped claimDeepScanURLs:1 minimumPriority:0 priorities:nil error:&error].count, 1u);
+    XCTAssertTrue([bumped forgetAnalyzers:@[ @"key" ] forURL:keyed.location error:&error], @"forget failed: %@", error);
+    XCTAssertTrue([bumped completeDeepScanForURL:keyed.location duration:nil tempo:nil key:nil error:&error], @"complete failed: %@", error);
+    XCTAssertEqual([bumped deepScanOutstandingCount:&error], 0);
+    XCTAssertEqual([bumped recordedAnalyzerVersionsForURL:keyed.location error:&error].count, 0u);
+}
+
+- (void)testScanFinishedOnPlaybackStaysDone
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+    MediaMetaData* meta = [self sampleMeta];
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:@[ meta ] error:&error], @"import failed: %@", error);
+    XCTAssertTrue([store recordAnalyzers:@[ @"key" ] forURL:meta.location error:&error], @"record failed: %@", error);
+
+    [self bumpVersionOfAnalyzer:[KeyAnalyzer class]];
+    LibraryStore* bumped = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+    XCTAssertEqual([bumped deepScanOutstandingCount:&error], 1);
+
+    // As playback does it: mark running, then record and complete.
+    XCTAssertTrue([bumped markDeepScanRunningForURL:meta.location error:&error], @"mark failed: %@", error);
+    XCTAssertTrue([bumped recordAnalyzers:@[ @"key" ] forURL:meta.location error:&error], @"record failed: %@", error);
+    XCTAssertTrue([bumped completeDeepScanForURL:meta.location duration:nil tempo:nil key:@"9A" error:&error], @"complete failed: %@", error);
+
+    XCTAssertNil([bumped nextDeepScanURL:&error], @"A finished track does not come back");
+    XCTAssertEqual([bumped deepScanOutstandingCount:&error], 0);
+    XCTAssertEqualObjects([bumped recordedAnalyzerVersionsForURL:meta.location error:&error][@"key"], [LibraryStore analyzerVersions][@"key"]);
+}
+
+- (TimedMediaMetaData*)trackWithArtist:(NSString*)artist title:(NSString*)title frame:(unsigned long long)frame
+{
+    TimedMediaMetaData* track = [TimedMediaMetaData new];
+    track.frame = @(frame);
+    track.meta = [MediaMetaData new];
+    track.meta.artist = artist;
+    track.meta.title = title;
+    return track;
+}
+
+- (void)testTracklistEntriesRoundTripAndFindSetsPlayingATrack
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+    NSURL* firstSet = [NSURL fileURLWithPath:@"/tmp/first set.mp3"];
+    NSURL* secondSet = [NSURL fileURLWithPath:@"/tmp/second set.mp3"];
+
+    TrackList* first = [TrackList new];
+    TimedMediaMetaData* opener = [self trackWithArtist:@"Artist" title:@"Opener" frame:0];
+    opener.endFrame = @44100;
+    opener.confidence = @0.75;
+    opener.score = @12.5;
+    opener.supportCount = @3;
+    opener.meta.appleLocation = [NSURL URLWithString:@"https://music.apple.com/track/1"];
+    opener.meta.key = @"8A";
+    [first addTrack:opener];
+    [first addTrack:[self trackWithArtist:@"Other" title:@"Closer" frame:88200]];
+
+    TrackList* second = [TrackList new];
+    [second addTrack:[self trackWithArtist:@"ARTIST" title:@"opener" frame:1000]];
+
+    NSError* error = nil;
+    XCTAssertTrue([store storeTrackList:first forURL:firstSet error:&error], @"store failed: %@", error);
+    XCTAssertTrue([store storeTrackList:second forURL:secondSet error:&error], @"store failed: %@", error);
+
+    TrackList* loaded = [store trackListForURL:firstSet error:&error];
+    XCTAssertNotNil(loaded, @"load failed: %@", error);
+    XCTAssertEqual(loaded.tracks.count, 2u);
+    TimedMediaMetaData* loadedOpener = [loaded trackAtFrame:0];
+    XCTAssertEqualObjects(loadedOpener.meta.title, @"Opener");
+    XCTAssertEqualObjects(loadedOpener.meta.artist, @"Artist");
+    XCTAssertEqualObjects(loadedOpener.endFrame, @44100);
+    XCTAssertEqualObjects(loadedOpener.confidence, @0.75);
+    XCTAssertEqualObjects(loadedOpener.score, @12.5);
+    XCTAssertEqualObjects(loadedOpener.supportCount, @3);
+    XCTAssertEqualObjects(loadedOpener.meta.appleLocation, opener.meta.appleLocation);
+    XCTAssertEqualObjects(loadedOpener.meta.key, @"8A");
+    XCTAssertNil([loaded trackAtFrame:88200].endFrame, @"Missing values stay missing");
+    XCTAssertNil([loaded trackAtFrame:88200].meta.key);
+
+    NSDictionary<NSURL*, NSArray<NSNumber*>*>* sets = [store setsContainingTrack:opener.meta error:&error];
+    XCTAssertEqualObjects(sets, (@{firstSet : @[ @0 ], secondSet : @[ @1000 ]}), @"lookup failed: %@", error);
+
+    // Storing again replaces the entries of just that set.
+    [first removeTrackAtFrame:0];
+    XCTAssertTrue([store storeTrackList:first forURL:firstSet error:&error], @"store failed: %@", error);
+    sets = [store setsContainingTrack:opener.meta error:&error];
+    XCTAssertEqualObjects(sets, (@{secondSet : @[ @1000 ]}));
+    XCTAssertEqual([store trackListForURL:firstSet error:&error].tracks.count, 1u);
+
+    XCTAssertTrue([store storeTrackList:[TrackList new] forURL:secondSet error:&error], @"store failed: %@", error);
+    XCTAssertEqual([store trackListForURL:secondSet error:&error].tracks.count, 0u);
+}
+
+- (void)testSearchFoldsCaseAndDiacriticsAndMatchesPrefixes
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+
+    MediaMetaData* umlauts = [self sampleMeta];
+    umlauts.location = [NSURL fileURLWithPath:@"/tmp/umlauts.mp3"];
+    umlauts.title = @"Über den Wolken";
+    umlauts.artist = @"Reinhard Mey";
+    MediaMetaData* other = [self sampleMeta];
+    other.location = [NSURL fileURLWithPath:@"/tmp/other.mp3"];
+    other.title = @"Around the World";
+    other.artist = @"Daft Punk";
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:@[ umlauts, other ] error:&error], @"import failed: %@", error);
+
+    NSSet<NSString*>* found = [store searchURLsMatchingNeedle:@"uber" error:&error];
+    XCTAssertEqualObjects(found, [NSSet setWithObject:umlauts.location.absoluteString], @"search failed: %@", error);
+    found = [store searchURLsMatchingNeedle:@"daft pu" error:&error];
+    XCTAssertEqualObjects(found, [NSSet setWithObject:other.location.absoluteString]);
+    found = [store searchURLsMatchingNeedle:@"WOR" error:&error];
+    XCTAssertEqualObjects(found, [NSSet setWithObject:other.location.absoluteString], @"Prefix only, 'Wolken' has no 'wor'");
+
+    // Triggers keep the index in sync with edits.
+    other.title = @"Harder Better Faster";
+    XCTAssertTrue([store importMediaItems:@[ other ] error:&error], @"update failed: %@", error);
+    XCTAssertEqual([store searchURLsMatchingNeedle:@"around" error:&error].count, 0u);
+    XCTAssertEqual([store searchURLsMatchingNeedle:@"faster" error:&error].count, 1u);
+
+    // Tags get searched as well, just like without the index.
+    umlauts.tags = @"#schlager#vinyl";
+    XCTAssertTrue([store importMediaItems:@[ umlauts ] error:&error], @"update failed: %@", error);
+    found = [store searchURLsMatchingNeedle:@"vinyl" error:&error];
+    XCTAssertEqualObjects(found, [NSSet setWithObject:umlauts.location.absoluteString]);
+
+    XCTAssertNil([store searchURLsMatchingNeedle:@" - " error:&error], @"Nothing to search for");
+}
+
+- (void)testFacetValuesCountTracksMatchingOtherFacets
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+
+    NSArray<NSArray*>* rows = @[
+        @[ @"House", @"Artist A", @128.0, @"8A" ],
+        @[ @"House", @"Artist A", @124.5, @"8A" ],
+        @[ @"House", @"Artist B", @128.0, @"9B" ],
+        @[ @"Techno", @"Artist B", @0.0, @"" ],
+    ];
+    NSMutableArray<MediaMetaData*>* metas = [NSMutableArray array];
+    for (NSUInteger i = 0; i < rows.count; i++) {
+        MediaMetaData* meta = [self sampleMeta];
+        meta.location = [NSURL fileURLWithPath:[NSString stringWithFormat:@"/tmp/facet%lu.mp3", (unsigned long) i]];
+        meta.genre = rows[i][0];
+        meta.artist = rows[i][1];
+        meta.tempo = rows[i][2];
+        meta.key = rows[i][3];
+        [metas addObject:meta];
+    }
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:metas error:&error], @"import failed: %@", error);
+
+    NSDictionary* genres = [store valuesOfFacet:LibraryFacetGenre filter:@{} error:&error];
+    XCTAssertEqualObjects(genres, (@{@"House" : @3, @"Techno" : @1}), @"facet query failed: %@", error);
+
+    NSDictionary* filter = @{@(LibraryFacetGenre) : @"House", @(LibraryFacetArtist) : @"Artist A"};
+    XCTAssertEqualObjects([store valuesOfFacet:LibraryFacetTempo filter:filter error:&error], (@{@"128" : @1, @"124.5" : @1}));
+    XCTAssertEqualObjects([store valuesOfFacet:LibraryFacetKey filter:filter error:&error], (@{@"8A" : @2}));
+    XCTAssertEqualObjects([store valuesOfFacet:LibraryFacetArtist filter:filter error:&error], (@{@"Artist A" : @2, @"Artist B" : @1}),
+                          @"A facet's own selection does not narrow it");
+    XCTAssertEqualObjects([store valuesOfFacet:LibraryFacetGenre filter:@{@(LibraryFacetTempo) : @"128"} error:&error], (@{@"House" : @2}));
+    XCTAssertEqualObjects([store valuesOfFacet:LibraryFacetKey filter:@{@(LibraryFacetGenre) : @"Techno"} error:&error], @{}, @"Empty values are no facet values");
+}
+
+- (void)testLoadedArtworkIsFetchedOnAccess
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+
+    MediaMetaData* meta = [self sampleMeta];
+    NSData* artwork = [@"not really a png" dataUsingEncoding:NSUTF8StringEncoding];
+    meta.artwork = artwork;
+    meta.artworkFormat = @(ITLibArtworkFormatPNG);
+    NSString* hash = meta.artworkHash;
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:@[ meta ] error:&error], @"import failed: %@", error);
+
+    MediaMetaData* loaded = [store loadAllMediaItems:&error].firstObject;
+    XCTAssertNotNil(loaded, @"load failed: %@", error);
+    XCTAssertEqualObjects(loaded.artworkHash, hash);
+    XCTAssertEqualObjects(loaded.artworkFormat, @(ITLibArtworkFormatPNG));
+    XCTAssertTrue(loaded.artworkSource == store, @"Artwork should be left in the store");
+    XCTAssertEqualObjects(loaded.artwork, artwork);
+    XCTAssertEqualObjects([store artworkDataForHashes:@[ hash, @"unknown" ] error:&error], @{hash : artwork});
+
+    // Writing back an item referring to stored artwork keeps that artwork.
+    XCTAssertTrue([store importMediaItems:@[ loaded ] error:&error], @"update failed: %@", error);
+    LibraryStore* reopened = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+    XCTAssertEqualObjects([reopened loadAllMediaItems:&error].firstObject.artwork, artwork);
+}
+
+- (void)testIndexedFilterMatchesLikeTheSearchKeys
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+
+    NSArray<NSString*>* words = @[ @"Über", @"night", @"Café", @"dream", @"Straße", @"love", @"Señor", @"fire", @"rock'n'roll", @"Déjà" ];
+    NSMutableArray<MediaMetaData*>* metas = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 500; i++) {
+        MediaMetaData* meta = [MediaMetaData new];
+        meta.location = [NSURL fileURLWithPath:[NSString stringWithFormat:@"/tmp/indexed/%lu.mp3", (unsigned long) i]];
+        meta.title = [NSString stringWithFormat:@"%@ %@ %lu", words[i % words.count], words[(i / 7) % words.count], (unsigned long) i];
+        meta.artist = [NSString stringWithFormat:@"Artist-%@", words[(i / 3) % words.count]];
+        meta.album = [NSString stringWithFormat:@"Album %lu", (unsigned long) (i % 90)];
+        meta.genre = words[(i / 11) % words.count];
+        [metas addObject:meta];
+    }
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:metas error:&error], @"import failed: %@", error);
+
+    NSArray<NSString*>* needles = @[ @"d", @"dre", @"ove", @"cafe", @"Café", @"deja ni", @"straße", @"roll", @"rock'n", @"dream (", @"artist fir", @"album 4" ];
+    for (NSString* needle in needles) {
+        LibraryFilter* plain = [LibraryFilter new];
+        plain.needle = needle;
+        LibraryFilter* indexed = [LibraryFilter new];
+        indexed.needle = needle;
+        indexed.indexedURLs = [store searchURLsMatchingNeedle:needle error:&error];
+        XCTAssertNotNil(indexed.indexedURLs, @"search for \"%@\" failed: %@", needle, error);
+        XCTAssertEqualObjects([indexed filterItems:metas operation:nil firstMatchCount:0 firstMatches:nil],
+                              [plain filterItems:metas operation:nil firstMatchCount:0 firstMatches:nil],
+                              @"\"%@\" should match the same with and without the index",
+                              needle);
+    }
+}
+
+- (void)testSearchLatencyOnLargeLibrary
+{
+#ifndef ENABLE_LIBRARY_SEARCH_BENCH
+    XCTSkip(@"Library search benchmark skipped unless ENABLE_LIBRARY_SEARCH_BENCH is defined.");
+#else
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+
+    // Synthetic library of 100k tracks spread over 5k artists.
+    const NSUInteger trackCount = 100000;
+    NSArray<NSString*>* words = @[ @"Über", @"night", @"Café", @"dream", @"Straße", @"love", @"Señor", @"fire", @"electric", @"Déjà" ];
+    NSMutableArray<MediaMetaData*>* metas = [NSMutableArray arrayWithCapacity:trackCount];
+    for (NSUInteger i = 0; i < trackCount; i++) {
+        MediaMetaData* meta = [MediaMetaData new];
+        meta.location = [NSURL fileURLWithPath:[NSString stringWithFormat:@"/tmp/bench/%lu.mp3", (unsigned long) i]];
+        meta.title = [NSString stringWithFormat:@"%@ %@ %lu", words[i % words.count], words[(i / 7) % words.count], (unsigned long) i];
+        meta.artist = [NSString stringWithFormat:@"Artist %lu", (unsigned long) (i % 5000)];
+        meta.album = [NSString stringWithFormat:@"Album %@ %lu", words[(i / 3) % words.count], (unsigned long) (i % 9000)];
+        meta.genre = words[(i / 11) % words.count];
+        [metas addObject:meta];
+    }
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:metas error:&error], @"import failed: %@", error);
+
+    // Every keystroke of a typed needle issues one query.
+    NSArray<NSString*>* keystrokes = @[ @"d", @"de", @"dej", @"deja", @"deja n", @"deja ni", @"deja nig" ];
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (NSString* needle in keystrokes) {
+        XCTAssertNotNil([store searchURLsMatchingNeedle:needle error:&error], @"search failed: %@", error);
+    }
+    double perKeystroke = (CFAbsoluteTimeGetCurrent() - start) / (double) keystrokes.count;
+    NSLog(@"library search: %.2fms per keystroke on %lu tracks", perKeystroke * 1000.0, (unsigned long) trackCount);
+    XCTAssertLessThan(perKeystroke, 0.05);
+
+    [self measureBlock:^{
+        for (NSString* needle in keystrokes) {
+            __unused NSSet<NSString*>* urls = [store searchURLsMatchingNeedle:needle error:nil];
+        }
+    }];
+#endif
+}
+
+- (void)testLoadTimeAndFootprintOnLargeLibrary
+{
+#ifndef ENABLE_LIBRARY_LOAD_BENCH
+    XCTSkip(@"Library load benchmark skipped unless ENABLE_LIBRARY_LOAD_BENCH is defined.");
+#else
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+
+    // 20k tracks over 2k albums, each album with 200KB of artwork.
+    const NSUInteger trackCount = 20000;
+    const NSUInteger albumCount = 2000;
+    NSMutableArray<NSData*>* covers = [NSMutableArray arrayWithCapacity:albumCount];
+    for (NSUInteger i = 0; i < albumCount; i++) {
+        NSMutableData* cover = [NSMutableData dataWithLength:200 * 1024];
+        memcpy(cover.mutableBytes, &i, sizeof(i));
+        [covers addObject:cover];
+    }
+    NSMutableArray<MediaMetaData*>* metas = [NSMutableArray arrayWithCapacity:trackCount];
+    for (NSUInteger i = 0; i < trackCount; i++) {
+        MediaMetaData* meta = [MediaMetaData new];
+        meta.location = [NSURL fileURLWithPath:[NSString stringWithFormat:@"/tmp/bench/%lu.mp3", (unsigned long) i]];
+        meta.title = [NSString stringWithFormat:@"Title %lu", (unsigned long) i];
+        meta.album = [NSString stringWithFormat:@"Album %lu", (unsigned long) (i % albumCount)];
+        meta.artwork = covers[i % albumCount];
+        meta.artworkFormat = @(ITLibArtworkFormatPNG);
+        [metas addObject:meta];
+    }
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:metas error:&error], @"import failed: %@", error);
+    metas = nil;
+    covers = nil;
+
+    LibraryStore* reopened = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+    size_t residentBefore = [self residentSize];
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    NSArray<MediaMetaData*>* loaded = [reopened loadAllMediaItems:&error];
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+    size_t residentGrowth = [self residentSize] - residentBefore;
+    XCTAssertEqual(loaded.count, trackCount, @"load failed: %@", error);
+    NSLog(@"library load: %.0fms, %.1fMB resident for %lu tracks", elapsed * 1000.0, residentGrowth / (1024.0 * 1024.0), (unsigned long) trackCount);
+    XCTAssertLessThan(residentGrowth, (size_t) 100 * 1024 * 1024, @"Artwork should not be loaded along");
+#endif
+}
+
+- (NSArray<MediaMetaData*>*)syntheticMetas:(NSUInteger)count
+{
+    NSMutableArray<MediaMetaData*>* metas = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        MediaMetaData* meta = [MediaMetaData new];
+        meta.location = [NSURL fileURLWithPath:[NSString stringWithFormat:@"/tmp/bench/%lu.mp3", (unsigned long) i]];
+        meta.title = [NSString stringWithFormat:@"Title %lu", (unsigned long) i];
+        meta.artist = [NSString stringWithFormat:@"Artist %lu", (unsigned long) (i % 500)];
+        meta.genre = [NSString stringWithFormat:@"Genre %lu", (unsigned long) (i % 20)];
+        [metas addObject:meta];
+    }
+    return metas;
+}
+
+/// Keeps writing analysis results on a thread of its own until `stop` is set;
+/// returns the number of writes.
+- (NSUInteger)writeSteadilyToStore:(LibraryStore*)store metas:(NSArray<MediaMetaData*>*)metas stop:(atomic_bool*)stop
+{
+    NSUInteger writes = 0;
+    while (!atomic_load(stop)) {
+        MediaMetaData* meta = metas[writes % metas.count];
+        XCTAssertTrue([store completeDeepScanForURL:meta.location duration:@(180) tempo:@(120 + writes % 10) key:@"8A" error:nil]);
+        writes++;
+    }
+    return writes;
+}
+
+- (void)testReadsRunNextToWrites
+{
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+    NSArray<MediaMetaData*>* metas = [self syntheticMetas:2000];
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:metas error:&error], @"import failed: %@", error);
+
+    // Reads complete while a write transaction is held open, and do not see
+    // what it has not committed yet.
+    MediaMetaData* pending = [MediaMetaData new];
+    pending.location = [NSURL fileURLWithPath:@"/tmp/bench/pending.mp3"];
+    pending.title = @"Pending";
+    dispatch_semaphore_t held = dispatch_semaphore_create(0);
+    dispatch_semaphore_t release = dispatch_semaphore_create(0);
+    dispatch_group_t transaction = dispatch_group_create();
+    dispatch_group_async(transaction, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        // Rolled back, so that the rest of the test sees the imported tracks only.
+        [store performTransaction:^BOOL {
+            XCTAssertTrue([store importMediaItems:@[ pending ] error:nil]);
+            dispatch_semaphore_signal(held);
+            dispatch_semaphore_wait(release, DISPATCH_TIME_FOREVER);
+            return NO;
+        } error:nil];
+    });
+    dispatch_semaphore_wait(held, DISPATCH_TIME_FOREVER);
+
+    __block NSUInteger heldCount = 0;
+    __block NSUInteger heldSearchCount = 0;
+    __block BOOL heldSeesPending = YES;
+    dispatch_group_t reads = dispatch_group_create();
+    dispatch_group_async(reads, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        heldCount = [store loadAllMediaItems:nil].count;
+        [store valuesOfFacet:LibraryFacetGenre filter:@{} error:nil];
+        heldSearchCount = [store searchURLsMatchingNeedle:@"title" error:nil].count;
+        heldSeesPending = [store hasEntryForURL:pending.location error:nil];
+    });
+    long waited = dispatch_group_wait(reads, dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC));
+    dispatch_semaphore_signal(release);
+    dispatch_group_wait(transaction, DISPATCH_TIME_FOREVER);
+    dispatch_group_wait(reads, DISPATCH_TIME_FOREVER);
+    XCTAssertEqual(waited, 0, @"Reads should not wait for an open write transaction");
+    XCTAssertEqual(heldCount, metas.count);
+    XCTAssertEqual(heldSearchCount, metas.count, @"Searches should run next to an open write transaction");
+    XCTAssertFalse(heldSeesPending, @"Reads should not see uncommitted writes");
+    XCTAssertFalse([store hasEntryForURL:pending.location error:&error]);
+
+    __block atomic_bool stop = false;
+    __block NSUInteger writes = 0;
+    dispatch_group_t writer = dispatch_group_create();
+    dispatch_group_async(writer, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        writes = [self writeSteadilyToStore:store metas:metas stop:&stop];
+    });
+
+    // Every reader sees whole commits; nested reads on one thread share a connection.
+    dispatch_apply(8, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t reader) {
+        for (int round = 0; round < 10; round++) {
+            NSError* readError = nil;
+            XCTAssertEqual([store loadAllMediaItems:&readError].count, metas.count, @"load failed: %@", readError);
+            NSDictionary<NSString*, NSNumber*>* genres = [store valuesOfFacet:LibraryFacetGenre filter:@{} error:&readError];
+            XCTAssertEqual([[genres.allValues valueForKeyPath:@"@sum.integerValue"] unsignedIntegerValue], metas.count);
+            XCTAssertTrue([store hasEntryForURL:metas[(reader * 10 + round) % metas.count].location error:&readError]);
+        }
+    });
+    atomic_store(&stop, true);
+    dispatch_group_wait(writer, DISPATCH_TIME_FOREVER);
+    XCTAssertGreaterThan(writes, 0u);
+
+    NSDictionary<NSString*, NSNumber*>* tempos = [store valuesOfFacet:LibraryFacetTempo filter:@{} error:&error];
+    NSUInteger tempoCount = [[tempos.allValues valueForKeyPath:@"@sum.integerValue"] unsignedIntegerValue];
+    XCTAssertEqual(tempoCount, MIN(writes, metas.count), @"Reads should see what got written");
+}
+
+- (void)testReadLatencyUnderWriteLoad
+{
+#ifndef ENABLE_LIBRARY_CONTENTION_BENCH
+    XCTSkip(@"Library contention benchmark skipped unless ENABLE_LIBRARY_CONTENTION_BENCH is defined.");
+#else
+    NSURL* dbURL = [self temporaryDatabaseURL];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:dbURL];
+    NSArray<MediaMetaData*>* metas = [self syntheticMetas:20000];
+    NSError* error = nil;
+    XCTAssertTrue([store importMediaItems:metas error:&error], @"import failed: %@", error);
+    XCTAssertTrue([store enqueueDeepScanForURLs:[metas valueForKey:@"location"] priority:0 error:&error], @"enqueue failed: %@", error);
+
+    __block atomic_bool stop = false;
+    __block NSUInteger writes = 0;
+    dispatch_group_t writer = dispatch_group_create();
+    dispatch_group_async(writer, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        writes = [self writeSteadilyToStore:store metas:metas stop:&stop];
+    });
+
+    // Filter queries, artwork fetches and deep scan dequeues, the way the browser
+    // and the scan workers issue them.
+    const size_t readerCount = 4;
+    const NSUInteger readsPerReader = 200;
+    NSMutableArray<NSNumber*>* latencies = [NSMutableArray array];
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    dispatch_apply(readerCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t reader) {
+        NSMutableArray<NSNumber*>* own = [NSMutableArray arrayWithCapacity:readsPerReader];
+        for (NSUInteger i = 0; i < readsPerReader; i++) {
+            CFAbsoluteTime readStart = CFAbsoluteTimeGetCurrent();
+            switch ((reader + i) % 4) {
+            case 0:
+                [store valuesOfFacet:LibraryFacetArtist filter:@{@(LibraryFacetGenre) : @"Genre 3"} error:nil];
+                break;
+            case 1:
+                [store artworkDataForHashes:@[ @"missing" ] error:nil];
+                break;
+            case 2:
+                [store nextDeepScanURL:nil];
+                break;
+            default:
+                [store hasEntryForURL:metas[i % metas.count].location error:nil];
+                break;
+            }
+            [own addObject:@(CFAbsoluteTimeGetCurrent() - readStart)];
+        }
+        @synchronized(latencies) {
+            [latencies addObjectsFromArray:own];
+        }
+    });
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+    atomic_store(&stop, true);
+    dispatch_group_wait(writer, DISPATCH_TIME_FOREVER);
+
+    NSArray<NSNumber*>* sorted = [latencies sortedArrayUsingSelector:@selector(compare:)];
+    double median = sorted[sorted.count / 2].doubleValue;
+    double p99 = sorted[sorted.count * 99 / 100].doubleValue;
+    NSLog(@"library contention: %.0f reads/s, median %.2fms, p99 %.2fms over %lu readers next to %.0f writes/s",
+          sorted.count / elapsed,
+          median * 1000.0,
+          p99 * 1000.0,
+          (unsigned long) readerCount,
+          writes / elapsed);
+#endif
+}
+
 @end
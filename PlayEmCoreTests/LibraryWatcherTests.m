@@ -0,0 +1,222 @@
+//
+//  LibraryWatcherTests.m
+//  PlayEmCoreTests
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "LibraryStore.h"
+#import "LibraryWatcher.h"
+#import "MediaMetaData.h"
+
+@interface LibraryWatcherTests : XCTestCase
+@end
+
+@implementation LibraryWatcherTests
+
+- (NSURL*)temporaryFolder
+{
+    // FSEvents reports resolved paths; /var is a symlink.
+    NSURL* tmp = [[NSURL fileURLWithPath:NSTemporaryDirectory() isDirectory:YES] URLByResolvingSymlinksInPath];
+    NSURL* folder = [tmp URLByAppendingPathComponent:[[NSUUID UUID] UUIDString] isDirectory:YES];
+    [[NSFileManager defaultManager] createDirectoryAtURL:folder withIntermediateDirectories:YES attributes:nil error:nil];
+    return folder;
+}
+
+- (NSSet<NSString*>*)filesInFolder:(NSURL*)folder
+{
+    NSArray<NSString*>* names = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:folder.path error:nil];
+    NSMutableSet<NSString*>* paths = [NSMutableSet set];
+    for (NSString* name in names) {
+        [paths addObject:[folder.path stringByAppendingPathComponent:name]];
+    }
+    return paths;
+}
+
+/// Creates, rewrites, deletes and renames files; calls `touched` with every path an operation touched.
+- (NSUInteger)churnFolder:(NSURL*)folder fileCount:(NSUInteger)fileCount touched:(void (^)(NSString* path))touched
+{
+    NSUInteger operations = 0;
+    NSData* data = [@"PlayEm" dataUsingEncoding:NSUTF8StringEncoding];
+    for (NSUInteger i = 0; i < fileCount; i++) {
+        NSString* path = [folder.path stringByAppendingPathComponent:[NSString stringWithFormat:@"%04lu.mp3", (unsigned long) i]];
+        [data writeToFile:path atomically:NO];
+        touched(path);
+        operations++;
+        if (i % 2 == 0) {
+            [data writeToFile:path atomically:NO];
+            touched(path);
+            operations++;
+        }
+        if (i % 5 == 0) {
+            [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+            touched(path);
+            operations++;
+        } else if (i % 7 == 0) {
+            NSString* renamed = [folder.path stringByAppendingPathComponent:[NSString stringWithFormat:@"%04lu renamed.mp3", (unsigned long) i]];
+            [[NSFileManager defaultManager] moveItemAtPath:path toPath:renamed error:nil];
+            touched(path);
+            touched(renamed);
+            operations++;
+        }
+    }
+    return operations;
+}
+
+- (void)testBurstFoldsIntoOneBatchPerPath
+{
+    NSURL* folder = [self temporaryFolder];
+    NSMutableArray<LibraryWatcherBatch*>* batches = [NSMutableArray array];
+    XCTestExpectation* exp = [self expectationWithDescription:@"batch"];
+    exp.assertForOverFulfill = NO;
+    LibraryWatcher* watcher = [[LibraryWatcher alloc] initWithRoots:@[ folder ]
+                                                            latency:0.5
+                                                            handler:^(LibraryWatcherBatch* batch) {
+                                                                @synchronized(batches) {
+                                                                    [batches addObject:batch];
+                                                                }
+                                                                [exp fulfill];
+                                                            }];
+
+    __block uint64_t eventId = 0;
+    NSMutableSet<NSString*>* touchedPaths = [NSMutableSet set];
+    [self churnFolder:folder
+            fileCount:2000
+              touched:^(NSString* path) {
+                  [touchedPaths addObject:path];
+                  [watcher noteEventAtPath:path scanDirectory:NO eventId:++eventId];
+              }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqual(batches.count, 1u, @"A burst should be reported at once");
+    LibraryWatcherBatch* batch = batches.firstObject;
+    XCTAssertEqual(batch.eventCount, (NSUInteger) eventId);
+    XCTAssertEqual(batch.lastEventId, eventId);
+    XCTAssertEqual(batch.changedFiles.count + batch.removedPaths.count, touchedPaths.count, @"Each path should be reported once");
+
+    NSSet<NSString*>* changed = [batch.changedFiles valueForKey:@"path"];
+    XCTAssertEqualObjects(changed, [self filesInFolder:folder], @"Changed files should be what is on disk");
+    XCTAssertFalse([changed intersectsSet:[batch.removedPaths valueForKey:@"path"]]);
+
+    [[NSFileManager defaultManager] removeItemAtURL:folder error:nil];
+}
+
+- (void)testFileSystemBurstEndsConsistent
+{
+    NSURL* folder = [self temporaryFolder];
+    NSMutableSet<NSString*>* reported = [NSMutableSet set];
+    __block NSUInteger batchCount = 0;
+    LibraryWatcher* watcher = [[LibraryWatcher alloc] initWithRoots:@[ folder ]
+                                                            latency:0.3
+                                                            handler:^(LibraryWatcherBatch* batch) {
+                                                                @synchronized(reported) {
+                                                                    batchCount++;
+                                                                    for (NSURL* url in batch.removedPaths) {
+                                                                        [reported removeObject:url.path];
+                                                                    }
+                                                                    for (NSURL* url in batch.changedFiles) {
+                                                                        [reported addObject:url.path];
+                                                                    }
+                                                                }
+                                                            }];
+    XCTAssertTrue([watcher startSinceEventId:LibraryWatcherSinceNow]);
+
+    NSUInteger operations = [self churnFolder:folder fileCount:3000 touched:^(NSString* path){}];
+    NSSet<NSString*>* expected = [self filesInFolder:folder];
+
+    NSPredicate* consistent = [NSPredicate predicateWithBlock:^BOOL(id object, NSDictionary* bindings) {
+        @synchronized(reported) {
+            return [reported isEqualToSet:expected];
+        }
+    }];
+    [self expectationForPredicate:consistent evaluatedWithObject:nil handler:nil];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    [watcher stop];
+
+    NSLog(@"library watcher: %lu operations reported in %lu batches", (unsigned long) operations, (unsigned long) batchCount);
+    XCTAssertLessThan(batchCount, operations / 100, @"Events should be coalesced");
+    XCTAssertNotEqual(watcher.lastEventId, LibraryWatcherSinceNow);
+
+    [[NSFileManager defaultManager] removeItemAtURL:folder error:nil];
+}
+
+- (void)testFileSystemBurstLeavesStoreConsistent
+{
+    NSURL* folder = [self temporaryFolder];
+    NSString* databasePath = [folder.path stringByAppendingString:@".sqlite"];
+    [self addTeardownBlock:^{
+        for (NSString* suffix in @[ @"", @"-wal", @"-shm" ]) {
+            [[NSFileManager defaultManager] removeItemAtPath:[databasePath stringByAppendingString:suffix] error:nil];
+        }
+        [[NSFileManager defaultManager] removeItemAtURL:folder error:nil];
+    }];
+    LibraryStore* store = [[LibraryStore alloc] initWithDatabaseURL:[NSURL fileURLWithPath:databasePath]];
+
+    // Batches get applied the way the browser does: changed files imported,
+    // removed paths dropped, before the next batch comes in.
+    LibraryWatcher* watcher = [[LibraryWatcher alloc] initWithRoots:@[ folder ]
+                                                            latency:0.3
+                                                            handler:^(LibraryWatcherBatch* batch) {
+                                                                NSMutableArray<MediaMetaData*>* metas = [NSMutableArray array];
+                                                                for (NSURL* url in batch.changedFiles) {
+                                                                    MediaMetaData* meta = [MediaMetaData new];
+                                                                    meta.location = url;
+                                                                    meta.title = url.lastPathComponent;
+                                                                    [metas addObject:meta];
+                                                                }
+                                                                NSError* error = nil;
+                                                                XCTAssertTrue([store importMediaItems:metas error:&error], @"import failed: %@", error);
+                                                                if (batch.removedPaths.count > 0) {
+                                                                    dispatch_semaphore_t removed = dispatch_semaphore_create(0);
+                                                                    [store removeEntriesForURLs:batch.removedPaths.allObjects
+                                                                                     completion:^(BOOL success, NSError* error) {
+                                                                                         XCTAssertTrue(success, @"removal failed: %@", error);
+                                                                                         dispatch_semaphore_signal(removed);
+                                                                                     }];
+                                                                    dispatch_semaphore_wait(removed, DISPATCH_TIME_FOREVER);
+                                                                }
+                                                            }];
+    XCTAssertTrue([watcher startSinceEventId:LibraryWatcherSinceNow]);
+
+    [self churnFolder:folder fileCount:1000 touched:^(NSString* path){}];
+    NSSet<NSString*>* expected = [self filesInFolder:folder];
+
+    NSPredicate* consistent = [NSPredicate predicateWithBlock:^BOOL(id object, NSDictionary* bindings) {
+        NSArray<MediaMetaData*>* stored = [store loadAllMediaItems:nil];
+        return [[NSSet setWithArray:[stored valueForKeyPath:@"location.path"]] isEqualToSet:expected];
+    }];
+    [self expectationForPredicate:consistent evaluatedWithObject:nil handler:nil];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    [watcher stop];
+}
+
+- (void)testRootsStayBelowHomeFoldersAndVolumes
+{
+    NSArray<NSURL*>* urls = @[
+        [NSURL fileURLWithPath:@"/Users/dj/Music/House/01 Track.mp3"],
+        [NSURL fileURLWithPath:@"/Users/dj/Downloads/02 Track.mp3"],
+        [NSURL fileURLWithPath:@"/Users/dj/Music/Techno/Deep/03 Track.mp3"],
+        [NSURL fileURLWithPath:@"/Volumes/Crate/Sets/Set.m4a"],
+        [NSURL fileURLWithPath:@"/Volumes/Crate/Edits/Edit.m4a"],
+    ];
+    NSArray<NSString*>* roots = [[LibraryWatcher rootsCoveringURLs:urls] valueForKey:@"path"];
+    XCTAssertEqualObjects(roots, (@[ @"/Users/dj/Downloads", @"/Users/dj/Music", @"/Volumes/Crate/Edits", @"/Volumes/Crate/Sets" ]));
+}
+
+- (void)testRootsCoverFoldersPerVolume
+{
+    NSArray<NSURL*>* urls = @[
+        [NSURL fileURLWithPath:@"/Users/dj/Music/House/Artist/01 Track.mp3"],
+        [NSURL fileURLWithPath:@"/Users/dj/Music/Techno/02 Track.mp3"],
+        [NSURL fileURLWithPath:@"/Volumes/Crate/Sets/Set.m4a"],
+        [NSURL fileURLWithPath:@"/Volumes/Crate/Sets/Old/Set.m4a"],
+        [NSURL URLWithString:@"https://example.com/stream.mp3"],
+    ];
+    NSArray<NSString*>* roots = [[LibraryWatcher rootsCoveringURLs:urls] valueForKey:@"path"];
+    XCTAssertEqualObjects(roots, (@[ @"/Users/dj/Music", @"/Volumes/Crate/Sets" ]));
+}
+
+@end
@@ -0,0 +1,165 @@
+//
+//  WaveformCacheTests.m
+//  PlayEmCoreTests
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "WaveformCache.h"
+#import "WaveformPyramid.h"
+
+static const size_t kPageFrames = 16384;
+
+@interface WaveformCacheTests : XCTestCase
+@end
+
+@implementation WaveformCacheTests
+
+- (NSURL*)temporaryDirectoryURL
+{
+    NSString* tmpDir = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    NSURL* url = [NSURL fileURLWithPath:tmpDir isDirectory:YES];
+    [self addTeardownBlock:^{
+        [[NSFileManager defaultManager] removeItemAtURL:url error:nil];
+    }];
+    return url;
+}
+
+/// Pyramid of `frames` frames of a stereo tone under a slow envelope.
+- (WaveformPyramid*)pyramidOfFrames:(size_t)frames phase:(double)phase
+{
+    WaveformPyramid* pyramid = [WaveformPyramid new];
+    for (size_t frame = 0; frame < frames; frame += kPageFrames) {
+        const size_t count = MIN(kPageFrames, frames - frame);
+        NSMutableData* left = [NSMutableData dataWithLength:count * sizeof(float)];
+        NSMutableData* right = [NSMutableData dataWithLength:count * sizeof(float)];
+        float* l = left.mutableBytes;
+        float* r = right.mutableBytes;
+        for (size_t i = 0; i < count; i++) {
+            const double t = (double) (frame + i);
+            const double envelope = 0.2 + 0.7 * fabs(sin(t / 20000.0 + phase));
+            l[i] = (float) (envelope * sin(t * 0.031));
+            r[i] = (float) (envelope * 0.6 * sin(t * 0.017 + 1.0));
+        }
+        [pyramid appendPageAtFrame:frame channels:@[ left, right ]];
+    }
+    [pyramid finish];
+    return pyramid;
+}
+
+- (void)testStoredPyramidMatchesFreshOne
+{
+    const size_t frames = 30 * kPageFrames + 777;
+    WaveformPyramid* fresh = [self pyramidOfFrames:frames phase:0.0];
+    NSURL* directory = [self temporaryDirectoryURL];
+
+    NSError* error = nil;
+    WaveformCache* cache = [[WaveformCache alloc] initWithDirectoryURL:directory byteBudget:16 * 1024 * 1024];
+    XCTAssertFalse([cache hasPyramidForKey:@"track"]);
+    XCTAssertNil([cache pyramidForKey:@"track"]);
+    XCTAssertTrue([cache storePyramid:fresh forKey:@"track" error:&error], @"store failed: %@", error);
+    XCTAssertTrue([cache hasPyramidForKey:@"track"]);
+    XCTAssertEqual(cache.size, fresh.dataRepresentation.length);
+
+    // As on the next launch.
+    WaveformCache* reopened = [[WaveformCache alloc] initWithDirectoryURL:directory byteBudget:16 * 1024 * 1024];
+    WaveformPyramid* loaded = [reopened pyramidForKey:@"track"];
+    XCTAssertNotNil(loaded);
+    XCTAssertTrue(loaded.finished);
+    XCTAssertEqual(loaded.frames, fresh.frames);
+    XCTAssertEqual(loaded.levelCount, fresh.levelCount);
+
+    // Every level gets asked for, aligned and not, up to the whole sample in
+    // a single pixel.
+    const size_t count = 48;
+    for (double framesPerPixel = WaveformPyramid.baseFramesPerBin * 8; framesPerPixel <= frames; framesPerPixel *= 1.7) {
+        WaveformBin expected[count];
+        WaveformBin got[count];
+        const double from = framesPerPixel / 3.0;
+        XCTAssertEqual([fresh bins:expected count:count fromFrame:from framesPerPixel:framesPerPixel], count);
+        XCTAssertEqual([loaded bins:got count:count fromFrame:from framesPerPixel:framesPerPixel], count);
+        for (size_t pixel = 0; pixel < count; pixel++) {
+            XCTAssertEqual(got[pixel].minimum, expected[pixel].minimum);
+            XCTAssertEqual(got[pixel].maximum, expected[pixel].maximum);
+            XCTAssertEqual(got[pixel].positiveSum, expected[pixel].positiveSum);
+            XCTAssertEqual(got[pixel].negativeSum, expected[pixel].negativeSum);
+            XCTAssertEqual(got[pixel].squareSum, expected[pixel].squareSum);
+            XCTAssertEqual(got[pixel].positiveCount, expected[pixel].positiveCount);
+            XCTAssertEqual(got[pixel].negativeCount, expected[pixel].negativeCount);
+        }
+    }
+
+    // A restored pyramid takes no more pages.
+    [loaded appendPageAtFrame:frames channels:@[ [NSMutableData dataWithLength:kPageFrames * sizeof(float)] ]];
+    XCTAssertEqual(loaded.frames, fresh.frames);
+}
+
+- (void)testUnusableDataGetsDropped
+{
+    WaveformPyramid* pyramid = [self pyramidOfFrames:4 * kPageFrames phase:0.0];
+    NSData* data = pyramid.dataRepresentation;
+    XCTAssertNotNil(data);
+    XCTAssertNil([WaveformPyramid new].dataRepresentation, @"Unfinished pyramids have no data");
+
+    NSError* error = nil;
+    XCTAssertNil([[WaveformPyramid alloc] initWithData:[data subdataWithRange:NSMakeRange(0, data.length - 3)] error:&error]);
+    XCTAssertNotNil(error);
+
+    // Another version, as after bins changed meaning.
+    NSMutableData* other = [data mutableCopy];
+    ((uint8_t*) other.mutableBytes)[4] += 1;
+    error = nil;
+    XCTAssertNil([[WaveformPyramid alloc] initWithData:other error:&error]);
+    XCTAssertNotNil(error);
+
+    NSURL* directory = [self temporaryDirectoryURL];
+    WaveformCache* cache = [[WaveformCache alloc] initWithDirectoryURL:directory byteBudget:16 * 1024 * 1024];
+    XCTAssertTrue([cache storePyramid:pyramid forKey:@"track" error:&error], @"store failed: %@", error);
+    NSURL* file = [[directory URLByAppendingPathComponent:@"track"] URLByAppendingPathExtension:@"waveform"];
+    XCTAssertTrue([other writeToURL:file atomically:YES]);
+    XCTAssertNil([cache pyramidForKey:@"track"]);
+    XCTAssertFalse([cache hasPyramidForKey:@"track"], @"Unusable files should get removed");
+
+    XCTAssertFalse([cache storePyramid:[WaveformPyramid new] forKey:@"unfinished" error:&error]);
+    XCTAssertFalse([cache hasPyramidForKey:@"unfinished"]);
+}
+
+- (void)testLeastRecentlyUsedGetEvicted
+{
+    NSArray<WaveformPyramid*>* pyramids = @[
+        [self pyramidOfFrames:10 * kPageFrames phase:0.0],
+        [self pyramidOfFrames:10 * kPageFrames phase:1.0],
+        [self pyramidOfFrames:10 * kPageFrames phase:2.0],
+    ];
+    const unsigned long long length = pyramids[0].dataRepresentation.length;
+    NSURL* directory = [self temporaryDirectoryURL];
+    WaveformCache* cache = [[WaveformCache alloc] initWithDirectoryURL:directory byteBudget:length * 5 / 2];
+
+    NSError* error = nil;
+    XCTAssertTrue([cache storePyramid:pyramids[0] forKey:@"a" error:&error], @"store failed: %@", error);
+    XCTAssertTrue([cache storePyramid:pyramids[1] forKey:@"b" error:&error], @"store failed: %@", error);
+    XCTAssertEqual(cache.size, 2 * length);
+
+    // Both are from a while ago, "a" having been stored first but loaded since.
+    NSString* a = [[directory URLByAppendingPathComponent:@"a"] URLByAppendingPathExtension:@"waveform"].path;
+    NSString* b = [[directory URLByAppendingPathComponent:@"b"] URLByAppendingPathExtension:@"waveform"].path;
+    [[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate : [NSDate dateWithTimeIntervalSinceNow:-7200]} ofItemAtPath:a error:nil];
+    [[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate : [NSDate dateWithTimeIntervalSinceNow:-3600]} ofItemAtPath:b error:nil];
+    XCTAssertNotNil([cache pyramidForKey:@"a"]);
+
+    XCTAssertTrue([cache storePyramid:pyramids[2] forKey:@"c" error:&error], @"store failed: %@", error);
+    XCTAssertTrue([cache hasPyramidForKey:@"a"]);
+    XCTAssertFalse([cache hasPyramidForKey:@"b"]);
+    XCTAssertTrue([cache hasPyramidForKey:@"c"]);
+    XCTAssertLessThanOrEqual(cache.size, cache.byteBudget);
+
+    // Anything beyond the whole budget does not get stored at all.
+    WaveformCache* tiny = [[WaveformCache alloc] initWithDirectoryURL:directory byteBudget:length / 2];
+    XCTAssertFalse([tiny storePyramid:pyramids[1] forKey:@"b" error:&error]);
+    XCTAssertFalse([cache hasPyramidForKey:@"b"]);
+}
+
+@end
@@ -0,0 +1,178 @@
+//
+//  WaveformPyramidTests.m
+//  PlayEmCoreTests
+//
+//  Created by Till Toenshoff on 2026-10-18.
+//  Copyright © 2026 Till Toenshoff. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "WaveformPyramid.h"
+
+static const size_t kPageFrames = 16384;
+
+@interface WaveformPyramidTests : XCTestCase
+@end
+
+@implementation WaveformPyramidTests
+
+/// Two channels of tones under a slow envelope.
+- (NSArray<NSMutableData*>*)syntheticChannels:(size_t)frames
+{
+    NSMutableData* left = [NSMutableData dataWithLength:frames * sizeof(float)];
+    NSMutableData* right = [NSMutableData dataWithLength:frames * sizeof(float)];
+    float* l = left.mutableBytes;
+    float* r = right.mutableBytes;
+    for (size_t i = 0; i < frames; i++) {
+        const double envelope = 0.2 + 0.7 * fabs(sin((double) i / 20000.0));
+        l[i] = (float) (envelope * sin((double) i * 0.031));
+        r[i] = (float) (envelope * 0.6 * sin((double) i * 0.017 + 1.0));
+    }
+    return @[ left, right ];
+}
+
+- (void)appendChannels:(NSArray<NSData*>*)channels toPyramid:(WaveformPyramid*)pyramid fromFrame:(size_t)from toFrame:(size_t)to
+{
+    for (size_t frame = from; frame < to; frame += kPageFrames) {
+        const size_t count = MIN(kPageFrames, to - frame);
+        NSMutableArray<NSData*>* page = [NSMutableArray array];
+        for (NSData* channel in channels) {
+            [page addObject:[channel subdataWithRange:NSMakeRange(frame * sizeof(float), count * sizeof(float))]];
+        }
+        [pyramid appendPageAtFrame:frame channels:page];
+    }
+}
+
+/// Summary of frames `from` up to `to` computed from the frames themselves.
+- (WaveformBin)binOfChannels:(NSArray<NSData*>*)channels fromFrame:(size_t)from toFrame:(size_t)to
+{
+    const float* l = channels[0].bytes;
+    const float* r = channels[1].bytes;
+    WaveformBin bin = {.minimum = INFINITY, .maximum = -INFINITY};
+    for (size_t i = from; i < to; i++) {
+        const float s = (l[i] + r[i]) / 2.0f;
+        bin.minimum = MIN(bin.minimum, s);
+        bin.maximum = MAX(bin.maximum, s);
+        bin.squareSum += s * s;
+        if (s >= 0) {
+            bin.positiveSum += s;
+            bin.positiveCount++;
+        } else {
+            bin.negativeSum += s;
+            bin.negativeCount++;
+        }
+    }
+    return bin;
+}
+
+- (void)testLevelsMatchTheFrames
+{
+    const size_t frames = 40 * kPageFrames + 1234;
+    NSArray<NSData*>* channels = [self syntheticChannels:frames];
+    WaveformPyramid* pyramid = [WaveformPyramid new];
+    [self appendChannels:channels toPyramid:pyramid fromFrame:0 toFrame:frames];
+    [pyramid finish];
+    XCTAssertEqual(pyramid.frames, frames);
+    XCTAssertGreaterThan(pyramid.levelCount, 8u);
+
+    // Pixels made of whole bins summarize just what the frames do.
+    const size_t count = 64;
+    for (size_t framesPerPixel = WaveformPyramid.baseFramesPerBin * 8; framesPerPixel * (count + 3) <= frames; framesPerPixel *= 2) {
+        WaveformBin bins[count];
+        XCTAssertEqual([pyramid bins:bins count:count fromFrame:framesPerPixel * 3 framesPerPixel:framesPerPixel], count);
+        for (size_t pixel = 0; pixel < count; pixel++) {
+            const size_t start = (pixel + 3) * framesPerPixel;
+            WaveformBin expected = [self binOfChannels:channels fromFrame:start toFrame:MIN(start + framesPerPixel, frames)];
+            XCTAssertEqual(bins[pixel].minimum, expected.minimum);
+            XCTAssertEqual(bins[pixel].maximum, expected.maximum);
+            XCTAssertEqual(bins[pixel].positiveCount, expected.positiveCount);
+            XCTAssertEqual(bins[pixel].negativeCount, expected.negativeCount);
+            XCTAssertEqualWithAccuracy(WaveformBinRMS(bins[pixel]), WaveformBinRMS(expected), 1e-4);
+            VisualPair pair = WaveformBinVisualPair(bins[pixel]);
+            VisualPair expectedPair = WaveformBinVisualPair(expected);
+            XCTAssertEqualWithAccuracy(pair.positiveAverage, expectedPair.positiveAverage, 1e-4);
+            XCTAssertEqualWithAccuracy(pair.negativeAverage, expectedPair.negativeAverage, 1e-4);
+        }
+    }
+
+    // Any other zoom stays within a bin of the frames at either edge.
+    const double framesPerPixel = 3001.7;
+    VisualPair pairs[count];
+    XCTAssertEqual([pyramid visualPairs:pairs count:count fromFrame:12345.0 framesPerPixel:framesPerPixel], count);
+    for (size_t pixel = 0; pixel < count; pixel++) {
+        const size_t start = (size_t) (12345.0 + pixel * framesPerPixel);
+        VisualPair expected = WaveformBinVisualPair([self binOfChannels:channels fromFrame:start toFrame:(size_t) (start + framesPerPixel)]);
+        XCTAssertEqualWithAccuracy(pairs[pixel].positiveAverage, expected.positiveAverage, 0.05);
+        XCTAssertEqualWithAccuracy(pairs[pixel].negativeAverage, expected.negativeAverage, 0.05);
+    }
+}
+
+- (void)testPixelsBecomeAvailableAsPagesComeIn
+{
+    const size_t frames = 20 * kPageFrames;
+    NSArray<NSData*>* channels = [self syntheticChannels:frames];
+    WaveformPyramid* pyramid = [WaveformPyramid new];
+    const double framesPerPixel = 4096.0;
+    const size_t count = frames / 4096;
+    WaveformBin bins[count];
+
+    XCTAssertEqual([pyramid bins:bins count:count fromFrame:0 framesPerPixel:framesPerPixel], 0u);
+    [self appendChannels:channels toPyramid:pyramid fromFrame:0 toFrame:frames / 2];
+    XCTAssertEqual([pyramid bins:bins count:count fromFrame:0 framesPerPixel:framesPerPixel], count / 2);
+
+    // A page out of order gets ignored.
+    [self appendChannels:channels toPyramid:pyramid fromFrame:frames / 2 + kPageFrames toFrame:frames];
+    XCTAssertEqual(pyramid.frames, frames / 2);
+
+    [self appendChannels:channels toPyramid:pyramid fromFrame:frames / 2 toFrame:frames];
+    [pyramid finish];
+    XCTAssertEqual([pyramid bins:bins count:count fromFrame:0 framesPerPixel:framesPerPixel], count);
+    WaveformBin past[4];
+    XCTAssertEqual([pyramid bins:past count:4 fromFrame:frames framesPerPixel:framesPerPixel], 4u, @"Pixels past the end should come out empty");
+    XCTAssertEqual(past[3].positiveCount + past[3].negativeCount, 0u);
+
+    XCTAssertEqual([pyramid bins:bins count:count fromFrame:0 framesPerPixel:WaveformPyramid.baseFramesPerBin], 0u,
+                   @"Narrow pixels should be left to the frames");
+}
+
+- (void)testZoomingOnLongSample
+{
+#ifndef ENABLE_WAVEFORM_PYRAMID_BENCH
+    XCTSkip(@"Waveform pyramid benchmark skipped unless ENABLE_WAVEFORM_PYRAMID_BENCH is defined.");
+#else
+    // Ten minutes at 48kHz.
+    const size_t frames = 600 * 48000;
+    NSArray<NSData*>* channels = [self syntheticChannels:frames];
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    WaveformPyramid* pyramid = [WaveformPyramid new];
+    [self appendChannels:channels toPyramid:pyramid fromFrame:0 toFrame:frames];
+    [pyramid finish];
+    NSLog(@"waveform pyramid: %lu frames summarized in %.0fms", (unsigned long) frames, (CFAbsoluteTimeGetCurrent() - start) * 1000.0);
+
+    // Resizing the total view: every width needs all of the sample.
+    const size_t widths[] = {800, 1024, 1333, 1600, 2048};
+    double fromFrames = 0.0;
+    double fromPyramid = 0.0;
+    for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+        const size_t width = widths[i];
+        const double framesPerPixel = (double) frames / width;
+        WaveformBin* bins = malloc(width * sizeof(WaveformBin));
+
+        start = CFAbsoluteTimeGetCurrent();
+        for (size_t pixel = 0; pixel < width; pixel++) {
+            bins[pixel] = [self binOfChannels:channels fromFrame:(size_t) (pixel * framesPerPixel) toFrame:(size_t) ((pixel + 1) * framesPerPixel)];
+        }
+        fromFrames += CFAbsoluteTimeGetCurrent() - start;
+
+        start = CFAbsoluteTimeGetCurrent();
+        XCTAssertEqual([pyramid bins:bins count:width fromFrame:0 framesPerPixel:framesPerPixel], width);
+        fromPyramid += CFAbsoluteTimeGetCurrent() - start;
+        free(bins);
+    }
+    NSLog(@"waveform pyramid: 5 zoom levels in %.1fms from the frames, %.2fms from the pyramid", fromFrames * 1000.0, fromPyramid * 1000.0);
+#endif
+}
+
+@end